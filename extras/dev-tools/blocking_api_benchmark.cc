@@ -0,0 +1,225 @@
+// Event rate benchmark for the blocking data API.
+//
+// Generates an in-memory USB listfile containing a CrateConfig with a single
+// readout stack and synthetic module data. The listfile is then replayed via
+// make_mvlc_replay_blocking() and consumed once using next_event() and once
+// using next_events() with the given batch size. Reports the consumed events
+// per second for both variants.
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+
+using namespace mesytec::mvlc;
+
+namespace
+{
+
+class MemoryReadHandle: public listfile::ReadHandle
+{
+    public:
+        explicit MemoryReadHandle(const std::vector<u8> &data)
+            : m_data(data)
+        {
+        }
+
+        size_t read(u8 *dest, size_t maxSize) override
+        {
+            const size_t toRead = std::min(maxSize, m_data.size() - m_pos);
+            std::memcpy(dest, m_data.data() + m_pos, toRead);
+            m_pos += toRead;
+            return toRead;
+        }
+
+        size_t seek(size_t pos) override
+        {
+            m_pos = std::min(pos, m_data.size());
+            return m_pos;
+        }
+
+    private:
+        const std::vector<u8> &m_data;
+        size_t m_pos = 0;
+};
+
+std::vector<u8> generate_listfile(size_t eventCount, size_t moduleCount, u32 maxWords, u32 seed)
+{
+    CrateConfig crateConfig;
+    crateConfig.connectionType = ConnectionType::USB;
+
+    StackCommandBuilder readoutStack;
+
+    for (size_t mi=0; mi<moduleCount; ++mi)
+    {
+        readoutStack.beginGroup("module" + std::to_string(mi));
+        readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+    }
+
+    crateConfig.stacks = { readoutStack };
+    crateConfig.triggers = { 0 };
+
+    listfile::BufferedWriteHandle writeHandle;
+    listfile::listfile_write_preamble(writeHandle, crateConfig);
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<u32> sizeDist(1, maxWords);
+    std::vector<std::vector<u32>> moduleStorage(moduleCount);
+    std::vector<readout_parser::ModuleData> moduleDataList(moduleCount);
+    ReadoutBuffer buffer;
+
+    for (size_t ei=0; ei<eventCount; ++ei)
+    {
+        for (size_t mi=0; mi<moduleCount; ++mi)
+        {
+            auto &storage = moduleStorage[mi];
+            storage.resize(sizeDist(rng));
+            std::iota(std::begin(storage), std::end(storage), (mi + 1) << 24);
+
+            auto &md = moduleDataList[mi];
+            md = {};
+            md.data = { storage.data(), static_cast<u32>(storage.size()) };
+            md.dynamicSize = storage.size();
+            md.hasDynamic = true;
+        }
+
+        listfile::write_event_data(buffer, 0, 0, moduleDataList.data(), moduleDataList.size());
+
+        if (buffer.used() >= util::Megabytes(1))
+        {
+            writeHandle.write(buffer.data(), buffer.used());
+            buffer.clear();
+        }
+    }
+
+    writeHandle.write(buffer.data(), buffer.used());
+    listfile_write_system_event(writeHandle, crateConfig.crateId, system_event::subtype::EndOfFile);
+
+    return writeHandle.getBuffer();
+}
+
+struct RunResult
+{
+    size_t events = 0u;
+    size_t words = 0u;
+    double seconds = 0.0;
+};
+
+void count_event(const EventContainer &event, RunResult &result)
+{
+    ++result.events;
+
+    if (event.type == EventContainer::Type::Readout)
+    {
+        for (unsigned mi=0; mi<event.readout.moduleCount; ++mi)
+            result.words += event.readout.moduleDataList[mi].data.size;
+    }
+}
+
+template<typename Consume>
+RunResult run_replay(const std::vector<u8> &listfileData, Consume consume)
+{
+    MemoryReadHandle readHandle(listfileData);
+    auto replay = make_mvlc_replay_blocking(&readHandle);
+    RunResult result;
+
+    auto tStart = std::chrono::steady_clock::now();
+
+    if (auto ec = replay.start())
+    {
+        std::cerr << "Error starting replay: " << ec.message() << "\n";
+        return result;
+    }
+
+    consume(replay, result);
+
+    result.seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::steady_clock::now() - tStart).count();
+
+    return result;
+}
+
+void print_result(const std::string &title, const RunResult &result)
+{
+    std::cout << std::left << std::setw(20) << title << ": " << result.events << " events, "
+        << result.events / result.seconds / 1000.0 << " kEvents/s, "
+        << result.words * sizeof(u32) / result.seconds / util::Megabytes(1) << " MiB/s\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t eventCount = 1000000;
+    size_t moduleCount = 4;
+    u32 maxWords = 16;
+    size_t batchSize = 1024;
+    u32 seed = 1234;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(eventCount, "count")["--events"]("number of events (default=1000000)")
+        | lyra::opt(moduleCount, "count")["--modules"]("number of modules (default=4)")
+        | lyra::opt(maxWords, "words")["--max-words"]("maximum module data size (default=16)")
+        | lyra::opt(batchSize, "count")["--batch"]("maximum batch size for next_events() (default=1024)")
+        | lyra::opt(seed, "seed")["--seed"]("random seed (default=1234)")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (!eventCount || !moduleCount || !maxWords || !batchSize)
+    {
+        std::cerr << "Error: invalid arguments\n";
+        return 1;
+    }
+
+    auto listfileData = generate_listfile(eventCount, moduleCount, maxWords, seed);
+
+    std::cout << "listfile size: " << listfileData.size() / static_cast<double>(util::Megabytes(1)) << " MiB\n";
+
+    auto single = run_replay(listfileData, [] (BlockingReplay &replay, RunResult &result)
+    {
+        while (auto event = next_event(replay))
+            count_event(event, result);
+    });
+
+    print_result("next_event()", single);
+
+    auto batched = run_replay(listfileData, [batchSize] (BlockingReplay &replay, RunResult &result)
+    {
+        while (true)
+        {
+            auto batch = next_events(replay, batchSize);
+
+            if (batch.empty())
+                break;
+
+            for (const auto &event: batch)
+                count_event(event, result);
+        }
+    });
+
+    print_result("next_events(" + std::to_string(batchSize) + ")", batched);
+
+    if (single.events != batched.events || single.words != batched.words)
+        std::cout << "warning: event or word counts differ between the runs\n";
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Benchmark for the per call cost of eth::Impl::read_packet().
+//
+// A fake MVLC is set up on localhost: the command pipe answers the super
+// transactions done by connect(), the data pipe sends bursts of readout data
+// packets to the eth::Impl data socket. Only the read_packet() calls are
+// timed, the time spent sending the packets is excluded. For comparison the
+// cost of a logger registry lookup via get_logger() and a CachedLogger lookup
+// is reported as well.
+//
+// Requires the MVLC command and data ports on localhost to be free.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+#include <mesytec-mvlc/mvlc_eth_fake_responder.h>
+#include <mesytec-mvlc/mvlc_impl_eth.h>
+#include <mesytec-mvlc/util/udp_sockets.h>
+#include <spdlog/spdlog.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+template<typename F>
+double ns_per_call(size_t calls, F &&f)
+{
+    auto tStart = std::chrono::steady_clock::now();
+
+    for (size_t i=0; i<calls; ++i)
+        f();
+
+    auto elapsed = std::chrono::steady_clock::now() - tStart;
+    return std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(elapsed).count() / calls;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t packetCount = 1000000;
+    size_t burstSize = 256;
+    u16 payloadWords = 1000;
+    std::string logLevel = "off";
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(packetCount, "count")["--packets"]("number of packets to read (default=1000000)")
+        | lyra::opt(burstSize, "count")["--burst-size"]("packets sent before reading them back (default=256)")
+        | lyra::opt(payloadWords, "words")["--payload-words"]("payload words per packet (default=1000)")
+        | lyra::opt(logLevel, "level")["--log-level"]("spdlog level during the benchmark (default=off)")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (burstSize == 0 || payloadWords == 0
+        || (payloadWords + HeaderWords) * sizeof(u32) > JumboFrameMaxSize)
+    {
+        std::cerr << "Error: invalid --burst-size or --payload-words\n";
+        return 1;
+    }
+
+    std::error_code ec;
+    int fakeCmdSock = bind_udp_socket(CommandPort, &ec);
+    int fakeDataSock = bind_udp_socket(DataPort, &ec);
+
+    if (fakeCmdSock < 0 || fakeDataSock < 0)
+    {
+        std::cerr << "Error: could not bind the MVLC UDP ports on localhost: " << ec.message() << "\n";
+        return 1;
+    }
+
+    std::atomic<bool> quitResponder{false};
+    std::thread responderThread(fake_command_responder, fakeCmdSock, std::ref(quitResponder));
+
+    Impl mvlc("127.0.0.1");
+
+    if (auto ec = mvlc.connect())
+    {
+        std::cerr << "Error connecting to the fake MVLC: " << ec.message() << "\n";
+        quitResponder = true;
+        responderThread.join();
+        return 1;
+    }
+
+    sockaddr_in dataDest = {};
+    dataDest.sin_family = AF_INET;
+    dataDest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dataDest.sin_port = htons(get_local_socket_port(mvlc.getSocket(Pipe::Data)));
+
+    std::vector<u32> packet(HeaderWords + payloadWords);
+    packet[2] = make_frame_header(frame_headers::StackFrame, payloadWords - 1u);
+
+    set_global_log_level(spdlog::level::from_str(logLevel));
+
+    std::vector<u8> destBuffer(JumboFrameMaxSize);
+    std::chrono::nanoseconds readTime(0);
+    size_t packetsRead = 0;
+    size_t readErrors = 0;
+    u16 packetNumber = 0;
+
+    while (packetsRead < packetCount)
+    {
+        size_t burst = std::min(burstSize, packetCount - packetsRead);
+
+        for (size_t i=0; i<burst; ++i)
+        {
+            packet[0] = make_header0(PacketChannel::Data, packetNumber++, payloadWords);
+            send_words(fakeDataSock, dataDest, packet);
+        }
+
+        auto tStart = std::chrono::steady_clock::now();
+
+        for (size_t i=0; i<burst; ++i)
+        {
+            auto res = mvlc.read_packet(Pipe::Data, destBuffer.data(), destBuffer.size());
+
+            if (res.ec)
+                ++readErrors;
+        }
+
+        readTime += std::chrono::steady_clock::now() - tStart;
+        packetsRead += burst;
+    }
+
+    set_global_log_level(spdlog::level::info);
+
+    auto stats = mvlc.getPipeStats()[DataPipe];
+    double readNs = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(readTime).count();
+
+    const size_t lookups = 1000000;
+    CachedLogger cachedLogger("mvlc_eth");
+    double registryNs = ns_per_call(lookups, [] { get_logger("mvlc_eth")->trace("benchmark"); });
+    double cachedNs = ns_per_call(lookups, [&] { cachedLogger->trace("benchmark"); });
+
+    mvlc.disconnect();
+    quitResponder = true;
+    responderThread.join();
+    close_socket(fakeCmdSock);
+    close_socket(fakeDataSock);
+
+    std::cout << "packets=" << packetsRead
+        << ", packetBytes=" << packet.size() * sizeof(u32)
+        << ", logLevel=" << logLevel
+        << ", readErrors=" << readErrors
+        << ", lostPackets=" << stats.lostPackets
+        << std::endl;
+    std::cout << "read_packet: " << readNs / packetsRead << " ns/call" << std::endl;
+    std::cout << "get_logger() + trace(): " << registryNs << " ns/call" << std::endl;
+    std::cout << "CachedLogger + trace(): " << cachedNs << " ns/call" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,324 @@
+// Compares the sustained loss-free receive rate of the two eth readout modes:
+// reading directly from the data socket in the readout loop versus using the
+// dedicated eth::PacketReceiver thread and consuming its packet ring.
+//
+// A fake MVLC on localhost sends readout data packets at a fixed rate. The
+// consumer emulates the readout loop: it fills 1 MiB buffers with packet data
+// and stalls after each buffer to simulate the work done between reads
+// (flushing, plugins, counter updates). Every --spike-interval buffers a
+// longer stall is inserted. The rate is increased in steps; for each step and
+// mode the packet loss reported by eth::Impl is printed.
+//
+// Requires the MVLC command and data ports on localhost to be free.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+#include <mesytec-mvlc/mvlc_eth_fake_responder.h>
+#include <mesytec-mvlc/mvlc_eth_receiver.h>
+#include <mesytec-mvlc/mvlc_impl_eth.h>
+#include <mesytec-mvlc/util/udp_sockets.h>
+#include <spdlog/spdlog.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+// Sends packets at the given rate until quit is set. Pacing is done in 1ms
+// ticks.
+void data_sender(int dataSock, const sockaddr_in &dest, u16 payloadWords, double rateMiBs,
+                 std::atomic<bool> &quit)
+{
+    std::vector<u32> packet(HeaderWords + payloadWords);
+    packet[2] = make_frame_header(frame_headers::StackFrame, payloadWords - 1u);
+
+    const double packetsPerTick = rateMiBs * util::Megabytes(1) / (packet.size() * sizeof(u32)) / 1000.0;
+    const auto tick = std::chrono::milliseconds(1);
+    auto tNext = std::chrono::steady_clock::now();
+    double credit = 0.0;
+    u16 packetNumber = 0;
+
+    while (!quit)
+    {
+        for (credit += packetsPerTick; credit >= 1.0; credit -= 1.0)
+        {
+            packet[0] = make_header0(PacketChannel::Data, packetNumber++, payloadWords);
+            send_words(dataSock, dest, packet);
+        }
+
+        tNext += tick;
+        std::this_thread::sleep_until(tNext);
+    }
+}
+
+struct StallOptions
+{
+    std::chrono::microseconds perBuffer;
+    std::chrono::milliseconds spike;
+    size_t spikeInterval;
+};
+
+void stall(size_t bufferNumber, const StallOptions &opts)
+{
+    std::this_thread::sleep_for(opts.perBuffer);
+
+    if (opts.spikeInterval && bufferNumber % opts.spikeInterval == 0)
+        std::this_thread::sleep_for(opts.spike);
+}
+
+// Readout loop emulation reading directly from the socket.
+void consume_direct(Impl &mvlc, const StallOptions &opts, std::atomic<bool> &quit)
+{
+    ReadoutBuffer buffer(util::Megabytes(1));
+    std::array<PacketReadResult, ReadPacketsMaxBatchSize> results;
+
+    for (size_t bufferNumber=1; !quit; ++bufferNumber)
+    {
+        buffer.clear();
+
+        while (buffer.free() >= JumboFrameMaxSize && !quit)
+        {
+            size_t count = mvlc.read_packets(Pipe::Data, buffer.data() + buffer.used(), buffer.free(),
+                                             results.data(), results.size());
+
+            for (size_t i=0; i<count; ++i)
+            {
+                u8 *dest = buffer.data() + buffer.used();
+
+                if (results[i].bytesTransferred && results[i].buffer != dest)
+                    std::memmove(dest, results[i].buffer, results[i].bytesTransferred);
+
+                buffer.use(results[i].bytesTransferred);
+            }
+        }
+
+        stall(bufferNumber, opts);
+    }
+}
+
+// Readout loop emulation consuming the PacketReceiver ring.
+void consume_receiver(PacketReceiver &receiver, const StallOptions &opts, std::atomic<bool> &quit)
+{
+    ReadoutBuffer buffer(util::Megabytes(1));
+    PacketBatch *batch = nullptr;
+    size_t batchIndex = 0;
+
+    for (size_t bufferNumber=1; !quit; ++bufferNumber)
+    {
+        buffer.clear();
+
+        while (buffer.free() >= JumboFrameMaxSize && !quit)
+        {
+            if (!batch && !(batch = receiver.nextBatch(std::chrono::milliseconds(100))))
+                continue;
+
+            for (; batchIndex < batch->packetCount && buffer.free() >= JumboFrameMaxSize; ++batchIndex)
+            {
+                const auto &result = batch->results[batchIndex];
+                std::memcpy(buffer.data() + buffer.used(), result.buffer, result.bytesTransferred);
+                buffer.use(result.bytesTransferred);
+            }
+
+            if (batchIndex >= batch->packetCount)
+            {
+                receiver.releaseBatch(batch);
+                batch = nullptr;
+                batchIndex = 0;
+            }
+        }
+
+        stall(bufferNumber, opts);
+    }
+
+    if (batch)
+        receiver.releaseBatch(batch);
+}
+
+// Drains whatever is left in the data socket.
+void drain(Impl &mvlc)
+{
+    std::vector<u8> buffer(JumboFrameMaxSize);
+
+    while (!mvlc.read_packet(Pipe::Data, buffer.data(), buffer.size()).ec) ;
+}
+
+int main(int argc, char *argv[])
+{
+    double startRate = 50.0;
+    double maxRate = 1000.0;
+    double rateStep = 50.0;
+    unsigned stepSeconds = 2;
+    u16 payloadWords = 2000;
+    unsigned stallUs = 200;
+    unsigned spikeMs = 20;
+    size_t spikeInterval = 50;
+    size_t batchCount = PacketReceiverOptions().batchCount;
+    int cpu = -1;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(startRate, "MiB/s")["--start-rate"]("first send rate (default=50)")
+        | lyra::opt(maxRate, "MiB/s")["--max-rate"]("last send rate (default=1000)")
+        | lyra::opt(rateStep, "MiB/s")["--rate-step"]("rate increment (default=50)")
+        | lyra::opt(stepSeconds, "s")["--step-duration"]("duration of each step and mode (default=2)")
+        | lyra::opt(payloadWords, "words")["--payload-words"]("payload words per packet (default=2000)")
+        | lyra::opt(stallUs, "us")["--stall-us"]("consumer stall after each buffer (default=200)")
+        | lyra::opt(spikeMs, "ms")["--spike-ms"]("additional periodic consumer stall (default=20)")
+        | lyra::opt(spikeInterval, "buffers")["--spike-interval"]("buffers between stall spikes, 0 to disable (default=50)")
+        | lyra::opt(batchCount, "count")["--batch-count"]("receiver ring size in batches (default=128)")
+        | lyra::opt(cpu, "cpu")["--cpu"]("pin the receiver thread to this cpu (default=-1, no pinning)")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (payloadWords == 0 || (payloadWords + HeaderWords) * sizeof(u32) > JumboFrameMaxSize
+        || rateStep <= 0.0 || startRate <= 0.0)
+    {
+        std::cerr << "Error: invalid --payload-words or rate arguments\n";
+        return 1;
+    }
+
+    std::error_code ec;
+    int fakeCmdSock = bind_udp_socket(CommandPort, &ec);
+    int fakeDataSock = bind_udp_socket(DataPort, &ec);
+
+    if (fakeCmdSock < 0 || fakeDataSock < 0)
+    {
+        std::cerr << "Error: could not bind the MVLC UDP ports on localhost: " << ec.message() << "\n";
+        return 1;
+    }
+
+    std::atomic<bool> quitResponder{false};
+    std::thread responderThread(fake_command_responder, fakeCmdSock, std::ref(quitResponder));
+
+    Impl mvlc("127.0.0.1");
+
+    if (auto ec = mvlc.connect())
+    {
+        std::cerr << "Error connecting to the fake MVLC: " << ec.message() << "\n";
+        quitResponder = true;
+        responderThread.join();
+        return 1;
+    }
+
+    sockaddr_in dataDest = {};
+    dataDest.sin_family = AF_INET;
+    dataDest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dataDest.sin_port = htons(get_local_socket_port(mvlc.getSocket(Pipe::Data)));
+
+    StallOptions stallOptions { std::chrono::microseconds(stallUs), std::chrono::milliseconds(spikeMs), spikeInterval };
+
+    PacketReceiverOptions receiverOptions;
+    receiverOptions.batchCount = batchCount;
+    receiverOptions.cpu = cpu;
+
+    set_global_log_level(spdlog::level::warn);
+
+    // Runs one step, returns the number of lost packets and the received rate.
+    auto run_step = [&] (double rate, bool useReceiver)
+    {
+        drain(mvlc);
+        mvlc.resetPipeAndChannelStats();
+
+        std::atomic<bool> quit{false};
+        std::unique_ptr<PacketReceiver> receiver;
+
+        if (useReceiver)
+        {
+            receiver = std::make_unique<PacketReceiver>(&mvlc, nullptr, receiverOptions);
+            receiver->start();
+        }
+
+        std::thread consumer([&] ()
+        {
+            if (receiver)
+                consume_receiver(*receiver, stallOptions, quit);
+            else
+                consume_direct(mvlc, stallOptions, quit);
+        });
+
+        std::atomic<bool> quitSender{false};
+        std::thread sender(data_sender, fakeDataSock, dataDest, payloadWords, rate, std::ref(quitSender));
+
+        std::this_thread::sleep_for(std::chrono::seconds(stepSeconds));
+
+        quitSender = true;
+        sender.join();
+        // Let the consumer catch up with buffered data before stopping.
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        quit = true;
+        consumer.join();
+
+        if (receiver)
+            receiver->stop();
+
+        auto stats = mvlc.getPipeStats()[DataPipe];
+        double received = stats.receivedBytes / static_cast<double>(util::Megabytes(1)) / stepSeconds;
+        return std::make_pair(stats.lostPackets, received);
+    };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(12) << "rate MiB/s"
+        << std::setw(16) << "direct lost"
+        << std::setw(16) << "direct MiB/s"
+        << std::setw(16) << "receiver lost"
+        << std::setw(16) << "receiver MiB/s"
+        << std::endl;
+
+    double maxLossFreeDirect = 0.0;
+    double maxLossFreeReceiver = 0.0;
+    bool directLossy = false;
+    bool receiverLossy = false;
+
+    for (double rate = startRate; rate <= maxRate && !(directLossy && receiverLossy); rate += rateStep)
+    {
+        auto direct = run_step(rate, false);
+        auto viaReceiver = run_step(rate, true);
+
+        if (!directLossy && direct.first == 0)
+            maxLossFreeDirect = rate;
+        else
+            directLossy = true;
+
+        if (!receiverLossy && viaReceiver.first == 0)
+            maxLossFreeReceiver = rate;
+        else
+            receiverLossy = true;
+
+        std::cout << std::setw(12) << rate
+            << std::setw(16) << direct.first
+            << std::setw(16) << direct.second
+            << std::setw(16) << viaReceiver.first
+            << std::setw(16) << viaReceiver.second
+            << std::endl;
+    }
+
+    std::cout << "max loss-free rate: direct=" << maxLossFreeDirect
+        << " MiB/s, receiver=" << maxLossFreeReceiver << " MiB/s" << std::endl;
+
+    mvlc.disconnect();
+    quitResponder = true;
+    responderThread.join();
+    close_socket(fakeCmdSock);
+    close_socket(fakeDataSock);
+
+    return 0;
+}
@@ -0,0 +1,399 @@
+// Offline simulation of the ETH throttling loop used to compare throttle
+// policies on data loss versus throughput without hardware.
+//
+// The load is either taken from a recorded receive buffer trace or generated
+// synthetically. Traces are the text files written by netlink-monitor-rmem and
+// by the throttler debug output (mvlc-eth-throttle-debug.txt): one sample per
+// line containing 'rmem_alloc=N rcvbuf=N delay=N'. Samples are assumed to be
+// --step microseconds apart (the throttlers queryDelay).
+//
+// From a trace the data rate offered by the readout and the consumer drain
+// rate are reconstructed: the arrival in each step is the fill level change
+// plus what the consumer drained, corrected by the delay that was active at
+// the time. The drain rate is the fastest observed drop of the fill level
+// unless given via --consumer-rate.
+//
+// Model per step:
+//   - the offered data enters the MVLC side buffer. If that is full the
+//     readout is blocked (dead time), the data is counted as 'blocked'.
+//   - the MVLC sends packets limited by the link rate and the current delay.
+//   - packets enter the socket receive buffer. Overflowing data is lost.
+//   - the consumer drains the receive buffer, optionally with periodic stalls.
+//   - the policy calculates the delay from the fill level. The new delay takes
+//     effect in the next step.
+//
+// All amounts are in receive buffer bytes (the units of rmem_alloc).
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <regex>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mvlc_eth_throttle.h>
+#include <mesytec-mvlc/util/storage_sizes.h>
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+struct TraceSample
+{
+    u32 used = 0u;
+    u32 capacity = 0u;
+    u16 delay = 0u;
+};
+
+std::vector<TraceSample> read_trace(std::istream &in)
+{
+    static const std::regex re(R"(rmem_alloc=(\d+)\s+rcvbuf=(\d+)\s+delay=(\d+))");
+
+    std::vector<TraceSample> result;
+    std::string line;
+    std::smatch m;
+
+    while (std::getline(in, line))
+    {
+        if (std::regex_search(line, m, re))
+        {
+            TraceSample sample;
+            sample.used = std::stoul(m[1]);
+            sample.capacity = std::stoul(m[2]);
+            sample.delay = std::stoul(m[3]);
+            result.emplace_back(sample);
+        }
+    }
+
+    return result;
+}
+
+struct SimOptions
+{
+    double stepSeconds = 0.001;
+    double linkRate = 117.0 * util::Megabytes(1);   // bytes/s on the wire
+    double packetBytes = 1500.0;                    // bytes per packet incl. headers
+    double consumerRate = 0.0;                      // bytes/s, 0: reconstruct from the trace
+    double mvlcBuffer = util::Megabytes(1);         // bytes buffered on the MVLC side
+    u32 capacity = util::Megabytes(10);             // receive buffer capacity
+    double stallMs = 0.0;                           // periodic consumer stall duration
+    double stallIntervalMs = 0.0;                   // interval between stall starts
+};
+
+// Fraction of the link rate available at the given inter-packet delay.
+double send_fraction(const SimOptions &opts, u16 delay)
+{
+    const double wireSeconds = opts.packetBytes / opts.linkRate;
+    return wireSeconds / (wireSeconds + delay * 1e-6);
+}
+
+struct Load
+{
+    std::vector<double> offered; // bytes offered by the readout per step
+    double consumerRate = 0.0;   // bytes/s
+    u32 capacity = 0u;
+};
+
+Load load_from_trace(const std::vector<TraceSample> &trace, const SimOptions &opts)
+{
+    Load load;
+    load.capacity = opts.capacity;
+    load.consumerRate = opts.consumerRate;
+
+    if (trace.size() < 2)
+        return load;
+
+    load.capacity = trace.front().capacity ? trace.front().capacity : opts.capacity;
+
+    if (load.consumerRate <= 0.0)
+    {
+        double maxDrop = 0.0;
+
+        for (size_t i=1; i<trace.size(); ++i)
+            maxDrop = std::max(maxDrop, static_cast<double>(trace[i-1].used) - trace[i].used);
+
+        load.consumerRate = std::max(maxDrop / opts.stepSeconds, opts.linkRate * 0.01);
+    }
+
+    const double maxPerStep = opts.linkRate * opts.stepSeconds;
+    const double drainPerStep = load.consumerRate * opts.stepSeconds;
+
+    for (size_t i=1; i<trace.size(); ++i)
+    {
+        const double before = trace[i-1].used;
+        const double after = trace[i].used;
+        const double drained = (before > 0.0 || after > before) ? std::min(before + std::max(after - before, 0.0), drainPerStep) : 0.0;
+        const double arrived = std::max(after - before + drained, 0.0);
+        load.offered.push_back(std::min(arrived / send_fraction(opts, trace[i-1].delay), maxPerStep));
+    }
+
+    return load;
+}
+
+// Constant base load with periodic bursts at the link rate.
+Load make_synthetic_load(const SimOptions &opts, double seconds, double baseRate,
+                         double burstMs, double burstIntervalMs)
+{
+    Load load;
+    load.capacity = opts.capacity;
+    load.consumerRate = opts.consumerRate > 0.0 ? opts.consumerRate : 0.8 * opts.linkRate;
+
+    const size_t steps = seconds / opts.stepSeconds;
+    const size_t burstSteps = burstMs * 1e-3 / opts.stepSeconds;
+    const size_t intervalSteps = std::max(static_cast<size_t>(burstIntervalMs * 1e-3 / opts.stepSeconds), size_t(1));
+
+    for (size_t i=0; i<steps; ++i)
+    {
+        bool inBurst = (i % intervalSteps) < burstSteps;
+        load.offered.push_back((inBurst ? opts.linkRate : baseRate) * opts.stepSeconds);
+    }
+
+    return load;
+}
+
+struct SimResult
+{
+    double offered = 0.0;
+    double delivered = 0.0;
+    double lost = 0.0;
+    double blocked = 0.0;
+    size_t delayChanges = 0u;
+    size_t stops = 0u;          // transitions to the max delay
+    double delaySum = 0.0;
+    double fillSum = 0.0;
+    size_t steps = 0u;
+};
+
+SimResult simulate(EthThrottlePolicy &policy, const EthThrottleContext &ctx,
+                   const Load &load, const SimOptions &opts, std::ostream *traceOut)
+{
+    static const u16 MaxDelay = std::numeric_limits<u16>::max();
+
+    SimResult r;
+    policy.reset();
+
+    const auto elapsed = std::chrono::microseconds(static_cast<s64>(opts.stepSeconds * 1e6));
+    const size_t stallSteps = opts.stallMs * 1e-3 / opts.stepSeconds;
+    const size_t stallInterval = opts.stallIntervalMs * 1e-3 / opts.stepSeconds;
+    double mvlcUsed = 0.0;
+    double rcvUsed = 0.0;
+    u16 delay = 0u;
+
+    for (size_t step=0; step<load.offered.size(); ++step)
+    {
+        double offered = load.offered[step];
+        r.offered += offered;
+
+        double accepted = std::min(offered, opts.mvlcBuffer - mvlcUsed);
+        r.blocked += offered - accepted;
+        mvlcUsed += accepted;
+
+        double sent = std::min(mvlcUsed, opts.linkRate * opts.stepSeconds * send_fraction(opts, delay));
+        mvlcUsed -= sent;
+        rcvUsed += sent;
+
+        if (rcvUsed > load.capacity)
+        {
+            r.lost += rcvUsed - load.capacity;
+            rcvUsed = load.capacity;
+        }
+
+        bool stalled = stallInterval && (step % stallInterval) < stallSteps;
+
+        if (!stalled)
+        {
+            double drained = std::min(rcvUsed, load.consumerRate * opts.stepSeconds);
+            rcvUsed -= drained;
+            r.delivered += drained;
+        }
+
+        ReceiveBufferSnapshot snapshot;
+        snapshot.used = rcvUsed;
+        snapshot.capacity = load.capacity;
+
+        u16 newDelay = policy.calculateDelay(ctx, snapshot, elapsed);
+
+        if (newDelay != delay)
+        {
+            ++r.delayChanges;
+
+            if (newDelay == MaxDelay)
+                ++r.stops;
+        }
+
+        delay = newDelay;
+        r.delaySum += delay;
+        r.fillSum += rcvUsed / load.capacity;
+        ++r.steps;
+
+        if (traceOut)
+        {
+            *traceOut << "rmem_alloc=" << snapshot.used
+                << " rcvbuf=" << snapshot.capacity
+                << " delay=" << delay << "\n";
+        }
+    }
+
+    // Whatever is still buffered counts as delivered: the run ends when the
+    // load ends, not when the buffers are empty.
+    r.delivered += rcvUsed + mvlcUsed;
+
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string traceFile;
+    std::string traceOutFile;
+    std::string policyName = "all";
+    double seconds = 10.0;
+    double baseRateMiB = 80.0;
+    double burstMs = 20.0;
+    double burstIntervalMs = 100.0;
+    double linkRateMiB = 117.0;
+    double consumerRateMiB = 0.0;
+    double mvlcBufferMiB = 1.0;
+    double capacityMiB = 10.0;
+    unsigned stepUs = 1000;
+    bool showHelp = false;
+
+    SimOptions opts;
+    EthThrottleContext ctx;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(traceFile, "file")["--trace"]("receive buffer trace to replay (default: synthetic load)")
+        | lyra::opt(traceOutFile, "file")["--write-trace"]("write the simulated trace of the selected policy to this file")
+        | lyra::opt(policyName, "name")["--policy"]("exponential, linear, pid or all (default=all)")
+        | lyra::opt(stepUs, "us")["--step"]("sample interval / throttle query delay (default=1000)")
+        | lyra::opt(linkRateMiB, "MiB/s")["--link-rate"]("MVLC send rate at zero delay (default=117)")
+        | lyra::opt(consumerRateMiB, "MiB/s")["--consumer-rate"]("consumer drain rate (default: from trace or 0.8*link rate)")
+        | lyra::opt(mvlcBufferMiB, "MiB")["--mvlc-buffer"]("MVLC side buffering before the readout blocks (default=1)")
+        | lyra::opt(capacityMiB, "MiB")["--capacity"]("receive buffer capacity for synthetic loads (default=10)")
+        | lyra::opt(opts.stallMs, "ms")["--stall-ms"]("periodic consumer stall (default=0)")
+        | lyra::opt(opts.stallIntervalMs, "ms")["--stall-interval"]("interval between consumer stalls (default=0, disabled)")
+        | lyra::opt(seconds, "s")["--duration"]("synthetic load duration (default=10)")
+        | lyra::opt(baseRateMiB, "MiB/s")["--base-rate"]("synthetic load base rate (default=80)")
+        | lyra::opt(burstMs, "ms")["--burst-ms"]("synthetic load burst duration at link rate (default=20)")
+        | lyra::opt(burstIntervalMs, "ms")["--burst-interval"]("synthetic load burst interval (default=100)")
+        | lyra::opt(ctx.threshold, "fraction")["--threshold"]("throttle threshold (default=0.5)")
+        | lyra::opt(ctx.range, "fraction")["--range"]("throttle range (default=0.45)")
+        | lyra::opt(ctx.pid.setpoint, "fraction")["--setpoint"]("pid: target fill level")
+        | lyra::opt(ctx.pid.kp, "value")["--kp"]("pid: proportional gain")
+        | lyra::opt(ctx.pid.ki, "value")["--ki"]("pid: integral gain")
+        | lyra::opt(ctx.pid.kd, "value")["--kd"]("pid: fill rate gain")
+        | lyra::opt(ctx.pid.rateSmoothing, "value")["--rate-smoothing"]("pid: fill rate smoothing factor")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    opts.stepSeconds = stepUs * 1e-6;
+    opts.linkRate = linkRateMiB * util::Megabytes(1);
+    opts.consumerRate = consumerRateMiB * util::Megabytes(1);
+    opts.mvlcBuffer = mvlcBufferMiB * util::Megabytes(1);
+    opts.capacity = capacityMiB * util::Megabytes(1);
+    ctx.queryDelay = std::chrono::milliseconds(std::max(stepUs / 1000u, 1u));
+
+    if (stepUs == 0 || opts.linkRate <= 0.0 || opts.capacity == 0)
+    {
+        std::cerr << "Error: invalid --step, --link-rate or --capacity\n";
+        return 1;
+    }
+
+    std::vector<EthThrottlePolicyType> policies;
+
+    for (auto type: { EthThrottlePolicyType::Exponential, EthThrottlePolicyType::Linear, EthThrottlePolicyType::PID })
+    {
+        if (policyName == "all" || policyName == to_string(type))
+            policies.push_back(type);
+    }
+
+    if (policies.empty() || (!traceOutFile.empty() && policies.size() != 1))
+    {
+        std::cerr << "Error: unknown --policy or --write-trace used without selecting a single policy\n";
+        return 1;
+    }
+
+    Load load;
+
+    if (!traceFile.empty())
+    {
+        std::ifstream in(traceFile);
+
+        if (!in.is_open())
+        {
+            std::cerr << "Error opening trace file " << traceFile << "\n";
+            return 1;
+        }
+
+        load = load_from_trace(read_trace(in), opts);
+
+        if (load.offered.empty())
+        {
+            std::cerr << "Error: no samples found in " << traceFile << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        load = make_synthetic_load(opts, seconds, baseRateMiB * util::Megabytes(1), burstMs, burstIntervalMs);
+    }
+
+    const double MiB = util::Megabytes(1);
+    const double duration = load.offered.size() * opts.stepSeconds;
+
+    std::cout << std::fixed << std::setprecision(2)
+        << "steps=" << load.offered.size() << " (" << duration << " s)"
+        << ", capacity=" << load.capacity / MiB << " MiB"
+        << ", consumer=" << load.consumerRate / MiB << " MiB/s"
+        << "\n\n";
+
+    std::cout << std::left
+        << std::setw(12) << "policy"
+        << std::right
+        << std::setw(12) << "MiB/s"
+        << std::setw(10) << "lost%"
+        << std::setw(10) << "blocked%"
+        << std::setw(12) << "changes/s"
+        << std::setw(8) << "stops"
+        << std::setw(12) << "avgDelay"
+        << std::setw(10) << "avgFill"
+        << "\n";
+
+    std::ofstream traceOut;
+
+    if (!traceOutFile.empty())
+        traceOut.open(traceOutFile);
+
+    for (auto type: policies)
+    {
+        auto policy = make_throttle_policy(type);
+        auto r = simulate(*policy, ctx, load, opts, traceOut.is_open() ? &traceOut : nullptr);
+        const double offered = std::max(r.offered, 1.0);
+
+        std::cout << std::left
+            << std::setw(12) << to_string(type)
+            << std::right
+            << std::setw(12) << r.delivered / MiB / duration
+            << std::setw(10) << r.lost / offered * 100.0
+            << std::setw(10) << r.blocked / offered * 100.0
+            << std::setw(12) << r.delayChanges / duration
+            << std::setw(8) << r.stops
+            << std::setw(12) << r.delaySum / std::max(r.steps, size_t(1))
+            << std::setw(10) << r.fillSum / std::max(r.steps, size_t(1))
+            << "\n";
+    }
+
+    return 0;
+}
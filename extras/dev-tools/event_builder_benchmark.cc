@@ -0,0 +1,271 @@
+// Throughput and allocation benchmark for the EventBuilder.
+//
+// Synthetic module data is generated for a single event spanning one or more
+// crates. Each module event starts with its timestamp, module timestamps are
+// jittered around the main module timestamp within the match window. The data
+// is pushed through recordEventData() in batches of --batch events, after each
+// batch buildEvents() is called. Reports the assembled event rate, the data
+// rate and the number of heap allocations per input event.
+//
+// With --threaded each crate records from its own thread while a separate
+// builder thread waits for and builds events, like in a multi-crate readout.
+//
+// To compare two EventBuilder implementations run the tool with identical
+// arguments (including --seed) against both library versions.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <thread>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+
+using namespace mesytec::mvlc;
+
+namespace
+{
+std::atomic<size_t> g_allocations{0u};
+}
+
+// Count all heap allocations of the process, including the ones made inside
+// the library.
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1u, std::memory_order_relaxed);
+
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t crateCount = 1;
+    size_t modulesPerCrate = 40;
+    size_t eventCount = 1000000;
+    size_t batchSize = 100;
+    u32 minWords = 4;
+    u32 maxWords = 64;
+    u32 seed = 1234;
+    bool threaded = false;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(crateCount, "count")["--crates"]("number of crates (default=1)")
+        | lyra::opt(modulesPerCrate, "count")["--modules"]("modules per crate (default=40)")
+        | lyra::opt(eventCount, "count")["--events"]("number of input events (default=1000000)")
+        | lyra::opt(batchSize, "count")["--batch"]("input events between buildEvents() calls (default=100)")
+        | lyra::opt(minWords, "words")["--min-words"]("minimum module event size (default=4)")
+        | lyra::opt(maxWords, "words")["--max-words"]("maximum module event size (default=64)")
+        | lyra::opt(seed, "seed")["--seed"]("random seed (default=1234)")
+        | lyra::opt(threaded)["--threaded"]("record from one thread per crate, build in a separate thread")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (!crateCount || !modulesPerCrate || !batchSize || !minWords || maxWords < minWords)
+    {
+        std::cerr << "Error: invalid arguments\n";
+        return 1;
+    }
+
+    auto timestamp_extractor = [] (const u32 *data, size_t size) -> u32
+    {
+        return size ? data[0] : event_builder::TimestampExtractionFailed;
+    };
+
+    EventSetup eventSetup;
+    eventSetup.enabled = true;
+    eventSetup.mainModule = { 0, 0 };
+
+    for (size_t ci=0; ci<crateCount; ++ci)
+    {
+        EventSetup::CrateSetup crateSetup;
+        crateSetup.moduleTimestampExtractors.resize(modulesPerCrate, timestamp_extractor);
+        crateSetup.moduleMatchWindows.resize(modulesPerCrate, event_builder::DefaultMatchWindow);
+        eventSetup.crateSetups.emplace_back(crateSetup);
+    }
+
+    EventBuilderConfig cfg;
+    cfg.setups = { eventSetup };
+    EventBuilder eventBuilder(cfg);
+
+    // Pregenerate a pool of module data per crate so that the generation cost
+    // and its allocations are not part of the measurement. Timestamps are
+    // patched in before each recordEventData() call.
+    static const size_t PoolSize = 1024;
+
+    struct CrateInput
+    {
+        std::vector<std::vector<u32>> pool;
+        std::vector<s32> jitter;
+        std::vector<ModuleData> moduleDataList;
+        size_t inputWords = 0u;
+    };
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<u32> sizeDist(minWords, maxWords);
+    std::uniform_int_distribution<s32> jitterDist(-4, 4);
+    std::vector<CrateInput> crateInputs(crateCount);
+
+    for (size_t ci=0; ci<crateCount; ++ci)
+    {
+        auto &input = crateInputs[ci];
+        input.pool.resize(PoolSize * modulesPerCrate);
+        input.jitter.resize(PoolSize * modulesPerCrate);
+        input.moduleDataList.resize(modulesPerCrate);
+
+        for (size_t i=0; i<input.pool.size(); ++i)
+        {
+            input.pool[i].resize(sizeDist(rng));
+            std::iota(input.pool[i].begin(), input.pool[i].end(), i << 16);
+            input.jitter[i] = (ci == 0 && (i % modulesPerCrate) == 0) ? 0 : jitterDist(rng);
+        }
+    }
+
+    auto record_event = [&] (size_t ci, size_t ei)
+    {
+        auto &input = crateInputs[ci];
+        const u32 ts = (ei * 100u) & event_builder::TimestampMax;
+        const size_t poolIndex = (ei % PoolSize) * modulesPerCrate;
+
+        for (size_t mi=0; mi<modulesPerCrate; ++mi)
+        {
+            auto &data = input.pool[poolIndex + mi];
+            data[0] = (ts + input.jitter[poolIndex + mi]) & event_builder::TimestampMax;
+            input.moduleDataList[mi] = {};
+            input.moduleDataList[mi].data = { data.data(), static_cast<u32>(data.size()) };
+            input.inputWords += data.size();
+        }
+
+        eventBuilder.recordEventData(ci, 0, input.moduleDataList.data(), input.moduleDataList.size());
+    };
+
+    size_t outputEvents = 0u;
+    size_t outputWords = 0u;
+
+    Callbacks callbacks;
+    callbacks.eventData = [&] (void *, int, int, const ModuleData *moduleDataList, unsigned moduleCount)
+    {
+        ++outputEvents;
+
+        for (unsigned mi=0; mi<moduleCount; ++mi)
+            outputWords += moduleDataList[mi].data.size;
+    };
+    callbacks.systemEvent = [] (void *, int, const u32 *, u32) {};
+
+    // Warm up: lets the builder reach its steady state buffer sizes.
+    const size_t warmupEvents = std::min(eventCount, PoolSize);
+    size_t allocs0 = 0u;
+    std::chrono::steady_clock::time_point tStart;
+
+    for (size_t ei=0; ei<warmupEvents; ++ei)
+    {
+        for (size_t ci=0; ci<crateCount; ++ci)
+            record_event(ci, ei);
+
+        if ((ei + 1) % batchSize == 0)
+            eventBuilder.buildEvents(callbacks);
+    }
+
+    eventBuilder.buildEvents(callbacks, true);
+    allocs0 = g_allocations.load(std::memory_order_relaxed);
+    tStart = std::chrono::steady_clock::now();
+    outputEvents = outputWords = 0u;
+
+    for (auto &input: crateInputs)
+        input.inputWords = 0u;
+
+    if (!threaded)
+    {
+        for (size_t ei=warmupEvents; ei<eventCount + warmupEvents; ++ei)
+        {
+            for (size_t ci=0; ci<crateCount; ++ci)
+                record_event(ci, ei);
+
+            if ((ei + 1) % batchSize == 0)
+                eventBuilder.buildEvents(callbacks);
+        }
+    }
+    else
+    {
+        std::atomic<size_t> producersDone{0u};
+        std::vector<std::thread> producers;
+
+        for (size_t ci=0; ci<crateCount; ++ci)
+        {
+            producers.emplace_back([&, ci] ()
+            {
+                for (size_t ei=warmupEvents; ei<eventCount + warmupEvents; ++ei)
+                    record_event(ci, ei);
+
+                ++producersDone;
+            });
+        }
+
+        std::thread builder([&] ()
+        {
+            while (producersDone < crateCount)
+            {
+                if (eventBuilder.waitForData(std::chrono::milliseconds(10)))
+                    eventBuilder.buildEvents(callbacks);
+            }
+        });
+
+        for (auto &t: producers)
+            t.join();
+
+        builder.join();
+    }
+
+    eventBuilder.buildEvents(callbacks, true);
+
+    size_t inputWords = 0u;
+
+    for (const auto &input: crateInputs)
+        inputWords += input.inputWords;
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::steady_clock::now() - tStart);
+    const size_t allocations = g_allocations.load(std::memory_order_relaxed) - allocs0;
+
+    std::cout << "input events:          " << eventCount << " (" << crateCount * modulesPerCrate << " modules)\n"
+        << "output events:         " << outputEvents << "\n"
+        << "elapsed:               " << elapsed.count() << " s\n"
+        << "event rate:            " << eventCount / elapsed.count() / 1000.0 << " kHz\n"
+        << "data rate:             " << inputWords * sizeof(u32) / elapsed.count() / util::Megabytes(1) << " MiB/s\n"
+        << "allocations per event: " << static_cast<double>(allocations) / eventCount << "\n"
+        << "max memory usage:      " << eventBuilder.getMaxMemoryUsage() / 1024.0 << " KiB\n";
+
+    if (outputWords != inputWords)
+        std::cout << "warning: output words (" << outputWords << ") != input words (" << inputWords << ")\n";
+
+    return 0;
+}
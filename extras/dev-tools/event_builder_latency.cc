@@ -0,0 +1,204 @@
+// Input to output latency of the EventBuilder under a module dropout.
+//
+// A recording thread feeds single crate events at a fixed rate, a builder
+// thread waits for data and builds events. Starting at --dropout-at one module
+// stops delivering data. Without age based flushing the following events are
+// held back until the final flush. With --max-age-ms or --max-ticks they are
+// yielded as partial events once they exceed the limit.
+//
+// Reports the p50/p99/max latency from recordEventData() to the output
+// callback for all events and for the events recorded after the dropout.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+
+using namespace mesytec::mvlc;
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+double percentile_ms(const std::vector<Clock::duration> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    const size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return std::chrono::duration<double, std::milli>(sorted[index]).count();
+}
+
+void print_latencies(const std::string &title, std::vector<Clock::duration> latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << title << " (" << latencies.size() << " events): "
+        << "p50=" << percentile_ms(latencies, 0.50) << " ms"
+        << ", p99=" << percentile_ms(latencies, 0.99) << " ms"
+        << ", max=" << percentile_ms(latencies, 1.0) << " ms\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t moduleCount = 8;
+    size_t eventCount = 50000;
+    double eventRate = 10000.0;
+    int dropoutModule = 1;
+    size_t dropoutAt = 10000;
+    unsigned maxAgeMs = 0;
+    u32 maxTicks = 0;
+    u32 tickStep = 100;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(moduleCount, "count")["--modules"]("number of modules, module 0 is the main module (default=8)")
+        | lyra::opt(eventCount, "count")["--events"]("number of input events (default=50000)")
+        | lyra::opt(eventRate, "hz")["--rate"]("input event rate (default=10000)")
+        | lyra::opt(dropoutModule, "index")["--dropout-module"]("module which stops delivering data, -1 for none (default=1)")
+        | lyra::opt(dropoutAt, "event")["--dropout-at"]("input event at which the module stops (default=10000)")
+        | lyra::opt(maxAgeMs, "ms")["--max-age-ms"]("EventBuilderConfig::maxEventAge (default=0, disabled)")
+        | lyra::opt(maxTicks, "ticks")["--max-ticks"]("EventBuilderConfig::maxTimestampAge (default=0, disabled)")
+        | lyra::opt(tickStep, "ticks")["--tick-step"]("main module timestamp increment per event (default=100)")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (moduleCount < 2 || !eventCount || eventRate <= 0.0
+        || dropoutModule == 0 || dropoutModule >= static_cast<int>(moduleCount))
+    {
+        std::cerr << "Error: invalid arguments\n";
+        return 1;
+    }
+
+    // Module data: [timestamp][input event number]
+    auto timestamp_extractor = [] (const u32 *data, size_t size) -> u32
+    {
+        return size ? data[0] : event_builder::TimestampExtractionFailed;
+    };
+
+    EventSetup eventSetup;
+    eventSetup.enabled = true;
+    eventSetup.mainModule = { 0, 0 };
+    eventSetup.crateSetups.resize(1);
+    eventSetup.crateSetups[0].moduleTimestampExtractors.resize(moduleCount, timestamp_extractor);
+    eventSetup.crateSetups[0].moduleMatchWindows.resize(moduleCount, event_builder::DefaultMatchWindow);
+
+    EventBuilderConfig cfg;
+    cfg.setups = { eventSetup };
+    cfg.maxEventAge = std::chrono::milliseconds(maxAgeMs);
+    cfg.maxTimestampAge = maxTicks;
+    EventBuilder eventBuilder(cfg);
+
+    std::vector<Clock::time_point> recordTimes(eventCount);
+    std::vector<Clock::duration> latencies;
+    std::vector<Clock::duration> dropoutLatencies;
+    latencies.reserve(eventCount);
+    dropoutLatencies.reserve(eventCount);
+
+    Callbacks callbacks;
+    callbacks.eventData = [&] (void *, int, int, const ModuleData *moduleDataList, unsigned)
+    {
+        const auto now = Clock::now();
+        const u32 inputEvent = moduleDataList[0].data.data[1];
+        const auto latency = now - recordTimes[inputEvent];
+
+        latencies.push_back(latency);
+
+        if (dropoutModule >= 0 && inputEvent >= dropoutAt)
+            dropoutLatencies.push_back(latency);
+    };
+    callbacks.systemEvent = [] (void *, int, const u32 *, u32) {};
+
+    std::atomic<bool> recordingDone(false);
+
+    std::thread recorder([&] ()
+    {
+        std::vector<std::array<u32, 2>> moduleStorage(moduleCount);
+        std::vector<ModuleData> moduleDataList(moduleCount);
+        const auto tStart = Clock::now();
+        const auto interval = std::chrono::duration<double>(1.0 / eventRate);
+
+        for (size_t ei=0; ei<eventCount; ++ei)
+        {
+            const auto tNext = tStart + std::chrono::duration_cast<Clock::duration>(interval * ei);
+
+            while (Clock::now() < tNext)
+                std::this_thread::yield();
+
+            const u32 ts = (ei * tickStep) & event_builder::TimestampMax;
+
+            for (size_t mi=0; mi<moduleCount; ++mi)
+            {
+                moduleStorage[mi] = { ts, static_cast<u32>(ei) };
+                moduleDataList[mi] = {};
+
+                const bool dropped = (static_cast<int>(mi) == dropoutModule && ei >= dropoutAt);
+
+                if (!dropped)
+                    moduleDataList[mi].data = { moduleStorage[mi].data(), 2 };
+            }
+
+            recordTimes[ei] = Clock::now();
+            eventBuilder.recordEventData(0, 0, moduleDataList.data(), moduleDataList.size());
+        }
+
+        recordingDone = true;
+    });
+
+    std::thread builder([&] ()
+    {
+        while (!recordingDone)
+        {
+            // waitForData() returns immediately while incomplete events are
+            // buffered. Back off a little if nothing could be built.
+            if (!eventBuilder.waitForData(std::chrono::milliseconds(1))
+                || !eventBuilder.buildEvents(callbacks))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    });
+
+    recorder.join();
+    builder.join();
+    eventBuilder.buildEvents(callbacks, true);
+
+    auto counters = eventBuilder.getCounters(0);
+    size_t partialEvents = 0u;
+
+    for (auto count: counters.partialEvents)
+        partialEvents += count;
+
+    std::cout << "input events:   " << eventCount << " at " << eventRate << " Hz, "
+        << moduleCount << " modules\n"
+        << "output events:  " << latencies.size() << "\n"
+        << "partial events: " << partialEvents << " (summed over modules)\n"
+        << "max memory:     " << eventBuilder.getMaxMemoryUsage() / 1024.0 << " KiB\n";
+
+    print_latencies("all events    ", latencies);
+
+    if (dropoutModule >= 0)
+        print_latencies("after dropout ", dropoutLatencies);
+
+    return 0;
+}
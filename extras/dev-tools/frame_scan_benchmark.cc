@@ -0,0 +1,139 @@
+// Throughput of the frame header scan kernels in frame_scan.
+//
+// Fills a buffer with random data words containing occasional words with a
+// readout frame type (--header-rate) to mimic corrupted readout data. For each
+// scan implementation supported by the CPU all matching words in the buffer
+// are located using find_frame_header(). Additionally fixup_buffer_mvlc_usb()
+// is run on the same data. Reports GB/s of scanned input.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::frame_scan;
+
+namespace
+{
+
+std::vector<u32> make_corrupted_data(size_t words, double headerRate, u32 seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<u32> wordDist;
+    std::bernoulli_distribution isHeader(headerRate);
+    std::vector<u32> result(words);
+
+    for (auto &w: result)
+    {
+        // Random non header data. The upper bit is cleared so no 0xFx types
+        // are generated by accident.
+        w = wordDist(rng) & 0x7fffffffu;
+
+        // Stack frame header with a random length which most likely does not
+        // match the following data.
+        if (isHeader(rng))
+            w = (static_cast<u32>(frame_headers::StackFrame) << frame_headers::TypeShift) | (w & 0x1fffu);
+    }
+
+    return result;
+}
+
+template<typename F>
+double measure_gbps(size_t bytes, size_t iterations, F f)
+{
+    auto tStart = std::chrono::steady_clock::now();
+
+    for (size_t i=0; i<iterations; ++i)
+        f();
+
+    auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::steady_clock::now() - tStart).count();
+
+    return bytes * iterations / seconds / 1e9;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t megabytes = 64;
+    size_t iterations = 10;
+    double headerRate = 1.0 / 4096;
+    u32 seed = 1234;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(megabytes, "MiB")["--size"]("size of the input data in MiB (default=64)")
+        | lyra::opt(iterations, "count")["--iterations"]("number of passes over the data (default=10)")
+        | lyra::opt(headerRate, "rate")["--header-rate"]("fraction of words looking like a frame header (default=1/4096)")
+        | lyra::opt(seed, "seed")["--seed"]("random seed (default=1234)")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (!megabytes || !iterations || headerRate < 0.0 || headerRate > 1.0)
+    {
+        std::cerr << "Error: invalid arguments\n";
+        return 1;
+    }
+
+    auto data = make_corrupted_data(util::Megabytes(megabytes) / sizeof(u32), headerRate, seed);
+    const u32 *begin = data.data();
+    const u32 *end = data.data() + data.size();
+    const size_t bytes = data.size() * sizeof(u32);
+    const auto mask = readout_frame_types();
+
+    std::cout << "input: " << megabytes << " MiB, header rate " << headerRate
+        << ", best implementation: " << to_string(best_scan_impl()) << "\n";
+
+    for (auto impl: supported_scan_impls())
+    {
+        size_t matches = 0u;
+
+        double gbps = measure_gbps(bytes, iterations, [&]
+        {
+            matches = 0u;
+            const u32 *pos = begin;
+
+            while ((pos = find_frame_header(pos, end, mask, impl)) != end)
+            {
+                ++matches;
+                ++pos;
+            }
+        });
+
+        std::cout << "find_frame_header " << std::left << std::setw(8) << to_string(impl)
+            << ": " << std::fixed << std::setprecision(2) << gbps << " GB/s"
+            << ", matches=" << matches << "\n";
+    }
+
+    std::vector<u8> tmpBuf;
+    tmpBuf.reserve(bytes);
+
+    double gbps = measure_gbps(bytes, iterations, [&]
+    {
+        tmpBuf.clear();
+        fixup_buffer_mvlc_usb(reinterpret_cast<const u8 *>(begin), bytes, tmpBuf);
+    });
+
+    std::cout << "fixup_buffer_mvlc_usb     : " << gbps << " GB/s"
+        << ", moved bytes=" << tmpBuf.size() << "\n";
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Benchmark for the LZ4 listfile compression throughput depending on the
+// number of compression threads.
+//
+// Synthetic USB listfile data is generated up front: stack frames containing
+// module data blocks with slowly changing channel numbers and noisy values.
+// Alternatively the data of an existing listfile archive is used. The data is
+// then written to a temporary LZ4 archive in readout buffer sized chunks, the
+// same way the listfile writer thread does it. Reported are the uncompressed
+// input rate and the compression ratio for each thread count.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+#include <spdlog/spdlog.h>
+
+using namespace mesytec::mvlc;
+
+std::vector<u8> generate_listfile_data(size_t totalBytes)
+{
+    std::vector<u32> words;
+    words.reserve(totalBytes / sizeof(u32) + 1024);
+
+    auto magic = listfile::get_filemagic_usb();
+    words.resize(2);
+    std::memcpy(words.data(), magic, listfile::get_filemagic_len());
+
+    std::mt19937 rng(1234);
+    std::normal_distribution<double> noise(1000.0, 100.0);
+    u32 eventCounter = 0;
+
+    while (words.size() * sizeof(u32) < totalBytes)
+    {
+        // One event: a stack frame containing 4 modules with 32 channels each.
+        size_t headerIndex = words.size();
+        words.push_back(0);
+
+        for (u32 module = 0; module < 4; ++module)
+        {
+            words.push_back(0x40000000u | (module << 16) | 33u); // module header
+
+            for (u32 channel = 0; channel < 32; ++channel)
+            {
+                u32 value = static_cast<u32>(std::max(0.0, noise(rng))) & 0xffffu;
+                words.push_back(0x04000000u | (channel << 16) | value);
+            }
+
+            words.push_back(0xc0000000u | (eventCounter & 0x3fffffffu)); // end of event
+        }
+
+        u32 frameLen = words.size() - headerIndex - 1;
+        words[headerIndex] = (frame_headers::StackFrame << frame_headers::TypeShift) | (1u << 13) | frameLen;
+        ++eventCounter;
+    }
+
+    std::vector<u8> result(words.size() * sizeof(u32));
+    std::memcpy(result.data(), words.data(), result.size());
+    return result;
+}
+
+std::vector<u8> read_listfile_data(const std::string &archiveName, size_t maxBytes)
+{
+    listfile::ZipReader reader;
+    reader.openArchive(archiveName);
+    auto rh = reader.openEntry(reader.firstListfileEntryName());
+
+    std::vector<u8> result(maxBytes);
+    result.resize(rh->read(result.data(), result.size()));
+    return result;
+}
+
+void run_benchmark(const std::vector<u8> &data, unsigned threads, int compressLevel, size_t bufferSize)
+{
+    const std::string archiveName = "listfile_compression_benchmark.zip";
+
+    listfile::ZipCreator creator;
+    creator.createArchive(archiveName, listfile::OverwriteMode::Overwrite);
+
+    listfile::LZ4EntryOptions options;
+    options.compressLevel = compressLevel;
+    options.compressionThreads = threads;
+
+    auto tStart = std::chrono::steady_clock::now();
+
+    auto wh = creator.createLZ4Entry("listfile.mvlclst", options);
+
+    for (size_t offset = 0; offset < data.size(); offset += bufferSize)
+        wh->write(data.data() + offset, std::min(bufferSize, data.size() - offset));
+
+    creator.closeCurrentEntry();
+
+    auto elapsed = std::chrono::steady_clock::now() - tStart;
+    double secs = std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+    const auto &entryInfo = creator.entryInfo();
+
+    creator.closeArchive();
+    util::delete_file(archiveName);
+
+    std::cout << "threads=" << threads
+        << ", input=" << data.size() / util::Megabytes(1) << " MiB"
+        << ", elapsed=" << secs << " s"
+        << ", rate=" << data.size() / util::Megabytes(1) / secs << " MiB/s"
+        << ", ratio=" << static_cast<double>(data.size()) / entryInfo.lz4CompressedBytesWritten
+        << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t dataSize = 512;
+    size_t bufferSize = 1;
+    unsigned maxThreads = std::thread::hardware_concurrency();
+    int compressLevel = 0;
+    std::string inputArchive;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(dataSize, "MiB")["--size"]("amount of data to compress in MiB (default=512)")
+        | lyra::opt(bufferSize, "MiB")["--buffer-size"]("size of each write in MiB (default=1)")
+        | lyra::opt(maxThreads, "count")["--max-threads"]("maximum number of compression threads (default=hardware concurrency)")
+        | lyra::opt(compressLevel, "level")["--level"]("lz4 compression level (default=0)")
+        | lyra::opt(inputArchive, "archive")["--input"]("use the data of an existing listfile archive instead of generated data")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (bufferSize == 0)
+    {
+        std::cerr << "Error: --buffer-size must be > 0\n";
+        return 1;
+    }
+
+    auto data = (inputArchive.empty()
+                 ? generate_listfile_data(util::Megabytes(dataSize))
+                 : read_listfile_data(inputArchive, util::Megabytes(dataSize)));
+
+    // 0 means inline compression in the writing thread.
+    run_benchmark(data, 0, compressLevel, util::Megabytes(bufferSize));
+
+    for (unsigned threads = 1; threads <= std::max(maxThreads, 1u); threads *= 2)
+        run_benchmark(data, threads, compressLevel, util::Megabytes(bufferSize));
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+// Replay throughput of a memory mapped listfile compared to the ReadHandle
+// based path.
+//
+// The input is either a plain listfile or a zip archive containing a listfile
+// entry stored without compression. The data is parsed once using
+// ZipReader/ReadHandle reads followed by fixup_buffer() and once using the
+// frame aligned views of MappedBufferIterator. Reports the parsed MiB/s for
+// both variants. Run twice to get page cache bound numbers.
+
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+#include <spdlog/spdlog.h>
+
+using namespace mesytec::mvlc;
+
+namespace
+{
+
+struct RunResult
+{
+    size_t bytes = 0u;
+    size_t buffers = 0u;
+    size_t events = 0u;
+    u32 checksum = 0u;
+    double seconds = 0.0;
+};
+
+struct Parser
+{
+    readout_parser::ReadoutParserState state;
+    readout_parser::ReadoutParserCallbacks callbacks;
+    readout_parser::ReadoutParserCounters counters;
+    RunResult result;
+
+    explicit Parser(const std::vector<StackCommandBuilder> &readoutStacks)
+        : state(readout_parser::make_readout_parser(readoutStacks))
+    {
+        state.zeroCopy = true;
+
+        callbacks.eventData = [this] (
+            void *, int, int, const readout_parser::ModuleData *moduleDataList, unsigned moduleCount)
+        {
+            ++result.events;
+
+            for (unsigned mi=0; mi<moduleCount; ++mi)
+            {
+                const auto &data = moduleDataList[mi].data;
+                result.checksum = std::accumulate(data.data, data.data + data.size, result.checksum);
+            }
+        };
+    }
+
+    void parse(ConnectionType bufferFormat, u32 bufferNumber, const u32 *data, size_t words)
+    {
+        readout_parser::parse_readout_buffer(
+            bufferFormat, state, callbacks, counters, bufferNumber, data, words);
+        ++result.buffers;
+        result.bytes += words * sizeof(u32);
+    }
+};
+
+double elapsed_seconds(const std::chrono::steady_clock::time_point &tStart)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double>>(
+        std::chrono::steady_clock::now() - tStart).count();
+}
+
+RunResult run_read_handle(listfile::ReadHandle *readHandle, const std::vector<StackCommandBuilder> &readoutStacks)
+{
+    Parser parser(readoutStacks);
+    auto tStart = std::chrono::steady_clock::now();
+    auto readerHelper = listfile::make_listfile_reader_helper(readHandle);
+    u32 bufferNumber = 1;
+
+    while (true)
+    {
+        readerHelper.destBuf().clear();
+        auto buffer = listfile::read_next_buffer(readerHelper);
+
+        if (!buffer->used())
+            break;
+
+        auto view = buffer->viewU32();
+        parser.parse(readerHelper.bufferFormat, bufferNumber++, view.data(), view.size());
+    }
+
+    parser.result.seconds = elapsed_seconds(tStart);
+    return parser.result;
+}
+
+RunResult run_mapped(const listfile::MappedListfile &listfile, const std::vector<StackCommandBuilder> &readoutStacks)
+{
+    Parser parser(readoutStacks);
+    auto tStart = std::chrono::steady_clock::now();
+    listfile::MappedBufferIterator it(listfile);
+
+    while (true)
+    {
+        auto view = it.next();
+
+        if (view.empty())
+            break;
+
+        parser.parse(listfile.bufferFormat(), it.bufferNumber(), view.data(), view.size());
+    }
+
+    parser.result.seconds = elapsed_seconds(tStart);
+    return parser.result;
+}
+
+void print_result(const std::string &title, const RunResult &result)
+{
+    std::cout << fmt::format("{:<12}: {:.3f} s, {:.2f} MiB/s, buffers={}, events={}, checksum={:#010x}\n",
+        title, result.seconds, result.bytes / result.seconds / util::Megabytes(1),
+        result.buffers, result.events, result.checksum);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    std::string arg_listfile;
+    std::string opt_entryName;
+    bool opt_showHelp = false;
+
+    auto cli
+        = lyra::help(opt_showHelp)
+        | lyra::opt(opt_entryName, "name")["--entry"]("name of the listfile entry in the zip archive (default=first listfile entry)")
+        | lyra::arg(arg_listfile, "listfile")("zip archive or plain listfile").required()
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (opt_showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    set_global_log_level(spdlog::level::err);
+
+    try
+    {
+        const bool isZip = arg_listfile.size() >= 4
+            && arg_listfile.compare(arg_listfile.size() - 4, 4, ".zip") == 0;
+
+        listfile::ZipReader zipReader;
+        listfile::MappedListfile mappedListfile;
+        listfile::ReadHandle *readHandle = nullptr;
+
+        if (isZip)
+        {
+            zipReader.openArchive(arg_listfile);
+
+            if (opt_entryName.empty())
+                opt_entryName = zipReader.firstListfileEntryName();
+
+            readHandle = zipReader.openEntry(opt_entryName);
+            mappedListfile.openZipEntry(arg_listfile, opt_entryName);
+        }
+        else
+        {
+            mappedListfile.openFile(arg_listfile);
+            readHandle = mappedListfile.readHandle();
+        }
+
+        auto preamble = listfile::read_preamble(*mappedListfile.readHandle());
+        auto configEvent = preamble.findCrateConfig();
+
+        if (!configEvent)
+        {
+            std::cerr << "Error: no CrateConfig found in " << arg_listfile << "\n";
+            return 1;
+        }
+
+        auto readoutStacks = crate_config_from_yaml(configEvent->contentsToString()).stacks;
+
+        std::cout << fmt::format("Input: {} MiB, zero copy: {}\n",
+            mappedListfile.size() / util::Megabytes(1),
+            listfile::MappedBufferIterator(mappedListfile).isZeroCopy());
+
+        auto readResult = run_read_handle(readHandle, readoutStacks);
+        print_result(isZip ? "ZipReader" : "ReadHandle", readResult);
+
+        auto mappedResult = run_mapped(mappedListfile, readoutStacks);
+        print_result("mmap", mappedResult);
+
+        if (readResult.events != mappedResult.events || readResult.checksum != mappedResult.checksum)
+            std::cout << "warning: event counts or checksums differ between the runs\n";
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -209,31 +209,29 @@ bool process_listfile(const std::string &listfile)
     std::cout << fmt::format("    buffersProcessed={}, unusedBytes={}, parserExceptions={}\n",
         parserCounters.buffersProcessed, parserCounters.unusedBytes, parserCounters.parserExceptions);
 
-    auto eventIndexes = std::accumulate(std::begin(parserCounters.eventHits), std::end(parserCounters.eventHits),
-        std::vector<int>(),
-        [] (auto &&accu, const auto &iter) { accu.push_back(iter.first); return accu; });
-    std::sort(std::begin(eventIndexes), std::end(eventIndexes));
     std::cout << fmt::format("    eventHits:\n");
-    for (auto ei: eventIndexes)
+    for (size_t ei=0; ei<parserCounters.eventHits.size(); ++ei)
     {
-        std::cout << fmt::format("      eventIndex={}, hits={}\n", ei, parserCounters.eventHits[ei]);
+        if (parserCounters.eventHits[ei])
+            std::cout << fmt::format("      eventIndex={}, hits={}\n", ei, parserCounters.eventHits[ei]);
     }
 
-    auto moduleIndexPairs = std::accumulate(std::begin(parserCounters.groupHits), std::end(parserCounters.groupHits),
-        std::vector<std::pair<int, int>>(),
-        [] (auto &&accu, const auto &iter) { accu.push_back(iter.first); return accu; });
-    std::sort(std::begin(moduleIndexPairs), std::end(moduleIndexPairs));
     std::cout << fmt::format("    moduleHits:\n");
-    for (auto ip: moduleIndexPairs)
+    for (size_t ei=0; ei<parserCounters.groupHits.size(); ++ei)
     {
-        auto eventIndex = ip.first;
-        auto moduleIndex = ip.second;
-        auto moduleHits = parserCounters.groupHits[ip];
-        auto moduleSizes = parserCounters.groupSizes[ip];
-
-        std::cout << fmt::format("      eventIndex={}, moduleIndex={}, hits={}, minSize={}, maxSize={}, avgSize={:.2f}\n",
-            eventIndex, moduleIndex, moduleHits, moduleSizes.min, moduleSizes.max,
-            moduleSizes.sum / static_cast<double>(moduleHits));
+        for (size_t mi=0; mi<parserCounters.groupHits[ei].size(); ++mi)
+        {
+            auto moduleHits = parserCounters.groupHits[ei][mi];
+
+            if (!moduleHits)
+                continue;
+
+            const auto &moduleSizes = parserCounters.groupSizes[ei][mi];
+
+            std::cout << fmt::format("      eventIndex={}, moduleIndex={}, hits={}, minSize={}, maxSize={}, avgSize={:.2f}\n",
+                ei, mi, moduleHits, moduleSizes.min, moduleSizes.max,
+                moduleSizes.sum / static_cast<double>(moduleHits));
+        }
     }
 
     return true;
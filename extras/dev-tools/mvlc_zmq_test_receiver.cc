@@ -1,8 +1,16 @@
+// Receives buffers published via ZMQ and reports the receive rate.
+//
+// With --benchmark the tool instead runs an in-process ZmqBufferPublisher
+// feeding synthetic readout buffers to --subscribers receiving threads and
+// reports the resulting throughput. By default buffers are published zero
+// copy, --copy copies each buffer into the zmq message for comparison.
+
 #include <argh.h>
 #include <mesytec-mvlc/mesytec-mvlc.h>
 #include <zmq.hpp>
 #include <iostream>
 #include <signal.h>
+#include <thread>
 
 using namespace mesytec::mvlc;
 
@@ -32,6 +40,117 @@ void setup_signal_handlers()
 #endif
 }
 
+struct BenchmarkOptions
+{
+    std::string zmqPort;
+    size_t bufferSize;
+    size_t bufferCount;
+    size_t subscribers;
+    bool copy;
+};
+
+double megabytes_per_second(size_t bytes, double seconds)
+{
+    return bytes / seconds / (1024 * 1024);
+}
+
+int run_benchmark(const BenchmarkOptions &opts)
+{
+    ZmqPublisherOptions pubOptions;
+    pubOptions.bindUrl = "tcp://*:" + opts.zmqPort;
+    ZmqBufferPublisher pub(pubOptions);
+
+    // The empty queue is filled from the zmq io threads when zero copy
+    // publishing is used.
+    ReadoutBufferQueues queues(opts.bufferSize, 16);
+    std::vector<size_t> receivedMessages(opts.subscribers);
+    std::vector<size_t> receivedBytes(opts.subscribers);
+    std::vector<std::thread> receivers;
+    std::string subUrl = "tcp://localhost:" + opts.zmqPort;
+
+    for (size_t i=0; i<opts.subscribers; ++i)
+    {
+        receivers.emplace_back([&, i]
+        {
+            zmq::context_t ctx;
+            zmq::socket_t sub(ctx, ZMQ_SUB);
+            int timeout = 2000; // milliseconds
+            zmq_setsockopt(static_cast<void *>(sub), ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+            zmq_setsockopt(static_cast<void *>(sub), ZMQ_SUBSCRIBE, "", 0);
+            zmq_connect(static_cast<void *>(sub), subUrl.c_str());
+
+            zmq_msg_t msg;
+            zmq_msg_init(&msg);
+
+            while (receivedMessages[i] < opts.bufferCount
+                   && zmq_msg_recv(&msg, static_cast<void *>(sub), 0) >= 0)
+            {
+                ++receivedMessages[i];
+                receivedBytes[i] += zmq_msg_size(&msg);
+            }
+
+            zmq_msg_close(&msg);
+        });
+    }
+
+    if (pub.waitForSubscribers(opts.subscribers, std::chrono::seconds(10)) < opts.subscribers)
+    {
+        spdlog::error("Not all subscribers connected");
+        for (auto &t: receivers)
+            t.join();
+        return 1;
+    }
+
+    spdlog::info("Publishing {} buffers of {} bytes to {} subscribers, mode={}",
+                 opts.bufferCount, opts.bufferSize, opts.subscribers, opts.copy ? "copy" : "zero copy");
+
+    auto tStart = std::chrono::steady_clock::now();
+
+    for (size_t bufferNumber=0; bufferNumber<opts.bufferCount; ++bufferNumber)
+    {
+        auto buffer = queues.emptyBufferQueue().dequeue_blocking();
+        // Only the first word is set, the contents do not matter here.
+        buffer->setUsed(opts.bufferSize);
+        *reinterpret_cast<u32 *>(buffer->data()) = bufferNumber;
+
+        if (opts.copy)
+        {
+            auto view = buffer->viewU8();
+            pub.publishCopy(view.data(), view.size());
+            queues.emptyBufferQueue().enqueue(buffer);
+        }
+        else
+            pub.publish(buffer, queues.emptyBufferQueue());
+    }
+
+    auto tPublished = std::chrono::steady_clock::now();
+
+    for (auto &t: receivers)
+        t.join();
+
+    auto tEnd = std::chrono::steady_clock::now();
+
+    auto seconds = [] (auto t0, auto t1)
+    {
+        return std::chrono::duration_cast<std::chrono::duration<double>>(t1 - t0).count();
+    };
+
+    auto counters = pub.counters();
+
+    spdlog::info("publisher: {} messages, {:.2f} MB/s, sendBlocked={}, sendTimeouts={}",
+                 counters.messagesPublished,
+                 megabytes_per_second(counters.bytesPublished, seconds(tStart, tPublished)),
+                 counters.sendBlocked, counters.sendTimeouts);
+
+    for (size_t i=0; i<opts.subscribers; ++i)
+    {
+        spdlog::info("subscriber {}: {} messages, {:.2f} MB/s", i, receivedMessages[i],
+                     megabytes_per_second(receivedBytes[i], seconds(tStart, tEnd)));
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     setup_signal_handlers();
@@ -51,7 +170,7 @@ int main(int argc, char *argv[])
     std::string zmqHost = "localhost";
     std::string zmqPort = "5575";
 
-    argh::parser parser({"--zmq_host", "--zmq_port"});
+    argh::parser parser({"--zmq_host", "--zmq_port", "--buffer_size", "--buffers", "--subscribers"});
     parser.parse(argv);
 
     std::string str;
@@ -60,6 +179,8 @@ int main(int argc, char *argv[])
     {
         std::cout << R"~(
             usage: mvlc-zmq-test-receiver [--zmq_host=localhost] [--zmq_port=5575]
+                   mvlc-zmq-test-receiver --benchmark [--zmq_port=5575] [--buffer_size=1048576]
+                                          [--buffers=10000] [--subscribers=1] [--copy]
             )~" << std::endl;
         return 0;
     }
@@ -70,6 +191,22 @@ int main(int argc, char *argv[])
     if (parser("--zmq_port") >> str)
         zmqPort = str;
 
+    if (parser["--benchmark"])
+    {
+        BenchmarkOptions opts{ zmqPort, util::Megabytes(1), 10000, 1, parser["--copy"] };
+        parser("--buffer_size") >> opts.bufferSize;
+        parser("--buffers") >> opts.bufferCount;
+        parser("--subscribers") >> opts.subscribers;
+
+        if (opts.bufferSize < sizeof(u32) || !opts.subscribers)
+        {
+            std::cerr << "Error: invalid arguments\n";
+            return 1;
+        }
+
+        return run_benchmark(opts);
+    }
+
     std::string pubUrl = "tcp://" + zmqHost + ":" + zmqPort;
 
     while (true)
@@ -92,6 +229,8 @@ int main(int argc, char *argv[])
     size_t nBytes = 0;
     auto tStart = std::chrono::steady_clock::now();
     auto lastReportTime = tStart;
+    size_t lastReportBytes = 0;
+    size_t lastReportMessages = 0;
 
     while (true)
     {
@@ -145,8 +284,13 @@ int main(int argc, char *argv[])
 
             if (std::chrono::duration_cast<std::chrono::seconds>(now - lastReportTime).count() >= 5)
             {
-                spdlog::info("Received a total of {} zmq messages, {} bytes", nMessages, nBytes);
+                double dt = std::chrono::duration_cast<std::chrono::duration<double>>(now - lastReportTime).count();
+                spdlog::info("Received a total of {} zmq messages, {} bytes, rate: {:.2f} msg/s, {:.2f} MB/s",
+                             nMessages, nBytes, (nMessages - lastReportMessages) / dt,
+                             megabytes_per_second(nBytes - lastReportBytes, dt));
                 lastReportTime = now;
+                lastReportBytes = nBytes;
+                lastReportMessages = nMessages;
             }
         }
 #ifndef __WIN32
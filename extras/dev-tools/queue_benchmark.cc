@@ -0,0 +1,97 @@
+// Microbenchmark comparing the buffer queue implementations usable with
+// ReadoutBufferQueues_: the mutex based ThreadSafeQueue and the lock-free
+// SPSCQueue/MPMCQueue.
+//
+// A producer thread takes buffers from the empty queue and puts them onto the
+// filled queue. A consumer thread moves them back. This is the same ping-pong
+// pattern used between the readout and the listfile writer threads. Reported
+// are buffer handovers per second and the mean time per handover.
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/readout_buffer_queues.h>
+#include <spdlog/spdlog.h>
+
+using namespace mesytec::mvlc;
+
+template<typename Queues>
+void run_benchmark(const std::string &name, size_t bufferCount, size_t iterations)
+{
+    // Small buffers: only the pointer handover is measured.
+    Queues queues(64, bufferCount);
+    auto &filled = queues.filledBufferQueue();
+    auto &empty = queues.emptyBufferQueue();
+
+    auto tStart = std::chrono::steady_clock::now();
+
+    std::thread consumer([&]
+    {
+        for (size_t i=0; i<iterations; ++i)
+        {
+            auto buffer = filled.dequeue_blocking();
+            empty.enqueue(buffer);
+        }
+    });
+
+    for (size_t i=0; i<iterations; ++i)
+    {
+        auto buffer = empty.dequeue_blocking();
+        buffer->setBufferNumber(i);
+        filled.enqueue(buffer);
+    }
+
+    consumer.join();
+
+    auto elapsed = std::chrono::steady_clock::now() - tStart;
+    double secs = std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+    double rate = iterations / secs;
+    double nsPerOp = secs * 1e9 / iterations;
+
+    std::cout << name << ": bufferCount=" << bufferCount
+        << ", iterations=" << iterations
+        << ", elapsed=" << secs << " s"
+        << ", rate=" << rate / 1e6 << " M buffers/s"
+        << ", " << nsPerOp << " ns/buffer"
+        << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t bufferCount = 10;
+    size_t iterations = 1000000;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(bufferCount, "count")["--buffers"]("number of buffers in circulation (default=10)")
+        | lyra::opt(iterations, "count")["--iterations"]("number of buffer handovers (default=1000000)")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << "\n";
+        return 0;
+    }
+
+    if (bufferCount == 0)
+    {
+        std::cerr << "Error: --buffers must be > 0\n";
+        return 1;
+    }
+
+    run_benchmark<ReadoutBufferQueues>("ThreadSafeQueue", bufferCount, iterations);
+    run_benchmark<SPSCReadoutBufferQueues>("SPSCQueue      ", bufferCount, iterations);
+    run_benchmark<MPMCReadoutBufferQueues>("MPMCQueue      ", bufferCount, iterations);
+
+    return 0;
+}
@@ -0,0 +1,397 @@
+// Throughput benchmark for the readout_parser under lossfull input.
+//
+// Input data is either read from a listfile or generated synthetically. Loss
+// is injected by randomly dropping ETH packets (or USB frames) and by
+// corrupting single data words. The resulting buffers are then parsed
+// repeatedly and the parser throughput, event counts and parse results are
+// reported.
+//
+// With --threads the ParallelReadoutParser is used in ordered mode.
+//
+// To compare two parser implementations run the tool with identical arguments
+// (including --seed) against both library versions.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+#include <spdlog/spdlog.h>
+
+using namespace mesytec::mvlc;
+
+namespace
+{
+
+struct InputData
+{
+    ConnectionType bufferFormat = ConnectionType::USB;
+    std::vector<StackCommandBuilder> readoutStacks;
+    std::vector<std::vector<u32>> buffers;
+};
+
+bool load_listfile(const std::string &filename, InputData &dest)
+{
+    listfile::ZipReader zipReader;
+    zipReader.openArchive(filename);
+    auto entryName = zipReader.firstListfileEntryName();
+
+    if (entryName.empty())
+    {
+        std::cerr << "Error: no listfile entry found in " << filename << "\n";
+        return false;
+    }
+
+    auto readHandle = zipReader.openEntry(entryName);
+    auto readerHelper = listfile::make_listfile_reader_helper(readHandle);
+    auto configEvent = readerHelper.preamble.findCrateConfig();
+
+    if (!configEvent)
+    {
+        std::cerr << "Error: no CrateConfig found in " << filename << "\n";
+        return false;
+    }
+
+    dest.readoutStacks = crate_config_from_yaml(configEvent->contentsToString()).stacks;
+    dest.bufferFormat = readerHelper.bufferFormat;
+
+    while (true)
+    {
+        readerHelper.destBuf().clear();
+        auto buffer = listfile::read_next_buffer(readerHelper);
+
+        if (!buffer->used())
+            break;
+
+        auto view = buffer->viewU32();
+        dest.buffers.emplace_back(std::begin(view), std::end(view));
+    }
+
+    return true;
+}
+
+// Generates USB formatted data for a single event containing two modules with
+// block reads of random size. If eth is true the data is split into ETH
+// packets with correct header pointers.
+void generate_data(size_t eventCount, bool eth, std::mt19937 &rng, InputData &dest)
+{
+    static const size_t BufferSize = util::Megabytes(1);
+    static const size_t PacketDataWords = 360;
+
+    StackCommandBuilder readoutStack;
+    readoutStack.beginGroup("module0");
+    readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+    readoutStack.beginGroup("module1");
+    readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+
+    dest.readoutStacks = { readoutStack };
+    dest.bufferFormat = eth ? ConnectionType::ETH : ConnectionType::USB;
+
+    std::uniform_int_distribution<u32> sizeDist(10, 400);
+    std::array<std::vector<u32>, 2> moduleStorage;
+    std::array<readout_parser::ModuleData, 2> moduleDataList = {};
+    ReadoutBuffer usbData;
+
+    for (size_t ei=0; ei<eventCount; ++ei)
+    {
+        for (size_t mi=0; mi<moduleStorage.size(); ++mi)
+        {
+            auto &storage = moduleStorage[mi];
+            storage.resize(sizeDist(rng));
+            std::iota(std::begin(storage), std::end(storage), (mi + 1) << 28);
+
+            auto &md = moduleDataList[mi];
+            md.data = { storage.data(), static_cast<u32>(storage.size()) };
+            md.dynamicSize = storage.size();
+            md.hasDynamic = true;
+        }
+
+        listfile::write_event_data(usbData, 0, 0, moduleDataList.data(), moduleDataList.size());
+    }
+
+    auto input = usbData.viewU32();
+
+    if (!eth)
+    {
+        // Split into buffers on frame boundaries.
+        while (!input.empty())
+        {
+            std::vector<u32> buffer;
+
+            while (!input.empty() && buffer.size() * sizeof(u32) < BufferSize)
+            {
+                size_t frameWords = extract_frame_info(input[0]).len + 1;
+                buffer.insert(std::end(buffer), std::begin(input), std::begin(input) + frameWords);
+                input.remove_prefix(frameWords);
+            }
+
+            dest.buffers.emplace_back(std::move(buffer));
+        }
+
+        return;
+    }
+
+    // Offset of the next frame header relative to the start of the generated
+    // data. Used to calculate the packets next header pointer values.
+    size_t nextFrameOffset = 0;
+    size_t inputOffset = 0;
+    u16 packetNumber = 0;
+    std::vector<u32> buffer;
+
+    while (!input.empty())
+    {
+        size_t dataWords = std::min(input.size(), PacketDataWords);
+        u32 headerPointer = eth::header1::NoHeaderPointerPresent;
+
+        while (nextFrameOffset < inputOffset + dataWords)
+        {
+            if (headerPointer == eth::header1::NoHeaderPointerPresent)
+                headerPointer = nextFrameOffset - inputOffset;
+
+            nextFrameOffset += extract_frame_info(usbData.viewU32()[nextFrameOffset]).len + 1;
+        }
+
+        buffer.push_back(
+            ((static_cast<u32>(eth::PacketChannel::Data) & eth::header0::PacketChannelMask) << eth::header0::PacketChannelShift)
+            | ((packetNumber++ & eth::header0::PacketNumberMask) << eth::header0::PacketNumberShift)
+            | ((dataWords & eth::header0::NumDataWordsMask) << eth::header0::NumDataWordsShift));
+        buffer.push_back((headerPointer & eth::header1::HeaderPointerMask) << eth::header1::HeaderPointerShift);
+        buffer.insert(std::end(buffer), std::begin(input), std::begin(input) + dataWords);
+
+        input.remove_prefix(dataWords);
+        inputOffset += dataWords;
+
+        if (buffer.size() * sizeof(u32) >= BufferSize || input.empty())
+            dest.buffers.emplace_back(std::move(buffer));
+    }
+}
+
+// Randomly drops ETH packets/USB frames and overwrites single words with
+// random values.
+std::vector<std::vector<u32>> inject_loss(
+    const InputData &input, double dropRate, double corruptRate, std::mt19937 &rng)
+{
+    std::bernoulli_distribution dropDist(dropRate);
+    std::bernoulli_distribution corruptDist(corruptRate);
+    std::uniform_int_distribution<u32> wordDist;
+    std::vector<std::vector<u32>> result;
+
+    for (const auto &buffer: input.buffers)
+    {
+        basic_string_view<u32> view(buffer.data(), buffer.size());
+        std::vector<u32> dest;
+
+        while (!view.empty())
+        {
+            size_t partWords = 0;
+
+            if (get_frame_type(view[0]) == frame_headers::SystemEvent)
+                partWords = extract_frame_info(view[0]).len + 1;
+            else if (input.bufferFormat == ConnectionType::ETH && view.size() >= eth::HeaderWords)
+                partWords = eth::HeaderWords + eth::PayloadHeaderInfo{ view[0], view[1] }.dataWordCount();
+            else
+                partWords = extract_frame_info(view[0]).len + 1;
+
+            partWords = std::min(partWords, view.size());
+
+            if (!dropDist(rng))
+            {
+                size_t offset = dest.size();
+                dest.insert(std::end(dest), std::begin(view), std::begin(view) + partWords);
+
+                if (corruptDist(rng))
+                {
+                    std::uniform_int_distribution<size_t> posDist(offset, dest.size() - 1);
+                    dest[posDist(rng)] = wordDist(rng);
+                }
+            }
+
+            view.remove_prefix(partWords);
+        }
+
+        result.emplace_back(std::move(dest));
+    }
+
+    return result;
+}
+
+} // end anon namespace
+
+int main(int argc, char *argv[])
+{
+    bool opt_showHelp = false;
+    bool opt_eth = false;
+    bool opt_zeroCopy = false;
+    size_t opt_events = 200000;
+    size_t opt_iterations = 5;
+    unsigned opt_threads = 0;
+    double opt_dropRate = 0.01;
+    double opt_corruptRate = 0.01;
+    unsigned opt_seed = 1234;
+    std::string arg_listfile;
+
+    auto cli
+        = lyra::help(opt_showHelp)
+        | lyra::opt(opt_eth)["--eth"]("generate ETH instead of USB formatted data")
+        | lyra::opt(opt_zeroCopy)["--zero-copy"]("enable the parsers zero copy mode")
+        | lyra::opt(opt_events, "count")["--events"]("number of events to generate (default=200000)")
+        | lyra::opt(opt_iterations, "count")["--iterations"]("number of parser runs over the data (default=5)")
+        | lyra::opt(opt_threads, "count")["--threads"]("use the parallel parser with the given number of worker threads (default=0, serial parser)")
+        | lyra::opt(opt_dropRate, "rate")["--drop"]("probability of dropping a packet/frame (default=0.01)")
+        | lyra::opt(opt_corruptRate, "rate")["--corrupt"]("probability of corrupting a word in a packet/frame (default=0.01)")
+        | lyra::opt(opt_seed, "seed")["--seed"]("random seed (default=1234)")
+        | lyra::arg(arg_listfile, "listfile")("optional zip listfile to use instead of generated data")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (opt_showHelp)
+    {
+        std::cout << "readout-parser-benchmark: readout_parser throughput with injected loss.\n"
+            << cli << "\n";
+        return 0;
+    }
+
+    // The parser logs a warning for each kind of broken frame it encounters.
+    set_global_log_level(spdlog::level::err);
+
+    std::mt19937 rng(opt_seed);
+    InputData inputData;
+
+    try
+    {
+        if (!arg_listfile.empty())
+        {
+            if (!load_listfile(arg_listfile, inputData))
+                return 1;
+        }
+        else
+            generate_data(opt_events, opt_eth, rng, inputData);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error preparing input data: " << e.what() << "\n";
+        return 1;
+    }
+
+    auto buffers = inject_loss(inputData, opt_dropRate, opt_corruptRate, rng);
+
+    double totalMiB = 0.0;
+
+    for (const auto &buffer: buffers)
+        totalMiB += buffer.size() * sizeof(u32) / static_cast<double>(util::Megabytes(1));
+
+    std::cout << fmt::format("Input: format={}, buffers={}, size={:.2f} MiB, drop={}, corrupt={}\n",
+        inputData.bufferFormat == ConnectionType::ETH ? "ETH" : "USB",
+        buffers.size(), totalMiB, opt_dropRate, opt_corruptRate);
+
+    readout_parser::ReadoutParserCallbacks parserCallbacks;
+    size_t eventCount = 0;
+    size_t systemEventCount = 0;
+    u32 checksum = 0;
+
+    // Touch all module data words like a consumer of the data would.
+    parserCallbacks.eventData = [&eventCount, &checksum] (
+        void *, int, int, const readout_parser::ModuleData *moduleDataList, unsigned moduleCount)
+    {
+        ++eventCount;
+
+        for (unsigned mi=0; mi<moduleCount; ++mi)
+        {
+            const auto &data = moduleDataList[mi].data;
+            checksum = std::accumulate(data.data, data.data + data.size, checksum);
+        }
+    };
+
+    parserCallbacks.systemEvent = [&systemEventCount] (void *, int, const u32 *, u32)
+    {
+        ++systemEventCount;
+    };
+
+    readout_parser::ReadoutParserCounters parserCounters;
+    std::chrono::duration<double> bestTime(0);
+
+    for (size_t iteration=0; iteration<opt_iterations; ++iteration)
+    {
+        auto parserState = readout_parser::make_readout_parser(inputData.readoutStacks);
+        parserState.zeroCopy = opt_zeroCopy;
+        parserCounters = {};
+        eventCount = 0;
+        systemEventCount = 0;
+        checksum = 0;
+        u32 bufferNumber = 1;
+
+        // The parallel parser takes over the storage of ReadoutBuffers like
+        // in a replay. Fill them outside of the measurement.
+        std::vector<ReadoutBuffer> readoutBuffers;
+
+        if (opt_threads)
+        {
+            for (const auto &buffer: buffers)
+            {
+                readoutBuffers.emplace_back(util::Megabytes(2));
+                auto &rb = readoutBuffers.back();
+                rb.setType(inputData.bufferFormat);
+                rb.ensureFreeSpace(buffer.size() * sizeof(u32));
+                std::memcpy(rb.data(), buffer.data(), buffer.size() * sizeof(u32));
+                rb.use(buffer.size() * sizeof(u32));
+            }
+        }
+
+        auto tStart = std::chrono::steady_clock::now();
+
+        if (opt_threads)
+        {
+            Protected<readout_parser::ReadoutParserCounters> counters;
+            readout_parser::ParallelParserOptions options;
+            options.workerCount = opt_threads;
+
+            readout_parser::ParallelReadoutParser parser(
+                parserState, parserCallbacks, counters, options);
+
+            for (auto &rb: readoutBuffers)
+            {
+                rb.setBufferNumber(bufferNumber++);
+                parser.takeBuffer(rb);
+            }
+
+            parser.finish();
+            parserCounters = counters.copy();
+        }
+        else
+        {
+            for (const auto &buffer: buffers)
+            {
+                readout_parser::parse_readout_buffer(
+                    inputData.bufferFormat, parserState, parserCallbacks, parserCounters,
+                    bufferNumber++, buffer.data(), buffer.size());
+            }
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - tStart;
+
+        if (iteration == 0 || elapsed < bestTime)
+            bestTime = elapsed;
+
+        std::cout << fmt::format("  iteration {}: {:.3f} s, {:.2f} MiB/s, events={}\n",
+            iteration, elapsed.count(), totalMiB / elapsed.count(),
+            eventCount);
+    }
+
+    std::cout << fmt::format("Best: {:.3f} s, {:.2f} MiB/s, events={}, systemEvents={}, checksum={:#010x}\n",
+        bestTime.count(), totalMiB / bestTime.count(),
+        eventCount, systemEventCount, checksum);
+
+    std::cout << "\nParser counters from the last iteration:\n";
+    readout_parser::print_counters(std::cout, parserCounters);
+
+    return 0;
+}
@@ -171,6 +171,8 @@ int main(int argc, char *argv[])
     std::string opt_listfileOut;
     std::string opt_listfileCompressionType = "lz4";
     int opt_listfileCompressionLevel = 0;
+    bool opt_listfileIndex = false;
+    unsigned opt_listfileCompressionThreads = 0;
     std::string opt_crateConfig;
     unsigned opt_secondsToRun = 0;
     bool opt_printReadoutData = false;
@@ -214,6 +216,12 @@ int main(int argc, char *argv[])
         | lyra::opt(opt_listfileCompressionLevel, "level")
             ["--listfile-compression-level"] ("compression level to use (for zip 0 means no compression)")
 
+        | lyra::opt(opt_listfileIndex)
+            ["--listfile-index"] ("write a random access index for lz4 listfiles")
+
+        | lyra::opt(opt_listfileCompressionThreads, "threads")
+            ["--listfile-compression-threads"] ("number of threads compressing lz4 listfiles (0 compresses in the listfile writer thread)")
+
         // logging
         | lyra::opt(opt_printReadoutData)
             ["--print-readout-data"]("log each word of readout data (very verbose!)")
@@ -362,6 +370,12 @@ int main(int argc, char *argv[])
 
             .compressionLevel = opt_listfileCompressionLevel,
 
+            .lz4IndexInterval = (opt_listfileIndex
+                                 ? listfile::DefaultLZ4IndexInterval
+                                 : 0u),
+
+            .compressionThreads = opt_listfileCompressionThreads,
+
         };
 
         //
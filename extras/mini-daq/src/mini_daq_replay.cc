@@ -16,7 +16,9 @@ int main(int argc, char *argv[])
     bool opt_printCrateConfig = false;
     std::string opt_listfileArchiveName;
     std::string opt_listfileMemberName;
+    unsigned opt_parserThreads = 0;
 
+    bool opt_readAhead = false;
     bool opt_showHelp = false;
     bool opt_logDebug = false;
     bool opt_logTrace = false;
@@ -28,6 +30,14 @@ int main(int argc, char *argv[])
         | lyra::opt(opt_printCrateConfig)
             ["--print-config"]("print the MVLC CrateConfig extracted from the listfile and exit")
 
+        // parallel readout parser
+        | lyra::opt(opt_parserThreads, "threads")
+            ["--parser-threads"]("use a parallel readout parser with the given number of worker threads")
+
+        // background decompression
+        | lyra::opt(opt_readAhead)
+            ["--read-ahead"]("read and decompress the listfile in a background thread")
+
         // logging
         | lyra::opt(opt_printReadoutData)
             ["--print-readout-data"]("log each word of readout data (very verbose!)")
@@ -119,6 +129,25 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if (opt_readAhead)
+    {
+        listfile::ReadAheadOptions readAheadOptions;
+        readAheadOptions.enabled = true;
+        replay.setReadAhead(readAheadOptions);
+    }
+
+    if (opt_parserThreads)
+    {
+        readout_parser::ParallelParserOptions parserOptions;
+        parserOptions.workerCount = opt_parserThreads;
+
+        if (auto ec = replay.enableParallelParser(parserOptions))
+        {
+            cerr << "Error enabling the parallel readout parser: " << ec.message() << endl;
+            return 1;
+        }
+    }
+
     cout << "Starting replay from " << opt_listfileArchiveName << "..." << endl;
 
     if (auto ec = replay.start())
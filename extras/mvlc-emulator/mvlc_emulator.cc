@@ -0,0 +1,928 @@
+// mvlc-emulator: emulates the ETH interface of a MVLC on the local machine.
+//
+// The emulator binds the MVLC command, data and delay ports (UDP 0x8000-0x8002)
+// and implements enough of the protocol to run the library side of the ETH
+// readout path (eth::Impl, the cmd_pipe_reader, ReadoutWorker and the ETH
+// throttling) without hardware:
+//
+// - Super command buffers received on the command port are answered with
+//   mirror responses. Register writes are stored, register reads return the
+//   stored values.
+// - Setting the immediate bit in the stack 0 trigger register executes the
+//   immediate stack. Stack commands are executed against a simulated VME
+//   crate: writes are stored, single reads return the last value written to
+//   the address, block reads yield --block-words words of generated data.
+// - While DAQ mode is enabled the readout stacks with an active trigger are
+//   executed round-robin and their output is streamed to the data pipe at the
+//   configured rate. Alternatively the readout data of a listfile is replayed.
+// - Delay commands received on the delay port are applied between outgoing
+//   data packets the same way the MVLC does it.
+// - Packet loss and reordering can be injected into the data stream.
+//
+// Example throughput benchmark:
+//   mvlc-emulator --rate 200 &
+//   mvlc-mini-daq --mvlc-eth 127.0.0.1 --no-listfile mvlc-emulator-crateconfig.yaml 10
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <lyra/lyra.hpp>
+#include <mesytec-mvlc/mesytec-mvlc.h>
+#include <mesytec-mvlc/util/udp_sockets.h>
+#include <spdlog/spdlog.h>
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+namespace
+{
+
+std::atomic<bool> g_quit(false);
+
+void signal_handler(int)
+{
+    g_quit = true;
+}
+
+// Max number of data words in a data pipe packet: 1500 byte standard and 9000
+// byte jumbo frames minus the IPv4, UDP and MVLC headers.
+static const size_t DataWordsPerPacket = (1500 - 20 - 8) / sizeof(u32) - HeaderWords;
+static const size_t DataWordsPerJumboPacket = (JumboFrameMaxSize - 20 - 8) / sizeof(u32) - HeaderWords;
+
+static const u32 EmulatedFirmwareRevision = 0x0039u;
+static const u32 EmulatedHardwareId = 0x5008u;
+
+// Packs a stream of frames into MVLC ETH packets. Each packet starts with the
+// two header words. The next header pointer in header1 is maintained here,
+// the rest of the header words is filled in when sending the packet.
+class Packetizer
+{
+    public:
+        using Packet = std::vector<u32>;
+
+        explicit Packetizer(size_t maxDataWords = DataWordsPerPacket)
+            : m_maxDataWords(maxDataWords)
+        {}
+
+        void setMaxDataWords(size_t maxDataWords)
+        {
+            flush();
+            m_maxDataWords = maxDataWords;
+        }
+
+        void appendFrame(u32 header, const u32 *contents, size_t size)
+        {
+            append(&header, 1, true);
+            append(contents, size, false);
+        }
+
+        // Appends an already formed packet payload, e.g. one read from a
+        // listfile.
+        void appendPacket(u16 nextHeaderPointer, const u32 *data, size_t size)
+        {
+            flush();
+            auto packet = makePacket();
+            packet[1] = nextHeaderPointer & header1::HeaderPointerMask;
+            packet.insert(std::end(packet), data, data + size);
+            m_packets.emplace_back(std::move(packet));
+        }
+
+        // Makes the partially filled packet available for sending.
+        void flush()
+        {
+            if (m_current.size() > HeaderWords)
+            {
+                m_packets.emplace_back(std::move(m_current));
+                m_current = {};
+            }
+        }
+
+        bool hasPackets() const { return !m_packets.empty(); }
+
+        Packet takePacket()
+        {
+            auto result = std::move(m_packets.front());
+            m_packets.pop_front();
+            return result;
+        }
+
+        // Returns the storage of a sent packet for reuse.
+        void recycle(Packet &&packet)
+        {
+            if (m_spares.size() < 64)
+                m_spares.emplace_back(std::move(packet));
+        }
+
+    private:
+        Packet makePacket()
+        {
+            Packet packet;
+
+            if (!m_spares.empty())
+            {
+                packet = std::move(m_spares.back());
+                m_spares.pop_back();
+            }
+
+            packet.assign(HeaderWords, 0u);
+            packet[1] = header1::NoHeaderPointerPresent;
+            return packet;
+        }
+
+        void append(const u32 *data, size_t size, bool isFrameHeader)
+        {
+            while (size)
+            {
+                if (m_current.empty())
+                    m_current = makePacket();
+
+                if (isFrameHeader && m_current[1] == header1::NoHeaderPointerPresent)
+                    m_current[1] = m_current.size() - HeaderWords;
+
+                size_t part = std::min(size, m_maxDataWords - (m_current.size() - HeaderWords));
+                m_current.insert(std::end(m_current), data, data + part);
+                data += part;
+                size -= part;
+                isFrameHeader = false;
+
+                if (m_current.size() - HeaderWords >= m_maxDataWords)
+                {
+                    m_packets.emplace_back(std::move(m_current));
+                    m_current = {};
+                }
+            }
+        }
+
+        size_t m_maxDataWords;
+        Packet m_current;
+        std::deque<Packet> m_packets;
+        std::vector<Packet> m_spares;
+};
+
+// Minimal VME crate: writes are stored, single reads return the last value
+// written to the address, block reads produce blockWords words of generated
+// data.
+struct SimulatedCrate
+{
+    std::unordered_map<u32, u32> memory;
+    u16 blockWords = 100;
+};
+
+void append_block_read(const StackCommand &cmd, u16 blockWords, u32 eventNumber, std::vector<u32> &dest)
+{
+    const bool is64 = vme_amods::is_mblt_mode(cmd.amod) || vme_amods::is_esst64_mode(cmd.amod);
+    size_t words = std::min(static_cast<size_t>(blockWords), static_cast<size_t>(cmd.transfers) * (is64 ? 2u : 1u));
+    u32 wordNumber = 0u;
+
+    // Same as the MVLC: blocks larger than the max frame length are split into
+    // multiple F5 frames, all but the last one have the Continue flag set.
+    do
+    {
+        size_t part = std::min(words, static_cast<size_t>(frame_headers::LengthMask));
+        words -= part;
+        dest.push_back(make_frame_header(frame_headers::BlockRead, part, 0,
+                                         words ? frame_flags::Continue : 0u));
+
+        for (size_t i=0; i<part; ++i)
+            dest.push_back(((eventNumber & 0xffffu) << 16) | (wordNumber++ & 0xffffu));
+    } while (words);
+}
+
+// Executes the stack commands against the crate and appends the produced data
+// words to dest.
+void execute_stack(const std::vector<StackCommand> &commands, SimulatedCrate &crate,
+                   u32 eventNumber, std::vector<u32> &dest)
+{
+    for (const auto &cmd: commands)
+    {
+        switch (cmd.type)
+        {
+            case StackCommand::CommandType::WriteMarker:
+                dest.push_back(cmd.value);
+                break;
+
+            case StackCommand::CommandType::WriteSpecial:
+                dest.push_back(eventNumber);
+                break;
+
+            case StackCommand::CommandType::VMEWrite:
+                crate.memory[cmd.address] = cmd.value;
+                break;
+
+            case StackCommand::CommandType::VMERead:
+            case StackCommand::CommandType::VMEReadSwapped:
+            case StackCommand::CommandType::VMEReadMem:
+            case StackCommand::CommandType::VMEReadMemSwapped:
+                if (vme_amods::is_block_mode(cmd.amod))
+                    append_block_read(cmd, crate.blockWords, eventNumber, dest);
+                else
+                {
+                    auto it = crate.memory.find(cmd.address);
+                    u32 value = it != std::end(crate.memory) ? it->second : 0u;
+
+                    if (cmd.dataWidth == VMEDataWidth::D16)
+                        value &= 0xffffu;
+
+                    dest.push_back(value);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+// Wraps the output of a stack execution into a F3 frame followed by F9
+// continuation frames if the data does not fit into a single frame.
+void append_stack_frames(u8 stackId, u8 ctrlId, const std::vector<u32> &contents, Packetizer &dest)
+{
+    size_t offset = 0u;
+    u8 frameType = frame_headers::StackFrame;
+
+    do
+    {
+        size_t part = std::min(contents.size() - offset, static_cast<size_t>(frame_headers::LengthMask));
+        bool more = offset + part < contents.size();
+        dest.appendFrame(make_frame_header(frameType, part, stackId, more ? frame_flags::Continue : 0u, ctrlId),
+                         contents.data() + offset, part);
+        offset += part;
+        frameType = frame_headers::StackContinuation;
+    } while (offset < contents.size());
+}
+
+// Replays the readout data contained in a listfile. System event frames are
+// skipped. Packets from ETH listfiles are sent as recorded except for the
+// packet number and timestamp, frames from USB listfiles are repacked.
+class ListfileSource
+{
+    public:
+        explicit ListfileSource(const std::string &filename)
+            : m_filename(filename)
+        {
+            rewind();
+        }
+
+        // Appends the next buffer of listfile data to the packetizer. Returns
+        // false once the end of the listfile has been reached.
+        bool next(Packetizer &dest)
+        {
+            m_readerHelper.destBuf().clear();
+            auto buffer = read_next_buffer(m_readerHelper);
+
+            if (!buffer->used())
+                return false;
+
+            auto view = buffer->viewU32();
+
+            if (m_readerHelper.bufferFormat == ConnectionType::ETH)
+            {
+                while (!view.empty())
+                {
+                    if (get_frame_type(view[0]) == frame_headers::SystemEvent)
+                    {
+                        view.remove_prefix(std::min(view.size(), static_cast<size_t>(extract_frame_info(view[0]).len) + 1u));
+                        continue;
+                    }
+
+                    if (view.size() < HeaderWords)
+                        break;
+
+                    size_t dataWords = (view[0] >> header0::NumDataWordsShift) & header0::NumDataWordsMask;
+                    u16 nextHeaderPointer = (view[1] >> header1::HeaderPointerShift) & header1::HeaderPointerMask;
+
+                    if (view.size() < HeaderWords + dataWords)
+                        break;
+
+                    dest.appendPacket(nextHeaderPointer, view.data() + HeaderWords, dataWords);
+                    view.remove_prefix(HeaderWords + dataWords);
+                }
+            }
+            else
+            {
+                while (!view.empty())
+                {
+                    auto frameInfo = extract_frame_info(view[0]);
+                    size_t frameWords = std::min(view.size(), static_cast<size_t>(frameInfo.len) + 1u);
+
+                    if (frameInfo.type == frame_headers::StackFrame
+                        || frameInfo.type == frame_headers::StackContinuation)
+                    {
+                        dest.appendFrame(view[0], view.data() + 1, frameWords - 1);
+                    }
+
+                    view.remove_prefix(frameWords);
+                }
+            }
+
+            return true;
+        }
+
+        void rewind()
+        {
+            m_readerHelper = {};
+            m_zipReader = std::make_unique<listfile::ZipReader>();
+            m_zipReader->openArchive(m_filename);
+            auto entryName = m_zipReader->firstListfileEntryName();
+
+            if (entryName.empty())
+                throw std::runtime_error("no listfile entry found in " + m_filename);
+
+            m_readerHelper = listfile::make_listfile_reader_helper(m_zipReader->openEntry(entryName));
+        }
+
+    private:
+        std::string m_filename;
+        std::unique_ptr<listfile::ZipReader> m_zipReader;
+        listfile::ListfileReaderHelper m_readerHelper;
+};
+
+struct EmulatorOptions
+{
+    double rateMiB = 100.0; // 0: unlimited
+    u16 blockWords = 100;
+    std::string listfile;
+    bool loopListfile = true;
+    double lossRate = 0.0;
+    double reorderRate = 0.0;
+    unsigned seed = 1;
+};
+
+struct EmulatorCounters
+{
+    std::atomic<u64> commandBuffers{0u};
+    std::atomic<u64> delayCommands{0u};
+    std::atomic<u64> events{0u};
+    std::atomic<u64> packetsSent{0u};
+    std::atomic<u64> bytesSent{0u};
+    std::atomic<u64> packetsDropped{0u};
+    std::atomic<u64> packetsReordered{0u};
+};
+
+class Emulator
+{
+    public:
+        Emulator(const EmulatorOptions &options, int cmdSock, int dataSock, int delaySock)
+            : m_options(options)
+            , m_cmdSock(cmdSock)
+            , m_dataSock(dataSock)
+            , m_delaySock(delaySock)
+            , m_rng(options.seed)
+        {
+            if (!options.listfile.empty())
+                m_listfileSource = std::make_unique<ListfileSource>(options.listfile);
+
+            m_crate.blockWords = options.blockWords;
+            m_registers[registers::firmware_revision] = EmulatedFirmwareRevision;
+            m_registers[registers::hardware_id] = EmulatedHardwareId;
+        }
+
+        void run()
+        {
+            std::thread dataThread(&Emulator::dataLoop, this);
+            controlLoop();
+            dataThread.join();
+        }
+
+        const EmulatorCounters &counters() const { return m_counters; }
+        bool daqMode() const { return m_daqMode; }
+        u16 delay() const { return m_delay; }
+
+    private:
+        void controlLoop();
+        void handleCommandBuffer(const u32 *request, size_t size, const sockaddr_in &src);
+        void executeImmediateStack(const sockaddr_in &dest);
+        std::vector<StackCommand> readStack(u8 stackId);
+        void dataLoop();
+        void sendDataPacket(Packetizer::Packet &packet, const sockaddr_in &dest);
+        void sendStackPackets(Packetizer &packetizer, const sockaddr_in &dest);
+        void pace(size_t bytes);
+
+        void sendTo(int sock, const Packetizer::Packet &packet, const sockaddr_in &dest)
+        {
+            ::sendto(sock, reinterpret_cast<const char *>(packet.data()), packet.size() * sizeof(u32), 0,
+                     reinterpret_cast<const sockaddr *>(&dest), sizeof(dest));
+        }
+
+        u32 timestamp() const
+        {
+            auto elapsed = std::chrono::steady_clock::now() - m_tStart;
+            return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        }
+
+        u8 ctrlId()
+        {
+            return m_registers[registers::controller_id] & frame_headers::CtrlIdMask;
+        }
+
+        EmulatorOptions m_options;
+        int m_cmdSock;
+        int m_dataSock;
+        int m_delaySock;
+        std::chrono::steady_clock::time_point m_tStart = std::chrono::steady_clock::now();
+
+        // Protects the registers, the crate and the data destination.
+        std::mutex m_mutex;
+        std::unordered_map<u16, u32> m_registers;
+        SimulatedCrate m_crate;
+        sockaddr_in m_dataDest = {};
+        bool m_haveDataDest = false;
+        u32 m_eventNumber = 0u;
+
+        std::atomic<bool> m_daqMode{false};
+        std::atomic<u16> m_delay{0u};
+        EmulatorCounters m_counters;
+
+        // Only used by the control thread.
+        u16 m_cmdPacketNumber = 0u;
+        u16 m_stackPacketNumber = 0u;
+
+        // Only used by the data thread.
+        std::unique_ptr<ListfileSource> m_listfileSource;
+        u16 m_dataPacketNumber = 0u;
+        u8 m_dataCtrlId = 0u;
+        std::mt19937 m_rng;
+        std::uniform_real_distribution<double> m_dist;
+        Packetizer::Packet m_heldPacket;
+        std::chrono::steady_clock::time_point m_nextSend;
+};
+
+void Emulator::controlLoop()
+{
+    std::array<pollfd, 3> fds = {{ { m_cmdSock, POLLIN, 0 }, { m_dataSock, POLLIN, 0 }, { m_delaySock, POLLIN, 0 } }};
+    std::array<u32, JumboFrameMaxSize / sizeof(u32)> buffer;
+
+    while (!g_quit)
+    {
+        if (::poll(fds.data(), fds.size(), 100) <= 0)
+            continue;
+
+        for (const auto &pfd: fds)
+        {
+            if (!(pfd.revents & POLLIN))
+                continue;
+
+            sockaddr_in src = {};
+            socklen_t srcSize = sizeof(src);
+            ssize_t res = ::recvfrom(pfd.fd, reinterpret_cast<char *>(buffer.data()), buffer.size() * sizeof(u32),
+                                     0, reinterpret_cast<sockaddr *>(&src), &srcSize);
+
+            if (res < static_cast<ssize_t>(sizeof(u32)))
+                continue;
+
+            const size_t wordCount = res / sizeof(u32);
+
+            if (pfd.fd == m_cmdSock)
+            {
+                handleCommandBuffer(buffer.data(), wordCount, src);
+            }
+            else if (pfd.fd == m_dataSock)
+            {
+                // Like the MVLC: the sender of the last packet received on the
+                // data port becomes the destination of the data stream.
+                std::lock_guard<std::mutex> guard(m_mutex);
+
+                if (!m_haveDataDest || m_dataDest.sin_addr.s_addr != src.sin_addr.s_addr
+                    || m_dataDest.sin_port != src.sin_port)
+                {
+                    spdlog::info("data pipe destination: {}:{}", inet_ntoa(src.sin_addr), ntohs(src.sin_port));
+                }
+
+                m_dataDest = src;
+                m_haveDataDest = true;
+            }
+            else if (pfd.fd == m_delaySock)
+            {
+                u32 word = buffer[0];
+
+                if ((word >> super_commands::SuperCmdShift) == static_cast<u32>(SuperCommandType::EthDelay))
+                {
+                    u16 delay = word & super_commands::SuperCmdArgMask;
+                    m_delay = delay;
+                    ++m_counters.delayCommands;
+                    spdlog::debug("delay command: {} us", delay);
+
+                    std::lock_guard<std::mutex> guard(m_mutex);
+                    m_registers[registers::eth_delay_read] = delay;
+                }
+            }
+        }
+    }
+}
+
+void Emulator::handleCommandBuffer(const u32 *request, size_t size, const sockaddr_in &src)
+{
+    if (size < 2 || (request[0] >> super_commands::SuperCmdShift) != static_cast<u32>(SuperCommandType::CmdBufferStart))
+    {
+        spdlog::warn("ignoring invalid command buffer of size {}", size);
+        return;
+    }
+
+    ++m_counters.commandBuffers;
+
+    std::vector<u32> response = { 0u, 0u, 0u }; // header0, header1, F1 frame header
+    bool execImmediate = false;
+    u8 controllerId = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        // Skip CmdBufferStart and CmdBufferEnd.
+        for (size_t i=1; i<size-1; ++i)
+        {
+            u32 word = request[i];
+            auto cmd = static_cast<SuperCommandType>(word >> super_commands::SuperCmdShift);
+            u16 address = word & super_commands::SuperCmdArgMask;
+            response.push_back(word);
+
+            if (cmd == SuperCommandType::ReadLocal)
+                response.push_back(m_registers[address]);
+            else if (cmd == SuperCommandType::WriteLocal && i+1 < size-1)
+            {
+                u32 value = request[++i];
+                response.push_back(value);
+                m_registers[address] = value;
+
+                if (address == registers::daq_mode)
+                {
+                    m_daqMode = value & 1u;
+                    spdlog::info("DAQ mode {}", m_daqMode ? "enabled" : "disabled");
+                }
+                else if (address == stacks::Stack0TriggerRegister && (value & (1u << stacks::ImmediateShift)))
+                    execImmediate = true;
+            }
+        }
+
+        controllerId = ctrlId();
+    }
+
+    const size_t frameLen = response.size() - 3;
+    response[0] = make_header0(PacketChannel::Command, m_cmdPacketNumber++, response.size() - HeaderWords, controllerId);
+    response[1] = (timestamp() & header1::TimestampMask) << header1::TimestampShift;
+    response[2] = make_frame_header(frame_headers::SuperFrame, frameLen, 0, 0, controllerId);
+    sendTo(m_cmdSock, response, src);
+
+    if (execImmediate)
+        executeImmediateStack(src);
+}
+
+std::vector<StackCommand> Emulator::readStack(u8 stackId)
+{
+    std::vector<u32> stackBuffer;
+    u32 offset = m_registers[stacks::get_offset_register(stackId)] & stacks::StackOffsetBitMaskBytes;
+    u32 address = stacks::StackMemoryBegin + offset + AddressIncrement; // skip StackStart
+
+    for (; address < stacks::StackMemoryEnd; address += AddressIncrement)
+    {
+        u32 word = m_registers[address];
+
+        if ((word >> stack_commands::CmdShift) == static_cast<u32>(StackCommandType::StackEnd))
+            break;
+
+        stackBuffer.push_back(word);
+    }
+
+    return stack_commands_from_buffer(stackBuffer);
+}
+
+void Emulator::executeImmediateStack(const sockaddr_in &dest)
+{
+    Packetizer packetizer;
+    std::vector<u32> contents;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        execute_stack(readStack(stacks::ImmediateStackID), m_crate, m_eventNumber, contents);
+        append_stack_frames(stacks::ImmediateStackID, ctrlId(), contents, packetizer);
+    }
+
+    packetizer.flush();
+    sendStackPackets(packetizer, dest);
+}
+
+void Emulator::sendStackPackets(Packetizer &packetizer, const sockaddr_in &dest)
+{
+    while (packetizer.hasPackets())
+    {
+        auto packet = packetizer.takePacket();
+        packet[0] = make_header0(PacketChannel::Stack, m_stackPacketNumber++, packet.size() - HeaderWords, 0);
+        packet[1] |= (timestamp() & header1::TimestampMask) << header1::TimestampShift;
+        sendTo(m_cmdSock, packet, dest);
+    }
+}
+
+void Emulator::dataLoop()
+{
+    auto &listfileSource = m_listfileSource;
+    Packetizer packetizer;
+    std::vector<std::pair<u8, std::vector<StackCommand>>> readoutStacks;
+    std::vector<u32> contents;
+    size_t nextStack = 0u;
+    bool running = false;
+    bool listfileDone = false;
+    sockaddr_in dest = {};
+
+    while (!g_quit)
+    {
+        if (!m_daqMode)
+        {
+            if (running)
+            {
+                // Send out the remaining data, then idle until DAQ mode is
+                // enabled again.
+                packetizer.flush();
+
+                while (packetizer.hasPackets())
+                {
+                    auto packet = packetizer.takePacket();
+                    sendDataPacket(packet, dest);
+                    packetizer.recycle(std::move(packet));
+                }
+
+                if (!m_heldPacket.empty())
+                {
+                    sendTo(m_dataSock, m_heldPacket, dest);
+                    m_heldPacket.clear();
+                }
+
+                running = false;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        if (!running)
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            if (!m_haveDataDest)
+            {
+                spdlog::warn("DAQ mode enabled but no packet was received on the data port yet");
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+
+            dest = m_dataDest;
+            m_dataCtrlId = ctrlId();
+            readoutStacks.clear();
+
+            for (u8 stackId = stacks::FirstReadoutStackID; stackId < stacks::StackCount; ++stackId)
+            {
+                stacks::Trigger trigger{};
+                trigger.value = m_registers[stacks::get_trigger_register(stackId)];
+
+                if (trigger.type != stacks::NoTrigger)
+                    readoutStacks.emplace_back(stackId, readStack(stackId));
+            }
+
+            packetizer.setMaxDataWords(m_registers[registers::jumbo_frame_enable]
+                                       ? DataWordsPerJumboPacket : DataWordsPerPacket);
+
+            if (listfileSource)
+                spdlog::info("replaying listfile {}", m_options.listfile);
+            else
+                spdlog::info("executing {} triggered readout stacks", readoutStacks.size());
+
+            m_nextSend = std::chrono::steady_clock::now();
+            nextStack = 0u;
+            running = true;
+        }
+
+        if (listfileSource && !listfileDone)
+        {
+            if (!listfileSource->next(packetizer))
+            {
+                if (m_options.loopListfile)
+                    listfileSource->rewind();
+                else
+                {
+                    spdlog::info("end of listfile reached");
+                    packetizer.flush();
+                    listfileDone = true;
+                }
+            }
+        }
+        else if (!listfileSource && !readoutStacks.empty())
+        {
+            // Produce one packet worth of readout data.
+            while (!packetizer.hasPackets())
+            {
+                const auto &stack = readoutStacks[nextStack];
+                nextStack = (nextStack + 1) % readoutStacks.size();
+                contents.clear();
+
+                std::lock_guard<std::mutex> guard(m_mutex);
+                execute_stack(stack.second, m_crate, m_eventNumber++, contents);
+                append_stack_frames(stack.first, ctrlId(), contents, packetizer);
+                ++m_counters.events;
+            }
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        while (packetizer.hasPackets())
+        {
+            auto packet = packetizer.takePacket();
+            sendDataPacket(packet, dest);
+            packetizer.recycle(std::move(packet));
+        }
+    }
+}
+
+void Emulator::sendDataPacket(Packetizer::Packet &packet, const sockaddr_in &dest)
+{
+    // The packet number is consumed even if the packet is dropped so that the
+    // receiver can detect the loss.
+    packet[0] = make_header0(PacketChannel::Data, m_dataPacketNumber++, packet.size() - HeaderWords, m_dataCtrlId);
+    packet[1] |= (timestamp() & header1::TimestampMask) << header1::TimestampShift;
+
+    if (m_options.lossRate > 0.0 && m_dist(m_rng) < m_options.lossRate)
+    {
+        ++m_counters.packetsDropped;
+        return;
+    }
+
+    if (m_options.reorderRate > 0.0 && m_heldPacket.empty() && m_dist(m_rng) < m_options.reorderRate)
+    {
+        // Hold back this packet and send it after the next one.
+        m_heldPacket = packet;
+        ++m_counters.packetsReordered;
+        return;
+    }
+
+    pace(packet.size() * sizeof(u32));
+    sendTo(m_dataSock, packet, dest);
+    ++m_counters.packetsSent;
+    m_counters.bytesSent += packet.size() * sizeof(u32);
+
+    if (!m_heldPacket.empty())
+    {
+        pace(m_heldPacket.size() * sizeof(u32));
+        sendTo(m_dataSock, m_heldPacket, dest);
+        ++m_counters.packetsSent;
+        m_counters.bytesSent += m_heldPacket.size() * sizeof(u32);
+        m_heldPacket.clear();
+    }
+}
+
+// Waits until the next packet may be sent. The gap between packets is the
+// transfer time at the configured rate plus the delay requested via the delay
+// port. Like on the MVLC the max delay value stops the data stream.
+void Emulator::pace(size_t bytes)
+{
+    using namespace std::chrono;
+
+    while (m_delay == std::numeric_limits<u16>::max() && m_daqMode && !g_quit)
+    {
+        std::this_thread::sleep_for(milliseconds(1));
+        m_nextSend = steady_clock::now();
+    }
+
+    nanoseconds interval = microseconds(m_delay);
+
+    if (m_options.rateMiB > 0.0)
+        interval += nanoseconds(static_cast<s64>(bytes * 1e9 / (m_options.rateMiB * util::Megabytes(1))));
+
+    // Sleeping for each packet is not precise enough at high rates. Instead
+    // send immediately while behind schedule but do not build up more than
+    // 1ms worth of backlog.
+    auto now = steady_clock::now();
+    m_nextSend = std::max(m_nextSend, now - milliseconds(1));
+
+    if (m_nextSend > now + microseconds(20))
+        std::this_thread::sleep_until(m_nextSend);
+
+    m_nextSend += interval;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    EmulatorOptions options;
+    double statsInterval = 1.0;
+    bool opt_noLoop = false;
+    bool opt_logDebug = false;
+    bool opt_logTrace = false;
+    bool showHelp = false;
+
+    auto cli
+        = lyra::help(showHelp)
+        | lyra::opt(options.rateMiB, "MiB/s")["--rate"]("data pipe rate limit in MiB/s, 0 for unlimited (default=100)")
+        | lyra::opt(options.blockWords, "words")["--block-words"]("number of words produced by block reads (default=100)")
+        | lyra::opt(options.listfile, "listfile")["--listfile"]("replay the readout data from this zip listfile instead of executing the readout stacks")
+        | lyra::opt(opt_noLoop)["--no-loop"]("stop after replaying the listfile once")
+        | lyra::opt(options.lossRate, "fraction")["--loss"]("fraction of data packets to drop (default=0)")
+        | lyra::opt(options.reorderRate, "fraction")["--reorder"]("fraction of data packets to swap with the following packet (default=0)")
+        | lyra::opt(options.seed, "seed")["--seed"]("seed for the loss and reordering decisions (default=1)")
+        | lyra::opt(statsInterval, "seconds")["--stats-interval"]("interval between stats output while DAQ mode is enabled (default=1)")
+        | lyra::opt(opt_logDebug)["--debug"]("enable debug logging")
+        | lyra::opt(opt_logTrace)["--trace"]("enable trace logging")
+        ;
+
+    auto cliParseResult = cli.parse({ argc, argv });
+
+    if (!cliParseResult)
+    {
+        std::cerr << "Error parsing command line arguments: " << cliParseResult.errorMessage() << "\n";
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << "mvlc-emulator: emulates the ETH interface of a MVLC on the local machine.\n"
+                  << cli << "\n";
+        return 0;
+    }
+
+    options.loopListfile = !opt_noLoop;
+
+    set_global_log_level(spdlog::level::info);
+
+    if (opt_logDebug)
+        set_global_log_level(spdlog::level::debug);
+
+    if (opt_logTrace)
+        set_global_log_level(spdlog::level::trace);
+
+    std::error_code ec;
+    int cmdSock = bind_udp_socket(CommandPort, &ec);
+    int dataSock = cmdSock >= 0 ? bind_udp_socket(DataPort, &ec) : -1;
+    int delaySock = dataSock >= 0 ? bind_udp_socket(DelayPort, &ec) : -1;
+
+    if (cmdSock < 0 || dataSock < 0 || delaySock < 0)
+    {
+        std::cerr << "Error binding the MVLC UDP ports: " << ec.message() << "\n";
+        return 1;
+    }
+
+    std::signal(SIGINT, signal_handler);
+    std::signal(SIGTERM, signal_handler);
+
+    try
+    {
+        Emulator emulator(options, cmdSock, dataSock, delaySock);
+        std::thread emulatorThread(&Emulator::run, &emulator);
+
+        spdlog::info("MVLC emulator listening on UDP ports {}-{}", CommandPort, DelayPort);
+
+        const auto &counters = emulator.counters();
+        auto tLast = std::chrono::steady_clock::now();
+        u64 lastBytes = 0u;
+        u64 lastPackets = 0u;
+
+        while (!g_quit)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - tLast).count();
+
+            if (elapsed < statsInterval)
+                continue;
+
+            u64 bytes = counters.bytesSent;
+            u64 packets = counters.packetsSent;
+
+            if (emulator.daqMode() || bytes != lastBytes)
+            {
+                spdlog::info("events={}, packets={}, dropped={}, reordered={}, rate={:.1f} MiB/s ({:.0f} packets/s), delay={} us",
+                             counters.events.load(), packets, counters.packetsDropped.load(),
+                             counters.packetsReordered.load(),
+                             (bytes - lastBytes) / elapsed / util::Megabytes(1),
+                             (packets - lastPackets) / elapsed, emulator.delay());
+            }
+
+            tLast = now;
+            lastBytes = bytes;
+            lastPackets = packets;
+        }
+
+        emulatorThread.join();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    close_socket(cmdSock);
+    close_socket(dataSock);
+    close_socket(delaySock);
+
+    return 0;
+}
@@ -1,9 +1,15 @@
 #include "event_builder.h"
 
+#include <array>
+#include <atomic>
 #include <deque>
 #include <numeric>
+#include <thread>
 #include "mvlc_threading.h"
+#include "readout_buffer_queues.h"
+#include "util/lockfree_queue.h"
 #include "util/logging.h"
+#include "util/record_ring.h"
 
 namespace mesytec
 {
@@ -57,19 +63,23 @@ struct SystemEventStorage
     std::vector<u32> data;
 };
 
-// maybe FIXME: Buffering module data using a std::vector here is not ideal as
-// we do need to alloc for each non-empty event.
-struct ModuleEventStorage
+using EventClock = std::chrono::steady_clock;
+
+struct ModuleEventMeta
 {
+    // extracted event timestamp
     u32 timestamp;
-    std::vector<u32> data;
-
-    size_t usedMemory() const
-    {
-        return data.size() * sizeof(*data.data());
-    }
+    // Time the data was passed to recordEventData(). Only set if age based
+    // flushing by wall-clock time is enabled.
+    EventClock::time_point recordTime;
 };
 
+// Buffered module events of a single module. Each record holds a copy of the
+// module data, the record meta value holds the extracted event timestamp. The
+// ring storage is reused so that buffering does not allocate once the rings
+// have grown to the working set size.
+using ModuleEventRing = util::RecordRing<ModuleEventMeta>;
+
 struct PassthroughEventStorage
 {
     int crateIndex;
@@ -81,13 +91,20 @@ using mesytec::mvlc::TicketMutex;
 using mesytec::mvlc::UniqueLock;
 using readout_parser::PairHash;
 
-ModuleData module_data_from_event_storage(const ModuleEventStorage &input)
+// recordEventData() and buildEvents() are called once per event.
+const std::shared_ptr<spdlog::logger> &event_builder_logger()
+{
+    static CachedLogger logger("event_builder");
+    return logger.get();
+}
+
+ModuleData module_data_from_event_storage(const ModuleEventRing &ring, const ModuleEventRing::Record &record)
 {
     auto result = ModuleData
     {
-        .data = { input.data.data(), static_cast<u32>(input.data.size()) },
+        .data = { ring.data(record), record.size },
         .prefixSize = 0,
-        .dynamicSize = static_cast<u32>(input.data.size()),
+        .dynamicSize = record.size,
         .suffixSize = 0,
         .hasDynamic = true,
     };
@@ -126,54 +143,202 @@ WindowMatchResult timestamp_match(u32 tsMain, u32 tsModule, const std::pair<s32,
     return { WindowMatch::in_window, static_cast<u32>(std::abs(diff)) };
 }
 
+// Copies of module data are handed from the recording threads to the building
+// side via per (crate, event) buffer queues. Each queued buffer holds the data
+// of one recordEventData() call:
+//   [recordTime low][recordTime high][moduleCount]
+//   [size of module 0]...[size of module N-1][module data...]
+// Buffers are reused so recording does not allocate once the buffers have
+// grown to the working set size.
+using InputBuffer = std::vector<u32>;
+using InputQueues = ReadoutBufferQueues_<InputBuffer, SPSCQueue<InputBuffer *>>;
+
+// Number of buffers per input queue. If a recording thread runs out of empty
+// buffers it takes the event lock and consumes the queued data itself.
+static const size_t InputQueueBufferCount = 256;
+
+static const size_t InputBufferHeaderWords = 3;
+
+void put_input_buffer_header(InputBuffer &buffer, EventClock::time_point recordTime, u32 moduleCount)
+{
+    const u64 ticks = recordTime.time_since_epoch().count();
+    buffer.push_back(ticks & 0xffffffffu);
+    buffer.push_back(ticks >> 32);
+    buffer.push_back(moduleCount);
+}
+
+EventClock::time_point input_buffer_record_time(const InputBuffer &buffer)
+{
+    assert(buffer.size() >= InputBufferHeaderWords);
+    const u64 ticks = buffer[0] | (static_cast<u64>(buffer[1]) << 32);
+    return EventClock::time_point(EventClock::duration(ticks));
+}
+
+// Calls f(moduleIndex, data, size) for each module stored in the input buffer.
+template<typename F>
+void for_each_module(const InputBuffer &buffer, F f)
+{
+    assert(buffer.size() >= InputBufferHeaderWords);
+    const u32 moduleCount = buffer[2];
+    const u32 *sizes = buffer.data() + InputBufferHeaderWords;
+    const u32 *data = sizes + moduleCount;
+
+    for (u32 moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
+    {
+        f(moduleIndex, data, sizes[moduleIndex]);
+        data += sizes[moduleIndex];
+    }
+}
+
+// Counter snapshots published by the building side. Readers pin the
+// published slot via its reader count. The builder only overwrites slots which
+// are neither published nor pinned so neither side ever blocks the other.
+class CounterSnapshots
+{
+    public:
+        // Copies the counters into a free slot and publishes it. Only yields
+        // if all other slots are pinned by readers copying them right now.
+        // Does not allocate once each slot has been written.
+        void publish(const EventBuilder::EventCounters &counters)
+        {
+            while (true)
+            {
+                const size_t current = m_published.load();
+
+                for (size_t i=1; i<SlotCount; ++i)
+                {
+                    const size_t slot = (current + i) % SlotCount;
+
+                    if (m_readers[slot].load() == 0)
+                    {
+                        m_slots[slot] = counters;
+                        m_published.store(slot);
+                        return;
+                    }
+                }
+
+                std::this_thread::yield();
+            }
+        }
+
+        EventBuilder::EventCounters load() const
+        {
+            while (true)
+            {
+                const size_t slot = m_published.load();
+                ++m_readers[slot];
+
+                // The slot may have been reused between loading the index and
+                // pinning it.
+                if (m_published.load() == slot)
+                {
+                    auto result = m_slots[slot];
+                    --m_readers[slot];
+                    return result;
+                }
+
+                --m_readers[slot];
+            }
+        }
+
+    private:
+        static const size_t SlotCount = 3;
+        std::array<EventBuilder::EventCounters, SlotCount> m_slots;
+        mutable std::array<std::atomic<unsigned>, SlotCount> m_readers = {};
+        std::atomic<size_t> m_published{0u};
+};
+
+// State of a single event index. Only the recording thread of a crate touches
+// the producer side of its input queues. Everything else, including consuming
+// the queues, is serialized by the event mutex so that different event indexes
+// can be built in parallel.
+struct EventState
+{
+    TicketMutex mutex;
+
+    bool enabled = false;
+
+    // indexes: crate
+    std::vector<std::unique_ptr<InputQueues>> inputQueues;
+    // Linear index of the first module of each crate and the number of modules
+    // per crate.
+    // indexes: crate
+    std::vector<size_t> crateModuleOffsets;
+    std::vector<size_t> crateModuleCounts;
+    // Linear module index of the main module
+    size_t mainModuleIndex = 0u;
+    // Timestamp of the most recently recorded main module event. Used for
+    // age based flushing in timestamp ticks.
+    u32 newestMainTimestamp = event_builder::TimestampExtractionFailed;
+
+    // Holds copies of module event data and the extracted event timestamp.
+    // indexes: linear module
+    std::vector<ModuleEventRing> moduleEventBuffers;
+    // indexes: linear module
+    std::vector<timestamp_extractor> timestampExtractors;
+    // indexes: linear module
+    std::vector<std::pair<s32, s32>> matchWindows;
+
+    // Modified with the event mutex held. Readers get the published snapshot
+    // and never block the builder.
+    EventBuilder::EventCounters counters;
+    CounterSnapshots counterSnapshots;
+
+    // Passthrough events moved out of the input queues by a recording thread
+    // which ran out of empty buffers. Older than the events still queued.
+    std::deque<PassthroughEventStorage> overflowEvents;
+
+    std::vector<ModuleData> eventAssembly;
+
+    // Number of records in the input queues plus the overflow events.
+    std::atomic<size_t> pendingRecords{0u};
+    // Bytes of module data in the input queues and in the module rings. The
+    // sum over all events is what is checked against the memory limit.
+    std::atomic<size_t> queuedBytes{0u};
+    std::atomic<size_t> ringBytes{0u};
+};
+
+void resize_counters(EventBuilder::EventCounters &counters, size_t moduleCount)
+{
+    counters.discardedEvents.resize(moduleCount);
+    counters.emptyEvents.resize(moduleCount);
+    counters.invScoreSums.resize(moduleCount);
+    counters.inputHits.resize(moduleCount);
+    counters.outputHits.resize(moduleCount);
+    counters.matchTooNew.resize(moduleCount);
+    counters.matchTooOld.resize(moduleCount);
+    counters.partialEvents.resize(moduleCount);
+}
+
 struct EventBuilder::Private
 {
     void *userContext_ = nullptr;
 
     std::vector<EventSetup> setups_;
     size_t memoryLimit_ = event_builder::DefaultMemoryLimit;
-
-    TicketMutex mutex_;
-    std::condition_variable_any cv_;
+    std::chrono::milliseconds maxEventAge_ = {};
+    u32 maxTimestampAge_ = 0u;
 
     // indexes: event, pair(crateIndex, moduleIndex) -> linear module index
     std::vector<std::unordered_map<std::pair<int, unsigned>, size_t, PairHash>> linearModuleIndexTable_;
-    // Reverse mapping back from calculated linear modules indexes to (crateIndex, moduleIndex)
-    // indexes: event, linear module index -> pair(crateIndex, moduleIndex)
-    //std::vector<std::unordered_map<size_t, std::pair<int, unsigned>>> reverseModuleIndexTable_;
-    // Linear module index of the main module for each event
-    // indexes: event, linear module
-    std::vector<size_t> mainModuleLinearIndexes_;
-
-    // copies of systemEvents
+
+    // indexes: event
+    std::vector<std::unique_ptr<EventState>> events_;
+
+    // Copies of system events and of passthrough events which do not map to
+    // an input queue (event or crate index out of range). These are rare so
+    // they share a single mutex protected storage.
+    TicketMutex miscMutex_;
     std::deque<SystemEventStorage> systemEvents_;
-    // copies of passthrough events (events for which event building is not enabled)
     std::deque<PassthroughEventStorage> passThroughEvents_;
-    // Holds copies of module event data and the extracted event timestamp.
-    // indexes: event, linear module, buffered event
-    std::vector<std::vector<std::deque<ModuleEventStorage>>> moduleEventBuffers_;
-    // indexes: event, linear module
-    std::vector<std::vector<size_t>> moduleMemCounters_;
+    std::atomic<size_t> miscEventCount_{0u};
+
     // Keeps track of the maximum total memory used for module event buffering
     // since the last call to reset()
-    size_t maxUsedMemory_ = 0u;;
-    // indexes: event, linear module
-    std::vector<std::vector<timestamp_extractor>> moduleTimestampExtractors_;
-    // indexes: event, linear module
-    std::vector<std::vector<std::pair<s32, s32>>> moduleMatchWindows_;
-    // indexes: event, linear module
-    std::vector<std::vector<size_t>> moduleDiscardedEvents_;
-    // indexes: event, linear module
-    std::vector<std::vector<size_t>> moduleEmptyEvents_;
-    // indexes: event, linear module
-    std::vector<std::vector<size_t>> moduleInvScoreSums_;
-    // indexes: event, linear module
-    std::vector<std::vector<size_t>> moduleInputHits_;
-    std::vector<std::vector<size_t>> moduleOutputHits_;
-    std::vector<std::vector<size_t>> moduleMatchTooOld_;
-    std::vector<std::vector<size_t>> moduleMatchTooNew_;
-
-    std::vector<ModuleData> eventAssembly_;
+    std::atomic<size_t> maxUsedMemory_{0u};
+
+    // The builder side waits here for new data.
+    lockfree_detail::Parker parker_;
 
     size_t getLinearModuleIndex(int crateIndex, int eventIndex, unsigned moduleIndex) const
     {
@@ -188,71 +353,316 @@ struct EventBuilder::Private
         return eventTable.at(key);
     }
 
-
-    EventBuilder::EventCounters getCounters(int eventIndex) const
+    // Returns the state of the given event if the crate has an input queue
+    // for it, nullptr otherwise.
+    EventState *getEventState(int crateIndex, int eventIndex)
     {
-        EventCounters ret = {};
-        ret.discardedEvents = moduleDiscardedEvents_.at(eventIndex);
-        ret.emptyEvents = moduleEmptyEvents_.at(eventIndex);
-        ret.invScoreSums = moduleInvScoreSums_.at(eventIndex);
-        ret.inputHits = moduleInputHits_.at(eventIndex);
-        ret.outputHits = moduleOutputHits_.at(eventIndex);
-        ret.matchTooOld = moduleMatchTooOld_.at(eventIndex);
-        ret.matchTooNew = moduleMatchTooNew_.at(eventIndex);
-        return ret;
+        if (static_cast<size_t>(eventIndex) >= events_.size())
+            return nullptr;
+
+        auto es = events_[eventIndex].get();
+
+        if (static_cast<size_t>(crateIndex) >= es->inputQueues.size())
+            return nullptr;
+
+        return es;
     }
 
     size_t getMemoryUsage() const
     {
-        return std::accumulate(
-            std::begin(moduleMemCounters_), std::end(moduleMemCounters_), static_cast<size_t>(0u),
-            [] (const size_t &a, const std::vector<size_t> &b)
+        size_t result = 0u;
+
+        for (const auto &es: events_)
+            result += es->queuedBytes.load(std::memory_order_relaxed) + es->ringBytes.load(std::memory_order_relaxed);
+
+        return result;
+    }
+
+    void updateMaxMemoryUsage(size_t usedMem)
+    {
+        size_t maxMem = maxUsedMemory_.load(std::memory_order_relaxed);
+
+        while (usedMem > maxMem && !maxUsedMemory_.compare_exchange_weak(maxMem, usedMem, std::memory_order_relaxed))
+            ;
+    }
+
+    // Copies a single module event into its ring. Returns the change in the
+    // number of bytes used by the ring. Requires the event mutex.
+    size_t ingestModuleEvent(EventState &es, size_t linearModuleIndex, const u32 *data, u32 size,
+                             EventClock::time_point recordTime)
+    {
+        assert(linearModuleIndex < es.moduleEventBuffers.size());
+
+        ++es.counters.inputHits[linearModuleIndex];
+
+        // The readout parser can yield zero length data if a module is read
+        // out using a block transfer but the module has not converted any
+        // events at all. In this case it will immediately raise BERR on the
+        // VME bus. This is different than the case where the module got a
+        // trigger but no channel was within the thresholds. Then we do get an
+        // event consisting of only the header and footer (containing the
+        // timestamp).
+        // The zero length events need to be skipped as there is no timestamp
+        // information contained within and the builder code assumes non-zero
+        // data for module events.
+        if (size == 0)
+        {
+            ++es.counters.emptyEvents[linearModuleIndex];
+            return 0u;
+        }
+
+        u32 timestamp = es.timestampExtractors[linearModuleIndex](data, size);
+        assert(timestamp <= event_builder::TimestampMax
+               || timestamp == event_builder::TimestampExtractionFailed);
+
+        if (linearModuleIndex == es.mainModuleIndex && timestamp != event_builder::TimestampExtractionFailed)
+            es.newestMainTimestamp = timestamp;
+
+        auto &ring = es.moduleEventBuffers[linearModuleIndex];
+        const size_t usedBefore = ring.usedBytes();
+        ring.push_back({ timestamp, recordTime }, data, size);
+        return ring.usedBytes() - usedBefore;
+    }
+
+    // Moves the queued module data of the given crate into the module rings.
+    // Requires the event mutex.
+    void ingestQueuedEvents(EventState &es, size_t crateIndex)
+    {
+        auto &queues = *es.inputQueues[crateIndex];
+        const size_t moduleOffset = es.crateModuleOffsets[crateIndex];
+        InputBuffer *buffer = nullptr;
+
+        while (queues.filledBufferQueue().try_dequeue(buffer))
+        {
+            size_t queuedBytes = 0u;
+            size_t ringBytes = 0u;
+            const auto recordTime = input_buffer_record_time(*buffer);
+
+            for_each_module(*buffer, [&] (u32 moduleIndex, const u32 *data, u32 size)
             {
-                return a + std::accumulate(std::begin(b), std::end(b), static_cast<size_t>(0u));
+                ringBytes += ingestModuleEvent(es, moduleOffset + moduleIndex, data, size, recordTime);
+                queuedBytes += size * sizeof(u32);
             });
+
+            // Account the ring first so that the total is never undercounted.
+            es.ringBytes.fetch_add(ringBytes, std::memory_order_relaxed);
+            es.queuedBytes.fetch_sub(queuedBytes, std::memory_order_relaxed);
+            es.pendingRecords.fetch_sub(1u, std::memory_order_relaxed);
+
+            buffer->clear();
+            queues.emptyBufferQueue().enqueue(buffer);
+        }
     }
 
-    size_t buildEvents(int eventIndex, Callbacks &callbacks, bool flush);
+    // Moves queued passthrough events of the given crate to the overflow
+    // deque. Requires the event mutex.
+    void spillQueuedEvents(EventState &es, int crateIndex, int eventIndex)
+    {
+        auto &queues = *es.inputQueues[crateIndex];
+        InputBuffer *buffer = nullptr;
+
+        while (queues.filledBufferQueue().try_dequeue(buffer))
+        {
+            PassthroughEventStorage storage;
+            storage.crateIndex = crateIndex;
+            storage.eventIndex = eventIndex;
+
+            for_each_module(*buffer, [&storage] (u32, const u32 *data, u32 size)
+            {
+                storage.moduleData.emplace_back(data, data + size);
+            });
+
+            es.overflowEvents.emplace_back(std::move(storage));
+            buffer->clear();
+            queues.emptyBufferQueue().enqueue(buffer);
+        }
+    }
 
-    void discardAllEventData()
+    // Yields passthrough events in the order they were recorded per crate.
+    // Requires the event mutex.
+    void yieldPassthroughEvents(EventState &es, int eventIndex, Callbacks &callbacks)
     {
-        for (size_t eventIndex = 0; eventIndex < moduleEventBuffers_.size(); ++eventIndex)
+        // Overflow events are older than the ones still in the queues.
+        while (!es.overflowEvents.empty())
         {
-            auto &eventBuffers = moduleEventBuffers_[eventIndex];
-            auto &discards = moduleDiscardedEvents_.at(eventIndex);
+            auto &storage = es.overflowEvents.front();
+            const size_t moduleCount = storage.moduleData.size();
+
+            es.eventAssembly.resize(moduleCount);
 
-            for (size_t moduleIndex = 0; moduleIndex < eventBuffers.size(); ++moduleIndex)
+            for (size_t moduleIndex=0; moduleIndex<moduleCount; ++moduleIndex)
             {
-                auto &eventBuffer = eventBuffers[moduleIndex];
-                discards[moduleIndex] += eventBuffer.size();
-                eventBuffer.clear();
+                es.eventAssembly[moduleIndex] = {};
+                es.eventAssembly[moduleIndex].data = {
+                    storage.moduleData[moduleIndex].data(),
+                    static_cast<u32>(storage.moduleData[moduleIndex].size()),
+                };
             }
+
+            callbacks.eventData(
+                userContext_, storage.crateIndex, storage.eventIndex,
+                es.eventAssembly.data(), es.eventAssembly.size());
+
+            es.overflowEvents.pop_front();
+            es.pendingRecords.fetch_sub(1u, std::memory_order_relaxed);
         }
 
-        for (auto &memCounters: moduleMemCounters_)
-            std::fill(std::begin(memCounters), std::end(memCounters), static_cast<size_t>(0u));
+        for (size_t crateIndex=0; crateIndex<es.inputQueues.size(); ++crateIndex)
+        {
+            auto &queues = *es.inputQueues[crateIndex];
+            InputBuffer *buffer = nullptr;
+
+            while (queues.filledBufferQueue().try_dequeue(buffer))
+            {
+                es.eventAssembly.resize((*buffer)[2]);
+
+                for_each_module(*buffer, [&es] (u32 moduleIndex, const u32 *data, u32 size)
+                {
+                    es.eventAssembly[moduleIndex] = {};
+                    es.eventAssembly[moduleIndex].data = { data, size };
+                });
+
+                callbacks.eventData(
+                    userContext_, crateIndex, eventIndex,
+                    es.eventAssembly.data(), es.eventAssembly.size());
+
+                es.pendingRecords.fetch_sub(1u, std::memory_order_relaxed);
+                buffer->clear();
+                queues.emptyBufferQueue().enqueue(buffer);
+            }
+        }
+    }
+
+    // Yields system events and passthrough events stored in the misc deques.
+    // The misc mutex is not held while invoking the callbacks.
+    void yieldMiscEvents(Callbacks &callbacks)
+    {
+        UniqueLock guard(miscMutex_);
+
+        while (!systemEvents_.empty())
+        {
+            auto ses = std::move(systemEvents_.front());
+            systemEvents_.pop_front();
+            miscEventCount_.fetch_sub(1u, std::memory_order_relaxed);
+            guard.unlock();
+            callbacks.systemEvent(userContext_, ses.crateIndex, ses.data.data(), ses.data.size());
+            guard.lock();
+        }
+
+        std::vector<ModuleData> eventAssembly;
 
-        assert(getMemoryUsage() == 0u);
+        while (!passThroughEvents_.empty())
+        {
+            auto storage = std::move(passThroughEvents_.front());
+            passThroughEvents_.pop_front();
+            miscEventCount_.fetch_sub(1u, std::memory_order_relaxed);
+            guard.unlock();
+
+            eventAssembly.resize(storage.moduleData.size());
+
+            for (size_t moduleIndex=0; moduleIndex<storage.moduleData.size(); ++moduleIndex)
+            {
+                eventAssembly[moduleIndex] = {};
+                eventAssembly[moduleIndex].data = {
+                    storage.moduleData[moduleIndex].data(),
+                    static_cast<u32>(storage.moduleData[moduleIndex].size()),
+                };
+            }
+
+            callbacks.eventData(
+                userContext_, storage.crateIndex, storage.eventIndex,
+                eventAssembly.data(), eventAssembly.size());
+
+            guard.lock();
+        }
+    }
+
+    // Builds events for a single event index. Requires the event mutex.
+    size_t buildEvents(EventState &es, int eventIndex, Callbacks &callbacks, bool flush);
+
+    // Locks the event, consumes its input queues and builds or yields the
+    // events.
+    size_t processEvent(int eventIndex, Callbacks &callbacks, bool flush)
+    {
+        auto &es = *events_.at(eventIndex);
+        UniqueLock guard(es.mutex);
+        size_t result = 0u;
+
+        if (es.enabled)
+        {
+            for (size_t crateIndex=0; crateIndex<es.inputQueues.size(); ++crateIndex)
+                ingestQueuedEvents(es, crateIndex);
+
+            result = buildEvents(es, eventIndex, callbacks, flush);
+            es.counterSnapshots.publish(es.counters);
+        }
+        else
+        {
+            yieldPassthroughEvents(es, eventIndex, callbacks);
+        }
+
+        return result;
+    }
+
+    // Discards all buffered module data including the data still in the
+    // input queues. If releaseMemory is set the ring storage is freed,
+    // otherwise it is kept for reuse. The event mutexes are locked one after
+    // the other in event index order.
+    void discardAllEventData(bool releaseMemory = false)
+    {
+        for (auto &esp: events_)
+        {
+            auto &es = *esp;
+
+            if (!es.enabled)
+                continue;
+
+            UniqueLock guard(es.mutex);
+
+            for (size_t crateIndex=0; crateIndex<es.inputQueues.size(); ++crateIndex)
+                ingestQueuedEvents(es, crateIndex);
+
+            for (size_t moduleIndex = 0; moduleIndex < es.moduleEventBuffers.size(); ++moduleIndex)
+            {
+                auto &eventBuffer = es.moduleEventBuffers[moduleIndex];
+                es.counters.discardedEvents[moduleIndex] += eventBuffer.size();
+
+                if (releaseMemory)
+                    eventBuffer.release();
+                else
+                    eventBuffer.clear();
+            }
+
+            es.ringBytes.store(0u, std::memory_order_relaxed);
+            es.counterSnapshots.publish(es.counters);
+        }
     }
 
     void resetCounters()
     {
         maxUsedMemory_ = 0u;
 
-        auto fill0 = [] (auto &c)
+        auto fill0 = [] (auto &counters)
         {
-            for (auto &counters: c)
-                std::fill(std::begin(counters), std::end(counters), static_cast<size_t>(0u));
+            std::fill(std::begin(counters), std::end(counters), static_cast<size_t>(0u));
         };
 
-        fill0(moduleMemCounters_);
-        fill0(moduleDiscardedEvents_);
-        fill0(moduleEmptyEvents_);
-        fill0(moduleInvScoreSums_);
-        fill0(moduleInputHits_);
-        fill0(moduleOutputHits_);
-        fill0(moduleMatchTooNew_);
-        fill0(moduleMatchTooOld_);
+        for (auto &esp: events_)
+        {
+            auto &es = *esp;
+            UniqueLock guard(es.mutex);
+
+            fill0(es.counters.discardedEvents);
+            fill0(es.counters.emptyEvents);
+            fill0(es.counters.invScoreSums);
+            fill0(es.counters.inputHits);
+            fill0(es.counters.outputHits);
+            fill0(es.counters.matchTooNew);
+            fill0(es.counters.matchTooOld);
+            fill0(es.counters.partialEvents);
+
+            es.counterSnapshots.publish(es.counters);
+        }
     }
 };
 
@@ -262,42 +672,37 @@ EventBuilder::EventBuilder(const EventBuilderConfig &cfg, void *userContext)
     d->userContext_ = userContext;
     d->setups_ = cfg.setups;
     d->memoryLimit_ = cfg.memoryLimit;
+    d->maxEventAge_ = cfg.maxEventAge;
+    d->maxTimestampAge_ = cfg.maxTimestampAge;
 
     const size_t eventCount = d->setups_.size();
 
+    // Passthrough events get one input queue per crate known to any of the
+    // event setups.
+    size_t crateCount = 1u;
+
+    for (const auto &eventSetup: d->setups_)
+        crateCount = std::max(crateCount, eventSetup.crateSetups.size());
+
     d->linearModuleIndexTable_.resize(eventCount);
-    d->mainModuleLinearIndexes_.resize(eventCount);
-    d->moduleEventBuffers_.resize(eventCount);
-    d->moduleMemCounters_.resize(eventCount);
-    d->moduleTimestampExtractors_.resize(eventCount);
-    d->moduleMatchWindows_.resize(eventCount);
-    d->moduleDiscardedEvents_.resize(eventCount);
-    d->moduleEmptyEvents_.resize(eventCount);
-    d->moduleInvScoreSums_.resize(eventCount);
-    d->moduleInputHits_.resize(eventCount);
-    d->moduleOutputHits_.resize(eventCount);
-    d->moduleMatchTooNew_.resize(eventCount);
-    d->moduleMatchTooOld_.resize(eventCount);
 
     for (size_t eventIndex = 0; eventIndex < eventCount; ++eventIndex)
     {
         const auto &eventSetup = d->setups_.at(eventIndex);
+        auto es = std::make_unique<EventState>();
+        es->enabled = eventSetup.enabled;
 
         if (!eventSetup.enabled)
+        {
+            for (size_t crateIndex = 0; crateIndex < crateCount; ++crateIndex)
+                es->inputQueues.emplace_back(std::make_unique<InputQueues>(0, InputQueueBufferCount));
+
+            es->counterSnapshots.publish(es->counters);
+            d->events_.emplace_back(std::move(es));
             continue;
+        }
 
         auto &eventTable = d->linearModuleIndexTable_.at(eventIndex);
-        auto &timestampExtractors = d->moduleTimestampExtractors_.at(eventIndex);
-        auto &matchWindows = d->moduleMatchWindows_.at(eventIndex);
-        auto &eventBuffers = d->moduleEventBuffers_.at(eventIndex);
-        auto &memCounters = d->moduleMemCounters_.at(eventIndex);
-        auto &discardedEvents = d->moduleDiscardedEvents_.at(eventIndex);
-        auto &emptyEvents = d->moduleEmptyEvents_.at(eventIndex);
-        auto &invScores = d->moduleInvScoreSums_.at(eventIndex);
-        auto &inputHits = d->moduleInputHits_.at(eventIndex);
-        auto &outputHits = d->moduleOutputHits_.at(eventIndex);
-        auto &hitsTooNew = d->moduleMatchTooNew_.at(eventIndex);
-        auto &hitsTooOld = d->moduleMatchTooOld_.at(eventIndex);
         unsigned linearModuleIndex = 0;
 
         for (size_t crateIndex = 0; crateIndex < eventSetup.crateSetups.size(); ++crateIndex)
@@ -308,33 +713,31 @@ EventBuilder::EventBuilder(const EventBuilderConfig &cfg, void *userContext)
 
             const size_t moduleCount = crateSetup.moduleTimestampExtractors.size();
 
+            es->inputQueues.emplace_back(std::make_unique<InputQueues>(0, InputQueueBufferCount));
+            es->crateModuleOffsets.push_back(linearModuleIndex);
+            es->crateModuleCounts.push_back(moduleCount);
+
             for (size_t moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
             {
                 auto key = std::make_pair(crateIndex, moduleIndex);
                 eventTable[key] = linearModuleIndex;
                 ++linearModuleIndex;
 
-                timestampExtractors.push_back(crateSetup.moduleTimestampExtractors.at(moduleIndex));
-                matchWindows.push_back(crateSetup.moduleMatchWindows.at(moduleIndex));
+                es->timestampExtractors.push_back(crateSetup.moduleTimestampExtractors.at(moduleIndex));
+                es->matchWindows.push_back(crateSetup.moduleMatchWindows.at(moduleIndex));
             }
-
-            eventBuffers.resize(eventBuffers.size() + moduleCount);
-            memCounters.resize(memCounters.size() + moduleCount);
-            discardedEvents.resize(discardedEvents.size() + moduleCount);
-            emptyEvents.resize(emptyEvents.size() + moduleCount);
-            invScores.resize(invScores.size() + moduleCount);
-            inputHits.resize(inputHits.size() + moduleCount);
-            outputHits.resize(outputHits.size() + moduleCount);
-            hitsTooNew.resize(hitsTooNew.size() + moduleCount);
-            hitsTooOld.resize(hitsTooOld.size() + moduleCount);
         }
 
-        size_t mainModuleLinearIndex = d->getLinearModuleIndex(
+        es->moduleEventBuffers.resize(linearModuleIndex);
+        resize_counters(es->counters, linearModuleIndex);
+
+        es->mainModuleIndex = d->getLinearModuleIndex(
             eventSetup.mainModule.first, // crateIndex
             eventIndex,
             eventSetup.mainModule.second); // moduleIndex
 
-        d->mainModuleLinearIndexes_[eventIndex] = mainModuleLinearIndex;
+        es->counterSnapshots.publish(es->counters);
+        d->events_.emplace_back(std::move(es));
     }
 }
 
@@ -369,195 +772,195 @@ bool EventBuilder::isEnabledForAnyEvent() const
 void EventBuilder::recordEventData(int crateIndex, int eventIndex,
                                    const ModuleData *moduleDataList, unsigned moduleCount)
 {
-    auto logger = get_logger("event_builder");
-
-    // lock, then copy the data to an internal buffer
-    UniqueLock guard(d->mutex_);
+    auto &logger = event_builder_logger();
 
     assert(0 <= crateIndex);
     assert(0 <= eventIndex);
 
-    // Store non eb event data so that it can be yielded from the eb thread in
-    // buildEvents().
-    if (!isEnabledFor(eventIndex))
+    auto es = d->getEventState(crateIndex, eventIndex);
+
+    if (!es)
     {
+        if (isEnabledFor(eventIndex))
+        {
+            logger->error("recordEventData(): crateIndex={} out of range for eventIndex={}", crateIndex, eventIndex);
+            throw std::out_of_range("recordEventData(): crateIndex out of range");
+        }
+
+        // Store passthrough events without an input queue so that they can
+        // be yielded from the eb thread in buildEvents().
         PassthroughEventStorage storage;
         storage.crateIndex = crateIndex;
         storage.eventIndex = eventIndex;
         for (unsigned moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
         {
             auto &data = moduleDataList[moduleIndex].data;
-            std::vector<u32> moduleData(data.data, data.data + data.size);
-            storage.moduleData.emplace_back(moduleData);
+            storage.moduleData.emplace_back(data.data, data.data + data.size);
+        }
+
+        {
+            UniqueLock guard(d->miscMutex_);
+            d->passThroughEvents_.emplace_back(std::move(storage));
+            d->miscEventCount_.fetch_add(1u, std::memory_order_relaxed);
         }
-        assert(storage.moduleData.size() == moduleCount);
-        d->passThroughEvents_.emplace_back(storage);
+
+        d->parker_.notify();
         return;
     }
 
-    assert(isEnabledFor(eventIndex));
+    size_t dataBytes = 0u;
 
-    // Memory usage check and possible discarding of all buffered data.
-    if (d->getMemoryUsage() >= d->memoryLimit_)
+    if (es->enabled)
     {
-        logger->warn("recordEventData(): memory limit exceeded, discarding all data");
-        d->discardAllEventData();
+        if (moduleCount > es->crateModuleCounts[crateIndex])
+        {
+            logger->error("recordEventData(): moduleCount={} out of range for crateIndex={}, eventIndex={}",
+                          moduleCount, crateIndex, eventIndex);
+            throw std::out_of_range("recordEventData(): moduleCount out of range");
+        }
+
+        // Memory usage check and possible discarding of all buffered data.
+        if (d->getMemoryUsage() >= d->memoryLimit_)
+        {
+            logger->warn("recordEventData(): memory limit exceeded, discarding all data");
+            d->discardAllEventData(true);
+        }
+
+        for (unsigned moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
+            dataBytes += moduleDataList[moduleIndex].data.size * sizeof(u32);
     }
 
-    // Now record the module data.
-    try
+    // Only query the clock if it's needed for age based flushing.
+    const auto recordTime = (es->enabled && d->maxEventAge_.count() > 0)
+        ? EventClock::now() : EventClock::time_point{};
+
+    auto &queues = *es->inputQueues[crateIndex];
+    InputBuffer *buffer = nullptr;
+
+    if (queues.emptyBufferQueue().try_dequeue(buffer))
     {
-        auto &moduleEventBuffers = d->moduleEventBuffers_.at(eventIndex);
-        auto &moduleMemCounters = d->moduleMemCounters_.at(eventIndex);
-        auto &timestampExtractors = d->moduleTimestampExtractors_.at(eventIndex);
-        auto &emptyEvents = d->moduleEmptyEvents_.at(eventIndex);
-        auto &moduleHits = d->moduleInputHits_.at(eventIndex);
+        // Fast path: copy the data into a buffer and hand it to the builder.
+        assert(buffer->empty());
+        put_input_buffer_header(*buffer, recordTime, moduleCount);
+
+        for (unsigned moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
+            buffer->push_back(moduleDataList[moduleIndex].data.size);
 
         for (unsigned moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
         {
-            const auto linearModuleIndex = d->getLinearModuleIndex(crateIndex, eventIndex, moduleIndex);
+            auto &data = moduleDataList[moduleIndex].data;
+            buffer->insert(buffer->end(), data.data, data.data + data.size);
+        }
 
-            assert(linearModuleIndex < moduleEventBuffers.size());
+        // Count before enqueueing so that the consumer never underflows.
+        es->queuedBytes.fetch_add(dataBytes, std::memory_order_relaxed);
+        es->pendingRecords.fetch_add(1u, std::memory_order_relaxed);
+        queues.filledBufferQueue().enqueue(buffer);
+    }
+    else
+    {
+        // The builder is lagging behind and no empty buffers are left. Take
+        // the event lock, which makes this thread the consumer of the queue,
+        // and consume the queued data directly.
+        UniqueLock guard(es->mutex);
 
-            ++moduleHits.at(linearModuleIndex);
+        if (es->enabled)
+        {
+            d->ingestQueuedEvents(*es, crateIndex);
 
-            auto moduleData = moduleDataList[moduleIndex];
-            auto &data = moduleData.data;
+            const size_t moduleOffset = es->crateModuleOffsets[crateIndex];
+            size_t ringBytes = 0u;
 
-            // The readout parser can yield zero length data if a module is read
-            // out using a block transfer but the module has not converted any
-            // events at all. In this case it will immediately raise BERR on the
-            // VME bus. This is different than the case where the module got a
-            // trigger but no channel was within the thresholds. Then we do get an
-            // event consisting of only the header and footer (containing the
-            // timestamp).
-            // The zero length events need to be skipped as there is no timestamp
-            // information contained within and the builder code assumes non-zero
-            // data for module events.
-            if (data.size == 0)
+            for (unsigned moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
             {
-                ++emptyEvents.at(linearModuleIndex);
-                continue;
+                auto &data = moduleDataList[moduleIndex].data;
+                ringBytes += d->ingestModuleEvent(*es, moduleOffset + moduleIndex, data.data, data.size, recordTime);
             }
 
-            u32 timestamp = timestampExtractors.at(linearModuleIndex)(data.data, data.size);
-            assert(timestamp <= event_builder::TimestampMax
-                   || timestamp == event_builder::TimestampExtractionFailed);
+            es->ringBytes.fetch_add(ringBytes, std::memory_order_relaxed);
+        }
+        else
+        {
+            d->spillQueuedEvents(*es, crateIndex, eventIndex);
 
-            ModuleEventStorage eventStorage =
+            PassthroughEventStorage storage;
+            storage.crateIndex = crateIndex;
+            storage.eventIndex = eventIndex;
+            for (unsigned moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
             {
-                timestamp,
-                { data.data, data.data + data.size },
-            };
-
-            size_t usedMem = eventStorage.usedMemory();
+                auto &data = moduleDataList[moduleIndex].data;
+                storage.moduleData.emplace_back(data.data, data.data + data.size);
+            }
 
-            moduleEventBuffers.at(linearModuleIndex).emplace_back(eventStorage);
-            moduleMemCounters.at(linearModuleIndex) += usedMem;
+            es->overflowEvents.emplace_back(std::move(storage));
+            es->pendingRecords.fetch_add(1u, std::memory_order_relaxed);
         }
     }
-    catch (const std::exception &e)
+
+    if (es->enabled)
     {
-        logger->error("recordEventData(): {}", e.what());
-        throw;
+        size_t usedMem = d->getMemoryUsage();
+        d->updateMaxMemoryUsage(usedMem);
+        logger->trace("recordEventData(): memory usage is {}", usedMem);
     }
 
-    size_t usedMem = d->getMemoryUsage();
-    d->maxUsedMemory_ = std::max(d->maxUsedMemory_, usedMem);
-
-    logger->trace("recordEventData(): memory usage is {}", usedMem);
-
-    guard.unlock();
-    d->cv_.notify_one();
+    d->parker_.notify();
 }
 
 void EventBuilder::recordSystemEvent(int crateIndex, const u32 *header, u32 size)
 {
-    // lock, then copy the data to an internal buffer
+    // copy the data, then lock and move it to the internal storage
     SystemEventStorage ses = { crateIndex, { header, header + size } };
 
-    UniqueLock guard(d->mutex_);
-    d->systemEvents_.emplace_back(ses);
+    {
+        UniqueLock guard(d->miscMutex_);
+        d->systemEvents_.emplace_back(std::move(ses));
+        d->miscEventCount_.fetch_add(1u, std::memory_order_relaxed);
+    }
 
-    guard.unlock();
-    d->cv_.notify_one();
+    d->parker_.notify();
 }
 
 bool EventBuilder::waitForData(const std::chrono::milliseconds &maxWait)
 {
     auto predicate = [this] ()
     {
-        if (!d->systemEvents_.empty())
+        if (d->miscEventCount_.load(std::memory_order_relaxed))
             return true;
 
-        for (const auto &moduleBuffers: d->moduleEventBuffers_)
+        for (const auto &es: d->events_)
         {
-            for (const auto &moduleBuffer: moduleBuffers)
-            {
-                if (!moduleBuffer.empty())
-                    return true;
-            }
+            if (es->pendingRecords.load(std::memory_order_relaxed)
+                || es->ringBytes.load(std::memory_order_relaxed))
+                return true;
         }
 
         return false;
     };
 
-    UniqueLock guard(d->mutex_);
-    return d->cv_.wait_for(guard, maxWait, predicate);
+    return d->parker_.wait_for(predicate, maxWait);
 }
 
 size_t EventBuilder::buildEvents(Callbacks callbacks, bool flush)
 {
-    UniqueLock guard(d->mutex_);
-
-    // system events
-    while (!d->systemEvents_.empty())
-    {
-        auto &ses = d->systemEvents_.front();
-        callbacks.systemEvent(d->userContext_, ses.crateIndex, ses.data.data(), ses.data.size());
-        d->systemEvents_.pop_front();
-    }
-
-    assert(d->systemEvents_.empty());
-
-    // non-eb events (passthrough)
-    while (!d->passThroughEvents_.empty())
-    {
-        auto es = d->passThroughEvents_.front();
-        unsigned moduleCount = es.moduleData.size();
-
-        d->eventAssembly_.resize(moduleCount);
-
-        for (unsigned moduleIndex=0; moduleIndex<moduleCount; ++moduleIndex)
-        {
-            d->eventAssembly_[moduleIndex].data = {
-                es.moduleData[moduleIndex].data(),
-                static_cast<unsigned>(es.moduleData[moduleIndex].size()),
-            };
-        }
-
-        callbacks.eventData(
-            d->userContext_, es.crateIndex, es.eventIndex,
-            d->eventAssembly_.data(), d->eventAssembly_.size());
-
-        d->passThroughEvents_.pop_front();
-    }
+    // system events and passthrough events without an input queue
+    d->yieldMiscEvents(callbacks);
 
-    assert(d->passThroughEvents_.empty());
-
-    // readout event building
-    const size_t eventCount = d->setups_.size();
+    // passthrough events and readout event building
+    const size_t eventCount = d->events_.size();
     size_t result = 0u;
 
     for (size_t eventIndex = 0; eventIndex < eventCount; ++eventIndex)
-    {
-        if (d->setups_[eventIndex].enabled)
-            result += d->buildEvents(eventIndex, callbacks, flush);
-    }
+        result += d->processEvent(eventIndex, callbacks, flush);
 
     return result;
 }
 
+size_t EventBuilder::buildEvents(int eventIndex, Callbacks callbacks, bool flush)
+{
+    return d->processEvent(eventIndex, callbacks, flush);
+}
+
 #if 0
 // Version 2:
 // - get rid of minMainModuleEvents
@@ -686,37 +1089,64 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
 // - Behavior change: try to only yield complete events, meaning events where
 // all modules are present.
 //
-size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks, bool flush)
+size_t EventBuilder::Private::buildEvents(EventState &es, int eventIndex, Callbacks &callbacks, bool flush)
 {
     if (flush)
-        get_logger("event_builder")->debug("Private::buildEvents(): flush requested!");
+        event_builder_logger()->debug("Private::buildEvents(): flush requested!");
 
-    auto &eventBuffers = moduleEventBuffers_.at(eventIndex);
-    const auto &matchWindows = moduleMatchWindows_.at(eventIndex);
+    auto &eventBuffers = es.moduleEventBuffers;
+    const auto &matchWindows = es.matchWindows;
     assert(eventBuffers.size() == matchWindows.size());
     const size_t moduleCount = eventBuffers.size();
-    auto mainModuleIndex = mainModuleLinearIndexes_.at(eventIndex);
+    auto mainModuleIndex = es.mainModuleIndex;
     assert(mainModuleIndex < moduleCount);
     const auto &mainBuffer = eventBuffers.at(mainModuleIndex);
-    auto &discardedEvents = moduleDiscardedEvents_.at(eventIndex);
-    auto &invScores = moduleInvScoreSums_.at(eventIndex);
-    auto &memCounters = moduleMemCounters_.at(eventIndex);
-    auto &matchTooOld = moduleMatchTooOld_.at(eventIndex);
-    auto &matchTooNew = moduleMatchTooNew_.at(eventIndex);
+    auto &discardedEvents = es.counters.discardedEvents;
+    auto &invScores = es.counters.invScoreSums;
+    auto &matchTooOld = es.counters.matchTooOld;
+    auto &matchTooNew = es.counters.matchTooNew;
+    auto &partialEvents = es.counters.partialEvents;
+    auto &eventAssembly = es.eventAssembly;
 
-    // Have to always resize as module counts vary for different eventIndexes.
-    eventAssembly_.resize(moduleCount);
+    eventAssembly.resize(moduleCount);
+
+    const auto now = maxEventAge_.count() > 0 ? EventClock::now() : EventClock::time_point{};
+
+    // True if the current main module event has exceeded one of the
+    // configured age limits. Aged events are yielded with the modules which
+    // are present instead of waiting for the missing module data.
+    auto main_event_is_aged = [&] ()
+    {
+        const auto &mainMeta = mainBuffer.front().meta;
+
+        if (maxEventAge_.count() > 0 && now - mainMeta.recordTime >= maxEventAge_)
+            return true;
+
+        if (maxTimestampAge_ > 0
+            && mainMeta.timestamp != event_builder::TimestampExtractionFailed
+            && es.newestMainTimestamp != event_builder::TimestampExtractionFailed)
+        {
+            const u32 age = (es.newestMainTimestamp - mainMeta.timestamp) & event_builder::TimestampMax;
+            return age <= event_builder::TimestampHalf && age >= maxTimestampAge_;
+        }
+
+        return false;
+    };
 
     size_t result = 0u;
 
     // Loop while we have data from the main module and none of the module
-    // buffers are empty or we're flushing.
-    while (!mainBuffer.empty() &&
-           (flush || !std::any_of(std::begin(eventBuffers), std::end(eventBuffers),
-                                  [] (const auto &buffer) { return buffer.empty(); })))
+    // buffers are empty or we're flushing or the main module event is aged.
+    while (!mainBuffer.empty())
     {
-        u32 mainModuleTimestamp = mainBuffer.front().timestamp;
-        std::fill(eventAssembly_.begin(), eventAssembly_.end(), ModuleData{});
+        const bool forceYield = flush || main_event_is_aged();
+
+        if (!forceYield && std::any_of(std::begin(eventBuffers), std::end(eventBuffers),
+                                       [] (const auto &buffer) { return buffer.empty(); }))
+            break;
+
+        u32 mainModuleTimestamp = mainBuffer.front().meta.timestamp;
+        std::fill(eventAssembly.begin(), eventAssembly.end(), ModuleData{});
         //u32 eventInvScore = 0u;
 
         for (size_t moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
@@ -728,10 +1158,11 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
             while (!moduleDone && !eventBuffer.empty())
             {
                 auto &moduleEvent = eventBuffer.front();
+                const u32 moduleTimestamp = moduleEvent.meta.timestamp;
                 WindowMatchResult matchResult = {};
 
-                if (moduleEvent.timestamp != event_builder::TimestampExtractionFailed)
-                    matchResult = timestamp_match(mainModuleTimestamp, moduleEvent.timestamp, matchWindow);
+                if (moduleTimestamp != event_builder::TimestampExtractionFailed)
+                    matchResult = timestamp_match(mainModuleTimestamp, moduleTimestamp, matchWindow);
                 else
                 {
                     // The extractor returned TimestampExtractionFailed. Either the module data
@@ -749,9 +1180,6 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
                             // main module. It cannot be matched at any future
                             // point in time. Pop the event off the queue and
                             // update counters.
-                            size_t usedMem = moduleEvent.usedMemory();
-                            assert(memCounters.at(moduleIndex) >= usedMem);
-                            memCounters.at(moduleIndex) -= usedMem;
                             eventBuffer.pop_front();
                             ++discardedEvents.at(moduleIndex);
                             ++matchTooOld.at(moduleIndex);
@@ -763,7 +1191,7 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
                         // Update the event assembly and counters but do not
                         // pop the event off the queue yet as the eventAssembly
                         // points to the queue.
-                        eventAssembly_[moduleIndex] = module_data_from_event_storage(moduleEvent);
+                        eventAssembly[moduleIndex] = module_data_from_event_storage(eventBuffer, moduleEvent);
                         //eventInvScore += matchResult.invscore;
                         invScores.at(moduleIndex) += matchResult.invscore;
                         moduleDone = true;
@@ -787,13 +1215,13 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
         // matched with the current main module event or there is no more data
         // for the respective module as it has not arrived yet.
 
-        if (!flush)
+        if (!forceYield)
         {
             bool yieldEvent = true;
 
             for (size_t moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
             {
-                if (!eventAssembly_.at(moduleIndex).data.data && eventBuffers.at(moduleIndex).empty())
+                if (!eventAssembly.at(moduleIndex).data.data && eventBuffers.at(moduleIndex).empty())
                 {
                     yieldEvent = false;
                     break;
@@ -807,26 +1235,26 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
         {
             // Assembled events are always mapped to crate 0.
             const int crateIndex = 0; // XXX: crateId
-            callbacks.eventData(userContext_, crateIndex, eventIndex, eventAssembly_.data(), moduleCount);
+            callbacks.eventData(userContext_, crateIndex, eventIndex, eventAssembly.data(), moduleCount);
             ++result;
 
-            auto &outputHits = moduleOutputHits_.at(eventIndex);
+            auto &outputHits = es.counters.outputHits;
 
-            // After the callback we can pop the consumed module events off the deques.
+            // After the callback we can pop the consumed module events off the rings.
             for (size_t moduleIndex = 0; moduleIndex < moduleCount; ++moduleIndex)
             {
-                auto &moduleData = eventAssembly_[moduleIndex];
+                auto &moduleData = eventAssembly[moduleIndex];
 
                 if (moduleData.data.data)
                 {
                     assert(!eventBuffers.at(moduleIndex).empty());
-                    const auto &eventStorage = eventBuffers.at(moduleIndex).front();
-                    size_t usedMem = eventStorage.usedMemory();
-                    assert(memCounters.at(moduleIndex) >= usedMem);
-                    memCounters.at(moduleIndex) -= usedMem;
                     eventBuffers.at(moduleIndex).pop_front();
                     ++outputHits.at(moduleIndex);
                 }
+                else
+                {
+                    ++partialEvents.at(moduleIndex);
+                }
             }
         }
     }
@@ -839,12 +1267,16 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
 
         assert(std::all_of(std::begin(eventBuffers), std::end(eventBuffers),
                            [] (const auto &eb) { return eb.empty(); }));
-
-        // Zero out the per module memory usage counters.
-        std::fill(std::begin(memCounters), std::end(memCounters), 0u);
     }
 
-    get_logger("event_builder")->trace("buildEvents(): built {} events", result);
+    size_t ringBytes = 0u;
+
+    for (const auto &eventBuffer: eventBuffers)
+        ringBytes += eventBuffer.usedBytes();
+
+    es.ringBytes.store(ringBytes, std::memory_order_relaxed);
+
+    event_builder_logger()->trace("buildEvents(): built {} events", result);
 
     return result;
 }
@@ -852,19 +1284,16 @@ size_t EventBuilder::Private::buildEvents(int eventIndex, Callbacks &callbacks,
 
 EventBuilder::EventCounters EventBuilder::getCounters(int eventIndex) const
 {
-    UniqueLock guard(d->mutex_);
-    return d->getCounters(eventIndex);
+    return d->events_.at(eventIndex)->counterSnapshots.load();
 }
 
 EventBuilder::EventBuilderCounters EventBuilder::getCounters() const
 {
-    UniqueLock guard(d->mutex_);
-
     std::vector<EventCounters> eventCounters;
-    eventCounters.reserve(d->moduleDiscardedEvents_.size());
+    eventCounters.reserve(d->events_.size());
 
-    for (size_t ei=0; ei<d->moduleDiscardedEvents_.size(); ++ei)
-        eventCounters.emplace_back(d->getCounters(ei));
+    for (const auto &es: d->events_)
+        eventCounters.emplace_back(es->counterSnapshots.load());
 
     EventBuilderCounters result;
     result.eventCounters = std::move(eventCounters);
@@ -875,25 +1304,21 @@ EventBuilder::EventBuilderCounters EventBuilder::getCounters() const
 
 size_t EventBuilder::getMemoryUsage() const
 {
-    UniqueLock guard(d->mutex_);
     return d->getMemoryUsage();
 }
 
 size_t EventBuilder::getMaxMemoryUsage() const
 {
-    UniqueLock guard(d->mutex_);
     return d->maxUsedMemory_;
 }
 
 void EventBuilder::discardAllEventData()
 {
-    UniqueLock guard(d->mutex_);
     d->discardAllEventData();
 }
 
 void EventBuilder::reset()
 {
-    UniqueLock guard(d->mutex_);
     d->discardAllEventData();
     d->resetCounters();
 }
@@ -919,10 +1344,11 @@ std::string to_string(const EventBuilder::EventBuilderCounters &counters)
         for (size_t mi=0; mi<eventCounters.discardedEvents.size(); ++mi)
         {
             ret += fmt::format(
-                "event{}, module{}, discarded events: {}, empty events: {}, invscore sum: {}, too_old={}, too_new={}, total hits: input={}, output={}\n",
+                "event{}, module{}, discarded events: {}, empty events: {}, partial events: {}, invscore sum: {}, too_old={}, too_new={}, total hits: input={}, output={}\n",
                 ei, mi,
                 eventCounters.discardedEvents.at(mi),
                 eventCounters.emptyEvents.at(mi),
+                eventCounters.partialEvents.at(mi),
                 eventCounters.invScoreSums.at(mi),
                 eventCounters.matchTooOld.at(mi),
                 eventCounters.matchTooNew.at(mi),
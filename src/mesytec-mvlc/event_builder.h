@@ -1,6 +1,7 @@
 #ifndef __MESYTEC_MVLC_EVENT_BUILDER_H__
 #define __MESYTEC_MVLC_EVENT_BUILDER_H__
 
+#include <chrono>
 #include <functional>
 #include <memory>
 #include "mesytec-mvlc/mesytec-mvlc_export.h"
@@ -102,6 +103,16 @@ struct MESYTEC_MVLC_EXPORT EventBuilderConfig
 {
     std::vector<EventSetup> setups;
     size_t memoryLimit = event_builder::DefaultMemoryLimit;
+
+    // Age based flushing: once the oldest buffered main module event exceeds
+    // one of these limits it is yielded with the module data that is present
+    // instead of waiting for the missing modules. This bounds the output
+    // latency if a module stops delivering data. Zero disables the check.
+
+    // Wall-clock time since the main module event was recorded.
+    std::chrono::milliseconds maxEventAge = {};
+    // Distance to the newest main module timestamp in timestamp ticks.
+    u32 maxTimestampAge = 0u;
 };
 
 class MESYTEC_MVLC_EXPORT EventBuilder
@@ -120,17 +131,23 @@ class MESYTEC_MVLC_EXPORT EventBuilder
         bool isEnabledForAnyEvent() const;
 
         // Push data into the eventbuilder (called after parsing and multi event splitting).
+        //
+        // The data is copied into lock-free single producer queues, one per
+        // crate and event index. Calls for the same crateIndex must not be
+        // made concurrently, e.g. use one parser thread per crate. Different
+        // crates may record concurrently with each other and with the builder.
         void recordEventData(int crateIndex, int eventIndex,
                              const ModuleData *moduleDataList, unsigned moduleCount);
         void recordSystemEvent(int crateIndex, const u32 *header, u32 size);
 
         // Attempt to build the next full events. If successful invoke the
         // callbacks to further process the assembled events. May be called
-        // from a different thread than the push*() methods.
+        // from a different thread than the record*() methods.
         //
-        // Note: right now doesn't do any age checking or similar. This means
-        // it tries to yield one assembled output event for each input event
-        // from the main module.
+        // Tries to yield one assembled output event for each input event from
+        // the main module. Incomplete events are held back until the missing
+        // module data arrives, the event exceeds one of the age limits in
+        // EventBuilderConfig or flush is set.
         //
         // Assembled output events are always mapped to crate 0! Events for
         // which event building is not enabled keep their crate index.
@@ -139,6 +156,12 @@ class MESYTEC_MVLC_EXPORT EventBuilder
         // in individual crates to linear module indexes in the assembled events.
         size_t buildEvents(Callbacks callbacks, bool flush = false);
 
+        // Builds events for a single event index only. System events are not
+        // yielded. Different event indexes may be built in parallel from
+        // different threads. Returns the number of assembled events, yielded
+        // passthrough events are not counted.
+        size_t buildEvents(int eventIndex, Callbacks callbacks, bool flush = false);
+
         bool waitForData(const std::chrono::milliseconds &maxWait);
 
         struct EventCounters
@@ -151,6 +174,9 @@ class MESYTEC_MVLC_EXPORT EventBuilder
             std::vector<size_t> outputHits;
             std::vector<size_t> matchTooNew;
             std::vector<size_t> matchTooOld;
+            // Number of output events yielded without data from this module
+            // (aged, flushed or no match in the window).
+            std::vector<size_t> partialEvents;
         };
 
         struct EventBuilderCounters
@@ -160,6 +186,8 @@ class MESYTEC_MVLC_EXPORT EventBuilder
             size_t curMemoryUsage;
         };
 
+        // The counters are served from snapshots published by the building
+        // side and do not block recording or building.
         EventCounters getCounters(int eventIndex) const;
         EventBuilderCounters getCounters() const;
 
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <thread>
 #include "event_builder.h"
 
 using namespace mesytec::mvlc;
@@ -552,3 +553,227 @@ TEST(event_builder, SingleCratePerfectMatches)
     ASSERT_EQ(dataCallbackCount, 1001);
     ASSERT_EQ(systemCallbackCount, 0);
 }
+
+// One recording thread per crate, one builder thread per event index and a
+// thread polling the counters. Event 0 is built across all crates, event 1 is
+// passed through.
+TEST(event_builder, MultiCrateConcurrentRecording)
+{
+    const size_t CrateCount = 3;
+    const size_t ModulesPerCrate = 2;
+    const u32 EventCount = 10000;
+
+    auto test_timestamp_extractor = [] (const u32 *moduleData, size_t size) -> u32
+    {
+        return size > 0 ? moduleData[0] : event_builder::TimestampExtractionFailed;
+    };
+
+    EventSetup ebSetup;
+    ebSetup.enabled = true;
+    ebSetup.mainModule = { 0, 0 };
+
+    for (size_t ci=0; ci<CrateCount; ++ci)
+    {
+        EventSetup::CrateSetup crateSetup;
+        crateSetup.moduleTimestampExtractors.resize(ModulesPerCrate, test_timestamp_extractor);
+        crateSetup.moduleMatchWindows.resize(ModulesPerCrate, { 0, 0 });
+        ebSetup.crateSetups.emplace_back(crateSetup);
+    }
+
+    EventSetup passthroughSetup;
+    passthroughSetup.enabled = false;
+
+    EventBuilderConfig cfg;
+    cfg.setups = { ebSetup, passthroughSetup };
+    EventBuilder eventBuilder(cfg);
+
+    std::vector<std::thread> producers;
+
+    for (size_t ci=0; ci<CrateCount; ++ci)
+    {
+        producers.emplace_back([&eventBuilder, ci] ()
+        {
+            std::array<std::array<u32, 2>, ModulesPerCrate> eventStorage = {};
+            auto moduleDataList = module_data_list_from_test_data(eventStorage);
+
+            for (u32 ts=0; ts<EventCount; ++ts)
+            {
+                for (auto &moduleData: eventStorage)
+                    moduleData = { ts, static_cast<u32>(ci) };
+
+                eventBuilder.recordEventData(ci, 0, moduleDataList.data(), moduleDataList.size());
+                eventBuilder.recordEventData(ci, 1, moduleDataList.data(), moduleDataList.size());
+            }
+        });
+    }
+
+    std::atomic<bool> producersDone(false);
+    std::atomic<bool> builtOk(true);
+    size_t builtEvents = 0;
+    std::array<u32, CrateCount> nextPassthroughTimestamps = {};
+    size_t passthroughEvents = 0;
+
+    Callbacks ebCallbacks;
+    ebCallbacks.eventData = [&] (void *, int crateIndex, int eventIndex, const ModuleData *moduleDataList, unsigned moduleCount)
+    {
+        if (crateIndex != 0 || eventIndex != 0 || moduleCount != CrateCount * ModulesPerCrate)
+            builtOk = false;
+
+        for (unsigned mi=0; mi<moduleCount; ++mi)
+        {
+            if (moduleDataList[mi].data.size != 2 || moduleDataList[mi].data.data[0] != builtEvents)
+                builtOk = false;
+        }
+
+        ++builtEvents;
+    };
+    ebCallbacks.systemEvent = [] (void *, int, const u32 *, u32) {};
+
+    Callbacks passthroughCallbacks;
+    passthroughCallbacks.eventData = [&] (void *, int crateIndex, int eventIndex, const ModuleData *moduleDataList, unsigned moduleCount)
+    {
+        if (crateIndex < 0 || static_cast<size_t>(crateIndex) >= CrateCount || eventIndex != 1 || moduleCount != ModulesPerCrate)
+        {
+            builtOk = false;
+            return;
+        }
+
+        // Passthrough events of each crate must arrive in recording order.
+        if (moduleDataList[0].data.data[0] != nextPassthroughTimestamps[crateIndex]++)
+            builtOk = false;
+
+        ++passthroughEvents;
+    };
+    passthroughCallbacks.systemEvent = [] (void *, int, const u32 *, u32) {};
+
+    auto run_builder = [&] (int eventIndex, Callbacks &callbacks)
+    {
+        while (!producersDone)
+        {
+            if (eventBuilder.waitForData(std::chrono::milliseconds(1)))
+                eventBuilder.buildEvents(eventIndex, callbacks);
+        }
+
+        eventBuilder.buildEvents(eventIndex, callbacks, true);
+    };
+
+    std::thread ebThread(run_builder, 0, std::ref(ebCallbacks));
+    std::thread passthroughThread(run_builder, 1, std::ref(passthroughCallbacks));
+
+    std::thread countersThread([&] ()
+    {
+        while (!producersDone)
+        {
+            auto counters = eventBuilder.getCounters();
+
+            if (counters.eventCounters.size() != 2
+                || counters.eventCounters[0].inputHits.size() != CrateCount * ModulesPerCrate)
+                builtOk = false;
+        }
+    });
+
+    for (auto &t: producers)
+        t.join();
+
+    producersDone = true;
+    ebThread.join();
+    passthroughThread.join();
+    countersThread.join();
+
+    ASSERT_TRUE(builtOk);
+    ASSERT_EQ(builtEvents, EventCount);
+    ASSERT_EQ(passthroughEvents, CrateCount * EventCount);
+    ASSERT_EQ(eventBuilder.getMemoryUsage(), 0u);
+
+    auto counters = eventBuilder.getCounters(0);
+
+    for (size_t mi=0; mi<CrateCount * ModulesPerCrate; ++mi)
+    {
+        ASSERT_EQ(counters.inputHits[mi], EventCount);
+        ASSERT_EQ(counters.outputHits[mi], EventCount);
+        ASSERT_EQ(counters.discardedEvents[mi], 0u);
+    }
+}
+
+namespace
+{
+    // Records events with the given timestamp for module0 and module1 (main)
+    // of the one crate test setup. module2 does not deliver any data.
+    void record_module2_dropout_event(EventBuilder &eventBuilder, u32 ts)
+    {
+        std::array<std::vector<u32>, TestSetupModuleCount> moduleTestData = {{ { ts }, { ts }, {} }};
+        auto moduleDataList = module_data_list_from_test_data(moduleTestData);
+        eventBuilder.recordEventData(0, 0, moduleDataList.data(), moduleDataList.size());
+    }
+}
+
+TEST(event_builder, AgeBasedFlushTimestampTicks)
+{
+    EventBuilderConfig cfg;
+    cfg.setups = std::vector<EventSetup>{ make_one_crate_one_event_test_setup() };
+    cfg.maxTimestampAge = 100;
+    EventBuilder eventBuilder(cfg);
+
+    std::vector<unsigned> presentModules;
+
+    Callbacks callbacks;
+    callbacks.eventData = [&] (void *, int, int, const ModuleData *moduleDataList, unsigned moduleCount)
+    {
+        unsigned present = 0;
+
+        for (unsigned mi=0; mi<moduleCount; ++mi)
+            present += moduleDataList[mi].data.data != nullptr;
+
+        presentModules.push_back(present);
+    };
+    callbacks.systemEvent = [] (void *, int, const u32 *, u32) {};
+
+    // Main module timestamps 0, 10, ..., 200. Events up to ts=100 are at
+    // least 100 ticks older than the newest main module event.
+    for (u32 ts=0; ts<=200; ts+=10)
+        record_module2_dropout_event(eventBuilder, ts);
+
+    ASSERT_EQ(eventBuilder.buildEvents(callbacks), 11u);
+    ASSERT_EQ(presentModules.size(), 11u);
+
+    for (auto present: presentModules)
+        ASSERT_EQ(present, 2u);
+
+    // No more aged events.
+    ASSERT_EQ(eventBuilder.buildEvents(callbacks), 0u);
+
+    auto counters = eventBuilder.getCounters(0);
+    ASSERT_EQ(counters.outputHits[0], 11u);
+    ASSERT_EQ(counters.outputHits[1], 11u);
+    ASSERT_EQ(counters.outputHits[2], 0u);
+    ASSERT_EQ(counters.partialEvents[0], 0u);
+    ASSERT_EQ(counters.partialEvents[1], 0u);
+    ASSERT_EQ(counters.partialEvents[2], 11u);
+}
+
+TEST(event_builder, AgeBasedFlushWallClock)
+{
+    EventBuilderConfig cfg;
+    cfg.setups = std::vector<EventSetup>{ make_one_crate_one_event_test_setup() };
+    cfg.maxEventAge = std::chrono::milliseconds(20);
+    EventBuilder eventBuilder(cfg);
+
+    size_t eventCount = 0;
+
+    Callbacks callbacks;
+    callbacks.eventData = [&] (void *, int, int, const ModuleData *, unsigned) { ++eventCount; };
+    callbacks.systemEvent = [] (void *, int, const u32 *, u32) {};
+
+    record_module2_dropout_event(eventBuilder, 42);
+
+    // module2 is missing, the event is held back
+    ASSERT_EQ(eventBuilder.buildEvents(callbacks), 0u);
+    ASSERT_EQ(eventCount, 0u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+
+    ASSERT_EQ(eventBuilder.buildEvents(callbacks), 1u);
+    ASSERT_EQ(eventCount, 1u);
+    ASSERT_EQ(eventBuilder.getCounters(0).partialEvents[2], 1u);
+    ASSERT_EQ(eventBuilder.getMemoryUsage(), 0u);
+}
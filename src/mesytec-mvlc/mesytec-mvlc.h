@@ -35,17 +35,21 @@
 #include "mvlc_dialog.h"
 #include "mvlc_dialog_util.h"
 #include "mvlc_factory.h"
+#include "mvlc_frame_scan.h"
 #include "mvlc.h"
 #include "mvlc_listfile_gen.h"
 #include "mvlc_listfile.h"
+#include "mvlc_listfile_mmap.h"
 #include "mvlc_listfile_util.h"
 #include "mvlc_listfile_zip.h"
 #ifdef MVLC_HAVE_ZMQ
 #include "mvlc_listfile_zmq_ganil.h"
+#include "mvlc_zmq_publisher.h"
 #endif
 #include "mvlc_eth_interface.h"
 #include "mvlc_readout.h"
 #include "mvlc_readout_parser.h"
+#include "mvlc_readout_parser_parallel.h"
 #include "mvlc_readout_parser_util.h"
 #include "mvlc_readout_worker.h"
 #include "mvlc_replay.h"
@@ -54,6 +58,7 @@
 #include "mvlc_usb_interface.h"
 #include "mvlc_util.h"
 #include "scanbus_support.h"
+#include "snoop_fanout.h"
 #include "util/filesystem.h"
 #include "util/fmt.h"
 #include "util/int_types.h"
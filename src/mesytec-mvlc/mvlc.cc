@@ -30,7 +30,10 @@
 
 #include <atomic>
 #include <fstream>
+#include <functional>
 #include <future>
+#include <map>
+#include <optional>
 
 #ifdef __linux__
 #include <sys/prctl.h>
@@ -52,12 +55,56 @@ namespace
 
 static const size_t LogBuffersMaxWords = 0; // set to 0 to output the full buffer contents
 
+// Cached loggers for the per-transaction code paths.
+const std::shared_ptr<spdlog::logger> &apiv2_logger()
+{
+    static CachedLogger logger("mvlc_apiv2");
+    return logger.get();
+}
+
+const std::shared_ptr<spdlog::logger> &mvlc_logger()
+{
+    static CachedLogger logger("mvlc");
+    return logger.get();
+}
+
+// Maximum number of super transactions that may be in flight at the same time.
+// Small enough to not overflow the MVLC command input buffer with the typical
+// single register or stack upload transactions.
+static const size_t PendingSuperLimit = 16;
+
+// The reserved immediate stack memory is split into slots so that a stack can
+// be uploaded and started while previous immediate stacks are still pending.
+// A slot is reused once the stack occupying it has produced its response.
+// Stacks not fitting into a single slot occupy all of them.
+static const size_t ImmediateStackSlotCount = 4;
+static const u16 ImmediateStackSlotWords = stacks::ImmediateStackReservedWords / ImmediateStackSlotCount;
+
+// Maximum number of immediate stack transactions in flight, one per slot.
+static const size_t PendingStackLimit = ImmediateStackSlotCount;
+
 struct PendingResponse
 {
-    std::promise<std::error_code> promise;
-    std::vector<u32> *dest = nullptr;
-    u32 reference = 0;
-    bool pending = false;
+    // Invoked exactly once with the result of the transaction. On success
+    // contents/len point to the full response frame, including continuation
+    // frames.
+    using Completion = std::function<void (const std::error_code &ec, const u32 *contents, size_t len)>;
+
+    Completion completion;
+    std::chrono::steady_clock::time_point deadline;
+    // Set for the super transactions uploading and starting an immediate
+    // stack: if one of these fails the stack transaction is failed too.
+    std::optional<u32> linkedStackReference;
+    // Immediate stack memory slots occupied by a stack transaction, one bit
+    // per slot.
+    u32 stackSlots = 0u;
+};
+
+// Outstanding super or stack transactions keyed by their reference number.
+struct PendingResponses
+{
+    std::map<u32, PendingResponse> entries;
+    size_t limit = 1;
 };
 
 struct ReaderContext
@@ -66,8 +113,8 @@ struct ReaderContext
     std::atomic<bool> quit;
     std::atomic<u16> nextSuperReference;
     std::atomic<u32> nextStackReference;
-    WaitableProtected<PendingResponse> pendingSuper;
-    WaitableProtected<PendingResponse> pendingStack;
+    WaitableProtected<PendingResponses> pendingSuper;
+    WaitableProtected<PendingResponses> pendingStack;
 
     Protected<StackErrorCounters> stackErrors;
     Protected<CmdPipeCounters> counters;
@@ -77,51 +124,215 @@ struct ReaderContext
         , quit(false)
         , nextSuperReference(1)
         , nextStackReference(1)
+        , pendingSuper(PendingResponses{ {}, PendingSuperLimit })
+        , pendingStack(PendingResponses{ {}, PendingStackLimit })
         , stackErrors()
         , counters()
         {}
 };
 
-std::error_code fullfill_pending_response(
+// Completion copying the response into dest and fullfilling the given promise.
+// Used by the blocking transactions which keep dest alive until the promise
+// is ready.
+PendingResponse::Completion make_copying_completion(
+    const std::shared_ptr<std::promise<std::error_code>> &promise,
+    std::vector<u32> &dest)
+{
+    return [promise, &dest] (const std::error_code &ec, const u32 *contents, size_t len)
+    {
+        if (!ec && contents && len)
+            std::copy(contents, contents+len, std::back_inserter(dest));
+
+        promise->set_value(ec);
+    };
+}
+
+// Adds an entry for the given reference to the table. Waits until 'deadline'
+// for a free slot if the table limit has been reached. pr is only moved into
+// the table on success.
+std::error_code add_pending_response(
+    WaitableProtected<PendingResponses> &pending,
+    u32 reference,
+    PendingResponse &pr,
+    const std::chrono::steady_clock::time_point &deadline,
+    const std::error_code &timeoutError,
+    const std::error_code &duplicateError)
+{
+    auto access = pending.wait_until(deadline,
+        [] (const PendingResponses &prs) { return prs.entries.size() < prs.limit; });
+
+    if (access->entries.size() >= access->limit)
+        return timeoutError;
+
+    if (!access->entries.try_emplace(reference, std::move(pr)).second)
+        return duplicateError;
+
+    return {};
+}
+
+// Returns the first of slotCount consecutive immediate stack slots not
+// occupied by any of the pending stack transactions.
+std::optional<size_t> find_free_stack_slots(const PendingResponses &prs, size_t slotCount)
+{
+    u32 usedSlots = 0u;
+
+    for (const auto &entry: prs.entries)
+        usedSlots |= entry.second.stackSlots;
+
+    const u32 slotMask = (1u << slotCount) - 1u;
+
+    for (size_t slot=0; slot + slotCount <= ImmediateStackSlotCount; ++slot)
+    {
+        if (!(usedSlots & (slotMask << slot)))
+            return slot;
+    }
+
+    return {};
+}
+
+// Adds an entry for the given immediate stack transaction and reserves
+// slotCount immediate stack slots for it. Waits until 'deadline' for the slots
+// to become free. On success firstSlot is set to the first reserved slot. pr
+// is only moved into the table on success.
+std::error_code add_pending_stack(
+    WaitableProtected<PendingResponses> &pending,
+    u32 stackRef,
     PendingResponse &pr,
+    size_t slotCount,
+    const std::chrono::steady_clock::time_point &deadline,
+    size_t &firstSlot)
+{
+    auto access = pending.wait_until(deadline,
+        [slotCount] (const PendingResponses &prs)
+        {
+            return prs.entries.size() < prs.limit && find_free_stack_slots(prs, slotCount);
+        });
+
+    auto slot = find_free_stack_slots(access.ref(), slotCount);
+
+    if (access->entries.size() >= access->limit || !slot)
+        return make_error_code(MVLCErrorCode::StackCommandTimeout);
+
+    pr.stackSlots = ((1u << slotCount) - 1u) << *slot;
+
+    if (!access->entries.try_emplace(stackRef, std::move(pr)).second)
+        return make_error_code(MVLCErrorCode::StackReferenceMismatch);
+
+    firstSlot = *slot;
+    return {};
+}
+
+// Removes the entry for the given reference and invokes its completion.
+// Returns false if no such entry exists, e.g. because the transaction timed
+// out or was fullfilled by another thread.
+bool fullfill_pending_response(
+    WaitableProtected<PendingResponses> &pending,
+    u32 reference,
     const std::error_code &ec,
-    const u32 *contents = nullptr, size_t len = 0)
+    const u32 *contents = nullptr, size_t len = 0,
+    std::optional<u32> *linkedStackReference = nullptr)
 {
-    if (pr.pending)
+    PendingResponse pr;
+
     {
-        pr.pending = false;
+        auto access = pending.access();
+        auto it = access->entries.find(reference);
 
-        if (pr.dest && contents && len)
-            std::copy(contents, contents+len, std::back_inserter(*pr.dest));
+        if (it == access->entries.end())
+            return false;
 
-        pr.promise.set_value(ec);
+        pr = std::move(it->second);
+        access->entries.erase(it);
     }
 
-    return ec;
+    if (linkedStackReference)
+        *linkedStackReference = pr.linkedStackReference;
+
+    pr.completion(ec, contents, len);
+    return true;
 }
 
-std::error_code fullfill_pending_response(
-    WaitableProtected<PendingResponse> &pr,
+// Fullfills the entry closest to its deadline. Used for malformed responses
+// which cannot be associated with a reference number.
+bool fullfill_oldest_pending_response(
+    WaitableProtected<PendingResponses> &pending,
     const std::error_code &ec,
-    const u32 *contents = nullptr, size_t len = 0)
+    std::optional<u32> *linkedStackReference = nullptr)
 {
-    return fullfill_pending_response(pr.access().ref(), ec, contents, len);
+    std::optional<u32> reference;
+
+    {
+        auto access = pending.access();
+        auto &entries = access->entries;
+
+        auto it = std::min_element(std::begin(entries), std::end(entries),
+            [] (const auto &a, const auto &b) { return a.second.deadline < b.second.deadline; });
+
+        if (it != std::end(entries))
+            reference = it->first;
+    }
+
+    return reference && fullfill_pending_response(pending, *reference, ec, nullptr, 0, linkedStackReference);
+}
+
+// Fullfills all entries whose deadline has passed. The references of stack
+// transactions linked to expired super transactions are appended to
+// linkedStackReferences.
+void expire_pending_responses(
+    WaitableProtected<PendingResponses> &pending,
+    const std::chrono::steady_clock::time_point &now,
+    const std::error_code &ec,
+    std::vector<u32> *linkedStackReferences = nullptr)
+{
+    std::vector<PendingResponse> expired;
+
+    {
+        auto access = pending.access();
+        auto &entries = access->entries;
+
+        for (auto it = std::begin(entries); it != std::end(entries); )
+        {
+            if (it->second.deadline <= now)
+            {
+                expired.emplace_back(std::move(it->second));
+                it = entries.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    for (auto &pr: expired)
+    {
+        if (linkedStackReferences && pr.linkedStackReference)
+            linkedStackReferences->push_back(*pr.linkedStackReference);
+
+        pr.completion(ec, nullptr, 0);
+    }
 }
 
-std::future<std::error_code> set_pending_response(
-    WaitableProtected<PendingResponse> &pending,
-    std::vector<u32> &dest,
-    u32 reference)
+void fullfill_all_pending_responses(
+    WaitableProtected<PendingResponses> &pending,
+    const std::error_code &ec)
 {
-    auto pendingResponse = pending.wait(
-        [] (const PendingResponse &pr) { return !pr.pending; });
+    expire_pending_responses(pending, std::chrono::steady_clock::time_point::max(), ec);
+}
 
-    assert(pendingResponse.ref().pending == false);
+// Fullfills a super transaction and, if it failed and is part of an immediate
+// stack transaction, also fails the linked stack transaction.
+bool fullfill_pending_super(
+    ReaderContext &context,
+    u32 reference,
+    const std::error_code &ec,
+    const u32 *contents = nullptr, size_t len = 0)
+{
+    std::optional<u32> linkedStackReference;
 
-    std::promise<std::error_code> promise;
-    auto result = promise.get_future();
+    bool result = fullfill_pending_response(
+        context.pendingSuper, reference, ec, contents, len, &linkedStackReference);
 
-    pendingResponse.ref() = { std::move(promise), &dest, reference, true };
+    if (ec && linkedStackReference)
+        fullfill_pending_response(context.pendingStack, *linkedStackReference, ec);
 
     return result;
 }
@@ -342,9 +553,9 @@ void cmd_pipe_reader(ReaderContext &context)
 
                     ++counters.superBuffers;
 
-                    auto pendingResponse = context.pendingSuper.access();
                     size_t toConsume = 0;
                     std::error_code ec;
+                    std::optional<u32> superRef;
 
                     if (frameLength == 0)
                     {
@@ -368,17 +579,7 @@ void cmd_pipe_reader(ReaderContext &context)
                             ++counters.superFormatErrors;
                         }
                         else
-                        {
-                            u32 superRef = buffer[1] & SuperCmdArgMask;
-
-                            if (superRef != pendingResponse->reference)
-                            {
-                                logger->warn("cmd_pipe_reader: super ref mismatch, wanted=0x{:04x}, got=0x{:04x}",
-                                             pendingResponse->reference, superRef);
-                                ec = make_error_code(MVLCErrorCode::SuperReferenceMismatch);
-                                ++counters.superRefMismatches;
-                            }
-                        }
+                            superRef = buffer[1] & SuperCmdArgMask;
                     }
 
                     const u32 *header = &buffer[0];
@@ -392,12 +593,26 @@ void cmd_pipe_reader(ReaderContext &context)
                     }
 
                     if (ec)
-                        fullfill_pending_response(
-                            pendingResponse.ref(), ec);
-                    else
-                        fullfill_pending_response(
+                    {
+                        // The response cannot be associated with a
+                        // transaction. Fail the oldest one instead of letting
+                        // it run into the timeout.
+                        std::optional<u32> linkedStackRef;
+                        if (fullfill_oldest_pending_response(context.pendingSuper, ec, &linkedStackRef)
+                            && linkedStackRef)
+                        {
+                            fullfill_pending_response(context.pendingStack, *linkedStackRef, ec);
+                        }
+                    }
+                    else if (!fullfill_pending_super(context, *superRef, ec, &buffer[0], toConsume))
+                    {
+                        // Most likely the late response to a transaction that
+                        // already timed out.
+                        logger->warn("cmd_pipe_reader: no pending super transaction for ref=0x{:04x}",
+                                     *superRef);
+                        ++counters.superRefMismatches;
+                    }
 
-                            pendingResponse.ref(), ec, &buffer[0], toConsume);
                     buffer.consume(toConsume);
                 }
                 // stack buffers
@@ -405,9 +620,9 @@ void cmd_pipe_reader(ReaderContext &context)
                 {
                     ++counters.stackBuffers;
 
-                    auto pendingResponse = context.pendingStack.access();
                     size_t toConsume = 0;
                     std::error_code ec;
+                    u32 stackRef = 0;
 
                     if (get_frame_length(buffer[0]) == 0)
                     {
@@ -417,16 +632,7 @@ void cmd_pipe_reader(ReaderContext &context)
                     else
                     {
                         toConsume += get_frame_length(buffer[0]) + 1;
-
-                        u32 stackRef = buffer[1];
-
-                        if (stackRef != pendingResponse->reference)
-                        {
-                            logger->warn("cmd_pipe_reader: stack ref mismatch, wanted=0x{:08x}, got=0x{:08x}",
-                                         pendingResponse->reference, stackRef);
-                            ec = make_error_code(MVLCErrorCode::StackReferenceMismatch);
-                            ++counters.stackRefMismatches;
-                        }
+                        stackRef = buffer[1];
                     }
 
                     const u32 *header = &buffer[0];
@@ -440,11 +646,13 @@ void cmd_pipe_reader(ReaderContext &context)
                     }
 
                     if (ec)
-                        fullfill_pending_response(
-                            pendingResponse.ref(), ec);
-                    else
-                        fullfill_pending_response(
-                            pendingResponse.ref(), ec, &buffer[0], toConsume);
+                        fullfill_oldest_pending_response(context.pendingStack, ec);
+                    else if (!fullfill_pending_response(context.pendingStack, stackRef, ec, &buffer[0], toConsume))
+                    {
+                        logger->warn("cmd_pipe_reader: no pending stack transaction for ref=0x{:08x}",
+                                     stackRef);
+                        ++counters.stackRefMismatches;
+                    }
 
                     buffer.consume(toConsume);
                 }
@@ -457,12 +665,10 @@ void cmd_pipe_reader(ReaderContext &context)
                 if (logNextIncomplete && logger->should_log(spdlog::level::trace))
                 {
                     // No complete frame in the buffer
-                    auto pendingSuper = context.pendingSuper.access();
-                    auto pendingStack = context.pendingStack.access();
                     logger->trace("cmd_pipe_reader: incomplete frame in buffer, trying to read more data "
-                        "(pendingSuper: pending={}, ref=0x{:04X}, pendingStack: pending={}, ref=0x{:08X})",
-                        pendingSuper->pending, pendingSuper->reference,
-                        pendingStack->pending, pendingStack->reference);
+                        "(pendingSuper={}, pendingStack={})",
+                        context.pendingSuper.access()->entries.size(),
+                        context.pendingStack.access()->entries.size());
                     logNextIncomplete = false;
                     //log_buffer(logger, spdlog::level::trace, buffer, "cmd_pipe_reader incomplete frame", LogBuffersMaxWords);
                 }
@@ -538,18 +744,34 @@ void cmd_pipe_reader(ReaderContext &context)
         if (ec == ErrorType::Timeout)
             ++counters.timeouts;
 
+        // Time out transactions which did not receive a response. This is
+        // what bounds the wait time of the asynchronous api.
+        {
+            auto now = std::chrono::steady_clock::now();
+            std::vector<u32> linkedStackRefs;
+
+            expire_pending_responses(context.pendingSuper, now,
+                make_error_code(MVLCErrorCode::SuperCommandTimeout), &linkedStackRefs);
+
+            for (auto stackRef: linkedStackRefs)
+                fullfill_pending_response(context.pendingStack, stackRef,
+                    make_error_code(MVLCErrorCode::SuperCommandTimeout));
+
+            expire_pending_responses(context.pendingStack, now,
+                make_error_code(MVLCErrorCode::StackCommandTimeout));
+        }
 
         if (ec == ErrorType::ConnectionError)
             context.quit = true;
     }
 
-    fullfill_pending_response(
-        context.pendingSuper.access().ref(),
-        ec ? ec : make_error_code(MVLCErrorCode::IsDisconnected));
+    // Pass on connection errors. Otherwise the last read most likely timed
+    // out which is not the reason the transactions are failed.
+    if (ec != ErrorType::ConnectionError)
+        ec = make_error_code(MVLCErrorCode::IsDisconnected);
 
-    fullfill_pending_response(
-        context.pendingStack.access().ref(),
-        ec ? ec : make_error_code(MVLCErrorCode::IsDisconnected));
+    fullfill_all_pending_responses(context.pendingSuper, ec);
+    fullfill_all_pending_responses(context.pendingStack, ec);
 
     logger->debug("cmd_pipe_reader exiting");
 }
@@ -576,6 +798,17 @@ class CmdApi
         std::error_code vmeBlockReadSwapped(u32 address, u8 amod, u16 maxTransfers, std::vector<u32> &dest, bool fifo = true);
         std::error_code vmeBlockReadSwapped(u32 address, const Blk2eSSTRate &rate, u16 maxTransfers, std::vector<u32> &dest, bool fifo = true);
 
+        // Asynchronous variants. The transactions are written out immediately,
+        // the returned futures become ready once the response arrived or the
+        // transaction timed out. Up to PendingSuperLimit super transactions
+        // and PendingStackLimit immediate stack transactions can be in flight.
+        // The calls only block if these limits have been reached.
+        std::future<std::pair<u32, std::error_code>> readRegisterAsync(u16 address);
+        std::future<std::error_code> writeRegisterAsync(u16 address, u32 value);
+
+        std::future<std::pair<u32, std::error_code>> vmeReadAsync(u32 address, u8 amod, VMEDataWidth dataWidth);
+        std::future<std::error_code> vmeWriteAsync(u32 address, u32 value, u8 amod, VMEDataWidth dataWidth);
+
         std::error_code uploadStack(u8 stackOutputPipe, u16 stackMemoryOffset,
                                     const std::vector<StackCommand> &commands);
 
@@ -592,30 +825,101 @@ class CmdApi
             readerContext_.stackErrors.access().ref() = {};
         }
 
+        u32 nextStackReference()
+        {
+            return readerContext_.nextStackReference++;
+        }
+
         std::error_code superTransaction(
             u16 ref, std::vector<u32> superBuffer, std::vector<u32> &responseBuffer);
 
         std::error_code stackTransaction(
             u32 stackRef, const StackCommandBuilder &stackBuilder, std::vector<u32> &stackResponse);
 
+        // Register the transaction with the cmd_pipe_reader and write the
+        // command buffer(s) without waiting for the response. The completion
+        // is invoked exactly once, also if registering or writing fails. The
+        // transaction fails with a timeout error if it did not complete
+        // before 'deadline', including the time spent waiting for a free
+        // pending response slot.
+        void superTransactionAsync(
+            u16 ref, const std::vector<u32> &cmdBuffer, PendingResponse::Completion completion,
+            const std::chrono::steady_clock::time_point &deadline,
+            std::optional<u32> linkedStackReference = {});
+
+        // Stacks fitting into an immediate stack slot are uploaded and
+        // started using a single command buffer. Larger stacks wait for all
+        // other immediate stacks to finish and for the confirmation of their
+        // upload before being started.
+        void stackTransactionAsync(
+            u32 stackRef, const StackCommandBuilder &stackBuilder, PendingResponse::Completion completion,
+            const std::chrono::steady_clock::time_point &deadline);
+
     private:
         static constexpr std::chrono::milliseconds ResultWaitTimeout = std::chrono::milliseconds(2000);
 
+        // Immediate stack transactions cover uploading, starting and
+        // executing the stack.
+        static constexpr std::chrono::milliseconds StackResultWaitTimeout = 2 * ResultWaitTimeout;
+
+        using StackUploadPart = std::pair<u16, std::vector<u32>>; // super reference, command buffer
+
+        std::error_code makeStackUploadParts(
+            u8 stackOutputPipe, u16 stackMemoryOffset, const std::vector<u32> &stackContents,
+            std::vector<StackUploadPart> &parts);
+
+        // Fullfills the transaction with IsDisconnected if the cmd_pipe_reader
+        // quit. Otherwise the transaction would never complete.
+        template<typename Fullfill>
+        void checkReaderRunning(Fullfill fullfill)
+        {
+            if (readerContext_.quit)
+                fullfill(make_error_code(MVLCErrorCode::IsDisconnected));
+        }
+
         ReaderContext &readerContext_;
 };
 
 constexpr std::chrono::milliseconds CmdApi::ResultWaitTimeout;
+constexpr std::chrono::milliseconds CmdApi::StackResultWaitTimeout;
 
-std::error_code CmdApi::superTransaction(
+void CmdApi::superTransactionAsync(
     u16 ref,
-    std::vector<u32> cmdBuffer,
-    std::vector<u32> &responseBuffer)
+    const std::vector<u32> &cmdBuffer,
+    PendingResponse::Completion completion,
+    const std::chrono::steady_clock::time_point &deadline,
+    std::optional<u32> linkedStackReference)
 {
+    auto fail_linked_stack = [this, &linkedStackReference] (const std::error_code &ec)
+    {
+        if (linkedStackReference)
+            fullfill_pending_response(readerContext_.pendingStack, *linkedStackReference, ec);
+    };
+
     if (cmdBuffer.size() > MirrorTransactionMaxWords)
-        return make_error_code(MVLCErrorCode::MirrorTransactionMaxWordsExceeded);
+    {
+        auto ec = make_error_code(MVLCErrorCode::MirrorTransactionMaxWordsExceeded);
+        completion(ec, nullptr, 0);
+        return fail_linked_stack(ec);
+    }
 
-    auto rf = set_pending_response(readerContext_.pendingSuper, responseBuffer, ref);
-    auto tSet = std::chrono::steady_clock::now();
+    PendingResponse pr;
+    pr.completion = std::move(completion);
+    pr.deadline = deadline;
+    pr.linkedStackReference = linkedStackReference;
+
+    if (auto ec = add_pending_response(
+            readerContext_.pendingSuper, ref, pr, deadline,
+            make_error_code(MVLCErrorCode::SuperCommandTimeout),
+            make_error_code(MVLCErrorCode::SuperReferenceMismatch)))
+    {
+        apiv2_logger()->warn("superTransaction: could not register super transaction (ref=0x{:04x}): {}",
+            ref, ec.message());
+        pr.completion(ec, nullptr, 0);
+        return fail_linked_stack(ec);
+    }
+
+    checkReaderRunning([&] (const std::error_code &ec) { fullfill_pending_super(readerContext_, ref, ec); });
 
     size_t bytesWritten = 0;
 
@@ -626,88 +930,181 @@ std::error_code CmdApi::superTransaction(
         bytesWritten);
 
     if (ec)
-        return fullfill_pending_response(readerContext_.pendingSuper, ec);
+        fullfill_pending_super(readerContext_, ref, ec);
+}
 
-    if (rf.wait_for(ResultWaitTimeout) != std::future_status::ready)
+std::error_code CmdApi::superTransaction(
+    u16 ref,
+    std::vector<u32> cmdBuffer,
+    std::vector<u32> &responseBuffer)
+{
+    auto promise = std::make_shared<std::promise<std::error_code>>();
+    auto rf = promise->get_future();
+    auto tSet = std::chrono::steady_clock::now();
+    auto deadline = tSet + ResultWaitTimeout;
+
+    superTransactionAsync(ref, cmdBuffer, make_copying_completion(promise, responseBuffer), deadline);
+
+    if (rf.wait_until(deadline) != std::future_status::ready)
     {
         auto elapsed = std::chrono::steady_clock::now() - tSet;
-        get_logger("mvlc_apiv2")->warn(
+        apiv2_logger()->warn(
             "superTransaction super future not ready -> SuperCommandTimeout"
             " (ref=0x{:04x}, timed_out after {}ms)",
-            readerContext_.pendingSuper.access()->reference,
+            ref,
             std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
             );
-        return fullfill_pending_response(readerContext_.pendingSuper, make_error_code(MVLCErrorCode::SuperCommandTimeout));
+        fullfill_pending_super(readerContext_, ref, make_error_code(MVLCErrorCode::SuperCommandTimeout));
     }
 
+    // Either fullfilled by the cmd_pipe_reader or by the timeout above.
     return rf.get();
 }
 
-std::error_code CmdApi::stackTransaction(
+void CmdApi::stackTransactionAsync(
     u32 stackRef, const StackCommandBuilder &stackBuilder,
-    std::vector<u32> &stackResponse)
+    PendingResponse::Completion completion,
+    const std::chrono::steady_clock::time_point &deadline)
 {
-    if (auto ec = uploadStack(CommandPipe, stacks::ImmediateStackStartOffsetBytes, make_stack_buffer(stackBuilder)))
-        return ec;
+    const auto stackBuffer = make_stack_buffer(stackBuilder);
 
-    u16 superRef = readerContext_.nextSuperReference++;
+    // StackStart and StackEnd are written in addition to the stack contents.
+    const bool fitsSlot = stackBuffer.size() + 2 <= ImmediateStackSlotWords;
 
-    SuperCommandBuilder superBuilder;
-    superBuilder.addReferenceWord(superRef);
-    superBuilder.addWriteLocal(stacks::Stack0OffsetRegister, stacks::ImmediateStackStartOffsetBytes);
-    superBuilder.addWriteLocal(stacks::Stack0TriggerRegister, 1u << stacks::ImmediateShift);
-    auto cmdBuffer = make_command_buffer(superBuilder);
+    // Larger stacks occupy all slots and are always uploaded to the start of
+    // the immediate stack area.
+    std::vector<StackUploadPart> parts;
 
-    log_buffer(get_logger("mvlc_apiv2"), spdlog::level::trace,
-        cmdBuffer, "stackTransaction: 'exec immediate stack' command buffer", LogBuffersMaxWords);
+    if (!fitsSlot)
+    {
+        if (auto ec = makeStackUploadParts(CommandPipe, stacks::ImmediateStackStartOffsetBytes,
+                                           stackBuffer, parts))
+        {
+            return completion(ec, nullptr, 0);
+        }
+    }
 
-    std::vector<u32> superResponse;
+    PendingResponse pr;
+    pr.completion = std::move(completion);
+    pr.deadline = deadline;
+    size_t slot = 0;
 
-    auto superFuture = set_pending_response(readerContext_.pendingSuper, superResponse, superRef);
-    auto stackFuture = set_pending_response(readerContext_.pendingStack, stackResponse, stackRef);
+    // Waits for previous immediate stacks to free up the required slots.
+    if (auto ec = add_pending_stack(
+            readerContext_.pendingStack, stackRef, pr,
+            fitsSlot ? 1u : ImmediateStackSlotCount, deadline, slot))
+    {
+        apiv2_logger()->warn("stackTransaction: could not register stack transaction (ref=0x{:08x}): {}",
+            stackRef, ec.message());
+        return pr.completion(ec, nullptr, 0);
+    }
 
-    size_t bytesWritten = 0;
+    checkReaderRunning([&] (const std::error_code &ec)
+    {
+        fullfill_pending_response(readerContext_.pendingStack, stackRef, ec);
+    });
 
-    auto ec = readerContext_.mvlc->write(
-        Pipe::Command,
-        reinterpret_cast<const u8 *>(cmdBuffer.data()),
-        cmdBuffer.size() * sizeof(u32),
-        bytesWritten);
+    const u16 stackOffset = stacks::ImmediateStackStartOffsetBytes
+        + slot * ImmediateStackSlotWords * AddressIncrement;
 
-    // super response
-    if (ec)
+    auto add_exec_commands = [stackOffset] (SuperCommandBuilder &superBuilder)
+    {
+        superBuilder.addWriteLocal(stacks::Stack0OffsetRegister, stackOffset);
+        superBuilder.addWriteLocal(stacks::Stack0TriggerRegister, 1u << stacks::ImmediateShift);
+    };
+
+    auto ignore_response = [] (const std::error_code &, const u32 *, size_t) {};
+
+    if (fitsSlot)
     {
-        // On write error use the same error_code to fullfill both responses.
-        fullfill_pending_response(readerContext_.pendingSuper, ec);
-        return fullfill_pending_response(readerContext_.pendingStack, ec);
+        // The MVLC processes the commands in order, so the stack can be
+        // started right after the upload without waiting for a response. A
+        // failed super transaction fails the stack transaction via the linked
+        // stack reference.
+        u16 ref = readerContext_.nextSuperReference++;
+        SuperCommandBuilder superBuilder;
+        superBuilder.addReferenceWord(ref);
+        superBuilder.addStackUpload(stackBuffer, CommandPipe, stackOffset);
+        add_exec_commands(superBuilder);
+        auto cmdBuffer = make_command_buffer(superBuilder);
+
+        log_buffer(apiv2_logger(), spdlog::level::trace,
+            cmdBuffer, "stackTransaction: 'upload and exec immediate stack' command buffer", LogBuffersMaxWords);
+
+        superTransactionAsync(ref, cmdBuffer, ignore_response, deadline, stackRef);
+        return;
     }
 
-    if (superFuture.wait_for(ResultWaitTimeout) != std::future_status::ready)
+    auto stack_pending = [this, stackRef] ()
     {
-        get_logger("mvlc_apiv2")->warn("stackTransaction super future still not ready -> SuperCommandTimeout (ref=0x{:04X})",
-            readerContext_.pendingSuper.access()->reference);
-        ec = make_error_code(MVLCErrorCode::SuperCommandTimeout);
-        fullfill_pending_response(readerContext_.pendingSuper, ec);
-        return fullfill_pending_response(readerContext_.pendingStack, ec);
+        return readerContext_.pendingStack.access()->entries.count(stackRef) > 0;
+    };
+
+    // Upload the parts one after the other, see makeStackUploadParts(). The
+    // stack is only started once the MVLC confirmed the complete upload,
+    // otherwise parts of a previous immediate stack might get executed.
+    for (const auto &part: parts)
+    {
+        // Do not continue uploading a stack that already failed.
+        if (!stack_pending())
+            return;
+
+        auto promise = std::make_shared<std::promise<std::error_code>>();
+        auto uploadFuture = promise->get_future();
+
+        superTransactionAsync(part.first, part.second,
+            [promise] (const std::error_code &ec, const u32 *, size_t) { promise->set_value(ec); },
+            deadline, stackRef);
+
+        if (uploadFuture.wait_until(deadline) != std::future_status::ready)
+        {
+            fullfill_pending_super(readerContext_, part.first,
+                make_error_code(MVLCErrorCode::SuperCommandTimeout));
+        }
+
+        if (uploadFuture.get())
+            return;
+    }
+
+    if (stack_pending())
+    {
+        u16 execRef = readerContext_.nextSuperReference++;
+        SuperCommandBuilder superBuilder;
+        superBuilder.addReferenceWord(execRef);
+        add_exec_commands(superBuilder);
+        auto execBuffer = make_command_buffer(superBuilder);
+
+        log_buffer(apiv2_logger(), spdlog::level::trace,
+            execBuffer, "stackTransaction: 'exec immediate stack' command buffer", LogBuffersMaxWords);
+
+        superTransactionAsync(execRef, execBuffer, ignore_response, deadline, stackRef);
     }
+}
+
+std::error_code CmdApi::stackTransaction(
+    u32 stackRef, const StackCommandBuilder &stackBuilder,
+    std::vector<u32> &stackResponse)
+{
+    auto promise = std::make_shared<std::promise<std::error_code>>();
+    auto stackFuture = promise->get_future();
+    auto deadline = std::chrono::steady_clock::now() + StackResultWaitTimeout;
 
-    if (auto ec = superFuture.get())
-        return fullfill_pending_response(readerContext_.pendingStack, ec);
+    stackTransactionAsync(stackRef, stackBuilder, make_copying_completion(promise, stackResponse), deadline);
 
-    // stack response
-    if (stackFuture.wait_for(ResultWaitTimeout) != std::future_status::ready)
+    if (stackFuture.wait_until(deadline) != std::future_status::ready)
     {
-        get_logger("mvlc_apiv2")->warn("stackTransaction stack future still not ready -> StackCommandTimeout (ref=0x{:08X})",
-            readerContext_.pendingStack.access()->reference);
-        ec = make_error_code(MVLCErrorCode::StackCommandTimeout);
-        return fullfill_pending_response(readerContext_.pendingStack, ec);
+        apiv2_logger()->warn("stackTransaction stack future still not ready -> StackCommandTimeout (ref=0x{:08X})",
+            stackRef);
+        fullfill_pending_response(readerContext_.pendingStack, stackRef,
+            make_error_code(MVLCErrorCode::StackCommandTimeout));
     }
 
     return stackFuture.get();
 }
 
-std::error_code CmdApi::uploadStack(
-    u8 stackOutputPipe, u16 stackMemoryOffset, const std::vector<u32> &stackContents)
+std::error_code CmdApi::makeStackUploadParts(
+    u8 stackOutputPipe, u16 stackMemoryOffset, const std::vector<u32> &stackContents,
+    std::vector<StackUploadPart> &parts)
 {
     // Uploading a command stack requires writing the following to the stack memory area:
     // - StackStart with the correct output pipe set
@@ -732,14 +1129,11 @@ std::error_code CmdApi::uploadStack(
     static const size_t UsbPartMaxSize = 768;
 
     // Update (230928): when continuously writing, the MVLC firmware can handle
-    // 256 incoming words at a time, so large buffers would have to be split
-    // into max 256 word sized pieces (with buffer start and end words). These
-    // pieces could be written out one after the other, without having to wait
-    // for each individual response. The incoming responses could be read in
-    // parallel while still writing data. The current system with one pending
-    // super and one pending stack response can't handle this (I think). As this
-    // most likely only affects things like MVP firmware updates over VME the
-    // code is not going to be rewritten now.
+    // 256 incoming words at a time. The parts created here can be larger, so
+    // uploadStack() and stackTransactionAsync() wait for the response of each
+    // part before writing the next one. Small immediate stacks are not split
+    // and are uploaded and started without waiting, see
+    // stackTransactionAsync().
 
     const size_t PartMaxSize = (dynamic_cast<usb::MVLC_USB_Interface *>(readerContext_.mvlc)
                                     ? UsbPartMaxSize : EthPartMaxSize);
@@ -750,8 +1144,6 @@ std::error_code CmdApi::uploadStack(
     const auto stackEnd = std::end(stackContents);
     auto partIter = stackBegin;
     u16 writeAddress = stacks::StackMemoryBegin + stackMemoryOffset;
-    std::vector<u32> superResponse;
-    size_t partCount = 0;
 
     while (partIter != stackEnd)
     {
@@ -805,11 +1197,36 @@ std::error_code CmdApi::uploadStack(
         }
 
         auto superBuffer = make_command_buffer(super);
-        logger->trace("stack part #{}: superBuffer.size()={}", partCount+1, superBuffer.size());
-        //log_buffer(logger, spdlog::level::trace, superBuffer, fmt::format("partial stack upload part {}", partCount+1));
+        logger->trace("stack part #{}: superBuffer.size()={}", parts.size()+1, superBuffer.size());
+        //log_buffer(logger, spdlog::level::trace, superBuffer, fmt::format("partial stack upload part {}", parts.size()+1));
         assert(superBuffer.size() <= MirrorTransactionMaxWords);
 
-        if (auto ec = superTransaction(superRef, superBuffer, superResponse))
+        parts.emplace_back(superRef, std::move(superBuffer));
+    }
+
+    assert(partIter == stackEnd);
+    logger->trace("stackWordsWritten={}, stackContents.size()={}, partCount={}",
+                 stackWordsWritten, stackContents.size(), parts.size());
+    assert(stackWordsWritten == stackContents.size());
+
+    return {};
+}
+
+std::error_code CmdApi::uploadStack(
+    u8 stackOutputPipe, u16 stackMemoryOffset, const std::vector<u32> &stackContents)
+{
+    std::vector<StackUploadPart> parts;
+
+    if (auto ec = makeStackUploadParts(stackOutputPipe, stackMemoryOffset, stackContents, parts))
+        return ec;
+
+    auto logger = get_logger("mvlc_uploadStack");
+    std::vector<u32> superResponse;
+    size_t partCount = 0;
+
+    for (const auto &part: parts)
+    {
+        if (auto ec = superTransaction(part.first, part.second, superResponse))
         {
             logger->warn("upload superTransaction for part #{} failed: {}", partCount+1, ec.message());
             return ec;
@@ -820,11 +1237,6 @@ std::error_code CmdApi::uploadStack(
         ++partCount;
     }
 
-    assert(partIter == stackEnd);
-    logger->trace("stackWordsWritten={}, stackContents.size()={}, partCount={}",
-                 stackWordsWritten, stackContents.size(), partCount);
-    assert(stackWordsWritten == stackContents.size());
-
     return {};
 }
 
@@ -887,7 +1299,7 @@ std::error_code CmdApi::vmeRead(
     if (auto ec = stackTransaction(stackRef, stackBuilder, stackResponse))
         return ec;
 
-    log_buffer(get_logger("mvlc"), spdlog::level::trace, stackResponse, "vmeRead(): stackResponse", LogBuffersMaxWords);
+    log_buffer(mvlc_logger(), spdlog::level::trace, stackResponse, "vmeRead(): stackResponse", LogBuffersMaxWords);
 
     if (stackResponse.size() != 3)
         return make_error_code(MVLCErrorCode::UnexpectedResponseSize);
@@ -924,7 +1336,7 @@ std::error_code CmdApi::vmeWrite(
     if (auto ec = stackTransaction(stackRef, stackBuilder, stackResponse))
         return ec;
 
-    log_buffer(get_logger("mvlc"), spdlog::level::trace, stackResponse, "vmeWrite(): stackResponse", LogBuffersMaxWords);
+    log_buffer(mvlc_logger(), spdlog::level::trace, stackResponse, "vmeWrite(): stackResponse", LogBuffersMaxWords);
 
     if (stackResponse.size() != 2)
         return make_error_code(MVLCErrorCode::UnexpectedResponseSize);
@@ -958,7 +1370,7 @@ std::error_code CmdApi::vmeBlockRead(
     if (auto ec = stackTransaction(stackRef, stackBuilder, dest))
         return ec;
 
-    log_buffer(get_logger("mvlc"), spdlog::level::trace, dest, "vmeBlockRead(): stackResponse", LogBuffersMaxWords);
+    log_buffer(mvlc_logger(), spdlog::level::trace, dest, "vmeBlockRead(): stackResponse", LogBuffersMaxWords);
 
     if (!dest.empty())
     {
@@ -989,7 +1401,7 @@ std::error_code CmdApi::vmeBlockRead(
     if (auto ec = stackTransaction(stackRef, stackBuilder, dest))
         return ec;
 
-    log_buffer(get_logger("mvlc"), spdlog::level::trace, dest, "vmeBlockRead(): stackResponse", LogBuffersMaxWords);
+    log_buffer(mvlc_logger(), spdlog::level::trace, dest, "vmeBlockRead(): stackResponse", LogBuffersMaxWords);
 
     if (!dest.empty())
     {
@@ -1020,7 +1432,7 @@ std::error_code CmdApi::vmeBlockReadSwapped(
     if (auto ec = stackTransaction(stackRef, stackBuilder, dest))
         return ec;
 
-    log_buffer(get_logger("mvlc"), spdlog::level::trace, dest, "vmeBlockReadSwapped(): stackResponse", LogBuffersMaxWords);
+    log_buffer(mvlc_logger(), spdlog::level::trace, dest, "vmeBlockReadSwapped(): stackResponse", LogBuffersMaxWords);
 
     if (!dest.empty())
     {
@@ -1051,7 +1463,7 @@ std::error_code CmdApi::vmeBlockReadSwapped(
     if (auto ec = stackTransaction(stackRef, stackBuilder, dest))
         return ec;
 
-    log_buffer(get_logger("mvlc"), spdlog::level::trace, dest, "vmeBlockReadSwapped(): stackResponse", LogBuffersMaxWords);
+    log_buffer(mvlc_logger(), spdlog::level::trace, dest, "vmeBlockReadSwapped(): stackResponse", LogBuffersMaxWords);
 
     if (!dest.empty())
     {
@@ -1070,6 +1482,134 @@ std::error_code CmdApi::vmeBlockReadSwapped(
     return {};
 }
 
+// Returns the error corresponding to the frame flags of a stack response.
+std::error_code stack_frame_flags_error(u32 frameHeader)
+{
+    auto frameFlags = extract_frame_flags(frameHeader);
+
+    if (frameFlags & frame_flags::Timeout)
+        return MVLCErrorCode::NoVMEResponse;
+
+    if (frameFlags & frame_flags::BusError)
+        return MVLCErrorCode::VMEBusError;
+
+    if (frameFlags & frame_flags::SyntaxError)
+        return MVLCErrorCode::StackSyntaxError;
+
+    return {};
+}
+
+std::future<std::pair<u32, std::error_code>> CmdApi::readRegisterAsync(u16 address)
+{
+    u16 ref = readerContext_.nextSuperReference++;
+
+    SuperCommandBuilder scb;
+    scb.addReferenceWord(ref);
+    scb.addReadLocal(address);
+
+    auto promise = std::make_shared<std::promise<std::pair<u32, std::error_code>>>();
+    auto result = promise->get_future();
+
+    superTransactionAsync(ref, make_command_buffer(scb),
+        [promise] (const std::error_code &ec, const u32 *contents, size_t len)
+        {
+            if (ec)
+                promise->set_value(std::make_pair(0u, ec));
+            else if (len != 4)
+                promise->set_value(std::make_pair(0u, make_error_code(MVLCErrorCode::UnexpectedResponseSize)));
+            else
+                promise->set_value(std::make_pair(contents[3], std::error_code{}));
+        },
+        std::chrono::steady_clock::now() + ResultWaitTimeout);
+
+    return result;
+}
+
+std::future<std::error_code> CmdApi::writeRegisterAsync(u16 address, u32 value)
+{
+    u16 ref = readerContext_.nextSuperReference++;
+
+    SuperCommandBuilder scb;
+    scb.addReferenceWord(ref);
+    scb.addWriteLocal(address, value);
+
+    auto promise = std::make_shared<std::promise<std::error_code>>();
+    auto result = promise->get_future();
+
+    superTransactionAsync(ref, make_command_buffer(scb),
+        [promise] (const std::error_code &ec, const u32 *, size_t len)
+        {
+            if (!ec && len != 4)
+                promise->set_value(make_error_code(MVLCErrorCode::UnexpectedResponseSize));
+            else
+                promise->set_value(ec);
+        },
+        std::chrono::steady_clock::now() + ResultWaitTimeout);
+
+    return result;
+}
+
+std::future<std::pair<u32, std::error_code>> CmdApi::vmeReadAsync(
+    u32 address, u8 amod, VMEDataWidth dataWidth)
+{
+    u32 stackRef = readerContext_.nextStackReference++;
+
+    StackCommandBuilder stackBuilder;
+    stackBuilder.addWriteMarker(stackRef);
+    stackBuilder.addVMERead(address, amod, dataWidth);
+
+    auto promise = std::make_shared<std::promise<std::pair<u32, std::error_code>>>();
+    auto result = promise->get_future();
+
+    stackTransactionAsync(stackRef, stackBuilder,
+        [promise, dataWidth] (const std::error_code &ec, const u32 *contents, size_t len)
+        {
+            if (ec)
+                return promise->set_value(std::make_pair(0u, ec));
+
+            if (len != 3)
+                return promise->set_value(std::make_pair(0u, make_error_code(MVLCErrorCode::UnexpectedResponseSize)));
+
+            if (auto ec = stack_frame_flags_error(contents[0]))
+                return promise->set_value(std::make_pair(0u, ec));
+
+            const u32 Mask = (dataWidth == VMEDataWidth::D16 ? 0x0000FFFF : 0xFFFFFFFF);
+
+            promise->set_value(std::make_pair(contents[2] & Mask, std::error_code{}));
+        },
+        std::chrono::steady_clock::now() + StackResultWaitTimeout);
+
+    return result;
+}
+
+std::future<std::error_code> CmdApi::vmeWriteAsync(
+    u32 address, u32 value, u8 amod, VMEDataWidth dataWidth)
+{
+    u32 stackRef = readerContext_.nextStackReference++;
+
+    StackCommandBuilder stackBuilder;
+    stackBuilder.addWriteMarker(stackRef);
+    stackBuilder.addVMEWrite(address, value, amod, dataWidth);
+
+    auto promise = std::make_shared<std::promise<std::error_code>>();
+    auto result = promise->get_future();
+
+    stackTransactionAsync(stackRef, stackBuilder,
+        [promise] (const std::error_code &ec, const u32 *contents, size_t len)
+        {
+            if (ec)
+                return promise->set_value(ec);
+
+            if (len != 2)
+                return promise->set_value(make_error_code(MVLCErrorCode::UnexpectedResponseSize));
+
+            promise->set_value(stack_frame_flags_error(contents[0]));
+        },
+        std::chrono::steady_clock::now() + StackResultWaitTimeout);
+
+    return result;
+}
+
 } // end anon namespace
 
 // ============================================
@@ -1325,6 +1865,30 @@ std::error_code MVLC::vmeWrite(u32 address, u32 value, u8 amod, VMEDataWidth dat
 }
 
 
+std::future<std::pair<u32, std::error_code>> MVLC::readRegisterAsync(u16 address)
+{
+    auto guard = d->locks_.lockCmd();
+    return d->cmdApi_.readRegisterAsync(address);
+}
+
+std::future<std::error_code> MVLC::writeRegisterAsync(u16 address, u32 value)
+{
+    auto guard = d->locks_.lockCmd();
+    return d->cmdApi_.writeRegisterAsync(address, value);
+}
+
+std::future<std::pair<u32, std::error_code>> MVLC::vmeReadAsync(u32 address, u8 amod, VMEDataWidth dataWidth)
+{
+    auto guard = d->locks_.lockCmd();
+    return d->cmdApi_.vmeReadAsync(address, amod, dataWidth);
+}
+
+std::future<std::error_code> MVLC::vmeWriteAsync(u32 address, u32 value, u8 amod, VMEDataWidth dataWidth)
+{
+    auto guard = d->locks_.lockCmd();
+    return d->cmdApi_.vmeWriteAsync(address, value, amod, dataWidth);
+}
+
 std::error_code MVLC::vmeBlockRead(u32 address, u8 amod, u16 maxTransfers, std::vector<u32> &dest, bool fifo)
 {
     auto guard = d->locks_.lockCmd();
@@ -1426,6 +1990,11 @@ std::error_code MVLC::stackTransaction(const StackCommandBuilder &stackBuilder,
     return d->resultCheck(d->cmdApi_.stackTransaction(stackRef, stackBuilder, dest));
 }
 
+u32 MVLC::nextStackReference()
+{
+    return d->cmdApi_.nextStackReference();
+}
+
 std::error_code MVLC::enableJumboFrames(bool b)
 {
     if (!isConnected())
@@ -1445,13 +2014,6 @@ std::pair<bool, std::error_code> MVLC::jumboFramesEnabled()
     return std::make_pair(static_cast<bool>(value), ec);
 }
 
-// Experimental: interact with the low level future/promise/cmd_pipe_reader system.
-//std::future<std::error_code> MVLC::setPendingStackResponse(std::vector<u32> &dest, u32 stackRef)
-//{
-//    auto guard = d->locks_.lockCmd();
-//    return set_pending_response(d->readerContext_.pendingStack, dest, stackRef);
-//}
-
 std::error_code MESYTEC_MVLC_EXPORT redirect_eth_data_stream(MVLC &mvlc)
 {
     if (mvlc.connectionType() != ConnectionType::ETH)
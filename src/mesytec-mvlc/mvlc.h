@@ -28,6 +28,7 @@
 #ifndef __MESYTEC_MVLC_MVLC_H__
 #define __MESYTEC_MVLC_MVLC_H__
 
+#include <future>
 #include <memory>
 #include <vector>
 
@@ -111,6 +112,19 @@ class MESYTEC_MVLC_EXPORT MVLC
         std::error_code vmeRead(u32 address, u32 &value, u8 amod, VMEDataWidth dataWidth);
         std::error_code vmeWrite(u32 address, u32 value, u8 amod, VMEDataWidth dataWidth);
 
+        // Asynchronous register and single word vme api. The transactions
+        // are written out immediately and the returned futures become ready
+        // once the response has been received or the transaction timed out.
+        // Multiple register and VME transactions can be in flight at the same
+        // time. VME transactions are executed via the immediate stack whose
+        // memory is split into a few slots: the calls only block if all slots
+        // are occupied by stacks still waiting for their response.
+        std::future<std::pair<u32, std::error_code>> readRegisterAsync(u16 address);
+        std::future<std::error_code> writeRegisterAsync(u16 address, u32 value);
+
+        std::future<std::pair<u32, std::error_code>> vmeReadAsync(u32 address, u8 amod, VMEDataWidth dataWidth);
+        std::future<std::error_code> vmeWriteAsync(u32 address, u32 value, u8 amod, VMEDataWidth dataWidth);
+
         // BLT, MBLT
         std::error_code vmeBlockRead(u32 address, u8 amod, u16 maxTransfers,
                                      std::vector<u32> &dest, bool fifo = true);
@@ -155,6 +169,11 @@ class MESYTEC_MVLC_EXPORT MVLC
         std::error_code superTransaction(const SuperCommandBuilder &superBuilder, std::vector<u32> &dest);
         std::error_code stackTransaction(const StackCommandBuilder &stackBuilder, std::vector<u32> &dest);
 
+        // Returns a new stack reference value to be used as the marker of a
+        // stackTransaction(). Shares the counter with the internally
+        // generated stack references so the values do not collide.
+        u32 nextStackReference();
+
         // Eth specific
         std::error_code enableJumboFrames(bool b);
         std::pair<bool, std::error_code> jumboFramesEnabled();
@@ -0,0 +1,517 @@
+#include "gtest/gtest.h"
+
+#ifndef __WIN32
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mvlc.h"
+#include "mvlc_command_builders.h"
+#include "mvlc_error.h"
+#include "mvlc_eth_interface.h"
+#include "mvlc_factory.h"
+#include "mvlc_stack_executor.h"
+#include "util/udp_sockets.h"
+#include "vme_constants.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+#ifndef __WIN32
+
+namespace
+{
+
+// VME writes to this address yield a bus error.
+static const u32 BusErrorAddress = 0xdead0000u;
+
+// Local stand-in for the MVLC command pipe. Answers super command buffers by
+// mirroring the commands, keeps the values of written registers and executes
+// the immediate stack. Single word VME writes and reads are performed on a
+// simulated VME address space.
+//
+// If holdCount is set the responder collects that many command buffers (or
+// until a timeout) before answering any of them. This is used to check that
+// transactions are actually in flight at the same time.
+class FakeMVLC
+{
+    public:
+        explicit FakeMVLC(int cmdSock)
+            : cmdSock_(cmdSock)
+            , thread_(&FakeMVLC::loop, this)
+        {}
+
+        ~FakeMVLC()
+        {
+            quit_ = true;
+            if (thread_.joinable())
+                thread_.join();
+        }
+
+        std::atomic<size_t> holdCount{0};
+        std::atomic<size_t> maxBatchSize{0};
+        std::atomic<size_t> requestCount{0};
+
+        std::map<u32, u32> vmeMemory()
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            return vmeMemory_;
+        }
+
+    private:
+        void loop();
+        void handleRequest(const std::vector<u32> &request, const sockaddr_in &srcAddr);
+        void executeImmediateStack(const sockaddr_in &srcAddr);
+        void sendFrame(PacketChannel channel, u16 &packetNumber, const std::vector<u32> &frame,
+                       const sockaddr_in &dest);
+
+        int cmdSock_;
+        std::atomic<bool> quit_{false};
+        std::mutex mutex_;
+        std::map<u16, u32> registers_;
+        std::map<u32, u32> vmeMemory_;
+        u16 cmdPacketNumber_ = 0;
+        u16 stackPacketNumber_ = 0;
+        std::thread thread_;
+};
+
+void FakeMVLC::loop()
+{
+    while (!quit_)
+    {
+        std::vector<std::pair<std::vector<u32>, sockaddr_in>> requests;
+        auto tStart = std::chrono::steady_clock::now();
+
+        do
+        {
+            std::array<u32, 1024> request;
+            size_t bytesTransferred = 0u;
+            sockaddr_in srcAddr = {};
+
+            if (receive_one_packet(cmdSock_, reinterpret_cast<u8 *>(request.data()),
+                                   request.size() * sizeof(u32), bytesTransferred,
+                                   10, &srcAddr))
+                continue;
+
+            const size_t wordCount = bytesTransferred / sizeof(u32);
+
+            if (wordCount >= 2)
+                requests.emplace_back(
+                    std::vector<u32>(request.data(), request.data() + wordCount), srcAddr);
+
+        } while (!quit_ && requests.size() < std::max(holdCount.load(), size_t(1))
+                 && (requests.empty() || std::chrono::steady_clock::now() - tStart < std::chrono::seconds(1)));
+
+        if (requests.empty())
+            continue;
+
+        maxBatchSize = std::max(maxBatchSize.load(), requests.size());
+        requestCount += requests.size();
+
+        for (const auto &req: requests)
+            handleRequest(req.first, req.second);
+    }
+}
+
+void FakeMVLC::handleRequest(const std::vector<u32> &request, const sockaddr_in &srcAddr)
+{
+    std::vector<u32> response = { 0u }; // F1 frame header
+    bool execImmediate = false;
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+
+        // Skip CmdBufferStart and CmdBufferEnd.
+        for (size_t i=1; i<request.size()-1; ++i)
+        {
+            u32 word = request[i];
+            auto cmd = static_cast<SuperCommandType>(word >> super_commands::SuperCmdShift);
+            u16 address = word & super_commands::SuperCmdArgMask;
+            response.push_back(word);
+
+            if (cmd == SuperCommandType::ReadLocal)
+                response.push_back(registers_[address]);
+            else if (cmd == SuperCommandType::WriteLocal && i+1 < request.size()-1)
+            {
+                u32 value = request[++i];
+                response.push_back(value);
+                registers_[address] = value;
+
+                if (address == stacks::Stack0TriggerRegister && (value & (1u << stacks::ImmediateShift)))
+                    execImmediate = true;
+            }
+        }
+    }
+
+    response[0] = (static_cast<u32>(frame_headers::SuperFrame) << frame_headers::TypeShift) | (response.size() - 1);
+    sendFrame(PacketChannel::Command, cmdPacketNumber_, response, srcAddr);
+
+    if (execImmediate)
+        executeImmediateStack(srcAddr);
+}
+
+void FakeMVLC::executeImmediateStack(const sockaddr_in &srcAddr)
+{
+    std::vector<u32> stackBuffer;
+    u8 frameFlags = 0u;
+    std::vector<u32> response = { 0u }; // F3 frame header
+
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+
+        u16 address = stacks::StackMemoryBegin + registers_[stacks::Stack0OffsetRegister];
+        address += AddressIncrement; // skip StackStart
+
+        for (; address < stacks::StackMemoryEnd; address += AddressIncrement)
+        {
+            u32 word = registers_[address];
+
+            if ((word >> stack_commands::CmdShift) == static_cast<u32>(StackCommandType::StackEnd))
+                break;
+
+            stackBuffer.push_back(word);
+        }
+
+        for (const auto &cmd: stack_commands_from_buffer(stackBuffer))
+        {
+            switch (cmd.type)
+            {
+                case StackCommand::CommandType::WriteMarker:
+                    response.push_back(cmd.value);
+                    break;
+
+                case StackCommand::CommandType::VMEWrite:
+                    if (cmd.address == BusErrorAddress)
+                        frameFlags |= frame_flags::BusError;
+                    else
+                        vmeMemory_[cmd.address] = cmd.value;
+                    break;
+
+                case StackCommand::CommandType::VMERead:
+                    // Failed reads yield 0xffffff00 plus the stack line number.
+                    if (cmd.address == BusErrorAddress)
+                    {
+                        frameFlags |= frame_flags::BusError;
+                        response.push_back(0xffffff00u | (response.size() & 0xffu));
+                    }
+                    else
+                        response.push_back(vmeMemory_[cmd.address]);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+    }
+
+    response[0] = (static_cast<u32>(frame_headers::StackFrame) << frame_headers::TypeShift)
+        | (static_cast<u32>(frameFlags) << frame_headers::FrameFlagsShift)
+        | (response.size() - 1);
+
+    sendFrame(PacketChannel::Stack, stackPacketNumber_, response, srcAddr);
+}
+
+void FakeMVLC::sendFrame(PacketChannel channel, u16 &packetNumber, const std::vector<u32> &frame,
+                         const sockaddr_in &dest)
+{
+    std::vector<u32> packet = { make_header0(channel, packetNumber++, frame.size()), 0u };
+    std::copy(std::begin(frame), std::end(frame), std::back_inserter(packet));
+
+    ::sendto(cmdSock_, reinterpret_cast<const char *>(packet.data()), packet.size() * sizeof(u32), 0,
+             reinterpret_cast<const sockaddr *>(&dest), sizeof(dest));
+}
+
+}
+
+class MVLCPipelinedTest: public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            std::error_code ec;
+            fakeCmdSock_ = bind_udp_socket(CommandPort, &ec);
+
+            if (fakeCmdSock_ < 0)
+                GTEST_SKIP() << "could not bind the MVLC command port on localhost: " << ec.message();
+
+            fake_ = std::make_unique<FakeMVLC>(fakeCmdSock_);
+            mvlc_ = make_mvlc_eth("127.0.0.1");
+            ASSERT_FALSE(mvlc_.connect());
+        }
+
+        void TearDown() override
+        {
+            if (mvlc_)
+                mvlc_.disconnect();
+            fake_.reset();
+            if (fakeCmdSock_ >= 0)
+                close_socket(fakeCmdSock_);
+        }
+
+        int fakeCmdSock_ = -1;
+        std::unique_ptr<FakeMVLC> fake_;
+        MVLC mvlc_;
+};
+
+TEST_F(MVLCPipelinedTest, RegisterTransactionsInFlight)
+{
+    static const size_t TransactionCount = 8;
+
+    // The fake only answers once all register writes have been received which
+    // requires them to be in flight at the same time.
+    fake_->holdCount = TransactionCount;
+    fake_->maxBatchSize = 0;
+
+    std::vector<std::future<std::error_code>> writeFutures;
+
+    for (size_t i=0; i<TransactionCount; ++i)
+        writeFutures.emplace_back(mvlc_.writeRegisterAsync(0x1000 + i * AddressIncrement, 100 + i));
+
+    for (auto &f: writeFutures)
+        ASSERT_FALSE(f.get());
+
+    ASSERT_EQ(fake_->maxBatchSize, TransactionCount);
+
+    std::vector<std::future<std::pair<u32, std::error_code>>> readFutures;
+
+    for (size_t i=0; i<TransactionCount; ++i)
+        readFutures.emplace_back(mvlc_.readRegisterAsync(0x1000 + i * AddressIncrement));
+
+    for (size_t i=0; i<TransactionCount; ++i)
+    {
+        auto result = readFutures[i].get();
+        ASSERT_FALSE(result.second) << result.second.message();
+        ASSERT_EQ(result.first, 100 + i);
+    }
+
+    fake_->holdCount = 0;
+
+    // The blocking api still works and sees the same state.
+    u32 value = 0;
+    ASSERT_FALSE(mvlc_.readRegister(0x1000, value));
+    ASSERT_EQ(value, 100u);
+}
+
+TEST_F(MVLCPipelinedTest, VMEWriteAsync)
+{
+    static const size_t WriteCount = 200;
+    static const u32 BaseAddress = 0x01000000u;
+
+    std::vector<std::future<std::error_code>> writeFutures;
+
+    for (size_t i=0; i<WriteCount; ++i)
+    {
+        writeFutures.emplace_back(mvlc_.vmeWriteAsync(
+            BaseAddress + i * 2, i, vme_amods::A32, VMEDataWidth::D16));
+    }
+
+    for (auto &f: writeFutures)
+        ASSERT_FALSE(f.get());
+
+    auto vmeMemory = fake_->vmeMemory();
+    ASSERT_EQ(vmeMemory.size(), WriteCount);
+
+    for (size_t i=0; i<WriteCount; ++i)
+        ASSERT_EQ(vmeMemory[BaseAddress + i * 2], i);
+
+    for (size_t i=0; i<WriteCount; i += 50)
+    {
+        auto result = mvlc_.vmeReadAsync(BaseAddress + i * 2, vme_amods::A32, VMEDataWidth::D16).get();
+        ASSERT_FALSE(result.second) << result.second.message();
+        ASSERT_EQ(result.first, i);
+    }
+
+    // VME errors are reported through the future of the failing write only.
+    auto f0 = mvlc_.vmeWriteAsync(BaseAddress, 42, vme_amods::A32, VMEDataWidth::D16);
+    auto f1 = mvlc_.vmeWriteAsync(BusErrorAddress, 1, vme_amods::A32, VMEDataWidth::D16);
+    auto f2 = mvlc_.vmeWriteAsync(BaseAddress + 2, 43, vme_amods::A32, VMEDataWidth::D16);
+
+    ASSERT_FALSE(f0.get());
+    ASSERT_EQ(f1.get(), MVLCErrorCode::VMEBusError);
+    ASSERT_FALSE(f2.get());
+
+    u32 value = 0;
+    ASSERT_FALSE(mvlc_.vmeRead(BaseAddress + 2, value, vme_amods::A32, VMEDataWidth::D16));
+    ASSERT_EQ(value, 43u);
+}
+
+TEST_F(MVLCPipelinedTest, StackUploadedAndStartedInOneBuffer)
+{
+    // Small stacks are uploaded and started with a single command buffer, so
+    // the stack can never be started before the upload has been processed.
+    const size_t requestsBefore = fake_->requestCount;
+
+    ASSERT_FALSE(mvlc_.vmeWriteAsync(0x01000000u, 42, vme_amods::A32, VMEDataWidth::D16).get());
+    ASSERT_EQ(fake_->requestCount - requestsBefore, 1u);
+    ASSERT_EQ(fake_->vmeMemory()[0x01000000u], 42u);
+}
+
+TEST_F(MVLCPipelinedTest, StacksInFlight)
+{
+    static const size_t StacksInFlight = 4;
+    static const u32 BaseAddress = 0x03000000u;
+
+    // The fake only answers once a stack for each of the immediate stack
+    // slots has been received.
+    fake_->holdCount = StacksInFlight;
+    fake_->maxBatchSize = 0;
+
+    std::vector<std::future<std::error_code>> writeFutures;
+
+    for (size_t i=0; i<StacksInFlight * 3; ++i)
+    {
+        writeFutures.emplace_back(mvlc_.vmeWriteAsync(
+            BaseAddress + i * 2, i, vme_amods::A32, VMEDataWidth::D16));
+    }
+
+    for (auto &f: writeFutures)
+        ASSERT_FALSE(f.get());
+
+    ASSERT_EQ(fake_->maxBatchSize, StacksInFlight);
+
+    fake_->holdCount = 0;
+
+    // A stack not fitting into a single slot uses the whole immediate stack
+    // area and still sees the memory written by the small stacks.
+    StackCommandBuilder stack;
+    stack.addWriteMarker(mvlc_.nextStackReference());
+
+    for (size_t i=0; i<StacksInFlight * 3; ++i)
+        stack.addVMERead(BaseAddress + i * 2, vme_amods::A32, VMEDataWidth::D16);
+
+    for (size_t i=0; i<100; ++i)
+        stack.addVMEWrite(BaseAddress + 0x1000 + i * 2, i, vme_amods::A32, VMEDataWidth::D16);
+
+    std::vector<u32> response;
+    ASSERT_FALSE(mvlc_.stackTransaction(stack, response));
+    ASSERT_EQ(response.size(), 2 + StacksInFlight * 3);
+
+    for (size_t i=0; i<StacksInFlight * 3; ++i)
+        ASSERT_EQ(response[2 + i], i);
+
+    ASSERT_EQ(fake_->vmeMemory()[BaseAddress + 0x1000 + 99 * 2], 99u);
+}
+
+TEST_F(MVLCPipelinedTest, DisconnectFailsPendingTransactions)
+{
+    // The fake never answers within the test, the pending transaction is
+    // failed when the command pipe reader stops.
+    fake_->holdCount = 1000;
+
+    auto f = mvlc_.readRegisterAsync(0x1000);
+    ASSERT_FALSE(mvlc_.disconnect());
+    ASSERT_EQ(f.get().second, MVLCErrorCode::IsDisconnected);
+
+    // Issuing on a disconnected instance fails right away.
+    ASSERT_EQ(mvlc_.writeRegisterAsync(0x1000, 1).get(), MVLCErrorCode::IsDisconnected);
+}
+
+TEST_F(MVLCPipelinedTest, RunCommandsBatched)
+{
+    static const size_t WriteCount = 300;
+    static const u32 BaseAddress = 0x02000000u;
+
+    StackCommandBuilder stack;
+
+    for (size_t i=0; i<WriteCount; ++i)
+        stack.addVMEWrite(BaseAddress + i * 2, i, vme_amods::A32, VMEDataWidth::D16);
+
+    stack.addSoftwareDelay(std::chrono::milliseconds(1));
+
+    for (size_t i=0; i<WriteCount; i += 10)
+        stack.addVMERead(BaseAddress + i * 2, vme_amods::A32, VMEDataWidth::D16);
+
+    const auto commands = stack.getCommands();
+    const size_t requestsBefore = fake_->requestCount;
+
+    auto results = run_commands(mvlc_, stack);
+
+    ASSERT_EQ(results.size(), commands.size());
+
+    for (size_t i=0; i<results.size(); ++i)
+    {
+        ASSERT_EQ(results[i].cmd, commands[i]);
+        ASSERT_FALSE(results[i].ec) << results[i].ec.message();
+
+        if (commands[i].type == StackCommand::CommandType::VMERead)
+        {
+            ASSERT_EQ(results[i].response.size(), 1u);
+            ASSERT_EQ(results[i].response[0], (commands[i].address - BaseAddress) / 2);
+        }
+    }
+
+    // Executing each command on its own takes two command buffers per
+    // command (stack upload and start).
+    const size_t requests = fake_->requestCount - requestsBefore;
+    ASSERT_LT(requests, 30u);
+}
+
+TEST_F(MVLCPipelinedTest, RunCommandsBatchedVMEError)
+{
+    StackCommandBuilder stack;
+    stack.addVMEWrite(0x1000, 1, vme_amods::A32, VMEDataWidth::D16);
+    stack.addVMEWrite(BusErrorAddress, 1, vme_amods::A32, VMEDataWidth::D16);
+    stack.addVMEWrite(0x1002, 1, vme_amods::A32, VMEDataWidth::D16);
+    stack.addSoftwareDelay(std::chrono::milliseconds(1));
+    stack.addVMEWrite(0x1004, 1, vme_amods::A32, VMEDataWidth::D16);
+    stack.addVMEWrite(0x1006, 1, vme_amods::A32, VMEDataWidth::D16);
+
+    // The error aborts execution after the failed batch.
+    {
+        auto results = run_commands(mvlc_, stack);
+
+        ASSERT_EQ(results.size(), 3u);
+        ASSERT_EQ(get_first_error(results), MVLCErrorCode::VMEBusError);
+        ASSERT_EQ(fake_->vmeMemory().count(0x1004), 0u);
+    }
+
+    {
+        CommandExecOptions options;
+        options.continueOnVMEError = true;
+
+        auto results = run_commands(mvlc_, stack, options);
+
+        ASSERT_EQ(results.size(), stack.getCommands().size());
+        ASSERT_EQ(results[1].ec, MVLCErrorCode::VMEBusError);
+        ASSERT_FALSE(results[4].ec);
+        ASSERT_FALSE(results[5].ec);
+        ASSERT_EQ(fake_->vmeMemory().count(0x1006), 1u);
+    }
+
+    // Without batching the error is attributed to the failing command only.
+    {
+        CommandExecOptions options;
+        options.noBatching = true;
+
+        auto results = run_commands(mvlc_, stack, options);
+
+        ASSERT_EQ(results.size(), 2u);
+        ASSERT_FALSE(results[0].ec);
+        ASSERT_EQ(results[1].ec, MVLCErrorCode::VMEBusError);
+    }
+
+    // A failed read inside a batch is attributed to the read only.
+    {
+        StackCommandBuilder readStack;
+        readStack.addVMEWrite(0x1000, 2, vme_amods::A32, VMEDataWidth::D16);
+        readStack.addVMERead(BusErrorAddress, vme_amods::A32, VMEDataWidth::D32);
+        readStack.addVMERead(0x1000, vme_amods::A32, VMEDataWidth::D16);
+
+        auto results = run_commands(mvlc_, readStack);
+
+        ASSERT_EQ(results.size(), 3u);
+        ASSERT_FALSE(results[0].ec);
+        ASSERT_EQ(results[1].ec, MVLCErrorCode::VMEBusError);
+        ASSERT_FALSE(results[2].ec);
+        ASSERT_EQ(results[2].response, std::vector<u32>{ 2u });
+    }
+}
+
+#endif // !__WIN32
@@ -1,23 +1,157 @@
 #include "mesytec-mvlc/mvlc_blocking_data_api.h"
 
 #include "util/logging.h"
+#include "util/storage_sizes.h"
 
 namespace mesytec
 {
 namespace mvlc
 {
 
+// Limits for the number of events and the amount of data buffered in a single
+// event arena. The parser thread blocks if the filling arena is full.
+static const size_t BlockingApiArenaMaxEvents = 4096;
+static const size_t BlockingApiArenaMaxBytes = util::Megabytes(4);
+// Marks module data entries without data in the arena.
+static const size_t BlockingApiArenaNoOffset = static_cast<size_t>(-1);
+
+// Copies of parsed events. The parser thread appends to one arena while the
+// consumer reads from the other one. While filling, data is referenced by
+// offsets as the vectors may grow. Pointers are resolved when the arena is
+// handed over to the consumer. Clearing keeps the allocated memory.
+struct EventArena
+{
+    std::vector<u32> data;
+    std::vector<readout_parser::ModuleData> moduleData;
+    // Offsets of the module data into 'data' or BlockingApiArenaNoOffset
+    // for null data.
+    std::vector<size_t> moduleDataOffsets;
+    std::vector<EventContainer> events;
+    // Per event: offset into 'moduleData' for readout events, into 'data' for
+    // system events.
+    std::vector<size_t> eventOffsets;
+
+    bool empty() const { return events.empty(); }
+
+    bool full() const
+    {
+        // A single large event is always accepted by an empty arena.
+        return !empty() && (events.size() >= BlockingApiArenaMaxEvents
+                            || data.size() * sizeof(u32) >= BlockingApiArenaMaxBytes);
+    }
+
+    void addReadoutEvent(int eventIndex, const readout_parser::ModuleData *moduleDataList, unsigned moduleCount)
+    {
+        eventOffsets.push_back(moduleData.size());
+
+        for (unsigned mi=0; mi<moduleCount; ++mi)
+        {
+            const auto &md = moduleDataList[mi];
+
+            moduleData.push_back(md);
+
+            if (md.data.data)
+            {
+                moduleDataOffsets.push_back(data.size());
+                data.insert(data.end(), md.data.data, md.data.data + md.data.size);
+            }
+            else
+                moduleDataOffsets.push_back(BlockingApiArenaNoOffset);
+        }
+
+        EventContainer event = {};
+        event.type = EventContainer::Type::Readout;
+        event.readout = { eventIndex, nullptr, moduleCount };
+        events.push_back(event);
+    }
+
+    void addSystemEvent(const u32 *header, u32 size)
+    {
+        eventOffsets.push_back(data.size());
+        data.insert(data.end(), header, header + size);
+
+        EventContainer event = {};
+        event.type = EventContainer::Type::System;
+        event.system = { nullptr, size };
+        events.push_back(event);
+    }
+
+    // Turns the stored offsets into pointers. Must be called after the
+    // arena has been filled and before handing out the events.
+    void resolve()
+    {
+        for (size_t i=0; i<moduleData.size(); ++i)
+        {
+            if (moduleDataOffsets[i] != BlockingApiArenaNoOffset)
+                moduleData[i].data.data = data.data() + moduleDataOffsets[i];
+        }
+
+        for (size_t i=0; i<events.size(); ++i)
+        {
+            auto &event = events[i];
+
+            if (event.type == EventContainer::Type::Readout)
+                event.readout.moduleDataList = moduleData.data() + eventOffsets[i];
+            else if (event.type == EventContainer::Type::System)
+                event.system.header = data.data() + eventOffsets[i];
+        }
+    }
+
+    void clear()
+    {
+        data.clear();
+        moduleData.clear();
+        moduleDataOffsets.clear();
+        events.clear();
+        eventOffsets.clear();
+    }
+};
+
+// Double buffered event handover between the parser thread and the caller of
+// next_events(). The parser copies events into the filling arena and only
+// blocks if that arena is full. The consumer swaps the filling arena with its
+// own arena once it has handed out all of its events.
 struct BlockingContext
 {
     std::mutex mutex_;
-    std::condition_variable cv_;
-    bool ready_ = false;    // true if there is an event available to be processed
-    bool processed_ = true; // true if the current event has been processed
-    EventContainer event_;
+    std::condition_variable producerCv_;    // parser waits for space in the filling arena
+    std::condition_variable consumerCv_;    // consumer waits for events
+    bool producerWaiting_ = false;
+    bool consumerWaiting_ = false;
+    bool done_ = false;                     // set by the monitor once the parser has quit
+    EventArena filling_;
+
+    // Owned by the consumer. Not protected by the mutex.
+    EventArena consumerArena_;
+    size_t consumerPos_ = 0;                // index of the next event to hand out
 };
 
 namespace
 {
+    // Waits for space in the filling arena, then calls f() to append to it.
+    template<typename F>
+    void add_event_blocking(BlockingContext &ctx, F f)
+    {
+        std::unique_lock<std::mutex> lock(ctx.mutex_);
+
+        if (ctx.filling_.full())
+        {
+            ctx.producerWaiting_ = true;
+            ctx.producerCv_.wait(lock, [&ctx] { return !ctx.filling_.full(); });
+            ctx.producerWaiting_ = false;
+        }
+
+        f(ctx.filling_);
+
+        // Only notify if the consumer is actually waiting. Otherwise it picks
+        // up the events on its next call without a context switch.
+        if (ctx.consumerWaiting_)
+        {
+            lock.unlock();
+            ctx.consumerCv_.notify_one();
+        }
+    }
+
     // Readout parser callback for event data
     void event_data_blocking(
         void *userContext,
@@ -28,23 +162,10 @@ namespace
     {
         auto &ctx = *reinterpret_cast<BlockingContext *>(userContext);
 
+        add_event_blocking(ctx, [&] (EventArena &arena)
         {
-            // Wait until the last event has been processed.
-            std::unique_lock<std::mutex> lock(ctx.mutex_);
-            ctx.cv_.wait(lock, [&ctx] { return ctx.processed_; });
-
-            // Copy the callback args into the context event structure.
-            ctx.event_.type = EventContainer::Type::Readout;
-            ctx.event_.readout = { eventIndex, moduleDataList, moduleCount };
-            ctx.event_.system = {};
-
-            // Update state
-            ctx.ready_ = true;
-            ctx.processed_ = false;
-        }
-
-        // Notify the main thread (blocked in next_event()).
-        ctx.cv_.notify_one();
+            arena.addReadoutEvent(eventIndex, moduleDataList, moduleCount);
+        });
     }
 
     // Readout parser callback for system events
@@ -56,23 +177,73 @@ namespace
     {
         auto &ctx = *reinterpret_cast<BlockingContext *>(userContext);
 
+        add_event_blocking(ctx, [&] (EventArena &arena)
+        {
+            arena.addSystemEvent(header, size);
+        });
+    }
+
+    // Hands out up to maxEvents events from the consumer arena. If it has
+    // been fully handed out, waits for the parser to fill the other arena and
+    // swaps them. Returns an empty batch once the readout/replay is done.
+    EventBatch next_events(BlockingContext &ctx, size_t maxEvents)
+    {
+        maxEvents = std::max(maxEvents, static_cast<size_t>(1u));
+
+        if (ctx.consumerPos_ >= ctx.consumerArena_.events.size())
         {
-            // Wait until the last event has been processed.
             std::unique_lock<std::mutex> lock(ctx.mutex_);
-            ctx.cv_.wait(lock, [&ctx] { return ctx.processed_; });
 
-            // Copy the callback args into the context event structure.
-            ctx.event_.type = EventContainer::Type::System;
-            ctx.event_.readout = {};
-            ctx.event_.system = { header, size };
+            if (ctx.filling_.empty() && !ctx.done_)
+            {
+                ctx.consumerWaiting_ = true;
+                ctx.consumerCv_.wait(lock, [&ctx] { return !ctx.filling_.empty() || ctx.done_; });
+                ctx.consumerWaiting_ = false;
+            }
+
+            if (ctx.filling_.empty())
+            {
+                assert(ctx.done_);
+                return {};
+            }
+
+            // The previously handed out events are released here.
+            ctx.consumerArena_.clear();
+            std::swap(ctx.consumerArena_, ctx.filling_);
+            ctx.consumerPos_ = 0;
 
-            // Update state
-            ctx.ready_ = true;
-            ctx.processed_ = false;
+            const bool notifyProducer = ctx.producerWaiting_;
+            lock.unlock();
+
+            if (notifyProducer)
+                ctx.producerCv_.notify_one();
+
+            ctx.consumerArena_.resolve();
         }
 
-        // Notify the main thread (blocked in next_event()).
-        ctx.cv_.notify_one();
+        const auto &events = ctx.consumerArena_.events;
+        EventBatch result;
+        result.events = events.data() + ctx.consumerPos_;
+        result.size = std::min(maxEvents, events.size() - ctx.consumerPos_);
+        ctx.consumerPos_ += result.size;
+        return result;
+    }
+
+    EventContainer next_event(BlockingContext &ctx)
+    {
+        auto batch = next_events(ctx, 1);
+
+        if (batch.empty())
+            return {};
+
+        return batch[0];
+    }
+
+    // Resets the end of data flag before a (re)start.
+    void reset_done(BlockingContext &ctx)
+    {
+        std::unique_lock<std::mutex> lock(ctx.mutex_);
+        ctx.done_ = false;
     }
 
     // Generic monitor function working with both ReadoutWorker and
@@ -108,26 +279,17 @@ namespace
         if (parserThread.joinable())
             parserThread.join();
 
-        logger->debug("monitor() creating final event and notifying main");
+        logger->debug("monitor() setting the done flag and notifying main");
 
+        // Events still in the filling arena are handed out before the consumer
+        // sees the end of data.
         {
-            // Wait until the last event has been processed.
             std::unique_lock<std::mutex> lock(ctx.mutex_);
-            ctx.cv_.wait(lock, [&ctx] { return ctx.processed_; });
-
-            // Setup the special 'None' event type so that the main loop knows it's
-            // time to quit.
-            ctx.event_.type = EventContainer::Type::None;
-            ctx.event_.readout = {};
-            ctx.event_.system = {};
-
-            // Update state
-            ctx.ready_ = true;
-            ctx.processed_ = false;
+            ctx.done_ = true;
         }
 
-        // Notify the main thread (blocked in next_event()).
-        ctx.cv_.notify_one();
+        // Notify the main thread (possibly blocked in next_events()).
+        ctx.consumerCv_.notify_one();
 
         logger->debug("monitor() done");
     }
@@ -172,6 +334,8 @@ std::error_code BlockingReadout::start(const std::chrono::seconds &timeToRun)
     if (d->monitorThread.joinable())
         d->monitorThread.join();
 
+    reset_done(*d->ctx_);
+
     d->monitorThread = std::thread(
         monitor<ReadoutWorker>,
         std::ref(d->rdo_->readoutWorker()),
@@ -289,28 +453,12 @@ BlockingReadout make_mvlc_readout_blocking(
 
 EventContainer next_event(BlockingReadout &br)
 {
-    auto &ctx = *br.d->ctx_;
-
-    // Notify the parser that the current event has been processed and the data
-    // may be discarded.
-    {
-        std::unique_lock<std::mutex> lock(ctx.mutex_);
-        ctx.ready_ = false;
-        ctx.processed_ = true;
-    }
-
-    ctx.cv_.notify_one();
-
-    // Wait for the parser to fill the event structure with data from the next
-    // event.
-    {
-        std::unique_lock<std::mutex> lock(ctx.mutex_);
-        ctx.cv_.wait(lock, [&ctx] { return ctx.ready_; });
-        assert(ctx.ready_);
-        assert(!ctx.processed_);
-    }
+    return next_event(*br.d->ctx_);
+}
 
-    return ctx.event_;
+EventBatch next_events(BlockingReadout &br, size_t maxEvents)
+{
+    return next_events(*br.d->ctx_, maxEvents);
 }
 
 // replay
@@ -352,6 +500,8 @@ std::error_code BlockingReplay::start()
     if (d->monitorThread.joinable())
         d->monitorThread.join();
 
+    reset_done(*d->ctx_);
+
     d->monitorThread = std::thread(
         monitor<ReplayWorker>,
         std::ref(d->rdo_->replayWorker()),
@@ -439,28 +589,12 @@ BlockingReplay make_mvlc_replay_blocking(
 
 EventContainer next_event(BlockingReplay &br)
 {
-    auto &ctx = *br.d->ctx_;
-
-    // Notify the parser that the current event has been processed and the data
-    // may be discarded.
-    {
-        std::unique_lock<std::mutex> lock(ctx.mutex_);
-        ctx.ready_ = false;
-        ctx.processed_ = true;
-    }
-
-    ctx.cv_.notify_one();
-
-    // Wait for the parser to fill the event structure with data from the next
-    // event.
-    {
-        std::unique_lock<std::mutex> lock(ctx.mutex_);
-        ctx.cv_.wait(lock, [&ctx] { return ctx.ready_; });
-        assert(ctx.ready_);
-        assert(!ctx.processed_);
-    }
+    return next_event(*br.d->ctx_);
+}
 
-    return ctx.event_;
+EventBatch next_events(BlockingReplay &br, size_t maxEvents)
+{
+    return next_events(*br.d->ctx_, maxEvents);
 }
 
 }
@@ -46,6 +46,21 @@ struct MESYTEC_MVLC_EXPORT EventContainer
     }
 };
 
+// A batch of events returned by next_events(). The events and the module data
+// they point to stay valid until the next call to next_events() or
+// next_event() on the same object. An empty batch signals the end of the
+// readout/replay.
+struct MESYTEC_MVLC_EXPORT EventBatch
+{
+    const EventContainer *events = nullptr;
+    size_t size = 0u;
+
+    bool empty() const { return size == 0u; }
+    const EventContainer *begin() const { return events; }
+    const EventContainer *end() const { return events + size; }
+    const EventContainer &operator[](size_t index) const { return events[index]; }
+};
+
 // readout
 
 class MESYTEC_MVLC_EXPORT BlockingReadout
@@ -86,6 +101,7 @@ class MESYTEC_MVLC_EXPORT BlockingReadout
             const std::shared_ptr<listfile::WriteHandle> &listfileWriteHandle);
 
         friend EventContainer next_event(BlockingReadout &br);
+        friend EventBatch next_events(BlockingReadout &br, size_t maxEvents);
 };
 
 BlockingReadout MESYTEC_MVLC_EXPORT make_mvlc_readout_blocking(
@@ -106,6 +122,11 @@ BlockingReadout MESYTEC_MVLC_EXPORT make_mvlc_readout_blocking(
     const CrateConfig &crateConfig,
     const std::shared_ptr<listfile::WriteHandle> &listfileWriteHandle);
 
+// The parser thread copies events into a double buffered event arena and only
+// blocks if the arena is full. next_events() hands out up to maxEvents events
+// at a time, next_event() is a convenience wrapper returning a single event
+// and a Type::None event at the end of the readout.
+EventBatch MESYTEC_MVLC_EXPORT next_events(BlockingReadout &br, size_t maxEvents = 1024);
 EventContainer MESYTEC_MVLC_EXPORT next_event(BlockingReadout &br);
 
 
@@ -143,6 +164,7 @@ class MESYTEC_MVLC_EXPORT BlockingReplay
             listfile::ReadHandle *lfh);
 
         friend EventContainer next_event(BlockingReplay &br);
+        friend EventBatch next_events(BlockingReplay &br, size_t maxEvents);
 };
 
 BlockingReplay MESYTEC_MVLC_EXPORT make_mvlc_replay_blocking(
@@ -155,6 +177,7 @@ BlockingReplay MESYTEC_MVLC_EXPORT make_mvlc_replay_blocking(
 BlockingReplay MESYTEC_MVLC_EXPORT make_mvlc_replay_blocking(
     listfile::ReadHandle *lfh);
 
+EventBatch MESYTEC_MVLC_EXPORT next_events(BlockingReplay &br, size_t maxEvents = 1024);
 EventContainer MESYTEC_MVLC_EXPORT next_event(BlockingReplay &br);
 
 }
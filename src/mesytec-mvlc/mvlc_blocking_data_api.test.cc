@@ -0,0 +1,129 @@
+#include <fstream>
+
+#include "gtest/gtest.h"
+
+#include "mvlc_blocking_data_api.h"
+#include "mvlc_listfile_mmap.h"
+#include "mvlc_listfile_util.h"
+#include "mvlc_util.h"
+#include "vme_constants.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::listfile;
+
+namespace
+{
+
+static const u32 ModuleDataWords = 16;
+
+// USB listfile containing eventCount readout events of a single module. The
+// module data words of event n are n << 8 | word index.
+std::vector<u8> make_listfile(size_t eventCount)
+{
+    StackCommandBuilder readoutStack;
+    readoutStack.beginGroup("module0");
+    readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+
+    CrateConfig crateConfig;
+    crateConfig.connectionType = ConnectionType::USB;
+    crateConfig.stacks = { readoutStack };
+
+    BufferedWriteHandle writeHandle;
+    listfile_write_preamble(writeHandle, crateConfig);
+
+    std::vector<u32> frame;
+
+    for (u32 n=0; n<eventCount; ++n)
+    {
+        frame.clear();
+        frame.push_back(make_frame_header(frame_headers::StackFrame, ModuleDataWords + 1, 1));
+        frame.push_back(make_frame_header(frame_headers::BlockRead, ModuleDataWords));
+
+        for (u32 i=0; i<ModuleDataWords; ++i)
+            frame.push_back((n << 8) | i);
+
+        writeHandle.write(reinterpret_cast<const u8 *>(frame.data()), frame.size() * sizeof(u32));
+    }
+
+    listfile_write_system_event(writeHandle, crateConfig.crateId, system_event::subtype::EndOfFile);
+
+    return writeHandle.getBuffer();
+}
+
+}
+
+// Replays more events than fit into a single event arena and more data than
+// fits into a single readout buffer. Checks that the module data pointers of
+// every batch are resolved against the current arena, also after the arenas
+// have been swapped and reused several times.
+TEST(mvlc_blocking_data_api, ReplayNextEvents)
+{
+    // ~1.4 MB of event data: more than one 1 MB replay buffer and more than
+    // four arenas of 4096 events.
+    const size_t EventCount = 20000;
+    const auto data = make_listfile(EventCount);
+    const std::string filename = "mvlc_blocking_data_api.test.ReplayNextEvents.mvlclst";
+
+    {
+        std::ofstream out(filename, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    MappedListfile listfile;
+    listfile.openFile(filename);
+    ASSERT_TRUE(listfile.isOpen());
+
+    auto replay = make_mvlc_replay_blocking(listfile.readHandle());
+    ASSERT_FALSE(replay.start());
+
+    size_t readoutEvents = 0;
+    size_t systemEvents = 0;
+    size_t arenaSwitches = 0;
+    const EventContainer *prevEnd = nullptr;
+
+    while (true)
+    {
+        auto batch = next_events(replay, 1000);
+
+        if (batch.empty())
+            break;
+
+        ASSERT_LE(batch.size, 1000u);
+
+        // Consecutive batches from the same arena are adjacent.
+        if (batch.begin() != prevEnd)
+            ++arenaSwitches;
+        prevEnd = batch.end();
+
+        for (const auto &event: batch)
+        {
+            if (event.type == EventContainer::Type::System)
+            {
+                ASSERT_NE(event.system.header, nullptr);
+                ASSERT_EQ(get_frame_type(event.system.header[0]), frame_headers::SystemEvent);
+                ++systemEvents;
+                continue;
+            }
+
+            ASSERT_EQ(event.type, EventContainer::Type::Readout);
+            ASSERT_EQ(event.readout.eventIndex, 0);
+            ASSERT_EQ(event.readout.moduleCount, 1u);
+
+            const auto &md = event.readout.moduleDataList[0];
+            ASSERT_EQ(md.data.size, ModuleDataWords);
+
+            for (u32 i=0; i<ModuleDataWords; ++i)
+                ASSERT_EQ(md.data.data[i], (readoutEvents << 8) | i) << "event " << readoutEvents;
+
+            ++readoutEvents;
+        }
+    }
+
+    ASSERT_EQ(readoutEvents, EventCount);
+    ASSERT_GE(systemEvents, 1u);
+    ASSERT_GE(arenaSwitches, EventCount / 4096);
+
+    // The end of the replay is signaled repeatedly.
+    ASSERT_TRUE(next_events(replay).empty());
+    ASSERT_FALSE(next_event(replay));
+}
@@ -1,9 +1,10 @@
 #ifndef __MESYTEC_MVLC_MVLC_COUNTERS_H__
 #define __MESYTEC_MVLC_MVLC_COUNTERS_H__
 
-#include <unordered_map>
+#include <array>
 
 #include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mesytec-mvlc/mvlc_constants.h"
 #include "mesytec-mvlc/util/int_types.h"
 
 namespace mesytec
@@ -13,8 +14,22 @@ namespace mvlc
 namespace eth
 {
 
-using PacketSizeMap = std::unordered_map<u16, u64>; // size -> count
-using HeaderTypeMap = std::unordered_map<u8, u64>;  // header type byte -> count
+// Fixed size histograms so that updating and copying the stats never
+// allocates. Packet sizes are counted in bins of PacketSizeBinWidth bytes to
+// keep the stats small enough to be copied on every readout counter update.
+// Packet sizes larger than JumboFrameMaxSize are counted in the last bin.
+static constexpr size_t PacketSizeBinWidth = 64;
+static constexpr size_t PacketSizeBins = JumboFrameMaxSize / PacketSizeBinWidth + 1;
+static constexpr size_t HeaderTypeBins = 256;
+
+using PacketSizeHistogram = std::array<u64, PacketSizeBins>; // size / PacketSizeBinWidth -> count
+using HeaderTypeHistogram = std::array<u64, HeaderTypeBins>; // header type byte -> count
+
+inline size_t packet_size_bin(size_t packetSize)
+{
+    const size_t bin = packetSize / PacketSizeBinWidth;
+    return bin < PacketSizeBins ? bin : PacketSizeBins - 1;
+}
 
 struct MESYTEC_MVLC_EXPORT PipeStats
 {
@@ -40,8 +55,8 @@ struct MESYTEC_MVLC_EXPORT PipeStats
     u64 packetChannelOutOfRange = 0u;
     u64 lostPackets = 0u;
 
-    PacketSizeMap packetSizes;
-    HeaderTypeMap headerTypes;
+    PacketSizeHistogram packetSizes = {};
+    HeaderTypeHistogram headerTypes = {};
 };
 
 struct MESYTEC_MVLC_EXPORT PacketChannelStats
@@ -52,8 +67,8 @@ struct MESYTEC_MVLC_EXPORT PacketChannelStats
     u64 noHeader = 0u;          // Packets where nextHeaderPointer = 0xffff
     u64 headerOutOfRange = 0u;  // Header points outside the packet data
 
-    PacketSizeMap packetSizes;
-    HeaderTypeMap headerTypes;
+    PacketSizeHistogram packetSizes = {};
+    HeaderTypeHistogram headerTypes = {};
 };
 
 }
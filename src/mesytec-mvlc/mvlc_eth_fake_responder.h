@@ -0,0 +1,85 @@
+#ifndef __MESYTEC_MVLC_MVLC_ETH_FAKE_RESPONDER_H__
+#define __MESYTEC_MVLC_MVLC_ETH_FAKE_RESPONDER_H__
+
+// Helpers for tests and benchmarks talking to eth::Impl without real
+// hardware. Not available on windows.
+
+#ifndef __WIN32
+
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "mesytec-mvlc/mvlc_constants.h"
+#include "mesytec-mvlc/mvlc_eth_interface.h"
+#include "mesytec-mvlc/mvlc_util.h"
+#include "mesytec-mvlc/util/udp_sockets.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace eth
+{
+
+inline void send_words(int sock, const sockaddr_in &dest, const std::vector<u32> &words)
+{
+    ::sendto(sock, reinterpret_cast<const char *>(words.data()), words.size() * sizeof(u32), 0,
+             reinterpret_cast<const sockaddr *>(&dest), sizeof(dest));
+}
+
+// Minimal stand-in for the MVLC command pipe. Answers super command buffers
+// by mirroring the commands. ReadLocal commands yield a register value of 0.
+// This is enough to make eth::Impl::connect() succeed. Runs until quit is set.
+inline void fake_command_responder(int cmdSock, std::atomic<bool> &quit)
+{
+    u16 packetNumber = 0;
+
+    while (!quit)
+    {
+        std::array<u32, 1024> request;
+        size_t bytesTransferred = 0u;
+        sockaddr_in srcAddr = {};
+
+        if (receive_one_packet(cmdSock, reinterpret_cast<u8 *>(request.data()),
+                               request.size() * sizeof(u32), bytesTransferred,
+                               100, &srcAddr))
+            continue;
+
+        const size_t wordCount = bytesTransferred / sizeof(u32);
+
+        if (wordCount < 2)
+            continue;
+
+        std::vector<u32> response = { 0u, 0u, 0u }; // header0, header1, F1 frame header
+
+        // Skip CmdBufferStart and CmdBufferEnd.
+        for (size_t i=1; i<wordCount-1; ++i)
+        {
+            u32 word = request[i];
+            auto cmd = static_cast<SuperCommandType>(word >> super_commands::SuperCmdShift);
+            response.push_back(word);
+
+            if (cmd == SuperCommandType::ReadLocal)
+                response.push_back(0u);
+        }
+
+        const u16 frameLen = response.size() - 3;
+        response[0] = make_header0(PacketChannel::Command, packetNumber++, response.size() - HeaderWords);
+        response[1] = make_header1(0);
+        response[2] = make_frame_header(frame_headers::SuperFrame, frameLen);
+
+        send_words(cmdSock, srcAddr, response);
+    }
+}
+
+} // end namespace eth
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif // __WIN32
+
+#endif /* __MESYTEC_MVLC_MVLC_ETH_FAKE_RESPONDER_H__ */
@@ -82,6 +82,22 @@ struct MESYTEC_MVLC_EXPORT PayloadHeaderInfo
     }
 };
 
+// Build the two ETH payload header words, the inverse of PayloadHeaderInfo.
+// Used by tests and tools emulating the MVLC side of the connection.
+inline u32 make_header0(PacketChannel channel, u16 packetNumber, u16 dataWordCount, u8 ctrlId = 0)
+{
+    return ((static_cast<u32>(channel) & header0::PacketChannelMask) << header0::PacketChannelShift)
+        | ((packetNumber & header0::PacketNumberMask) << header0::PacketNumberShift)
+        | ((ctrlId & header0::CtrlIdMask) << header0::CtrlIdShift)
+        | ((dataWordCount & header0::NumDataWordsMask) << header0::NumDataWordsShift);
+}
+
+inline u32 make_header1(u16 nextHeaderPointer, u16 udpTimestamp = 0)
+{
+    return ((udpTimestamp & header1::TimestampMask) << header1::TimestampShift)
+        | ((nextHeaderPointer & header1::HeaderPointerMask) << header1::HeaderPointerShift);
+}
+
 struct MESYTEC_MVLC_EXPORT PacketReadResult
 {
     std::error_code ec;
@@ -165,6 +181,14 @@ struct MESYTEC_MVLC_EXPORT PacketReadResult
     }
 };
 
+// Maximum number of packets received by a single call to
+// MVLC_ETH_Interface::read_packets().
+static const size_t ReadPacketsMaxBatchSize = 32;
+
+// Size of each of the destination slots used by read_packets(). Each slot can
+// hold a single jumbo frame.
+static const size_t ReadPacketsSlotSize = JumboFrameMaxSize;
+
 struct EthThrottleCounters
 {
     u32 rcvBufferSize = 0u;
@@ -180,6 +204,19 @@ class MVLC_ETH_Interface
         virtual ~MVLC_ETH_Interface() {}
 
         virtual PacketReadResult read_packet(Pipe pipe, u8 *buffer, size_t size) = 0;
+
+        // Batched version of read_packet(): receives up to maxPackets
+        // datagrams, using a single system call where the platform supports
+        // it (recvmmsg() under linux). The dest buffer is split into slots of
+        // ReadPacketsSlotSize bytes, packet i is received into the memory at
+        // buffer + i * ReadPacketsSlotSize. Blocks until at least one packet
+        // is available or the read timeout expires, then returns whatever is
+        // currently queued without blocking again.
+        // Returns the number of PacketReadResults stored in the results array.
+        // A socket error is reported as a single result with the error code
+        // set and bytesTransferred=0.
+        virtual size_t read_packets(Pipe pipe, u8 *buffer, size_t size,
+                                    PacketReadResult *results, size_t maxPackets) = 0;
         virtual std::array<eth::PipeStats, PipeCount> getPipeStats() const = 0;
         virtual std::array<PacketChannelStats, NumPacketChannels> getPacketChannelStats() const = 0;
         virtual void resetPipeAndChannelStats() = 0;
@@ -0,0 +1,226 @@
+#include "mvlc_eth_receiver.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#endif
+
+#include "mvlc_error.h"
+#include "util/logging.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace eth
+{
+
+PacketBatch::PacketBatch(size_t maxPackets)
+    : buffer(maxPackets * ReadPacketsSlotSize)
+    , results(maxPackets)
+{
+}
+
+PacketBatch::PacketBatch(const PacketBatch &other)
+{
+    *this = other;
+}
+
+PacketBatch &PacketBatch::operator=(const PacketBatch &other)
+{
+    buffer = other.buffer;
+    results = other.results;
+    packetCount = other.packetCount;
+
+    for (auto &result: results)
+    {
+        if (result.buffer)
+            result.buffer = buffer.data() + (result.buffer - other.buffer.data());
+    }
+
+    return *this;
+}
+
+namespace
+{
+
+void update_max(std::atomic<size_t> &dest, size_t value)
+{
+    size_t prev = dest.load(std::memory_order_relaxed);
+    while (prev < value && !dest.compare_exchange_weak(prev, value, std::memory_order_relaxed)) ;
+}
+
+}
+
+PacketReceiver::PacketReceiver(MVLC_ETH_Interface *eth, Mutex *dataMutex,
+                               const PacketReceiverOptions &options)
+    : m_eth(eth)
+    , m_dataMutex(dataMutex)
+    , m_options(options)
+    , m_queues(ReadPacketsMaxBatchSize, std::max(options.batchCount, static_cast<size_t>(1u)))
+    , m_quit(false)
+    , m_running(false)
+    , m_batchesReceived(0u)
+    , m_packetsReceived(0u)
+    , m_bytesReceived(0u)
+    , m_ringFullWaits(0u)
+    , m_filledBatches(0u)
+    , m_maxFilledBatches(0u)
+{
+}
+
+PacketReceiver::~PacketReceiver()
+{
+    stop();
+}
+
+void PacketReceiver::start()
+{
+    if (isRunning())
+        return;
+
+    // Join a thread that left the loop on its own.
+    if (m_thread.joinable())
+        m_thread.join();
+
+    m_quit = false;
+    m_running = true;
+    m_thread = std::thread(&PacketReceiver::loop, this);
+}
+
+void PacketReceiver::stop()
+{
+    m_quit = true;
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+PacketBatch *PacketReceiver::nextBatch(const std::chrono::milliseconds &timeout)
+{
+    auto batch = m_queues.filledBufferQueue().dequeue(timeout);
+
+    if (batch)
+        m_filledBatches.fetch_sub(1u, std::memory_order_relaxed);
+
+    return batch;
+}
+
+void PacketReceiver::releaseBatch(PacketBatch *batch)
+{
+    batch->packetCount = 0u;
+    m_queues.emptyBufferQueue().enqueue(batch);
+}
+
+PacketReceiverCounters PacketReceiver::counters() const
+{
+    PacketReceiverCounters result;
+    result.batchesReceived = m_batchesReceived.load(std::memory_order_relaxed);
+    result.packetsReceived = m_packetsReceived.load(std::memory_order_relaxed);
+    result.bytesReceived = m_bytesReceived.load(std::memory_order_relaxed);
+    result.ringFullWaits = m_ringFullWaits.load(std::memory_order_relaxed);
+    result.maxFilledBatches = m_maxFilledBatches.load(std::memory_order_relaxed);
+    return result;
+}
+
+void PacketReceiver::loop()
+{
+    auto logger = get_logger("eth_receiver");
+
+#ifdef __linux__
+    prctl(PR_SET_NAME,"eth_receiver",0,0,0);
+
+    if (m_options.cpu >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(m_options.cpu, &cpuset);
+
+        if (int res = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+            logger->warn("Could not pin the receiver thread to cpu {}: {}",
+                         m_options.cpu, std::error_code(res, std::system_category()).message());
+        else
+            logger->debug("Pinned the receiver thread to cpu {}", m_options.cpu);
+    }
+#else
+    if (m_options.cpu >= 0)
+        logger->warn("Pinning the receiver thread is not supported on this platform");
+#endif
+
+    logger->debug("eth packet receiver entering loop, batchCount={}", m_queues.bufferCount());
+
+    auto &empty = m_queues.emptyBufferQueue();
+    auto &filled = m_queues.filledBufferQueue();
+    static const auto EmptyWaitTimeout = std::chrono::milliseconds(100);
+
+    while (!m_quit.load(std::memory_order_relaxed))
+    {
+        // A batch left over from a read timeout is reused. Only the consumer
+        // enqueues onto the empty queue, the receiver must not.
+        PacketBatch *batch = m_currentBatch;
+
+        if (!batch && !empty.try_dequeue(batch))
+        {
+            // The consumer is behind: the kernel buffer has to absorb the
+            // incoming data until a batch is released.
+            m_ringFullWaits.fetch_add(1u, std::memory_order_relaxed);
+
+            if (!(batch = empty.dequeue(EmptyWaitTimeout)))
+                continue;
+        }
+
+        m_currentBatch = batch;
+
+        {
+            UniqueLock guard;
+
+            if (m_dataMutex)
+                guard = UniqueLock(*m_dataMutex);
+
+            batch->packetCount = m_eth->read_packets(
+                Pipe::Data, batch->buffer.data(), batch->buffer.size(),
+                batch->results.data(), batch->maxPackets());
+        }
+
+        const auto &first = batch->results[0];
+
+        if (batch->packetCount == 1 && first.ec && first.bytesTransferred == 0
+            && first.ec != ErrorType::ConnectionError)
+        {
+            // Read timeout or another transient error without data. Keep the
+            // batch for the next read.
+            batch->packetCount = 0u;
+            continue;
+        }
+
+        size_t bytes = 0u;
+
+        for (size_t i=0; i<batch->packetCount; ++i)
+            bytes += batch->results[i].bytesTransferred;
+
+        m_batchesReceived.fetch_add(1u, std::memory_order_relaxed);
+        m_packetsReceived.fetch_add(batch->packetCount, std::memory_order_relaxed);
+        m_bytesReceived.fetch_add(bytes, std::memory_order_relaxed);
+        update_max(m_maxFilledBatches, m_filledBatches.fetch_add(1u, std::memory_order_relaxed) + 1);
+
+        const bool connectionError = first.ec == ErrorType::ConnectionError;
+
+        m_currentBatch = nullptr;
+        filled.enqueue(batch);
+
+        if (connectionError)
+        {
+            logger->warn("eth packet receiver: connection error from the data pipe: {}",
+                         first.ec.message());
+            break;
+        }
+    }
+
+    m_running = false;
+    logger->debug("eth packet receiver leaving loop");
+}
+
+} // end namespace eth
+} // end namespace mvlc
+} // end namespace mesytec
@@ -0,0 +1,134 @@
+#ifndef __MESYTEC_MVLC_MVLC_ETH_RECEIVER_H__
+#define __MESYTEC_MVLC_MVLC_ETH_RECEIVER_H__
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mesytec-mvlc/mvlc_eth_interface.h"
+#include "mesytec-mvlc/mvlc_threading.h"
+#include "mesytec-mvlc/readout_buffer_queues.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace eth
+{
+
+// Datagrams received by a single MVLC_ETH_Interface::read_packets() call.
+// Packet i is stored at buffer.data() + i * ReadPacketsSlotSize, results[i]
+// holds the corresponding PacketReadResult.
+struct MESYTEC_MVLC_EXPORT PacketBatch
+{
+    explicit PacketBatch(size_t maxPackets = ReadPacketsMaxBatchSize);
+
+    // PacketReadResult::buffer points into the batch buffer. The copy
+    // operations rebase the pointers.
+    PacketBatch(const PacketBatch &other);
+    PacketBatch &operator=(const PacketBatch &other);
+
+    size_t maxPackets() const { return results.size(); }
+
+    std::vector<u8> buffer;
+    std::vector<PacketReadResult> results;
+    size_t packetCount = 0u;
+};
+
+// Ring of packet batches: the receiver thread takes batches from the empty
+// queue, fills them and puts them onto the filled queue.
+using PacketBatchQueues = ReadoutBufferQueues_<PacketBatch, SPSCQueue<PacketBatch *>>;
+
+struct PacketReceiverOptions
+{
+    // Number of batches in the ring. Each batch can hold up to
+    // ReadPacketsMaxBatchSize jumbo frames (~288 KiB).
+    size_t batchCount = 128;
+
+    // CPU to pin the receiver thread to. -1 to leave the affinity alone.
+    // Pinning is only implemented under linux.
+    int cpu = -1;
+};
+
+struct PacketReceiverCounters
+{
+    size_t batchesReceived = 0u;
+    size_t packetsReceived = 0u;
+    size_t bytesReceived = 0u;
+
+    // Number of times the ring was full when the receiver wanted to read more
+    // data. Meanwhile datagrams accumulate in the kernel receive buffer.
+    size_t ringFullWaits = 0u;
+
+    // Maximum number of filled batches waiting for the consumer.
+    size_t maxFilledBatches = 0u;
+};
+
+// Dedicated thread moving datagrams from the MVLC data pipe into a
+// pre-allocated ring of PacketBatches. The thread does nothing else so that
+// the kernel socket buffer is drained even if the consumer stalls for a while.
+//
+// There must be exactly one consumer thread calling nextBatch() and
+// releaseBatch() at a time.
+class MESYTEC_MVLC_EXPORT PacketReceiver
+{
+    public:
+        // If dataMutex is non-null it is locked around each read from the
+        // data pipe.
+        PacketReceiver(MVLC_ETH_Interface *eth, Mutex *dataMutex = nullptr,
+                       const PacketReceiverOptions &options = {});
+        ~PacketReceiver();
+
+        PacketReceiver(const PacketReceiver &) = delete;
+        PacketReceiver &operator=(const PacketReceiver &) = delete;
+
+        // start() can be called again after the receiver thread stopped
+        // because of a ConnectionError.
+        void start();
+        void stop();
+
+        // False once the receiver thread left its loop, either because of
+        // stop() or because of a ConnectionError.
+        bool isRunning() const { return m_running.load(); }
+
+        // Returns the next filled batch or nullptr if none became available
+        // within the timeout. A ConnectionError from the data pipe is delivered
+        // as a batch containing a single result with the error code set, the
+        // receiver thread stops afterwards.
+        PacketBatch *nextBatch(const std::chrono::milliseconds &timeout);
+
+        // Hands a batch obtained from nextBatch() back to the receiver.
+        void releaseBatch(PacketBatch *batch);
+
+        PacketReceiverCounters counters() const;
+
+    private:
+        void loop();
+
+        MVLC_ETH_Interface *m_eth;
+        Mutex *m_dataMutex;
+        PacketReceiverOptions m_options;
+        PacketBatchQueues m_queues;
+        std::thread m_thread;
+        std::atomic<bool> m_quit;
+        std::atomic<bool> m_running;
+        // Batch owned by the receiver thread between reads. Kept across
+        // stop()/start() so that only the consumer ever enqueues onto the
+        // empty queue.
+        PacketBatch *m_currentBatch = nullptr;
+
+        std::atomic<size_t> m_batchesReceived;
+        std::atomic<size_t> m_packetsReceived;
+        std::atomic<size_t> m_bytesReceived;
+        std::atomic<size_t> m_ringFullWaits;
+        std::atomic<size_t> m_filledBatches;
+        std::atomic<size_t> m_maxFilledBatches;
+};
+
+} // end namespace eth
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_MVLC_ETH_RECEIVER_H__ */
@@ -0,0 +1,242 @@
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <mutex>
+#include <deque>
+
+#include "mvlc_error.h"
+#include "mvlc_eth_receiver.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+namespace
+{
+
+// Hands out scripted packets from read_packets(). Once the script is
+// exhausted timeouts are returned, or a ConnectionError if disconnectAtEnd is
+// set.
+class ScriptedEth: public MVLC_ETH_Interface
+{
+    public:
+        void addPacket(u16 packetNumber, u16 payloadWords)
+        {
+            std::vector<u32> packet(HeaderWords + payloadWords);
+            packet[0] = make_header0(PacketChannel::Data, packetNumber, payloadWords);
+            packet[1] = make_header1(header1::NoHeaderPointerPresent);
+            std::lock_guard<std::mutex> guard(mutex_);
+            packets_.emplace_back(std::move(packet));
+        }
+
+        std::atomic<bool> disconnectAtEnd{false};
+        size_t maxPacketsPerRead = ReadPacketsMaxBatchSize;
+        // If non-zero every n-th read returns a timeout even if packets are
+        // available.
+        size_t timeoutEvery = 0u;
+
+        PacketReadResult read_packet(Pipe, u8 *, size_t) override { return {}; }
+
+        size_t read_packets(Pipe, u8 *buffer, size_t size,
+                            PacketReadResult *results, size_t maxPackets) override
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+
+            if (timeoutEvery && ++reads_ % timeoutEvery == 0)
+            {
+                results[0] = {};
+                results[0].ec = make_error_code(MVLCErrorCode::SocketReadTimeout);
+                return 1u;
+            }
+
+            if (packets_.empty())
+            {
+                guard.unlock();
+                results[0] = {};
+
+                if (disconnectAtEnd)
+                    results[0].ec = make_error_code(MVLCErrorCode::IsDisconnected);
+                else
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    results[0].ec = make_error_code(MVLCErrorCode::SocketReadTimeout);
+                }
+
+                return 1u;
+            }
+
+            size_t count = std::min({ maxPackets, maxPacketsPerRead, packets_.size(),
+                                      size / ReadPacketsSlotSize });
+
+            for (size_t i=0; i<count; ++i)
+            {
+                const auto &packet = packets_.front();
+                results[i] = {};
+                results[i].buffer = buffer + i * ReadPacketsSlotSize;
+                results[i].bytesTransferred = packet.size() * sizeof(u32);
+                std::memcpy(results[i].buffer, packet.data(), results[i].bytesTransferred);
+                packets_.pop_front();
+            }
+
+            return count;
+        }
+
+        std::array<PipeStats, PipeCount> getPipeStats() const override { return {}; }
+        std::array<PacketChannelStats, NumPacketChannels> getPacketChannelStats() const override { return {}; }
+        void resetPipeAndChannelStats() override {}
+        EthThrottleCounters getThrottleCounters() const override { return {}; }
+
+    private:
+        std::mutex mutex_;
+        std::deque<std::vector<u32>> packets_;
+        size_t reads_ = 0u;
+};
+
+}
+
+TEST(mvlc_eth_receiver, PacketBatchCopyRebasesPointers)
+{
+    PacketBatch a(2);
+    a.packetCount = 1;
+    a.results[0].buffer = a.buffer.data() + ReadPacketsSlotSize;
+    a.results[0].bytesTransferred = 8;
+
+    PacketBatch b(a);
+    ASSERT_EQ(b.results[0].buffer, b.buffer.data() + ReadPacketsSlotSize);
+    ASSERT_EQ(b.results[1].buffer, nullptr);
+}
+
+TEST(mvlc_eth_receiver, ReceivesPacketsInOrder)
+{
+    static const size_t PacketCount = 1000;
+
+    ScriptedEth eth;
+    eth.maxPacketsPerRead = 7;
+
+    for (size_t i=0; i<PacketCount; ++i)
+        eth.addPacket(i, 1 + i % 100);
+
+    PacketReceiverOptions options;
+    options.batchCount = 4; // small ring to exercise the ring full path
+    Mutex dataMutex;
+    PacketReceiver receiver(&eth, &dataMutex, options);
+    receiver.start();
+
+    size_t received = 0;
+
+    while (received < PacketCount)
+    {
+        auto batch = receiver.nextBatch(std::chrono::milliseconds(1000));
+        ASSERT_NE(batch, nullptr);
+        ASSERT_GT(batch->packetCount, 0u);
+        ASSERT_LE(batch->packetCount, 7u);
+
+        for (size_t i=0; i<batch->packetCount; ++i, ++received)
+        {
+            const auto &result = batch->results[i];
+            ASSERT_FALSE(result.ec);
+            ASSERT_EQ(result.packetNumber(), received & header0::PacketNumberMask);
+            ASSERT_EQ(result.dataWordCount(), 1 + received % 100);
+        }
+
+        // Slow consumer
+        if (received % 100 == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        receiver.releaseBatch(batch);
+    }
+
+    // Only timeouts from here on: no more batches.
+    ASSERT_EQ(receiver.nextBatch(std::chrono::milliseconds(50)), nullptr);
+
+    receiver.stop();
+    auto counters = receiver.counters();
+    ASSERT_EQ(counters.packetsReceived, PacketCount);
+    ASSERT_LE(counters.maxFilledBatches, options.batchCount);
+}
+
+TEST(mvlc_eth_receiver, ConnectionErrorStopsReceiver)
+{
+    ScriptedEth eth;
+    eth.addPacket(0, 10);
+    eth.disconnectAtEnd = true;
+
+    PacketReceiver receiver(&eth);
+    receiver.start();
+
+    auto batch = receiver.nextBatch(std::chrono::milliseconds(1000));
+    ASSERT_NE(batch, nullptr);
+    ASSERT_EQ(batch->packetCount, 1u);
+    ASSERT_FALSE(batch->results[0].ec);
+    receiver.releaseBatch(batch);
+
+    batch = receiver.nextBatch(std::chrono::milliseconds(1000));
+    ASSERT_NE(batch, nullptr);
+    ASSERT_EQ(batch->packetCount, 1u);
+    ASSERT_EQ(batch->results[0].ec, ErrorType::ConnectionError);
+    receiver.releaseBatch(batch);
+
+    ASSERT_EQ(receiver.nextBatch(std::chrono::milliseconds(50)), nullptr);
+
+    // The thread left its loop on its own.
+    for (int i=0; i<100 && receiver.isRunning(); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    ASSERT_FALSE(receiver.isRunning());
+
+    // The receiver can be restarted once the connection is back.
+    eth.disconnectAtEnd = false;
+    eth.addPacket(1, 10);
+    receiver.start();
+    ASSERT_TRUE(receiver.isRunning());
+
+    batch = receiver.nextBatch(std::chrono::milliseconds(1000));
+    ASSERT_NE(batch, nullptr);
+    ASSERT_EQ(batch->packetCount, 1u);
+    ASSERT_FALSE(batch->results[0].ec);
+    receiver.releaseBatch(batch);
+
+    receiver.stop();
+    ASSERT_FALSE(receiver.isRunning());
+}
+
+TEST(mvlc_eth_receiver, TimeoutsWhileConsumerReleases)
+{
+    static const size_t PacketCount = 100000;
+
+    ScriptedEth eth;
+    eth.maxPacketsPerRead = 3;
+    eth.timeoutEvery = 2;
+
+    for (size_t i=0; i<PacketCount; ++i)
+        eth.addPacket(i, 1);
+
+    PacketReceiverOptions options;
+    options.batchCount = 2;
+    PacketReceiver receiver(&eth, nullptr, options);
+    receiver.start();
+
+    size_t received = 0;
+
+    while (received < PacketCount)
+    {
+        auto batch = receiver.nextBatch(std::chrono::milliseconds(1000));
+        ASSERT_NE(batch, nullptr);
+
+        for (size_t i=0; i<batch->packetCount; ++i, ++received)
+            ASSERT_EQ(batch->results[i].packetNumber(), received & header0::PacketNumberMask);
+
+        receiver.releaseBatch(batch);
+
+        // Restart the receiver now and then. The batch held over a timeout
+        // must survive this.
+        if (received % 10000 < 3)
+        {
+            receiver.stop();
+            receiver.start();
+        }
+    }
+
+    ASSERT_EQ(receiver.nextBatch(std::chrono::milliseconds(50)), nullptr);
+    receiver.stop();
+    ASSERT_EQ(receiver.counters().packetsReceived, PacketCount);
+}
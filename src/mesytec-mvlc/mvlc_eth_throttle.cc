@@ -0,0 +1,187 @@
+#include "mvlc_eth_throttle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace eth
+{
+
+namespace
+{
+
+// The exponential policy increases the delay value by powers of two. The max
+// value is 64k so we need 16 steps to reach the maximum.
+static const unsigned EthThrottleSteps = 16;
+
+inline double buffer_use(const ReceiveBufferSnapshot &bufferInfo)
+{
+    return bufferInfo.capacity ? bufferInfo.used * 1.0 / bufferInfo.capacity : 0.0;
+}
+
+class ExponentialThrottlePolicy: public EthThrottlePolicy
+{
+    public:
+        u16 calculateDelay(const EthThrottleContext &ctx, const ReceiveBufferSnapshot &bufferInfo,
+                           std::chrono::microseconds) override
+        {
+            /* At 50% buffer level start throttling. Delay value
+             * scales within the range of ctx.range of buffer usage
+             * from 1 to 2^16.
+             * So at buffer fill level of (ctx.threshold +
+             * ctx.range) the maximum delay value should be set,
+             * effectively blocking the MVLC from sending. Directly
+             * at threshold level the minimum delay of 1 should be
+             * set. In between scaling in powers of two is applied
+             * to the delay value. This means the scaling range is
+             * divided into 16 scaling steps so that at the maximum
+             * value a delay of 2^16 is calculated.
+             */
+
+            double bufferUse = buffer_use(bufferInfo);
+            u16 delay = 0u;
+
+            if (bufferUse >= ctx.threshold)
+            {
+                const double throttleIncrement = ctx.range / EthThrottleSteps;
+                double aboveThreshold = bufferUse - ctx.threshold;
+                u32 increments = std::floor(aboveThreshold / throttleIncrement);
+
+                if (increments > EthThrottleSteps)
+                    increments = EthThrottleSteps;
+
+                delay = std::min(1u << increments, static_cast<u32>(std::numeric_limits<u16>::max()));
+            }
+
+            return delay;
+        }
+};
+
+// Similar to the exponential policy but apply linear throttling from 1 to 300
+// µs (at a=747.5) in the range [ctx.threshold, ctx.treshold + ctx.range].
+class LinearThrottlePolicy: public EthThrottlePolicy
+{
+    public:
+        u16 calculateDelay(const EthThrottleContext &ctx, const ReceiveBufferSnapshot &bufferInfo,
+                           std::chrono::microseconds) override
+        {
+            double bufferUse = buffer_use(bufferInfo);
+            u16 delay = 0u;
+
+            if (bufferUse >= ctx.threshold)
+            {
+                double aboveThreshold = bufferUse - ctx.threshold;
+                const double a = 747.5;
+                delay = a * aboveThreshold + 1;
+            }
+
+            return delay;
+        }
+};
+
+// Controls the fill level around ctx.pid.setpoint. The proportional and
+// integral terms act on the fill level error, the derivative term on the
+// smoothed fill rate. The fill rate term reacts to bursts before the fill
+// level has moved far from the setpoint, the integral term finds the delay
+// needed to match the sustained data rate to the consumer so that the
+// controller does not fall back to zero delay as soon as the fill level
+// drops below the setpoint.
+class PidThrottlePolicy: public EthThrottlePolicy
+{
+    public:
+        void reset() override
+        {
+            m_integral = 0.0;
+            m_fillRate = 0.0;
+            m_lastUse = -1.0;
+        }
+
+        u16 calculateDelay(const EthThrottleContext &ctx, const ReceiveBufferSnapshot &bufferInfo,
+                           std::chrono::microseconds elapsed) override
+        {
+            const auto &params = ctx.pid;
+            const double bufferUse = buffer_use(bufferInfo);
+            const double dt = std::max(elapsed.count(), static_cast<decltype(elapsed.count())>(1)) * 1e-6;
+            const double error = bufferUse - params.setpoint;
+
+            if (m_lastUse >= 0.0)
+            {
+                double rate = (bufferUse - m_lastUse) / dt;
+                m_fillRate = params.rateSmoothing * rate + (1.0 - params.rateSmoothing) * m_fillRate;
+            }
+
+            m_lastUse = bufferUse;
+
+            if (params.ki > 0.0)
+                m_integral = std::clamp(m_integral + error * dt, 0.0, EthThrottleSteps / static_cast<double>(params.ki));
+            else
+                m_integral = 0.0;
+
+            if (bufferUse >= ctx.threshold + ctx.range)
+                return std::numeric_limits<u16>::max();
+
+            double level = params.kp * error + params.ki * m_integral + params.kd * m_fillRate;
+
+            return throttle_level_to_delay(level);
+        }
+
+    private:
+        double m_integral = 0.0;
+        double m_fillRate = 0.0;
+        double m_lastUse = -1.0;
+};
+
+} // end anon namespace
+
+std::unique_ptr<EthThrottlePolicy> make_throttle_policy(EthThrottlePolicyType type)
+{
+    switch (type)
+    {
+        case EthThrottlePolicyType::Exponential:
+            return std::make_unique<ExponentialThrottlePolicy>();
+
+        case EthThrottlePolicyType::Linear:
+            return std::make_unique<LinearThrottlePolicy>();
+
+        case EthThrottlePolicyType::PID:
+            return std::make_unique<PidThrottlePolicy>();
+    }
+
+    return {};
+}
+
+std::string to_string(EthThrottlePolicyType type)
+{
+    switch (type)
+    {
+        case EthThrottlePolicyType::Exponential:
+            return "exponential";
+
+        case EthThrottlePolicyType::Linear:
+            return "linear";
+
+        case EthThrottlePolicyType::PID:
+            return "pid";
+    }
+
+    return "unknown";
+}
+
+u16 throttle_level_to_delay(double level)
+{
+    if (level <= 0.0)
+        return 0u;
+
+    if (level >= EthThrottleSteps)
+        return std::numeric_limits<u16>::max();
+
+    return std::max(1.0, std::round(std::exp2(level)));
+}
+
+} // end namespace eth
+} // end namespace mvlc
+} // end namespace mesytec
@@ -0,0 +1,126 @@
+#ifndef __MESYTEC_MVLC_MVLC_ETH_THROTTLE_H__
+#define __MESYTEC_MVLC_MVLC_ETH_THROTTLE_H__
+
+#ifndef __WIN32
+#include <sys/types.h> // ino_t
+#endif
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mvlc_constants.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace eth
+{
+
+// Fill level of the data pipe socket receive buffer as reported by the OS.
+struct ReceiveBufferSnapshot
+{
+    u32 used = 0u;
+    u32 capacity = 0u;
+#ifndef __WIN32
+    ino_t inode = 0u;
+#endif
+};
+
+enum class EthThrottlePolicyType
+{
+    Exponential,    // Doubles the delay for each 1/16th of 'range' above 'threshold'.
+    Linear,         // Linear delay increase above 'threshold'.
+    PID,            // Closed-loop control of the fill level, see EthThrottlePidParams.
+};
+
+// Parameters of the PID throttle policy. The controller output is a throttle
+// level in [0, 16] which is mapped to a delay of 2^level µs, the same scale
+// the exponential policy uses. A fill level of threshold+range always results
+// in the max delay.
+struct EthThrottlePidParams
+{
+    // Target receive buffer fill level (fraction of the capacity).
+    float setpoint = 0.5;
+
+    // Throttle levels per unit of fill level error.
+    float kp = 16.0;
+
+    // Throttle levels per unit of integrated fill level error (per second).
+    // The integral is limited to [0, 16/ki] to avoid windup.
+    float ki = 10.0;
+
+    // Throttle levels per unit of fill rate (fill level change per second).
+    float kd = 0.05;
+
+    // Exponential smoothing factor applied to the measured fill rate.
+    float rateSmoothing = 0.25;
+};
+
+struct EthThrottleContext;
+
+// Interface for calculating the ETH delay value from the receive buffer fill
+// level. Policies may keep state between calls, reset() is called before
+// throttling starts.
+class MESYTEC_MVLC_EXPORT EthThrottlePolicy
+{
+    public:
+        virtual ~EthThrottlePolicy() {}
+
+        virtual void reset() {}
+
+        // Returns the delay in µs to send to the MVLC. 'elapsed' is the time
+        // since the previous call.
+        virtual u16 calculateDelay(
+            const EthThrottleContext &ctx, const ReceiveBufferSnapshot &bufferInfo,
+            std::chrono::microseconds elapsed) = 0;
+};
+
+struct EthThrottleContext
+{
+#ifndef __WIN32
+    u32 dataSocketInode; // Inode of the socket used for MVLCs data pipe. This is needed
+                         // to correctly identify the socket in the netlink response data.
+#else
+    int dataSocket = -1; // File descriptor of the data pipe socket.
+    int dataSocketReceiveBufferSize; // Size in bytes of the receive buffer in the OS.
+#endif
+
+    int delaySocket = -1; // The socket used for sending delay commands to the MVLC.
+
+    // Amount of time to sleep after each cycle. This directly affects the number of
+    // measurements taken and the number of delay packets sent out per second!
+    std::chrono::milliseconds queryDelay = std::chrono::milliseconds(1);
+
+    float threshold = 0.5; // Throttling begins when buffer fill level / buffer capacity is above this level.
+    float range = 0.45; // The buffer fill level range until max throttle is reached.
+                        // Throttling starts at threshold and reaches its max value at
+                        // threshold+range.
+
+    EthThrottlePolicyType policy = EthThrottlePolicyType::Exponential;
+    EthThrottlePidParams pid;
+
+    // If set this policy is used instead of the one selected by 'policy'.
+    std::shared_ptr<EthThrottlePolicy> customPolicy;
+
+    bool quit = false; // Set to true to make the throttler thread quit
+
+    std::ofstream debugOut; // Will receive throttling debug output if open.
+};
+
+MESYTEC_MVLC_EXPORT std::unique_ptr<EthThrottlePolicy> make_throttle_policy(EthThrottlePolicyType type);
+
+MESYTEC_MVLC_EXPORT std::string to_string(EthThrottlePolicyType type);
+
+// Throttle level in [0, 16] to delay value in µs. Levels <= 0 yield no delay,
+// level 16 the max delay which stops the MVLC data stream.
+MESYTEC_MVLC_EXPORT u16 throttle_level_to_delay(double level);
+
+} // end namespace eth
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_MVLC_ETH_THROTTLE_H__ */
@@ -0,0 +1,141 @@
+#include "gtest/gtest.h"
+
+#include <limits>
+
+#include "mvlc_eth_throttle.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+namespace
+{
+
+static const u32 Capacity = 1000000u;
+static const auto Step = std::chrono::milliseconds(1);
+static const u16 MaxDelay = std::numeric_limits<u16>::max();
+
+ReceiveBufferSnapshot fill(double level)
+{
+    ReceiveBufferSnapshot result;
+    result.used = level * Capacity;
+    result.capacity = Capacity;
+    return result;
+}
+
+}
+
+TEST(mvlc_eth_throttle, ThrottleLevelToDelay)
+{
+    ASSERT_EQ(throttle_level_to_delay(-1.0), 0u);
+    ASSERT_EQ(throttle_level_to_delay(0.0), 0u);
+    ASSERT_EQ(throttle_level_to_delay(0.01), 1u);
+    ASSERT_EQ(throttle_level_to_delay(1.0), 2u);
+    ASSERT_EQ(throttle_level_to_delay(10.0), 1024u);
+    ASSERT_EQ(throttle_level_to_delay(16.0), MaxDelay);
+    ASSERT_EQ(throttle_level_to_delay(100.0), MaxDelay);
+}
+
+TEST(mvlc_eth_throttle, Exponential)
+{
+    EthThrottleContext ctx;
+    auto policy = make_throttle_policy(EthThrottlePolicyType::Exponential);
+    ASSERT_TRUE(policy);
+
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(0.0), Step), 0u);
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.threshold - 0.01), Step), 0u);
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.threshold + 0.001), Step), 1u);
+    // Each 1/16th of the range doubles the delay.
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.threshold + ctx.range / 16 * 4.5), Step), 16u);
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.threshold + ctx.range + 0.01), Step), MaxDelay);
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(1.0), Step), MaxDelay);
+
+    // Empty snapshots do not throttle.
+    ASSERT_EQ(policy->calculateDelay(ctx, ReceiveBufferSnapshot{}, Step), 0u);
+}
+
+TEST(mvlc_eth_throttle, Linear)
+{
+    EthThrottleContext ctx;
+    auto policy = make_throttle_policy(EthThrottlePolicyType::Linear);
+    ASSERT_TRUE(policy);
+
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.threshold - 0.01), Step), 0u);
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.threshold), Step), 1u);
+    ASSERT_GT(policy->calculateDelay(ctx, fill(ctx.threshold + 0.2), Step),
+              policy->calculateDelay(ctx, fill(ctx.threshold + 0.1), Step));
+}
+
+TEST(mvlc_eth_throttle, PidBelowSetpoint)
+{
+    EthThrottleContext ctx;
+    auto policy = make_throttle_policy(EthThrottlePolicyType::PID);
+    ASSERT_TRUE(policy);
+    policy->reset();
+
+    for (int i=0; i<100; ++i)
+        ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.pid.setpoint * 0.5), Step), 0u);
+}
+
+TEST(mvlc_eth_throttle, PidIntegralAndEmergency)
+{
+    EthThrottleContext ctx;
+    auto policy = make_throttle_policy(EthThrottlePolicyType::PID);
+    policy->reset();
+
+    // Constant fill level above the setpoint: the integral term keeps
+    // increasing the delay.
+    const double level = ctx.pid.setpoint + 0.05;
+    u16 first = policy->calculateDelay(ctx, fill(level), Step);
+    u16 last = first;
+
+    for (int i=0; i<2000; ++i)
+        last = policy->calculateDelay(ctx, fill(level), Step);
+
+    ASSERT_GT(first, 0u);
+    ASSERT_GT(last, first);
+
+    // At threshold+range the data stream is stopped.
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.threshold + ctx.range + 0.01), Step), MaxDelay);
+
+    // The integral is bounded: after a long time at the max delay the delay
+    // drops back to zero within a bounded time once the fill level is below
+    // the setpoint.
+    for (int i=0; i<10000; ++i)
+        policy->calculateDelay(ctx, fill(0.99), Step);
+
+    int steps = 0;
+
+    while (policy->calculateDelay(ctx, fill(0.0), Step) != 0u)
+        ASSERT_LT(++steps, 2000);
+
+    // reset() clears the state.
+    for (int i=0; i<100; ++i)
+        policy->calculateDelay(ctx, fill(level), Step);
+
+    policy->reset();
+    ASSERT_EQ(policy->calculateDelay(ctx, fill(ctx.pid.setpoint), Step), 0u);
+}
+
+TEST(mvlc_eth_throttle, PidFillRate)
+{
+    // A rising fill level results in a larger delay than a constant one.
+    EthThrottleContext ctx;
+    ctx.pid.ki = 0.0;
+
+    auto rising = make_throttle_policy(EthThrottlePolicyType::PID);
+    auto constant = make_throttle_policy(EthThrottlePolicyType::PID);
+    rising->reset();
+    constant->reset();
+
+    const double level = ctx.pid.setpoint + 0.1;
+    u16 risingDelay = 0u;
+    u16 constantDelay = 0u;
+
+    for (int i=0; i<10; ++i)
+    {
+        risingDelay = rising->calculateDelay(ctx, fill(level - 0.01 * (10 - i)), Step);
+        constantDelay = constant->calculateDelay(ctx, fill(level), Step);
+    }
+
+    ASSERT_GT(risingDelay, constantDelay);
+}
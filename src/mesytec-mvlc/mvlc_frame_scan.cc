@@ -0,0 +1,270 @@
+#include "mvlc_frame_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MVLC_FRAME_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace frame_scan
+{
+
+namespace
+{
+
+const u32 *find_frame_header_scalar(const u32 *begin, const u32 *end, FrameTypeMask mask)
+{
+    for (; begin < end; ++begin)
+    {
+        if (frame_type_matches(*begin, mask))
+            return begin;
+    }
+
+    return end;
+}
+
+#ifdef MVLC_FRAME_SCAN_X86
+
+// The SIMD versions check the high nibble of the frame type for 0xF and look
+// up the low nibble in a 16 entry byte table (pshufb) built from the mask.
+// Bytes other than the lowest one in each 32 bit lane index table entry 0 and
+// are masked out after the lookup.
+
+inline void make_lookup_table(FrameTypeMask mask, u8 *table)
+{
+    for (unsigned i=0; i<16; ++i)
+        table[i] = ((mask >> i) & 1u) ? 0xffu : 0x00u;
+}
+
+__attribute__((target("sse4.2")))
+inline __m128i match_sse42(__m128i words, __m128i lut)
+{
+    const __m128i nibbleMask = _mm_set1_epi32(0x0f);
+    const __m128i lowByte = _mm_set1_epi32(0xff);
+
+    __m128i typeLow = _mm_and_si128(_mm_srli_epi32(words, 24), nibbleMask);
+    __m128i lookup = _mm_and_si128(_mm_shuffle_epi8(lut, typeLow), lowByte);
+    __m128i isTypeF = _mm_cmpeq_epi32(_mm_srli_epi32(words, 28), nibbleMask);
+    return _mm_and_si128(_mm_cmpeq_epi32(lookup, lowByte), isTypeF);
+}
+
+__attribute__((target("sse4.2")))
+const u32 *find_frame_header_sse42(const u32 *begin, const u32 *end, FrameTypeMask mask)
+{
+    alignas(16) u8 table[16];
+    make_lookup_table(mask, table);
+    const __m128i lut = _mm_load_si128(reinterpret_cast<const __m128i *>(table));
+
+    const u32 *pos = begin;
+
+    for (; end - pos >= 8; pos += 8)
+    {
+        __m128i m0 = match_sse42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos)), lut);
+        __m128i m1 = match_sse42(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pos + 4)), lut);
+
+        if (_mm_testz_si128(_mm_or_si128(m0, m1), _mm_or_si128(m0, m1)))
+            continue;
+
+        if (int bits = _mm_movemask_ps(_mm_castsi128_ps(m0)))
+            return pos + __builtin_ctz(bits);
+
+        return pos + 4 + __builtin_ctz(_mm_movemask_ps(_mm_castsi128_ps(m1)));
+    }
+
+    return find_frame_header_scalar(pos, end, mask);
+}
+
+__attribute__((target("avx2")))
+inline __m256i match_avx2(__m256i words, __m256i lut)
+{
+    const __m256i nibbleMask = _mm256_set1_epi32(0x0f);
+    const __m256i lowByte = _mm256_set1_epi32(0xff);
+
+    __m256i typeLow = _mm256_and_si256(_mm256_srli_epi32(words, 24), nibbleMask);
+    __m256i lookup = _mm256_and_si256(_mm256_shuffle_epi8(lut, typeLow), lowByte);
+    __m256i isTypeF = _mm256_cmpeq_epi32(_mm256_srli_epi32(words, 28), nibbleMask);
+    return _mm256_and_si256(_mm256_cmpeq_epi32(lookup, lowByte), isTypeF);
+}
+
+__attribute__((target("avx2")))
+const u32 *find_frame_header_avx2(const u32 *begin, const u32 *end, FrameTypeMask mask)
+{
+    alignas(16) u8 table[16];
+    make_lookup_table(mask, table);
+    // vpshufb works on the two 128 bit lanes separately: use the same table in both.
+    const __m256i lut = _mm256_broadcastsi128_si256(
+        _mm_load_si128(reinterpret_cast<const __m128i *>(table)));
+
+    const u32 *pos = begin;
+
+    for (; end - pos >= 16; pos += 16)
+    {
+        __m256i m0 = match_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos)), lut);
+        __m256i m1 = match_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos + 8)), lut);
+
+        if (_mm256_testz_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m0, m1)))
+            continue;
+
+        if (int bits = _mm256_movemask_ps(_mm256_castsi256_ps(m0)))
+            return pos + __builtin_ctz(bits);
+
+        return pos + 8 + __builtin_ctz(_mm256_movemask_ps(_mm256_castsi256_ps(m1)));
+    }
+
+    return find_frame_header_scalar(pos, end, mask);
+}
+
+#endif // MVLC_FRAME_SCAN_X86
+
+bool cpu_supports(ScanImpl impl)
+{
+    switch (impl)
+    {
+        case ScanImpl::Scalar:
+            return true;
+
+#ifdef MVLC_FRAME_SCAN_X86
+        case ScanImpl::SSE42:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.2");
+
+        case ScanImpl::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#else
+        case ScanImpl::SSE42:
+        case ScanImpl::AVX2:
+            return false;
+#endif
+    }
+
+    return false;
+}
+
+using FindFunc = const u32 *(*)(const u32 *begin, const u32 *end, FrameTypeMask mask);
+
+FindFunc get_find_func(ScanImpl impl)
+{
+    if (!cpu_supports(impl))
+        return find_frame_header_scalar;
+
+    switch (impl)
+    {
+#ifdef MVLC_FRAME_SCAN_X86
+        case ScanImpl::SSE42:
+            return find_frame_header_sse42;
+
+        case ScanImpl::AVX2:
+            return find_frame_header_avx2;
+#endif
+
+        default:
+            break;
+    }
+
+    return find_frame_header_scalar;
+}
+
+} // end anon namespace
+
+FrameTypeMask readout_frame_types()
+{
+    return make_frame_type_mask(
+        {
+            frame_headers::StackFrame,
+            frame_headers::StackContinuation,
+            frame_headers::SystemEvent,
+        });
+}
+
+FrameTypeMask known_frame_types()
+{
+    return make_frame_type_mask(
+        {
+            frame_headers::SuperFrame,
+            frame_headers::SuperContinuation,
+            frame_headers::StackFrame,
+            frame_headers::BlockRead,
+            frame_headers::StackError,
+            frame_headers::StackContinuation,
+            frame_headers::SystemEvent,
+        });
+}
+
+const char *to_string(ScanImpl impl)
+{
+    switch (impl)
+    {
+        case ScanImpl::Scalar:
+            return "scalar";
+        case ScanImpl::SSE42:
+            return "sse4.2";
+        case ScanImpl::AVX2:
+            return "avx2";
+    }
+
+    return "unknown";
+}
+
+std::vector<ScanImpl> supported_scan_impls()
+{
+    std::vector<ScanImpl> result;
+
+    for (auto impl: { ScanImpl::Scalar, ScanImpl::SSE42, ScanImpl::AVX2 })
+    {
+        if (cpu_supports(impl))
+            result.push_back(impl);
+    }
+
+    return result;
+}
+
+ScanImpl best_scan_impl()
+{
+    static const ScanImpl best = supported_scan_impls().back();
+    return best;
+}
+
+const u32 *find_frame_header(const u32 *begin, const u32 *end, FrameTypeMask mask)
+{
+    static const FindFunc func = get_find_func(best_scan_impl());
+    return func(begin, end, mask);
+}
+
+const u32 *find_frame_header(const u32 *begin, const u32 *end, FrameTypeMask mask, ScanImpl impl)
+{
+    return get_find_func(impl)(begin, end, mask);
+}
+
+FollowState follow_frames(
+    const u32 *begin, const u32 *end, FrameTypeMask followMask, FrameTypeMask stopMask)
+{
+    const u32 *pos = begin;
+
+    while (pos < end)
+    {
+        const u32 header = *pos;
+
+        if (frame_type_matches(header, stopMask))
+            return { pos, FollowResult::StopType };
+
+        if (!frame_type_matches(header, followMask))
+            return { pos, FollowResult::InvalidHeader };
+
+        const size_t frameWords = 1u + ((header >> frame_headers::LengthShift) & frame_headers::LengthMask);
+
+        if (frameWords > static_cast<size_t>(end - pos))
+            return { pos, FollowResult::Incomplete };
+
+        pos += frameWords;
+    }
+
+    return { end, FollowResult::End };
+}
+
+} // end namespace frame_scan
+} // end namespace mvlc
+} // end namespace mesytec
@@ -0,0 +1,105 @@
+#ifndef __MESYTEC_MVLC_MVLC_FRAME_SCAN_H__
+#define __MESYTEC_MVLC_MVLC_FRAME_SCAN_H__
+
+#include <initializer_list>
+#include <vector>
+
+#include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mesytec-mvlc/mvlc_constants.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace frame_scan
+{
+
+// Kernels for locating MVLC frame headers in (possibly corrupted) readout
+// data. Used to resynchronize after data loss or corruption by the readout
+// worker, the listfile buffer fixup code and the readout parser.
+
+// Set of frame types to search for. All MVLC frame types are of the form
+// 0xFx, bit x of the mask selects type 0xFx.
+using FrameTypeMask = u16;
+
+inline FrameTypeMask make_frame_type_mask(std::initializer_list<u8> frameTypes)
+{
+    FrameTypeMask result = 0u;
+
+    for (u8 frameType: frameTypes)
+    {
+        if ((frameType & 0xf0u) == 0xf0u)
+            result |= 1u << (frameType & 0x0fu);
+    }
+
+    return result;
+}
+
+// Returns true if the type of the given header word is contained in the mask.
+inline bool frame_type_matches(u32 header, FrameTypeMask mask)
+{
+    const u32 frameType = header >> frame_headers::TypeShift;
+    return (frameType >> 4) == 0xfu && ((mask >> (frameType & 0x0fu)) & 1u);
+}
+
+// Frames that can appear in readout data: StackFrame, StackContinuation and
+// SystemEvent. The latter are inserted by the listfile_write_* functions.
+MESYTEC_MVLC_EXPORT FrameTypeMask readout_frame_types();
+
+// All known MVLC frame types, see is_known_frame_header().
+MESYTEC_MVLC_EXPORT FrameTypeMask known_frame_types();
+
+enum class ScanImpl
+{
+    Scalar,
+    SSE42,
+    AVX2,
+};
+
+MESYTEC_MVLC_EXPORT const char *to_string(ScanImpl impl);
+
+// Returns the scan implementations usable on the current CPU. Scalar is
+// always included.
+MESYTEC_MVLC_EXPORT std::vector<ScanImpl> supported_scan_impls();
+
+// The implementation selected at runtime for find_frame_header().
+MESYTEC_MVLC_EXPORT ScanImpl best_scan_impl();
+
+// Returns a pointer to the first word in [begin, end) whose frame type is
+// contained in the mask or 'end' if there is no such word. Dispatches to the
+// fastest implementation supported by the CPU.
+MESYTEC_MVLC_EXPORT const u32 *find_frame_header(
+    const u32 *begin, const u32 *end, FrameTypeMask mask);
+
+// Same as above using a specific implementation. Falls back to the scalar
+// version if the implementation is not supported by the CPU.
+MESYTEC_MVLC_EXPORT const u32 *find_frame_header(
+    const u32 *begin, const u32 *end, FrameTypeMask mask, ScanImpl impl);
+
+enum class FollowResult
+{
+    End,            // All frames were followed up to the end of the data.
+    StopType,       // Found a header with a type contained in the stop mask.
+    InvalidHeader,  // Found a header with a type not contained in the follow mask.
+    Incomplete,     // The frame at 'pos' extends past the end of the data.
+};
+
+struct FollowState
+{
+    const u32 *pos;
+    FollowResult result;
+};
+
+// Follows the frame structure starting at 'begin' which must point to a frame
+// header. Frames with a type contained in followMask are skipped based on
+// their length field. Stops at the first header matching stopMask, at the
+// first header not matching followMask or at a frame not fully contained in
+// the data. 'pos' points to the header word that caused the stop or to 'end'.
+MESYTEC_MVLC_EXPORT FollowState follow_frames(
+    const u32 *begin, const u32 *end, FrameTypeMask followMask, FrameTypeMask stopMask = 0u);
+
+} // end namespace frame_scan
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_MVLC_FRAME_SCAN_H__ */
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "mvlc_buffer_validators.h"
+#include "mvlc_frame_scan.h"
+#include "mvlc_util.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::frame_scan;
+
+namespace
+{
+
+const u32 *find_frame_header_reference(const u32 *begin, const u32 *end, FrameTypeMask mask)
+{
+    return std::find_if(begin, end, [mask] (u32 w) { return frame_type_matches(w, mask); });
+}
+
+// Random data words with occasional words that look like frame headers
+// including types outside of the 0xFx range and unknown 0xFx types.
+std::vector<u32> make_random_words(size_t count, std::mt19937 &rng)
+{
+    static const std::vector<u8> HeaderTypes =
+    {
+        frame_headers::StackFrame, frame_headers::BlockRead, frame_headers::StackError,
+        frame_headers::StackContinuation, frame_headers::SystemEvent,
+        0xf0, 0xff, 0xe3, 0x0f, 0x3f,
+    };
+
+    std::uniform_int_distribution<u32> wordDist;
+    std::uniform_int_distribution<size_t> typeDist(0, HeaderTypes.size() - 1);
+    std::bernoulli_distribution isHeader(1.0 / 64);
+    std::vector<u32> result(count);
+
+    for (auto &w: result)
+    {
+        w = wordDist(rng) & 0x7fffffffu; // no 0xFx type by default
+
+        if (isHeader(rng))
+            w = (w & 0x00ffffffu) | (static_cast<u32>(HeaderTypes[typeDist(rng)]) << 24);
+    }
+
+    return result;
+}
+
+// Stream of valid readout frames with random sizes. Payload words never look
+// like frame headers.
+std::vector<u32> make_frame_stream(size_t frameCount, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<u16> lenDist(0, 300);
+    std::uniform_int_distribution<u32> wordDist(0, 0x7fffffffu);
+    std::uniform_int_distribution<int> typeDist(0, 2);
+    const u8 types[] = { frame_headers::StackFrame, frame_headers::StackContinuation, frame_headers::SystemEvent };
+    std::vector<u32> result;
+
+    for (size_t fi=0; fi<frameCount; ++fi)
+    {
+        u16 len = lenDist(rng);
+        result.push_back(make_frame_header(types[typeDist(rng)], len));
+
+        for (u16 i=0; i<len; ++i)
+            result.push_back(wordDist(rng));
+    }
+
+    return result;
+}
+
+}
+
+TEST(mvlc_frame_scan, FrameTypeMask)
+{
+    auto mask = make_frame_type_mask({ frame_headers::StackFrame, frame_headers::SystemEvent });
+
+    ASSERT_TRUE(frame_type_matches(make_frame_header(frame_headers::StackFrame, 10), mask));
+    ASSERT_TRUE(frame_type_matches(make_frame_header(frame_headers::SystemEvent, 0), mask));
+    ASSERT_FALSE(frame_type_matches(make_frame_header(frame_headers::StackContinuation, 10), mask));
+    ASSERT_FALSE(frame_type_matches(make_frame_header(0xe3, 10), mask));
+    ASSERT_FALSE(frame_type_matches(0u, mask));
+
+    for (u32 type=0; type<=0xff; ++type)
+    {
+        ASSERT_EQ(frame_type_matches(type << 24, known_frame_types()),
+                  is_known_frame_header(type << 24)) << type;
+    }
+}
+
+TEST(mvlc_frame_scan, FindFrameHeaderRandomized)
+{
+    std::mt19937 rng(1234);
+    auto words = make_random_words(10000, rng);
+    const std::vector<FrameTypeMask> masks =
+    {
+        readout_frame_types(),
+        known_frame_types(),
+        make_frame_type_mask({ frame_headers::StackFrame }),
+        0xffffu,
+        0u,
+    };
+
+    std::uniform_int_distribution<size_t> offsetDist(0, words.size());
+
+    for (auto impl: supported_scan_impls())
+    {
+        SCOPED_TRACE(to_string(impl));
+
+        for (auto mask: masks)
+        {
+            // All short ranges at the start to cover the scalar tails.
+            for (size_t begin=0; begin<40; ++begin)
+            {
+                for (size_t end=begin; end<begin+40; ++end)
+                {
+                    ASSERT_EQ(find_frame_header(words.data() + begin, words.data() + end, mask, impl),
+                              find_frame_header_reference(words.data() + begin, words.data() + end, mask));
+                }
+            }
+
+            // Random ranges.
+            for (size_t i=0; i<1000; ++i)
+            {
+                size_t a = offsetDist(rng), b = offsetDist(rng);
+                const u32 *begin = words.data() + std::min(a, b);
+                const u32 *end = words.data() + std::max(a, b);
+
+                ASSERT_EQ(find_frame_header(begin, end, mask, impl),
+                          find_frame_header_reference(begin, end, mask));
+            }
+
+            // Walk all matches.
+            const u32 *pos = words.data();
+            const u32 *end = words.data() + words.size();
+            size_t matches = 0u;
+
+            while ((pos = find_frame_header(pos, end, mask, impl)) != end)
+            {
+                ASSERT_TRUE(frame_type_matches(*pos, mask));
+                ++matches;
+                ++pos;
+            }
+
+            ASSERT_EQ(matches, std::count_if(words.begin(), words.end(),
+                                             [mask] (u32 w) { return frame_type_matches(w, mask); }));
+        }
+    }
+
+    // The dispatching version must agree as well.
+    ASSERT_EQ(find_frame_header(words.data(), words.data() + words.size(), readout_frame_types()),
+              find_frame_header_reference(words.data(), words.data() + words.size(), readout_frame_types()));
+}
+
+TEST(mvlc_frame_scan, FollowFrames)
+{
+    const auto follow = make_frame_type_mask({ frame_headers::StackFrame, frame_headers::StackContinuation });
+    const auto stop = make_frame_type_mask({ frame_headers::SystemEvent });
+
+    std::vector<u32> data =
+    {
+        make_frame_header(frame_headers::StackFrame, 2), 1, 2,
+        make_frame_header(frame_headers::StackContinuation, 0),
+        make_frame_header(frame_headers::SystemEvent, 1), 3,
+        0x12345678,
+        make_frame_header(frame_headers::StackFrame, 5), 1, 2,
+    };
+
+    const u32 *begin = data.data();
+    const u32 *end = data.data() + data.size();
+
+    auto r = follow_frames(begin, begin + 4, follow, stop);
+    ASSERT_EQ(r.result, FollowResult::End);
+    ASSERT_EQ(r.pos, begin + 4);
+
+    r = follow_frames(begin, end, follow, stop);
+    ASSERT_EQ(r.result, FollowResult::StopType);
+    ASSERT_EQ(r.pos, begin + 4);
+
+    r = follow_frames(begin, end, follow | stop);
+    ASSERT_EQ(r.result, FollowResult::InvalidHeader);
+    ASSERT_EQ(r.pos, begin + 6);
+
+    r = follow_frames(begin + 7, end, follow);
+    ASSERT_EQ(r.result, FollowResult::Incomplete);
+    ASSERT_EQ(r.pos, begin + 7);
+
+    r = follow_frames(begin, begin + 2, follow);
+    ASSERT_EQ(r.result, FollowResult::Incomplete);
+    ASSERT_EQ(r.pos, begin);
+
+    r = follow_frames(end, end, follow);
+    ASSERT_EQ(r.result, FollowResult::End);
+}
+
+TEST(mvlc_frame_scan, FixupUsbIntactStream)
+{
+    std::mt19937 rng(42);
+    auto stream = make_frame_stream(200, rng);
+    std::uniform_int_distribution<size_t> cutDist(0, stream.size() * sizeof(u32));
+
+    for (size_t i=0; i<200; ++i)
+    {
+        const size_t cut = cutDist(rng);
+        const u8 *buf = reinterpret_cast<const u8 *>(stream.data());
+        std::vector<u8> tmp;
+
+        size_t moved = fixup_buffer_mvlc_usb(buf, cut, tmp);
+
+        ASSERT_EQ(moved, tmp.size());
+        ASSERT_LE(moved, cut);
+        ASSERT_TRUE(std::equal(tmp.begin(), tmp.end(), buf + cut - moved));
+
+        // The kept part must end on a frame boundary and the moved part must
+        // be the start of the next frame.
+        const u32 *begin = stream.data();
+        const size_t keptWords = (cut - moved) / sizeof(u32);
+        ASSERT_EQ((cut - moved) % sizeof(u32), 0u);
+        auto r = follow_frames(begin, begin + keptWords, readout_frame_types());
+        ASSERT_EQ(r.result, FollowResult::End);
+
+        if (moved >= sizeof(u32))
+        {
+            u32 header = begin[keptWords];
+            ASSERT_TRUE(frame_type_matches(header, readout_frame_types()));
+            ASSERT_GT((extract_frame_info(header).len + 1u) * sizeof(u32), moved);
+        }
+    }
+}
+
+TEST(mvlc_frame_scan, FixupUsbCorruptedStream)
+{
+    std::mt19937 rng(43);
+
+    for (size_t iteration=0; iteration<100; ++iteration)
+    {
+        auto stream = make_frame_stream(50, rng);
+
+        // Overwrite random words with garbage that may look like headers.
+        std::uniform_int_distribution<size_t> posDist(0, stream.size() - 1);
+        auto garbage = make_random_words(20, rng);
+
+        for (u32 w: garbage)
+            stream[posDist(rng)] = w;
+
+        std::uniform_int_distribution<size_t> cutDist(0, stream.size() * sizeof(u32));
+        const size_t cut = cutDist(rng);
+        const u8 *buf = reinterpret_cast<const u8 *>(stream.data());
+        std::vector<u8> tmp = { 0xaa }; // data is appended
+
+        size_t moved = fixup_buffer_mvlc_usb(buf, cut, tmp);
+
+        ASSERT_EQ(moved + 1, tmp.size());
+        ASSERT_LE(moved, cut);
+        ASSERT_TRUE(std::equal(tmp.begin() + 1, tmp.end(), buf + cut - moved));
+        ASSERT_EQ((cut - moved) % sizeof(u32), 0u);
+
+        // Following the kept part while skipping non header words must end
+        // exactly at the end of the kept data.
+        const auto known = known_frame_types();
+        const u32 *pos = stream.data();
+        const u32 *end = pos + (cut - moved) / sizeof(u32);
+
+        while (true)
+        {
+            auto r = follow_frames(pos, end, known);
+
+            if (r.result == FollowResult::InvalidHeader)
+            {
+                pos = find_frame_header(r.pos + 1, end, known);
+                continue;
+            }
+
+            ASSERT_EQ(r.result, FollowResult::End);
+            break;
+        }
+    }
+}
+
+TEST(mvlc_frame_scan, FixupUsbTrailingPartialWord)
+{
+    std::vector<u32> data =
+    {
+        make_frame_header(frame_headers::StackFrame, 1), 1,
+        make_frame_header(frame_headers::StackFrame, 1), 2,
+    };
+
+    std::vector<u8> tmp;
+    const u8 *buf = reinterpret_cast<const u8 *>(data.data());
+
+    ASSERT_EQ(fixup_buffer_mvlc_usb(buf, 4 * sizeof(u32) - 2, tmp), sizeof(u32) + 2);
+    ASSERT_EQ(tmp.size(), sizeof(u32) + 2);
+
+    tmp.clear();
+    ASSERT_EQ(fixup_buffer_mvlc_usb(buf, 2 * sizeof(u32) + 3, tmp), 3);
+}
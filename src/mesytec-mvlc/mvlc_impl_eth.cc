@@ -92,83 +92,60 @@ std::error_code send_delay_command(int delaySock, u16 delay_us)
     return {};
 };
 
-// This code increases the delay value by powers of two. The max value is 64k
-// so we need 16 steps to reach the maximum.
-static const unsigned EthThrottleSteps = 16;
-
-struct ReceiveBufferSnapshot
-{
-    u32 used = 0u;
-    u32 capacity = 0u;
-#ifndef __WIN32
-    ino_t inode = 0u;
-#endif
-};
-
-u16 throttle_exponential(eth::EthThrottleContext &ctx,  const ReceiveBufferSnapshot &bufferInfo) __attribute__((used));
-u16 throttle_linear(eth::EthThrottleContext &ctx, const ReceiveBufferSnapshot &bufferInfo) __attribute__((used));
-
-u16 throttle_exponential(eth::EthThrottleContext &ctx,  const ReceiveBufferSnapshot &bufferInfo)
+inline float calc_avg_delay(u16 curDelay, float lastAvg)
 {
-    /* At 50% buffer level start throttling. Delay value
-     * scales within the range of ctx.range of buffer usage
-     * from 1 to 2^16.
-     * So at buffer fill level of (ctx.threshold +
-     * ctx.range) the maximum delay value should be set,
-     * effectively blocking the MVLC from sending. Directly
-     * at threshold level the minimum delay of 1 should be
-     * set. In between scaling in powers of two is applied
-     * to the delay value. This means the scaling range is
-     * divided into 16 scaling steps so that at the maximum
-     * value a delay of 2^16 is calculated.
-     */
-
-    double bufferUse = bufferInfo.used * 1.0 / bufferInfo.capacity;
-    u16 delay = 0u;
-
-    if (bufferUse >= ctx.threshold)
-    {
-        const double throttleIncrement = ctx.range / EthThrottleSteps;
-        double aboveThreshold = bufferUse - ctx.threshold;
-        u32 increments = std::floor(aboveThreshold / throttleIncrement);
-
-        if (increments > EthThrottleSteps)
-            increments = EthThrottleSteps;
+    static const float Smoothing = 0.75;
 
-        delay = std::min(1u << increments, static_cast<u32>(std::numeric_limits<u16>::max()));
-    }
+    return Smoothing * curDelay + (1.0 - Smoothing) * lastAvg;
+}
 
-    return delay;
-};
+using eth::ReceiveBufferSnapshot;
 
-// Similar to throttle_exponential but apply linear throttling from 1 to 300
-// µs (at a=747.5).
-// in the range [ctx.threshold, ctx.treshold + ctx.range].
-u16 throttle_linear(eth::EthThrottleContext &ctx, const ReceiveBufferSnapshot &bufferInfo)
+// Runs the throttle policy selected in the context. The policy is recreated
+// if the selection changes while the throttler is running.
+class ThrottlePolicyRunner
 {
-    double bufferUse = bufferInfo.used * 1.0 / bufferInfo.capacity;
-    u16 delay = 0u;
+    public:
+        u16 operator()(Protected<eth::EthThrottleContext> &ctx, const ReceiveBufferSnapshot &bufferInfo)
+        {
+            // The context stays locked during the calculation which also keeps
+            // a custom policy alive.
+            auto ca = ctx.access();
+            eth::EthThrottlePolicy *policy = ca->customPolicy.get();
 
-    if (bufferUse >= ctx.threshold)
-    {
-        double aboveThreshold = bufferUse - ctx.threshold;
-        const double a = 747.5;
-        delay = a * aboveThreshold + 1;
-    }
+            if (!policy)
+            {
+                if (!m_ownPolicy || m_ownPolicyType != ca->policy)
+                {
+                    m_ownPolicy = eth::make_throttle_policy(ca->policy);
+                    m_ownPolicyType = ca->policy;
+                }
 
-    return delay;
-}
+                policy = m_ownPolicy.get();
+            }
 
-inline float calc_avg_delay(u16 curDelay, float lastAvg)
-{
-    static const float Smoothing = 0.75;
+            auto now = std::chrono::steady_clock::now();
+            std::chrono::microseconds elapsed = ca->queryDelay;
 
-    return Smoothing * curDelay + (1.0 - Smoothing) * lastAvg;
-}
+            if (policy != m_lastPolicy)
+            {
+                policy->reset();
+                m_lastPolicy = policy;
+            }
+            else
+                elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - m_lastCall);
+
+            m_lastCall = now;
 
-using ThrottleFunc = u16 (*)(eth::EthThrottleContext &ctx,  const ReceiveBufferSnapshot &bufferInfo);
+            return policy->calculateDelay(ca.ref(), bufferInfo, elapsed);
+        }
 
-static ThrottleFunc theThrottleFunc = throttle_exponential;
+    private:
+        std::unique_ptr<eth::EthThrottlePolicy> m_ownPolicy;
+        eth::EthThrottlePolicyType m_ownPolicyType = {};
+        eth::EthThrottlePolicy *m_lastPolicy = nullptr;
+        std::chrono::steady_clock::time_point m_lastCall;
+};
 
 #ifdef __linux__
 void mvlc_eth_throttler(
@@ -364,6 +341,7 @@ void mvlc_eth_throttler(
 
     u32 dataSocketInode = ctx.access()->dataSocketInode;
     s32 lastSentDelay = -1;
+    ThrottlePolicyRunner calculate_delay;
 
     logger->debug("mvlc_eth_throttler entering loop");
 
@@ -375,7 +353,7 @@ void mvlc_eth_throttler(
 
             if (res.second)
             {
-                u16 delay = theThrottleFunc(ctx.access().ref(), res.first);
+                u16 delay = calculate_delay(ctx, res.first);
 
                 if (lastSentDelay != static_cast<s32>(delay))
                 {
@@ -425,6 +403,7 @@ void mvlc_eth_throttler(
     static const unsigned Win32TimePeriod = 1;
     timeBeginPeriod(Win32TimePeriod);
     s32 lastSentDelay = -1;
+    ThrottlePolicyRunner calculate_delay;
 
     logger->debug("mvlc_eth_throttler entering loop");
 
@@ -446,7 +425,7 @@ void mvlc_eth_throttler(
 
         if (res == 0)
         {
-            u16 delay = theThrottleFunc(ctx.access().ref(), rbs);
+            u16 delay = calculate_delay(ctx, rbs);
 
             if (lastSentDelay != static_cast<s32>(delay))
             {
@@ -495,6 +474,36 @@ void mvlc_eth_throttler(
 }
 #endif
 
+// read_packet() and read() are called for every received datagram. Avoid the
+// logger registry lookup on each call.
+const std::shared_ptr<spdlog::logger> &eth_logger()
+{
+    static mesytec::mvlc::CachedLogger logger("mvlc_eth");
+    return logger.get();
+}
+
+inline void inc_counter(mesytec::mvlc::eth::StatsCounter &counter, u64 value = 1u)
+{
+    counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+template<typename Counters>
+void reset_counters(Counters &counters)
+{
+    for (auto &counter: counters)
+        counter.store(0u, std::memory_order_relaxed);
+}
+
+template<typename Dest, typename Counters>
+void copy_counters(Dest &dest, const Counters &counters)
+{
+    static_assert(std::tuple_size<Dest>::value == std::tuple_size<Counters>::value,
+                  "histogram size mismatch");
+
+    for (size_t i=0; i<counters.size(); ++i)
+        dest[i] = counters[i].load(std::memory_order_relaxed);
+}
+
 } // end anon namespace
 
 namespace mesytec
@@ -504,11 +513,70 @@ namespace mvlc
 namespace eth
 {
 
+void PipeCounters::reset()
+{
+    receiveAttempts = 0u;
+    receivedPackets = 0u;
+    receivedBytes = 0u;
+    shortPackets = 0u;
+    packetsWithResidue = 0u;
+    noHeader = 0u;
+    headerOutOfRange = 0u;
+    packetChannelOutOfRange = 0u;
+    lostPackets = 0u;
+    reset_counters(packetSizes);
+    reset_counters(headerTypes);
+}
+
+PipeStats PipeCounters::snapshot() const
+{
+    PipeStats result;
+    result.receiveAttempts = receiveAttempts.load(std::memory_order_relaxed);
+    result.receivedPackets = receivedPackets.load(std::memory_order_relaxed);
+    result.receivedBytes = receivedBytes.load(std::memory_order_relaxed);
+    result.shortPackets = shortPackets.load(std::memory_order_relaxed);
+    result.packetsWithResidue = packetsWithResidue.load(std::memory_order_relaxed);
+    result.noHeader = noHeader.load(std::memory_order_relaxed);
+    result.headerOutOfRange = headerOutOfRange.load(std::memory_order_relaxed);
+    result.packetChannelOutOfRange = packetChannelOutOfRange.load(std::memory_order_relaxed);
+    result.lostPackets = lostPackets.load(std::memory_order_relaxed);
+    copy_counters(result.packetSizes, packetSizes);
+    copy_counters(result.headerTypes, headerTypes);
+    return result;
+}
+
+void PacketChannelCounters::reset()
+{
+    receivedPackets = 0u;
+    receivedBytes = 0u;
+    lostPackets = 0u;
+    noHeader = 0u;
+    headerOutOfRange = 0u;
+    reset_counters(packetSizes);
+    reset_counters(headerTypes);
+}
+
+PacketChannelStats PacketChannelCounters::snapshot() const
+{
+    PacketChannelStats result;
+    result.receivedPackets = receivedPackets.load(std::memory_order_relaxed);
+    result.receivedBytes = receivedBytes.load(std::memory_order_relaxed);
+    result.lostPackets = lostPackets.load(std::memory_order_relaxed);
+    result.noHeader = noHeader.load(std::memory_order_relaxed);
+    result.headerOutOfRange = headerOutOfRange.load(std::memory_order_relaxed);
+    copy_counters(result.packetSizes, packetSizes);
+    copy_counters(result.headerTypes, headerTypes);
+    return result;
+}
+
 Impl::Impl(const std::string &host)
     : m_host(host)
     , m_throttleCounters()
     , m_throttleContext()
 {
+    for (auto &lastPacketNumber: m_lastPacketNumbers)
+        lastPacketNumber = -1;
+
 #ifdef __WIN32
     WORD wVersionRequested;
     WSADATA wsaData;
@@ -868,17 +936,11 @@ std::error_code Impl::write(Pipe pipe, const u8 *buffer, size_t size,
 
 PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
 {
-    auto logger = get_logger("mvlc_eth");
+    auto &logger = eth_logger();
 
     PacketReadResult res = {};
 
     unsigned pipe = static_cast<unsigned>(pipe_);
-    auto &pipeStats = m_pipeStats[pipe];
-
-    {
-        UniqueLock guard(m_statsMutex);
-        ++pipeStats.receiveAttempts;
-    }
 
     if (pipe >= PipeCount)
     {
@@ -886,6 +948,8 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
         return res;
     }
 
+    inc_counter(m_pipeStats[pipe].receiveAttempts);
+
     if (!isConnected())
     {
         res.ec = make_error_code(MVLCErrorCode::IsDisconnected);
@@ -903,6 +967,104 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
     if (res.ec && res.bytesTransferred == 0)
         return res;
 
+    handleReceivedPacket(pipe, res, logger);
+
+    return res;
+}
+
+size_t Impl::read_packets(Pipe pipe_, u8 *buffer, size_t size,
+                          PacketReadResult *results, size_t maxPackets)
+{
+    unsigned pipe = static_cast<unsigned>(pipe_);
+
+    if (maxPackets == 0 || size == 0)
+        return 0u;
+
+    if (pipe >= PipeCount)
+    {
+        results[0] = {};
+        results[0].ec = make_error_code(MVLCErrorCode::InvalidPipe);
+        return 1u;
+    }
+
+    if (!isConnected())
+    {
+        results[0] = {};
+        results[0].ec = make_error_code(MVLCErrorCode::IsDisconnected);
+        return 1u;
+    }
+
+#ifdef __linux__
+    auto &logger = eth_logger();
+
+    // Split the dest buffer into slots of ReadPacketsSlotSize. If the buffer
+    // is smaller than a single slot use all of it for one packet.
+    size_t slotCount = std::min({ maxPackets, size / ReadPacketsSlotSize, ReadPacketsMaxBatchSize });
+    size_t slotSize = ReadPacketsSlotSize;
+
+    if (slotCount == 0)
+    {
+        slotCount = 1;
+        slotSize = size;
+    }
+
+    std::array<struct iovec, ReadPacketsMaxBatchSize> iovecs;
+    std::array<struct mmsghdr, ReadPacketsMaxBatchSize> msgs;
+
+    for (size_t i=0; i<slotCount; ++i)
+    {
+        iovecs[i].iov_base = buffer + i * slotSize;
+        iovecs[i].iov_len = slotSize;
+        msgs[i] = {};
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    inc_counter(m_pipeStats[pipe].receiveAttempts);
+
+    // MSG_WAITFORONE: block (subject to SO_RCVTIMEO) until the first datagram
+    // arrives, then collect whatever else is queued up without blocking.
+    int received = ::recvmmsg(getSocket(pipe_), msgs.data(), slotCount, MSG_WAITFORONE, nullptr);
+
+    if (received <= 0)
+    {
+        results[0] = {};
+        results[0].buffer = buffer;
+
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            results[0].ec = std::error_code(EAGAIN, std::system_category());
+        else if (received < 0)
+            results[0].ec = std::error_code(errno, std::system_category());
+
+        return 1u;
+    }
+
+    logger->trace("read_packets: pipe={}, received {} packets using a single recvmmsg() call",
+                  pipe, received);
+
+    for (int i=0; i<received; ++i)
+    {
+        auto &res = results[i];
+        res = {};
+        res.buffer = buffer + i * slotSize;
+        res.bytesTransferred = msgs[i].msg_len;
+        handleReceivedPacket(pipe, res, logger);
+    }
+
+    return received;
+#else
+    // No batched receive available on this platform: fall back to reading a
+    // single packet.
+    results[0] = read_packet(pipe_, buffer, std::min(size, ReadPacketsSlotSize));
+    return 1u;
+#endif
+}
+
+void Impl::handleReceivedPacket(unsigned pipe, PacketReadResult &res,
+                                const std::shared_ptr<spdlog::logger> &logger)
+{
+    auto &pipeStats = m_pipeStats[pipe];
+
     if (res.bytesTransferred >= sizeof(u32)
         && logger->should_log(spdlog::level::trace))
     {
@@ -913,22 +1075,18 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
         log_buffer(logger, spdlog::level::trace, view, "read_packet(): 32 bit words in packet");
     }
 
-    {
-        UniqueLock guard(m_statsMutex);
-        ++pipeStats.receivedPackets;
-        pipeStats.receivedBytes += res.bytesTransferred;
-        ++pipeStats.packetSizes[res.bytesTransferred];
-    }
+    inc_counter(pipeStats.receivedPackets);
+    inc_counter(pipeStats.receivedBytes, res.bytesTransferred);
+    inc_counter(pipeStats.packetSizes[packet_size_bin(res.bytesTransferred)]);
 
     logger->trace("read_packet: pipe={}, res.bytesTransferred={}", pipe, res.bytesTransferred);
 
     if (!res.hasHeaders())
     {
-        UniqueLock guard(m_statsMutex);
-        ++pipeStats.shortPackets;
+        inc_counter(pipeStats.shortPackets);
         logger->warn("read_packet: pipe={}, received data is smaller than the MVLC UDP header size", pipe);
         res.ec = make_error_code(MVLCErrorCode::ShortRead);
-        return res;
+        return;
     }
 
     logger->trace("read_packet: pipe={}, header0=0x{:008x} -> packetChannel={}, packetNumber={}, controllerId={}, wordCount={}",
@@ -943,7 +1101,7 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
     if (res.dataWordCount() > res.availablePayloadWords())
     {
         res.ec = make_error_code(MVLCErrorCode::UDPDataWordCountExceedsPacketSize);
-        return res;
+        return;
     }
 
     // This is a workaround for an issue in Windows 10 Build 2004 where
@@ -961,28 +1119,23 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
     {
         logger->warn("read_packet: pipe={}, {} leftover bytes in received packet",
                  pipe, res.leftoverBytes());
-        UniqueLock guard(m_statsMutex);
-        ++pipeStats.packetsWithResidue;
+        inc_counter(pipeStats.packetsWithResidue);
     }
 
     if (res.packetChannel() >= NumPacketChannels)
     {
         logger->warn("read_packet: pipe={}, packet channel number out of range: {}", pipe, res.packetChannel());
-        UniqueLock guard(m_statsMutex);
-        ++pipeStats.packetChannelOutOfRange;
+        inc_counter(pipeStats.packetChannelOutOfRange);
         res.ec = make_error_code(MVLCErrorCode::UDPPacketChannelOutOfRange);
-        return res;
+        return;
     }
 
     auto &channelStats = m_packetChannelStats[res.packetChannel()];
-    {
-        UniqueLock guard(m_statsMutex);
-        ++channelStats.receivedPackets;
-        channelStats.receivedBytes += res.bytesTransferred;
-    }
+    inc_counter(channelStats.receivedPackets);
+    inc_counter(channelStats.receivedBytes, res.bytesTransferred);
 
     {
-        auto &lastPacketNumber = m_lastPacketNumbers[res.packetChannel()];
+        s32 lastPacketNumber = m_lastPacketNumbers[res.packetChannel()].load(std::memory_order_relaxed);
 
         logger->trace("read_packet: pipe={}, packetChannel={}, packetNumber={}, lastPacketNumber={}",
                   pipe, res.packetChannel(), res.packetNumber(), lastPacketNumber);
@@ -1000,17 +1153,13 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
             }
 
             res.lostPackets = loss;
-            UniqueLock guard(m_statsMutex);
-            pipeStats.lostPackets += loss;
-            channelStats.lostPackets += loss;
+            inc_counter(pipeStats.lostPackets, loss);
+            inc_counter(channelStats.lostPackets, loss);
         }
 
-        lastPacketNumber = res.packetNumber();
+        m_lastPacketNumbers[res.packetChannel()].store(res.packetNumber(), std::memory_order_relaxed);
 
-        {
-            UniqueLock guard(m_statsMutex);
-            ++channelStats.packetSizes[res.bytesTransferred];
-        }
+        inc_counter(channelStats.packetSizes[packet_size_bin(res.bytesTransferred)]);
     }
 
     // Check where nextHeaderPointer is pointing to
@@ -1022,9 +1171,8 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
 
         if (headerp >= end)
         {
-            UniqueLock guard(m_statsMutex);
-            ++pipeStats.headerOutOfRange;
-            ++channelStats.headerOutOfRange;
+            inc_counter(pipeStats.headerOutOfRange);
+            inc_counter(channelStats.headerOutOfRange);
 
             logger->info("read_packet: pipe={}, nextHeaderPointer out of range: nHPtr={}, "
                      "availDataWords={}, pktChan={}, pktNum={}, pktSize={} bytes",
@@ -1037,21 +1185,17 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
             logger->trace("read_packet: pipe={}, nextHeaderPointer={} -> header=0x{:008x}",
                       pipe, res.nextHeaderPointer(), header);
             u32 type = get_frame_type(header);
-            UniqueLock guard(m_statsMutex);
-            ++pipeStats.headerTypes[type];
-            ++channelStats.headerTypes[type];
+            inc_counter(pipeStats.headerTypes[type]);
+            inc_counter(channelStats.headerTypes[type]);
         }
     }
     else
     {
         logger->trace("read_packet: pipe={}, NoHeaderPointerPresent, eth header1=0x{:008x}",
                   pipe, res.header1());
-        UniqueLock guard(m_statsMutex);
-        ++pipeStats.noHeader;
-        ++channelStats.noHeader;
+        inc_counter(pipeStats.noHeader);
+        inc_counter(channelStats.noHeader);
     }
-
-    return res;
 }
 
 /* initial:
@@ -1069,7 +1213,7 @@ PacketReadResult Impl::read_packet(Pipe pipe_, u8 *buffer, size_t size)
 std::error_code Impl::read(Pipe pipe_, u8 *buffer, size_t size,
                            size_t &bytesTransferred)
 {
-    auto logger = get_logger("mvlc_eth");
+    auto &logger = eth_logger();
 
     unsigned pipe = static_cast<unsigned>(pipe_);
 
@@ -1183,22 +1327,34 @@ std::error_code Impl::getReadQueueSize(Pipe pipe_, u32 &dest)
 
 std::array<PipeStats, PipeCount> Impl::getPipeStats() const
 {
-    UniqueLock guard(m_statsMutex);
-    return m_pipeStats;
+    std::array<PipeStats, PipeCount> result;
+
+    for (size_t pipe=0; pipe<PipeCount; ++pipe)
+        result[pipe] = m_pipeStats[pipe].snapshot();
+
+    return result;
 }
 
 std::array<PacketChannelStats, NumPacketChannels> Impl::getPacketChannelStats() const
 {
-    UniqueLock guard(m_statsMutex);
-    return m_packetChannelStats;
+    std::array<PacketChannelStats, NumPacketChannels> result;
+
+    for (size_t chan=0; chan<NumPacketChannels; ++chan)
+        result[chan] = m_packetChannelStats[chan].snapshot();
+
+    return result;
 }
 
 void Impl::resetPipeAndChannelStats()
 {
-    UniqueLock guard(m_statsMutex);
-    m_pipeStats = {};
-    m_packetChannelStats = {};
-    std::fill(m_lastPacketNumbers.begin(), m_lastPacketNumbers.end(), -1);
+    for (auto &stats: m_pipeStats)
+        stats.reset();
+
+    for (auto &stats: m_packetChannelStats)
+        stats.reset();
+
+    for (auto &lastPacketNumber: m_lastPacketNumbers)
+        lastPacketNumber = -1;
 }
 
 u32 Impl::getCmdAddress() const
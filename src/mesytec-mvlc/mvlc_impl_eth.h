@@ -35,6 +35,7 @@
 #endif
 
 #include <array>
+#include <atomic>
 #include <fstream>
 #include <string>
 #include <thread>
@@ -44,8 +45,9 @@
 #include "mesytec-mvlc/mvlc_constants.h"
 #include "mesytec-mvlc/mvlc_counters.h"
 #include "mesytec-mvlc/mvlc_eth_interface.h"
+#include "mesytec-mvlc/mvlc_eth_throttle.h"
+#include "mesytec-mvlc/util/logging.h"
 #include "mesytec-mvlc/util/protected.h"
-#include "mesytec-mvlc/util/ticketmutex.h"
 
 namespace mesytec
 {
@@ -54,29 +56,45 @@ namespace mvlc
 namespace eth
 {
 
-struct EthThrottleContext
-{
-#ifndef __WIN32
-    u32 dataSocketInode; // Inode of the socket used for MVLCs data pipe. This is needed
-                         // to correctly identify the socket in the netlink response data.
-#else
-    int dataSocket = -1; // File descriptor of the data pipe socket.
-    int dataSocketReceiveBufferSize; // Size in bytes of the receive buffer in the OS.
-#endif
-
-    int delaySocket = -1; // The socket used for sending delay commands to the MVLC.
+// Live versions of PipeStats and PacketChannelStats. The counters are updated
+// by the reading threads using relaxed atomics so that receiving a packet never
+// locks or allocates. snapshot() copies the current values into the plain
+// structs. The copy is not atomic as a whole: counters incremented during the
+// snapshot may or may not be included.
+using StatsCounter = std::atomic<u64>;
 
-    // Amount of time to sleep after each cycle. This directly affects the number of
-    // measurements taken and the number of delay packets sent out per second!
-    std::chrono::milliseconds queryDelay = std::chrono::milliseconds(1);
-
-    float threshold = 0.5; // Throttling begins when buffer fill level / buffer capacity is above this level.
-    float range = 0.45; // The buffer fill level range until max throttle is reached.
-                        // Throttling starts at threshold and reaches its max value at
-                        // threshold+range.
-    bool quit = false; // Set to true to make the throttler thread quit
+struct PipeCounters
+{
+    StatsCounter receiveAttempts;
+    StatsCounter receivedPackets;
+    StatsCounter receivedBytes;
+    StatsCounter shortPackets;
+    StatsCounter packetsWithResidue;
+    StatsCounter noHeader;
+    StatsCounter headerOutOfRange;
+    StatsCounter packetChannelOutOfRange;
+    StatsCounter lostPackets;
+    std::array<StatsCounter, PacketSizeBins> packetSizes;
+    std::array<StatsCounter, HeaderTypeBins> headerTypes;
+
+    PipeCounters() { reset(); }
+    void reset();
+    PipeStats snapshot() const;
+};
 
-    std::ofstream debugOut; // Will receive throttling debug output if open.
+struct PacketChannelCounters
+{
+    StatsCounter receivedPackets;
+    StatsCounter receivedBytes;
+    StatsCounter lostPackets;
+    StatsCounter noHeader;
+    StatsCounter headerOutOfRange;
+    std::array<StatsCounter, PacketSizeBins> packetSizes;
+    std::array<StatsCounter, HeaderTypeBins> headerTypes;
+
+    PacketChannelCounters() { reset(); }
+    void reset();
+    PacketChannelStats snapshot() const;
 };
 
 class MESYTEC_MVLC_EXPORT Impl: public MVLCBasicInterface, public MVLC_ETH_Interface
@@ -96,6 +114,8 @@ class MESYTEC_MVLC_EXPORT Impl: public MVLCBasicInterface, public MVLC_ETH_Inter
                              size_t &bytesTransferred) override;
 
         PacketReadResult read_packet(Pipe pipe, u8 *buffer, size_t size) override;
+        size_t read_packets(Pipe pipe, u8 *buffer, size_t size,
+                            PacketReadResult *results, size_t maxPackets) override;
 
         ConnectionType connectionType() const override { return ConnectionType::ETH; }
         std::string connectionInfo() const override;
@@ -129,9 +149,19 @@ class MESYTEC_MVLC_EXPORT Impl: public MVLCBasicInterface, public MVLC_ETH_Inter
 
         EthThrottleCounters getThrottleCounters() const override;
 
+        // Throttling parameters and policy selection. Changes take effect
+        // while the throttler thread is running.
+        Protected<EthThrottleContext> &getThrottleContext() { return m_throttleContext; }
+
         int getSocket(Pipe pipe) { return pipe == Pipe::Command ? m_cmdSock : m_dataSock; }
 
     private:
+        // Validates the headers of a freshly received packet and updates the
+        // pipe and packet channel stats including packet loss. Sets res.ec if
+        // the packet is not usable. Lock-free, may be called concurrently for
+        // different pipes.
+        void handleReceivedPacket(unsigned pipe, PacketReadResult &res,
+                                  const std::shared_ptr<spdlog::logger> &logger);
 
         std::string m_host;
         int m_cmdSock = -1;
@@ -157,11 +187,12 @@ class MESYTEC_MVLC_EXPORT Impl: public MVLCBasicInterface, public MVLC_ETH_Inter
         };
 
         std::array<ReceiveBuffer, PipeCount> m_receiveBuffers;
-        std::array<PipeStats, PipeCount> m_pipeStats;
-        std::array<PacketChannelStats, NumPacketChannels> m_packetChannelStats;
-        std::array<s32, NumPacketChannels> m_lastPacketNumbers;
+        std::array<PipeCounters, PipeCount> m_pipeStats;
+        std::array<PacketChannelCounters, NumPacketChannels> m_packetChannelStats;
+        // Initially -1. Written by the thread reading the pipe the packet
+        // channel is routed to and by resetPipeAndChannelStats().
+        std::array<std::atomic<s32>, NumPacketChannels> m_lastPacketNumbers;
         bool m_disableTriggersOnConnect = false;
-        mutable TicketMutex m_statsMutex;
         mutable Protected<EthThrottleCounters> m_throttleCounters;
         Protected<EthThrottleContext> m_throttleContext;
         std::thread m_throttleThread;
@@ -0,0 +1,189 @@
+#include "gtest/gtest.h"
+
+#ifndef __WIN32
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#endif
+
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "mvlc_error.h"
+#include "mvlc_eth_fake_responder.h"
+#include "mvlc_impl_eth.h"
+#include "util/udp_sockets.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::eth;
+
+#ifndef __WIN32
+
+TEST(mvlc_impl_eth, ReadPacketsLossAccounting)
+{
+    std::error_code ec;
+    int fakeCmdSock = bind_udp_socket(CommandPort, &ec);
+    int fakeDataSock = bind_udp_socket(DataPort, &ec);
+
+    if (fakeCmdSock < 0 || fakeDataSock < 0)
+    {
+        if (fakeCmdSock >= 0) close_socket(fakeCmdSock);
+        if (fakeDataSock >= 0) close_socket(fakeDataSock);
+        GTEST_SKIP() << "could not bind the MVLC UDP ports on localhost: " << ec.message();
+    }
+
+    std::atomic<bool> quitResponder{false};
+    std::thread responderThread(fake_command_responder, fakeCmdSock, std::ref(quitResponder));
+
+    // Stops the responder and closes the fake sockets even if an assertion
+    // returns early from the test.
+    struct Cleanup
+    {
+        std::atomic<bool> &quit;
+        std::thread &thread;
+        int cmdSock;
+        int dataSock;
+
+        ~Cleanup()
+        {
+            quit = true;
+            if (thread.joinable())
+                thread.join();
+            close_socket(cmdSock);
+            close_socket(dataSock);
+        }
+    } cleanup{quitResponder, responderThread, fakeCmdSock, fakeDataSock};
+
+    {
+        Impl mvlc("127.0.0.1");
+
+        ASSERT_FALSE(mvlc.connect());
+
+        // Address of the data socket of the eth::Impl instance.
+        sockaddr_in dataDest = {};
+        dataDest.sin_family = AF_INET;
+        dataDest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        dataDest.sin_port = htons(get_local_socket_port(mvlc.getSocket(Pipe::Data)));
+
+        static const size_t BurstCount = 64;
+        static const size_t PacketsPerBurst = 16;
+        static const u16 PayloadWords = 100;
+
+        // Start close to the 12 bit packet number wrap-around. Skip every 5th
+        // packet number to simulate packet loss.
+        u16 nextPacketNumber = header0::PacketNumberMask - 30;
+        u64 expectedLoss = 0u;
+        u64 sentPackets = 0u;
+        u64 observedLoss = 0u;
+
+        std::vector<u8> destBuffer(ReadPacketsMaxBatchSize * ReadPacketsSlotSize);
+        std::array<PacketReadResult, ReadPacketsMaxBatchSize> results;
+
+        for (size_t burst=0; burst<BurstCount; ++burst)
+        {
+            std::vector<s32> expectedLosses;
+
+            for (size_t i=0; i<PacketsPerBurst; ++i)
+            {
+                s32 lossBefore = 0;
+
+                if (nextPacketNumber % 5 == 0)
+                {
+                    nextPacketNumber = (nextPacketNumber + 1) & header0::PacketNumberMask;
+                    ++lossBefore;
+                }
+
+                std::vector<u32> packet =
+                {
+                    make_header0(PacketChannel::Data, nextPacketNumber, PayloadWords),
+                    make_header1(0),
+                    make_frame_header(frame_headers::StackFrame, PayloadWords - 1u),
+                };
+
+                for (u16 w=0; w<PayloadWords-1u; ++w)
+                    packet.push_back(w);
+
+                send_words(fakeDataSock, dataDest, packet);
+
+                // The very first packet cannot yield a loss value.
+                if (sentPackets == 0)
+                    lossBefore = 0;
+
+                expectedLoss += lossBefore;
+                expectedLosses.push_back(lossBefore);
+                ++sentPackets;
+                nextPacketNumber = (nextPacketNumber + 1) & header0::PacketNumberMask;
+            }
+
+            size_t receivedInBurst = 0u;
+            size_t readCalls = 0u;
+
+            while (receivedInBurst < PacketsPerBurst)
+            {
+                size_t count = mvlc.read_packets(
+                    Pipe::Data, destBuffer.data(), destBuffer.size(),
+                    results.data(), results.size());
+
+                ++readCalls;
+
+                ASSERT_GT(count, 0u);
+                ASSERT_FALSE(results[0].ec) << results[0].ec.message();
+
+                for (size_t i=0; i<count; ++i)
+                {
+                    const auto &res = results[i];
+                    ASSERT_FALSE(res.ec) << res.ec.message();
+                    ASSERT_EQ(res.buffer, destBuffer.data() + i * ReadPacketsSlotSize);
+                    ASSERT_EQ(res.bytesTransferred, (PayloadWords + HeaderWords) * sizeof(u32));
+                    ASSERT_EQ(res.dataWordCount(), PayloadWords);
+                    ASSERT_EQ(res.lostPackets, expectedLosses.at(receivedInBurst + i));
+                    observedLoss += res.lostPackets;
+                }
+
+                receivedInBurst += count;
+            }
+
+            ASSERT_EQ(receivedInBurst, PacketsPerBurst);
+
+#ifdef __linux__
+            // All packets of a burst are queued in the socket before reading
+            // starts, so recvmmsg() must return them all at once.
+            ASSERT_EQ(readCalls, 1u);
+#endif
+        }
+
+        ASSERT_EQ(observedLoss, expectedLoss);
+        ASSERT_GT(expectedLoss, 0u);
+
+        auto pipeStats = mvlc.getPipeStats()[DataPipe];
+        ASSERT_EQ(pipeStats.receivedPackets, sentPackets);
+        ASSERT_EQ(pipeStats.lostPackets, expectedLoss);
+
+        // All packets have the same size and start with a stack frame header.
+        const size_t packetBytes = (PayloadWords + HeaderWords) * sizeof(u32);
+        ASSERT_EQ(pipeStats.packetSizes[packet_size_bin(packetBytes)], sentPackets);
+        ASSERT_EQ(pipeStats.headerTypes[frame_headers::StackFrame], sentPackets);
+        ASSERT_EQ(std::accumulate(pipeStats.packetSizes.begin(), pipeStats.packetSizes.end(), u64(0)), sentPackets);
+
+        auto channelStats = mvlc.getPacketChannelStats()[static_cast<u8>(PacketChannel::Data)];
+        ASSERT_EQ(channelStats.receivedPackets, sentPackets);
+        ASSERT_EQ(channelStats.lostPackets, expectedLoss);
+        ASSERT_EQ(channelStats.packetSizes[packet_size_bin(packetBytes)], sentPackets);
+        ASSERT_EQ(channelStats.headerTypes[frame_headers::StackFrame], sentPackets);
+
+        mvlc.resetPipeAndChannelStats();
+        ASSERT_EQ(mvlc.getPipeStats()[DataPipe].receivedPackets, 0u);
+        ASSERT_EQ(mvlc.getPipeStats()[DataPipe].packetSizes[packet_size_bin(packetBytes)], 0u);
+
+        // Nothing left to read: expect a single result carrying a timeout.
+        size_t count = mvlc.read_packets(
+            Pipe::Data, destBuffer.data(), destBuffer.size(),
+            results.data(), results.size());
+        ASSERT_EQ(count, 1u);
+        ASSERT_EQ(results[0].ec, ErrorType::Timeout);
+        ASSERT_EQ(results[0].bytesTransferred, 0u);
+    }
+}
+
+#endif // !__WIN32
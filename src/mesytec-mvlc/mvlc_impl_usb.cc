@@ -368,6 +368,14 @@ std::error_code post_connect_cleanup(mesytec::mvlc::usb::Impl &impl)
     return ec;
 }
 
+// Cached logger for the read and write paths which are used for every
+// command and readout buffer.
+const std::shared_ptr<spdlog::logger> &usb_logger()
+{
+    static CachedLogger logger("mvlc_usb");
+    return logger.get();
+}
+
 } // end anon namespace
 
 namespace mesytec::mvlc::usb
@@ -661,7 +669,7 @@ bool Impl::isConnected() const
 std::error_code Impl::write(Pipe pipe, const u8 *buffer, size_t size,
                             size_t &bytesTransferred)
 {
-    auto logger = get_logger("mvlc_usb");
+    auto &logger = usb_logger();
 
     assert(buffer);
     assert(size <= USBSingleTransferMaxBytes);
@@ -772,7 +780,7 @@ std::error_code Impl::write(Pipe pipe, const u8 *buffer, size_t size,
 std::error_code Impl::write(Pipe pipe, const u8 *buffer, size_t size,
                             size_t &bytesTransferred)
 {
-    auto logger = get_logger("mvlc_usb");
+    auto &logger = usb_logger();
 
     assert(buffer);
     assert(size <= USBSingleTransferMaxBytes);
@@ -825,7 +833,7 @@ std::error_code Impl::write(Pipe pipe, const u8 *buffer, size_t size,
 std::error_code Impl::read(Pipe pipe, u8 *buffer, size_t size,
                            size_t &bytesTransferred)
 {
-    auto logger = get_logger("mvlc_usb");
+    auto &logger = usb_logger();
 
     assert(buffer);
     assert(size <= USBSingleTransferMaxBytes);
@@ -974,7 +982,7 @@ std::error_code Impl::read(Pipe pipe, u8 *buffer, size_t size,
 std::error_code Impl::read(Pipe pipe, u8 *buffer, size_t size,
                            size_t &bytesTransferred)
 {
-    auto logger = get_logger("mvlc_usb");
+    auto &logger = usb_logger();
 
     assert(buffer);
     assert(size <= USBSingleTransferMaxBytes);
@@ -1034,7 +1042,7 @@ std::error_code Impl::read(Pipe pipe, u8 *buffer, size_t size,
 std::error_code Impl::read_unbuffered(Pipe pipe, u8 *buffer, size_t size,
                                       size_t &bytesTransferred)
 {
-    auto logger = get_logger("mvlc_usb");
+    auto &logger = usb_logger();
 
     assert(buffer);
     assert(static_cast<unsigned>(pipe) < PipeCount);
@@ -0,0 +1,380 @@
+#include "mvlc_listfile_mmap.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef __WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <mz.h>
+#include <mz_strm.h>
+#include <mz_strm_os.h>
+#include <mz_zip.h>
+#include <mz_zip_rw.h>
+
+#include "mvlc_util.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace listfile
+{
+
+namespace
+{
+
+class MappedReadHandle: public ReadHandle
+{
+    public:
+        MappedReadHandle(const u8 *data, size_t size)
+            : data_(data)
+            , size_(size)
+        {
+        }
+
+        size_t read(u8 *dest, size_t maxSize) override
+        {
+            const size_t toRead = std::min(maxSize, size_ - pos_);
+            std::memcpy(dest, data_ + pos_, toRead);
+            pos_ += toRead;
+            return toRead;
+        }
+
+        size_t seek(size_t pos) override
+        {
+            pos_ = std::min(pos, size_);
+            return pos_;
+        }
+
+    private:
+        const u8 *data_;
+        size_t size_;
+        size_t pos_ = 0;
+};
+
+// Returns the offset and size of the data of a stored zip entry inside the
+// archive file.
+std::pair<size_t, size_t> locate_stored_zip_entry(
+    const std::string &archiveName, const std::string &entryName)
+{
+    void *osStream = nullptr;
+    void *reader = nullptr;
+    mz_stream_os_create(&osStream);
+    mz_zip_reader_create(&reader);
+
+    auto cleanup = [&]
+    {
+        mz_zip_reader_close(reader);
+        mz_stream_os_close(osStream);
+        mz_zip_reader_delete(&reader);
+        mz_stream_os_delete(&osStream);
+    };
+
+    try
+    {
+        if (auto err = mz_stream_os_open(osStream, archiveName.c_str(), MZ_OPEN_MODE_READ))
+            throw std::runtime_error("mz_stream_os_open: " + std::to_string(err));
+
+        if (auto err = mz_zip_reader_open(reader, osStream))
+            throw std::runtime_error("mz_zip_reader_open: " + std::to_string(err));
+
+        if (auto err = mz_zip_reader_locate_entry(reader, entryName.c_str(), false))
+            throw std::runtime_error("mz_zip_reader_locate_entry: " + std::to_string(err));
+
+        mz_zip_file *entryInfo = nullptr;
+
+        if (auto err = mz_zip_reader_entry_get_info(reader, &entryInfo))
+            throw std::runtime_error("mz_zip_reader_entry_get_info: " + std::to_string(err));
+
+        if (entryInfo->compression_method != MZ_COMPRESS_METHOD_STORE
+            || (entryInfo->flag & MZ_ZIP_FLAG_ENCRYPTED))
+        {
+            throw std::runtime_error(
+                "MappedListfile: zip entry " + entryName + " is compressed or encrypted");
+        }
+
+        if (entryName.size() >= 4 && entryName.compare(entryName.size() - 4, 4, ".lz4") == 0)
+            throw std::runtime_error("MappedListfile: cannot map LZ4 entry " + entryName);
+
+        // Opening the entry positions the archive stream at the start of the
+        // entry data, past the local file header.
+        if (auto err = mz_zip_reader_entry_open(reader))
+            throw std::runtime_error("mz_zip_reader_entry_open: " + std::to_string(err));
+
+        auto result = std::make_pair(
+            static_cast<size_t>(mz_stream_tell(osStream)),
+            static_cast<size_t>(entryInfo->uncompressed_size));
+
+        mz_zip_reader_entry_close(reader);
+        cleanup();
+        return result;
+    }
+    catch (...)
+    {
+        cleanup();
+        throw;
+    }
+}
+
+} // end anon namespace
+
+struct MappedListfile::Private
+{
+    // The whole file is mapped, data points to the start of the listfile
+    // data inside the mapping.
+    void *mapping = nullptr;
+    size_t mappingSize = 0u;
+    const u8 *data = nullptr;
+    size_t size = 0u;
+    ConnectionType bufferFormat = ConnectionType::USB;
+    std::unique_ptr<MappedReadHandle> readHandle;
+
+    void map(const std::string &filename)
+    {
+#ifndef __WIN32
+        int fd = ::open(filename.c_str(), O_RDONLY);
+
+        if (fd < 0)
+            throw std::runtime_error("MappedListfile: open " + filename + ": " + std::strerror(errno));
+
+        struct stat sb = {};
+
+        if (::fstat(fd, &sb) < 0)
+        {
+            int err = errno;
+            ::close(fd);
+            throw std::runtime_error("MappedListfile: fstat " + filename + ": " + std::strerror(err));
+        }
+
+        mappingSize = sb.st_size;
+
+        if (mappingSize)
+        {
+            mapping = ::mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (mapping == MAP_FAILED)
+            {
+                int err = errno;
+                mapping = nullptr;
+                mappingSize = 0u;
+                ::close(fd);
+                throw std::runtime_error("MappedListfile: mmap " + filename + ": " + std::strerror(err));
+            }
+
+            // Replays read the data front to back.
+            ::madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+        }
+
+        // The mapping stays valid after closing the file descriptor.
+        ::close(fd);
+#else
+        (void) filename;
+        throw std::runtime_error("MappedListfile: not supported on this platform");
+#endif
+    }
+
+    void unmap()
+    {
+#ifndef __WIN32
+        if (mapping)
+            ::munmap(mapping, mappingSize);
+#endif
+        mapping = nullptr;
+        mappingSize = 0u;
+        data = nullptr;
+        size = 0u;
+    }
+
+    void setData(size_t offset, size_t size_)
+    {
+        if (offset + size_ > mappingSize)
+            throw std::runtime_error("MappedListfile: listfile data exceeds the file size");
+
+        if (size_ < get_filemagic_len())
+            throw std::runtime_error("MappedListfile: listfile too short");
+
+        data = reinterpret_cast<const u8 *>(mapping) + offset;
+        size = size_;
+
+        const std::string magic(reinterpret_cast<const char *>(data), get_filemagic_len());
+
+        if (magic == get_filemagic_eth())
+            bufferFormat = ConnectionType::ETH;
+        else if (magic == get_filemagic_usb())
+            bufferFormat = ConnectionType::USB;
+        else
+            throw std::runtime_error("MappedListfile: invalid listfile magic bytes");
+    }
+};
+
+MappedListfile::MappedListfile()
+    : d(std::make_unique<Private>())
+{
+}
+
+MappedListfile::~MappedListfile()
+{
+    if (d)
+        close();
+}
+
+MappedListfile::MappedListfile(MappedListfile &&other) noexcept
+{
+    d = std::move(other.d);
+}
+
+MappedListfile &MappedListfile::operator=(MappedListfile &&other) noexcept
+{
+    if (d)
+        close();
+    d = std::move(other.d);
+    return *this;
+}
+
+void MappedListfile::openFile(const std::string &filename)
+{
+    close();
+
+    if (!d)
+        d = std::make_unique<Private>();
+
+    try
+    {
+        d->map(filename);
+        d->setData(0, d->mappingSize);
+    }
+    catch (...)
+    {
+        close();
+        throw;
+    }
+}
+
+void MappedListfile::openZipEntry(const std::string &archiveName, const std::string &entryName)
+{
+    close();
+
+    if (!d)
+        d = std::make_unique<Private>();
+
+    auto location = locate_stored_zip_entry(archiveName, entryName);
+
+    try
+    {
+        d->map(archiveName);
+        d->setData(location.first, location.second);
+    }
+    catch (...)
+    {
+        close();
+        throw;
+    }
+}
+
+void MappedListfile::close()
+{
+    if (!d)
+        return;
+
+    d->readHandle = {};
+    d->unmap();
+}
+
+bool MappedListfile::isOpen() const
+{
+    return d && d->data != nullptr;
+}
+
+const u8 *MappedListfile::data() const
+{
+    return d ? d->data : nullptr;
+}
+
+size_t MappedListfile::size() const
+{
+    return d ? d->size : 0u;
+}
+
+ConnectionType MappedListfile::bufferFormat() const
+{
+    return d ? d->bufferFormat : ConnectionType::USB;
+}
+
+ReadHandle *MappedListfile::readHandle()
+{
+    if (!d)
+        d = std::make_unique<Private>();
+
+    if (!d->readHandle)
+        d->readHandle = std::make_unique<MappedReadHandle>(d->data, d->size);
+    return d->readHandle.get();
+}
+
+MappedBufferIterator::MappedBufferIterator(const MappedListfile &listfile, size_t maxBufferSize)
+    : bufferFormat_(listfile.bufferFormat())
+    , pos_(listfile.data())
+    , end_(listfile.data() + listfile.size())
+    , maxBufferSize_(maxBufferSize)
+{
+    // The readout data starts right after the magic bytes. The preamble
+    // SystemEvents are part of the buffers.
+    if (pos_)
+        pos_ += get_filemagic_len();
+
+    isZeroCopy_ = reinterpret_cast<uintptr_t>(pos_) % alignof(u32) == 0;
+}
+
+size_t MappedBufferIterator::scanChunk(size_t chunkSize)
+{
+    if (isZeroCopy_)
+        return complete_frames_size(bufferFormat_, pos_, chunkSize);
+
+    // The frame scan reads whole words, so misaligned data is copied into the
+    // aligned scratch buffer first and the copy is scanned instead.
+    alignedCopy_.resize((chunkSize + sizeof(u32) - 1) / sizeof(u32));
+    std::memcpy(alignedCopy_.data(), pos_, chunkSize);
+    return complete_frames_size(bufferFormat_,
+                                reinterpret_cast<const u8 *>(alignedCopy_.data()), chunkSize);
+}
+
+nonstd::basic_string_view<const u32> MappedBufferIterator::next()
+{
+    const size_t remaining = end_ - pos_;
+    size_t chunkSize = std::min(remaining, maxBufferSize_);
+    size_t bufferSize = scanChunk(chunkSize);
+
+    // The first frame or packet is larger than the maximum buffer size.
+    while (bufferSize == 0 && chunkSize < remaining)
+    {
+        chunkSize = std::min(remaining, chunkSize * 2);
+        bufferSize = scanChunk(chunkSize);
+    }
+
+    if (bufferSize == 0)
+    {
+        pos_ = end_;
+        return {};
+    }
+
+    const u8 *bufferStart = pos_;
+    pos_ += bufferSize;
+    ++bufferNumber_;
+
+    if (isZeroCopy_)
+        return { reinterpret_cast<const u32 *>(bufferStart), bufferSize / sizeof(u32) };
+
+    // The complete frames are already at the start of the scratch buffer.
+    return { alignedCopy_.data(), bufferSize / sizeof(u32) };
+}
+
+} // end namespace listfile
+} // end namespace mvlc
+} // end namespace mesytec
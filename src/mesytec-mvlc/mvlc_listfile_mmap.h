@@ -0,0 +1,104 @@
+#ifndef __MESYTEC_MVLC_MVLC_LISTFILE_MMAP_H__
+#define __MESYTEC_MVLC_MVLC_LISTFILE_MMAP_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mesytec-mvlc/mvlc_constants.h"
+#include "mesytec-mvlc/mvlc_listfile.h"
+#include "mesytec-mvlc/util/string_view.hpp"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace listfile
+{
+
+// Read-only memory mapping of listfile data. Either a plain listfile or an
+// entry stored without compression in a zip archive, e.g. created via
+// ZipCreator::createZIPEntry(name, 0). Compressed and LZ4 entries cannot be
+// mapped, use ZipReader for these.
+//
+// Everything throws on error.
+class MESYTEC_MVLC_EXPORT MappedListfile
+{
+    public:
+        MappedListfile();
+        ~MappedListfile();
+
+        // A moved-from instance is closed and can be opened again.
+        MappedListfile(MappedListfile &&other) noexcept;
+        MappedListfile &operator=(MappedListfile &&other) noexcept;
+
+        MappedListfile(const MappedListfile &) = delete;
+        MappedListfile &operator=(const MappedListfile &) = delete;
+
+        void openFile(const std::string &filename);
+        void openZipEntry(const std::string &archiveName, const std::string &entryName);
+        void close();
+        bool isOpen() const;
+
+        // The complete listfile data starting with the magic bytes.
+        const u8 *data() const;
+        size_t size() const;
+
+        // USB or ETH depending on the magic bytes.
+        ConnectionType bufferFormat() const;
+
+        // Copying ReadHandle working on the mapped data. Can be used with
+        // read_preamble() or passed to ReplayWorker.
+        ReadHandle *readHandle();
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+// Splits the data of a MappedListfile into buffers containing only complete
+// USB frames or ETH packets, like the fixup_buffer() based readers do. The
+// returned views point directly into the mapped data and can be passed to
+// readout_parser::parse_readout_buffer().
+//
+// The views are u32 aligned if the listfile data is. For zip entries this
+// depends on the length of the entry name and the extra fields in front of
+// the data. If the data is not aligned each buffer is copied into an internal
+// buffer first. The returned view stays valid until the next call to next().
+class MESYTEC_MVLC_EXPORT MappedBufferIterator
+{
+    public:
+        explicit MappedBufferIterator(
+            const MappedListfile &listfile, size_t maxBufferSize = util::Megabytes(1));
+
+        // Returns the next buffer or an empty view once the end of the data
+        // is reached. Buffers are at most maxBufferSize bytes in size unless
+        // the first frame or packet is larger. Incomplete data at the end of
+        // the listfile is not returned.
+        nonstd::basic_string_view<const u32> next();
+
+        // Number of the buffer last returned by next(). Starts at 1.
+        u32 bufferNumber() const { return bufferNumber_; }
+
+        // True if the views returned by next() point into the mapped data.
+        bool isZeroCopy() const { return isZeroCopy_; }
+
+    private:
+        // Returns the size of the complete frames in the next chunkSize bytes.
+        size_t scanChunk(size_t chunkSize);
+
+        ConnectionType bufferFormat_;
+        const u8 *pos_;
+        const u8 *end_;
+        size_t maxBufferSize_;
+        u32 bufferNumber_ = 0;
+        bool isZeroCopy_;
+        std::vector<u32> alignedCopy_;
+};
+
+} // end namespace listfile
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_MVLC_LISTFILE_MMAP_H__ */
@@ -0,0 +1,222 @@
+#include <fstream>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "mvlc_frame_scan.h"
+#include "mvlc_listfile_mmap.h"
+#include "mvlc_listfile_util.h"
+#include "mvlc_listfile_zip.h"
+#include "util/filesystem.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::listfile;
+
+namespace
+{
+
+// USB listfile with a preamble followed by stack frames of random sizes. Some
+// frames are larger than the buffer size used in the tests.
+std::vector<u8> make_usb_listfile(std::mt19937 &rng)
+{
+    CrateConfig crateConfig;
+    crateConfig.connectionType = ConnectionType::USB;
+
+    BufferedWriteHandle writeHandle;
+    listfile_write_preamble(writeHandle, crateConfig);
+
+    std::uniform_int_distribution<u32> lenDist(0, 3000);
+    std::vector<u32> frame;
+    u32 value = 0;
+
+    for (size_t i=0; i<500; ++i)
+    {
+        u32 len = lenDist(rng);
+        frame.clear();
+        frame.push_back((frame_headers::StackFrame << frame_headers::TypeShift) | len);
+
+        for (u32 j=0; j<len; ++j)
+            frame.push_back(value++ & 0x0fffffffu);
+
+        writeHandle.write(reinterpret_cast<const u8 *>(frame.data()), frame.size() * sizeof(u32));
+    }
+
+    listfile_write_system_event(writeHandle, crateConfig.crateId, system_event::subtype::EndOfFile);
+
+    return writeHandle.getBuffer();
+}
+
+// Reads all buffers from the iterator and checks that each one contains only
+// complete frames. Returns the concatenated buffer data.
+std::vector<u8> read_all_buffers(const MappedListfile &listfile, size_t maxBufferSize)
+{
+    MappedBufferIterator it(listfile, maxBufferSize);
+    std::vector<u8> result;
+    u32 expectedBufferNumber = 1;
+
+    while (true)
+    {
+        auto view = it.next();
+
+        if (view.empty())
+            break;
+
+        EXPECT_EQ(it.bufferNumber(), expectedBufferNumber++);
+
+        auto follow = frame_scan::follow_frames(view.data(), view.data() + view.size(),
+                                                frame_scan::known_frame_types());
+        EXPECT_EQ(follow.result, frame_scan::FollowResult::End);
+
+        // Only buffers starting with a large frame may exceed the maximum
+        // size.
+        if (view.size() * sizeof(u32) > maxBufferSize)
+        {
+            EXPECT_GT((extract_frame_info(view[0]).len + 1u) * sizeof(u32), maxBufferSize);
+        }
+
+        auto bytes = reinterpret_cast<const u8 *>(view.data());
+        result.insert(result.end(), bytes, bytes + view.size() * sizeof(u32));
+    }
+
+    EXPECT_TRUE(it.next().empty());
+
+    return result;
+}
+
+}
+
+TEST(mvlc_listfile_mmap, PlainFile)
+{
+    std::mt19937 rng(1234);
+    const auto data = make_usb_listfile(rng);
+    const std::string filename = "mvlc_listfile_mmap.test.PlainFile.mvlclst";
+
+    {
+        std::ofstream out(filename, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    MappedListfile listfile;
+    listfile.openFile(filename);
+
+    ASSERT_TRUE(listfile.isOpen());
+    ASSERT_EQ(listfile.size(), data.size());
+    ASSERT_EQ(listfile.bufferFormat(), ConnectionType::USB);
+    ASSERT_TRUE(std::equal(data.begin(), data.end(), listfile.data()));
+
+    auto preamble = read_preamble(*listfile.readHandle());
+    ASSERT_EQ(preamble.magic, get_filemagic_usb());
+    ASSERT_TRUE(preamble.findCrateConfig() != nullptr);
+
+    const std::vector<u8> expected(data.begin() + get_filemagic_len(), data.end());
+
+    for (size_t maxBufferSize: { size_t(4096), util::Megabytes(1) })
+    {
+        SCOPED_TRACE(maxBufferSize);
+        ASSERT_TRUE(MappedBufferIterator(listfile).isZeroCopy());
+        ASSERT_EQ(read_all_buffers(listfile, maxBufferSize), expected);
+    }
+
+    // Move construction keeps the mapping alive.
+    MappedListfile moved(std::move(listfile));
+    ASSERT_TRUE(moved.isOpen());
+    ASSERT_EQ(read_all_buffers(moved, 4096), expected);
+
+    // The moved-from instance is closed and can be reused.
+    ASSERT_FALSE(listfile.isOpen());
+    listfile.close();
+    listfile.openFile(filename);
+    ASSERT_TRUE(listfile.isOpen());
+    listfile.close();
+
+    moved.close();
+    ASSERT_FALSE(moved.isOpen());
+    ASSERT_TRUE(util::delete_file(filename));
+}
+
+TEST(mvlc_listfile_mmap, TruncatedFile)
+{
+    std::mt19937 rng(1234);
+    auto data = make_usb_listfile(rng);
+    const std::string filename = "mvlc_listfile_mmap.test.TruncatedFile.mvlclst";
+
+    // Cut off the EndOfFile frame and part of the last stack frame.
+    data.resize(data.size() - 2 * sizeof(u32) - 5);
+
+    {
+        std::ofstream out(filename, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+
+    MappedListfile listfile;
+    listfile.openFile(filename);
+
+    auto result = read_all_buffers(listfile, 4096);
+    std::vector<u8> tmpBuf;
+    size_t completeSize = data.size() - fixup_buffer_mvlc_usb(data.data(), data.size(), tmpBuf);
+
+    ASSERT_LT(result.size() + get_filemagic_len(), data.size());
+    ASSERT_EQ(result.size() + get_filemagic_len(), completeSize);
+    ASSERT_TRUE(std::equal(result.begin(), result.end(), data.begin() + get_filemagic_len()));
+
+    listfile.close();
+    ASSERT_TRUE(util::delete_file(filename));
+}
+
+TEST(mvlc_listfile_mmap, ZipEntries)
+{
+    std::mt19937 rng(4321);
+    const auto data = make_usb_listfile(rng);
+    const std::string archiveName = "mvlc_listfile_mmap.test.ZipEntries.zip";
+    // Different name lengths to get both aligned and unaligned entry data.
+    const std::vector<std::string> storedEntries = { "a.mvlclst", "ab.mvlclst", "abc.mvlclst", "abcd.mvlclst" };
+
+    {
+        ZipCreator creator;
+        creator.createArchive(archiveName, OverwriteMode::Overwrite);
+
+        for (const auto &entryName: storedEntries)
+        {
+            auto wh = creator.createZIPEntry(entryName, 0);
+            wh->write(data.data(), data.size());
+            creator.closeCurrentEntry();
+        }
+
+        auto wh = creator.createZIPEntry("deflate.mvlclst", 1);
+        wh->write(data.data(), data.size());
+        creator.closeCurrentEntry();
+
+        wh = creator.createLZ4Entry("lz4.mvlclst");
+        wh->write(data.data(), data.size());
+        creator.closeCurrentEntry();
+    }
+
+    const std::vector<u8> expected(data.begin() + get_filemagic_len(), data.end());
+    size_t zeroCopyEntries = 0u;
+
+    for (const auto &entryName: storedEntries)
+    {
+        SCOPED_TRACE(entryName);
+
+        MappedListfile listfile;
+        listfile.openZipEntry(archiveName, entryName);
+
+        ASSERT_EQ(listfile.size(), data.size());
+        ASSERT_TRUE(std::equal(data.begin(), data.end(), listfile.data()));
+        ASSERT_EQ(read_all_buffers(listfile, 4096), expected);
+
+        if (MappedBufferIterator(listfile).isZeroCopy())
+            ++zeroCopyEntries;
+    }
+
+    ASSERT_GT(zeroCopyEntries, 0u);
+    ASSERT_LT(zeroCopyEntries, storedEntries.size());
+
+    MappedListfile listfile;
+    ASSERT_THROW(listfile.openZipEntry(archiveName, "deflate.mvlclst"), std::runtime_error);
+    ASSERT_THROW(listfile.openZipEntry(archiveName, "lz4.mvlclst.lz4"), std::runtime_error);
+    ASSERT_THROW(listfile.openZipEntry(archiveName, "missing.mvlclst"), std::runtime_error);
+    ASSERT_FALSE(listfile.isOpen());
+
+    ASSERT_TRUE(util::delete_file(archiveName));
+}
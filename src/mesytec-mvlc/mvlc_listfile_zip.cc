@@ -2,12 +2,21 @@
 
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <mutex>
 #include <regex>
 #include <stdexcept>
 #include <sys/stat.h>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 #include <lz4frame.h>
 #include <mz.h>
@@ -19,6 +28,7 @@
 #include <mz_zip.h>
 #include <mz_zip_rw.h>
 
+#include "mvlc_util.h"
 #include "util/filesystem.h"
 #include "util/fmt.h"
 #include "util/logging.h"
@@ -36,6 +46,253 @@ namespace mvlc
 namespace listfile
 {
 
+//
+// ListfileIndex
+//
+
+namespace
+{
+
+static const char IndexMagic[] = "MVLCIDX2";
+static const size_t IndexMagicLen = sizeof(IndexMagic) - 1;
+
+// The index is stored as little endian u64 values independent of the host
+// byte order and struct layout.
+static const size_t IndexEntryFields = 5;
+static const size_t IndexEntrySize = IndexEntryFields * sizeof(u64);
+
+u8 *put_u64_le(u8 *out, u64 value)
+{
+    for (size_t i = 0; i < sizeof(u64); ++i)
+        *out++ = static_cast<u8>(value >> (8 * i));
+    return out;
+}
+
+const u8 *get_u64_le(const u8 *in, u64 &value)
+{
+    value = 0u;
+    for (size_t i = 0; i < sizeof(u64); ++i)
+        value |= static_cast<u64>(*in++) << (8 * i);
+    return in;
+}
+
+// Follows the top level structure of the listfile data written to an entry:
+// the magic bytes followed by either USB frames or ETH packets and system
+// event frames. Counts UnixTimetick system events and readout events and tells
+// if the data written so far ends on a frame or packet boundary.
+//
+// Readout events are counted by their StackFrame headers. For ETH data the
+// frames inside each packet are followed starting from the packet's next
+// header pointer. Frames continued in the next packet are skipped using that
+// packet's header pointer.
+class ListfileStructureScanner
+{
+    public:
+        void feed(const u8 *data, size_t size)
+        {
+            while (size)
+            {
+                if (format_ == Format::Unknown)
+                {
+                    size_t toCopy = std::min(size, get_filemagic_len() - magic_.size());
+                    magic_.append(reinterpret_cast<const char *>(data), toCopy);
+                    data += toCopy;
+                    size -= toCopy;
+
+                    if (magic_.size() == get_filemagic_len())
+                    {
+                        if (magic_ == get_filemagic_usb())
+                            format_ = Format::USB;
+                        else if (magic_ == get_filemagic_eth())
+                            format_ = Format::ETH;
+                        else
+                            format_ = Format::Invalid;
+                    }
+                    continue;
+                }
+
+                if (format_ == Format::Invalid)
+                    return;
+
+                if (bytesToSkip_)
+                {
+                    size_t toSkip = std::min(size, bytesToSkip_);
+                    data += toSkip;
+                    size -= toSkip;
+                    bytesToSkip_ -= toSkip;
+                    continue;
+                }
+
+                if (partialBytes_ == 0 && size >= sizeof(u32))
+                {
+                    u32 word = 0u;
+                    std::memcpy(&word, data, sizeof(word));
+                    data += sizeof(word);
+                    size -= sizeof(word);
+                    handleWord(word);
+                    continue;
+                }
+
+                partial_[partialBytes_++] = *data++;
+                --size;
+
+                if (partialBytes_ == sizeof(u32))
+                {
+                    u32 word = 0u;
+                    std::memcpy(&word, partial_, sizeof(word));
+                    partialBytes_ = 0;
+                    handleWord(word);
+                }
+            }
+        }
+
+        // Unknown data formats are treated as having a boundary after each
+        // write.
+        bool atBoundary() const
+        {
+            return (format_ == Format::Invalid
+                    || (format_ != Format::Unknown && bytesToSkip_ == 0 && partialBytes_ == 0
+                        && ethState_ == EthState::Header0));
+        }
+
+        u64 timeticks() const { return timeticks_; }
+        u64 events() const { return events_; }
+
+    private:
+        enum class Format { Unknown, Invalid, USB, ETH };
+        enum class EthState { Header0, Header1, Payload };
+
+        void handleWord(u32 word)
+        {
+            if (ethState_ == EthState::Header1)
+                handleEthHeader1(word);
+            else if (ethState_ == EthState::Payload)
+                handleEthFrameHeader(word);
+            else
+                handleHeader(word);
+        }
+
+        void handleHeader(u32 header)
+        {
+            if (get_frame_type(header) == frame_headers::SystemEvent)
+            {
+                if (system_event::extract_subtype(header) == system_event::subtype::UnixTimetick)
+                    ++timeticks_;
+                bytesToSkip_ = get_frame_length(header) * sizeof(u32);
+            }
+            else if (format_ == Format::USB)
+            {
+                if (get_frame_type(header) == frame_headers::StackFrame)
+                    ++events_;
+                bytesToSkip_ = get_frame_length(header) * sizeof(u32);
+            }
+            else
+            {
+                // header0 of an ETH packet
+                packetWordsLeft_ = (header >> eth::header0::NumDataWordsShift) & eth::header0::NumDataWordsMask;
+                ethState_ = EthState::Header1;
+            }
+        }
+
+        void handleEthHeader1(u32 header1)
+        {
+            u32 nextHeader = (header1 >> eth::header1::HeaderPointerShift) & eth::header1::HeaderPointerMask;
+
+            // No frame starts in this packet: skip the whole packet data.
+            if (nextHeader >= packetWordsLeft_)
+                nextHeader = packetWordsLeft_;
+
+            skipPacketWords(nextHeader);
+        }
+
+        void handleEthFrameHeader(u32 header)
+        {
+            if (get_frame_type(header) == frame_headers::StackFrame)
+                ++events_;
+
+            --packetWordsLeft_;
+            skipPacketWords(std::min(get_frame_length(header), packetWordsLeft_));
+        }
+
+        // Skips words of the current ETH packet. The next word is either
+        // another frame header inside the packet or the next top level header.
+        void skipPacketWords(u32 words)
+        {
+            packetWordsLeft_ -= words;
+            bytesToSkip_ = words * sizeof(u32);
+            ethState_ = packetWordsLeft_ ? EthState::Payload : EthState::Header0;
+        }
+
+        Format format_ = Format::Unknown;
+        EthState ethState_ = EthState::Header0;
+        std::string magic_;
+        size_t bytesToSkip_ = 0u;
+        u8 partial_[sizeof(u32)] = {};
+        size_t partialBytes_ = 0u;
+        u32 packetWordsLeft_ = 0u;
+        u64 timeticks_ = 0u;
+        u64 events_ = 0u;
+};
+
+} // end anon namespace
+
+std::string index_entry_name(const std::string &lz4EntryName)
+{
+    return lz4EntryName + ".idx";
+}
+
+std::vector<u8> serialize_listfile_index(const ListfileIndex &index)
+{
+    std::vector<u8> result(IndexMagicLen + sizeof(u64) + index.size() * IndexEntrySize);
+    u8 *out = result.data();
+
+    std::memcpy(out, IndexMagic, IndexMagicLen);
+    out += IndexMagicLen;
+    out = put_u64_le(out, index.size());
+
+    for (const auto &entry: index)
+    {
+        out = put_u64_le(out, entry.uncompressedOffset);
+        out = put_u64_le(out, entry.compressedOffset);
+        out = put_u64_le(out, entry.writeIndex);
+        out = put_u64_le(out, entry.timeticks);
+        out = put_u64_le(out, entry.events);
+    }
+
+    assert(out == result.data() + result.size());
+
+    return result;
+}
+
+ListfileIndex deserialize_listfile_index(const u8 *data, size_t size)
+{
+    if (size < IndexMagicLen + sizeof(u64)
+        || std::memcmp(data, IndexMagic, IndexMagicLen) != 0)
+    {
+        throw std::runtime_error("deserialize_listfile_index: invalid index header");
+    }
+
+    u64 count = 0u;
+    const u8 *in = get_u64_le(data + IndexMagicLen, count);
+    size -= IndexMagicLen + sizeof(count);
+
+    if (count > size / IndexEntrySize)
+        throw std::runtime_error("deserialize_listfile_index: truncated index data");
+
+    ListfileIndex result(count);
+
+    for (auto &entry: result)
+    {
+        in = get_u64_le(in, entry.uncompressedOffset);
+        in = get_u64_le(in, entry.compressedOffset);
+        in = get_u64_le(in, entry.writeIndex);
+        in = get_u64_le(in, entry.timeticks);
+        in = get_u64_le(in, entry.events);
+    }
+
+    return result;
+}
+
 //
 // ZipCreator
 //
@@ -94,6 +351,86 @@ struct ZipCreator::Private
         }
     };
 
+    // State of the random access index of the current LZ4 entry.
+    struct LZ4IndexContext
+    {
+        size_t interval = 0u; // 0 means the index is disabled
+        ListfileIndex index;
+        ListfileStructureScanner scanner;
+        u64 uncompressedBytes = 0u;
+        u64 writes = 0u;
+        u64 lastSeekPointOffset = 0u;
+
+        // True if a new seek point should be started in front of the next
+        // write.
+        bool seekPointDue() const
+        {
+            return (interval
+                    && uncompressedBytes - lastSeekPointOffset >= interval
+                    && scanner.atBoundary());
+        }
+
+        ListfileIndexEntry makeSeekPoint()
+        {
+            ListfileIndexEntry entry;
+            entry.uncompressedOffset = uncompressedBytes;
+            entry.writeIndex = writes;
+            entry.timeticks = scanner.timeticks();
+            entry.events = scanner.events();
+            lastSeekPointOffset = uncompressedBytes;
+            return entry;
+        }
+
+        void addSeekPoint(u64 compressedOffset)
+        {
+            auto entry = makeSeekPoint();
+            entry.compressedOffset = compressedOffset;
+            index.push_back(entry);
+        }
+    };
+
+    // Parallel LZ4 compression: the data written to the entry is collected
+    // into jobs which are compressed into independent LZ4 frames by a pool of
+    // worker threads. The frames are written to the ZIP in job order by the
+    // thread calling writeToCurrentEntry().
+    struct LZ4CompressJob
+    {
+        std::vector<u8> input;
+        std::unique_ptr<u8[]> output;
+        size_t outputCapacity = 0u;
+        size_t outputSize = 0u;
+        bool done = false;
+        std::string error;
+        // Index seek point at the start of this job. The compressed offset is
+        // filled in once the frame is written.
+        bool isSeekPoint = false;
+        ListfileIndexEntry seekPoint;
+    };
+
+    struct LZ4CompressPool
+    {
+        // Uncompressed size of a job and thus the size of the LZ4 frames.
+        static constexpr size_t JobSize = util::Megabytes(4);
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable workCv;
+        std::condition_variable doneCv;
+        // Jobs waiting for a worker. Protected by the mutex.
+        std::deque<LZ4CompressJob *> todo;
+        // Submitted jobs in submission order. Only accessed by the writing
+        // thread.
+        std::deque<std::unique_ptr<LZ4CompressJob>> inFlight;
+        std::vector<std::unique_ptr<LZ4CompressJob>> freeJobs;
+        // Job collecting the data of the current writes.
+        std::unique_ptr<LZ4CompressJob> current;
+        size_t maxInFlight = 0u;
+        bool quit = false;
+        LZ4F_preferences_t prefs = {};
+
+        bool isRunning() const { return !workers.empty(); }
+    };
+
     explicit Private()
     {
         mz_stream_os_create(&mz_osStream);
@@ -106,6 +443,7 @@ struct ZipCreator::Private
 
     ~Private()
     {
+        stopCompressPool();
         mz_zip_writer_delete(&mz_zipWriter);
         mz_stream_delete(&mz_bufStream);
         mz_stream_delete(&mz_osStream);
@@ -127,12 +465,295 @@ struct ZipCreator::Private
         return static_cast<size_t>(bytesWritten);
     }
 
+    void writeLZ4FrameHeader()
+    {
+        size_t lz4BufferBytes = LZ4F_compressBegin(
+            lz4Ctx.ctx,
+            lz4Ctx.buffer.data(),
+            lz4Ctx.buffer.size(),
+            &lz4Ctx.lz4Prefs);
+
+        if (LZ4F_isError(lz4BufferBytes))
+            throw std::runtime_error("LZ4F_compressBegin: " + std::to_string(lz4BufferBytes));
+
+        // flush the LZ4 buffer contents to the ZIP
+        writeToCurrentZIPEntry(lz4Ctx.buffer.data(), lz4BufferBytes);
+
+        entryInfo.lz4CompressedBytesWritten += lz4BufferBytes;
+    }
+
+    size_t writeLZ4FrameEnd()
+    {
+        // flush whatever remains within internal buffers
+        size_t const compressedSize = LZ4F_compressEnd(
+            lz4Ctx.ctx,
+            lz4Ctx.buffer.data(), lz4Ctx.buffer.size(),
+            nullptr);
+
+        if (LZ4F_isError(compressedSize))
+            throw std::runtime_error("LZ4F_compressEnd: " + std::to_string(compressedSize));
+
+        // flush the LZ4 buffer contents to the ZIP
+        size_t bytesWritten = writeToCurrentZIPEntry(lz4Ctx.buffer.data(), compressedSize);
+
+        entryInfo.lz4CompressedBytesWritten += compressedSize;
+
+        return bytesWritten;
+    }
+
+    // Ends the current LZ4 frame and starts a new one if the index is enabled
+    // and enough data has been written since the last seek point.
+    void maybeStartNewLZ4Frame()
+    {
+        if (!lz4Index.seekPointDue())
+            return;
+
+        if (compressPool.isRunning())
+        {
+            submitCompressJob();
+
+            if (!compressPool.current)
+                compressPool.current = acquireCompressJob();
+
+            compressPool.current->isSeekPoint = true;
+            compressPool.current->seekPoint = lz4Index.makeSeekPoint();
+        }
+        else
+        {
+            writeLZ4FrameEnd();
+            lz4Index.addSeekPoint(entryInfo.lz4CompressedBytesWritten);
+            writeLZ4FrameHeader();
+        }
+    }
+
+    void startCompressPool(unsigned threads)
+    {
+        assert(!compressPool.isRunning());
+
+        compressPool.quit = false;
+        compressPool.prefs = lz4Ctx.lz4Prefs;
+        compressPool.maxInFlight = 2 * threads;
+
+        for (unsigned i = 0; i < threads; ++i)
+            compressPool.workers.emplace_back(std::thread(&Private::compressLoop, this));
+    }
+
+    void stopCompressPool()
+    {
+        {
+            std::unique_lock<std::mutex> guard(compressPool.mutex);
+            compressPool.quit = true;
+        }
+
+        compressPool.workCv.notify_all();
+
+        for (auto &t: compressPool.workers)
+            if (t.joinable())
+                t.join();
+
+        compressPool.workers.clear();
+        compressPool.todo.clear();
+        compressPool.inFlight.clear();
+        compressPool.current = {};
+    }
+
+    void compressLoop()
+    {
+#ifdef __linux__
+        prctl(PR_SET_NAME,"lz4_compress",0,0,0);
+#endif
+
+        auto &pool = compressPool;
+
+        while (true)
+        {
+            LZ4CompressJob *job = nullptr;
+
+            {
+                std::unique_lock<std::mutex> guard(pool.mutex);
+                pool.workCv.wait(guard, [&pool] { return pool.quit || !pool.todo.empty(); });
+
+                if (pool.quit)
+                    return;
+
+                job = pool.todo.front();
+                pool.todo.pop_front();
+            }
+
+            size_t bound = LZ4F_compressFrameBound(job->input.size(), &pool.prefs);
+
+            if (job->outputCapacity < bound)
+            {
+                job->output = std::make_unique<u8[]>(bound);
+                job->outputCapacity = bound;
+            }
+
+            size_t res = LZ4F_compressFrame(
+                job->output.get(), job->outputCapacity,
+                job->input.data(), job->input.size(),
+                &pool.prefs);
+
+            {
+                std::unique_lock<std::mutex> guard(pool.mutex);
+
+                if (LZ4F_isError(res))
+                    job->error = "LZ4F_compressFrame: " + std::to_string(res);
+                else
+                    job->outputSize = res;
+
+                job->done = true;
+            }
+
+            pool.doneCv.notify_all();
+        }
+    }
+
+    std::unique_ptr<LZ4CompressJob> acquireCompressJob()
+    {
+        std::unique_ptr<LZ4CompressJob> job;
+
+        if (!compressPool.freeJobs.empty())
+        {
+            job = std::move(compressPool.freeJobs.back());
+            compressPool.freeJobs.pop_back();
+        }
+        else
+        {
+            job = std::make_unique<LZ4CompressJob>();
+            job->input.reserve(LZ4CompressPool::JobSize);
+        }
+
+        job->input.clear();
+        job->outputSize = 0u;
+        job->done = false;
+        job->error.clear();
+        job->isSeekPoint = false;
+
+        return job;
+    }
+
+    // Copies the data into compression jobs which are handed to the workers
+    // once they are full.
+    void writeToCompressPool(const u8 *data, size_t size)
+    {
+        auto &pool = compressPool;
+
+        while (size)
+        {
+            if (!pool.current)
+                pool.current = acquireCompressJob();
+
+            size_t toCopy = std::min(size, LZ4CompressPool::JobSize - pool.current->input.size());
+            pool.current->input.insert(std::end(pool.current->input), data, data + toCopy);
+            data += toCopy;
+            size -= toCopy;
+
+            if (pool.current->input.size() >= LZ4CompressPool::JobSize)
+                submitCompressJob();
+        }
+
+        writeCompressedFrames(false);
+    }
+
+    void submitCompressJob()
+    {
+        auto &pool = compressPool;
+
+        if (!pool.current || pool.current->input.empty())
+            return;
+
+        // Limit the memory in use by waiting for the oldest job.
+        while (pool.inFlight.size() >= pool.maxInFlight)
+            writeCompressedFrames(true);
+
+        {
+            std::unique_lock<std::mutex> guard(pool.mutex);
+            pool.todo.push_back(pool.current.get());
+        }
+
+        pool.inFlight.emplace_back(std::move(pool.current));
+        pool.workCv.notify_one();
+    }
+
+    // Writes the frames of finished jobs to the ZIP in submission order. If
+    // wait is true blocks until the oldest job is finished.
+    void writeCompressedFrames(bool wait)
+    {
+        auto &pool = compressPool;
+
+        while (!pool.inFlight.empty())
+        {
+            auto &job = pool.inFlight.front();
+
+            {
+                std::unique_lock<std::mutex> guard(pool.mutex);
+
+                if (wait)
+                    pool.doneCv.wait(guard, [&job] { return job->done; });
+                else if (!job->done)
+                    return;
+            }
+
+            wait = false;
+
+            if (!job->error.empty())
+                throw std::runtime_error(job->error);
+
+            if (job->isSeekPoint)
+            {
+                job->seekPoint.compressedOffset = entryInfo.lz4CompressedBytesWritten;
+                lz4Index.index.push_back(job->seekPoint);
+            }
+
+            writeToCurrentZIPEntry(job->output.get(), job->outputSize);
+            entryInfo.lz4CompressedBytesWritten += job->outputSize;
+
+            pool.freeJobs.emplace_back(std::move(job));
+            pool.inFlight.pop_front();
+        }
+    }
+
+    // Compresses and writes all remaining data, then stops the workers.
+    void finishCompressPool()
+    {
+        try
+        {
+            submitCompressJob();
+
+            while (!compressPool.inFlight.empty())
+                writeCompressedFrames(true);
+
+            // Write an empty frame to get a valid LZ4 stream if no data was
+            // written to the entry.
+            if (entryInfo.lz4CompressedBytesWritten == 0)
+            {
+                size_t res = LZ4F_compressFrame(
+                    lz4Ctx.buffer.data(), lz4Ctx.buffer.size(), nullptr, 0, &compressPool.prefs);
+
+                if (LZ4F_isError(res))
+                    throw std::runtime_error("LZ4F_compressFrame: " + std::to_string(res));
+
+                writeToCurrentZIPEntry(lz4Ctx.buffer.data(), res);
+                entryInfo.lz4CompressedBytesWritten += res;
+            }
+        }
+        catch (...)
+        {
+            stopCompressPool();
+            throw;
+        }
+
+        stopCompressPool();
+    }
+
     void *mz_zipWriter = nullptr;
     void *mz_bufStream = nullptr;
     void *mz_osStream = nullptr;
 
     ZipEntryInfo entryInfo;
     LZ4WriteContext lz4Ctx;
+    LZ4IndexContext lz4Index;
+    LZ4CompressPool compressPool;
     std::string archiveName;
 };
 
@@ -227,7 +848,8 @@ std::unique_ptr<WriteHandle> ZipCreator::createZIPEntry(const std::string &entry
     return std::unique_ptr<ZipEntryWriteHandle>(new ZipEntryWriteHandle(this));
 }
 
-std::unique_ptr<WriteHandle> ZipCreator::createLZ4Entry(const std::string &entryName_, int compressLevel)
+std::unique_ptr<WriteHandle> ZipCreator::createLZ4Entry(
+    const std::string &entryName_, const LZ4EntryOptions &options)
 {
     if (hasOpenEntry())
         throw std::runtime_error("ZipCreator has open archive entry");
@@ -253,23 +875,25 @@ std::unique_ptr<WriteHandle> ZipCreator::createLZ4Entry(const std::string &entry
     d->entryInfo.name = entryName;
     d->entryInfo.isOpen = true;
 
-    d->lz4Ctx.begin(compressLevel);
+    d->lz4Ctx.begin(options.compressLevel);
 
-    // write the LZ4 frame header
-    size_t lz4BufferBytes = LZ4F_compressBegin(
-        d->lz4Ctx.ctx,
-        d->lz4Ctx.buffer.data(),
-        d->lz4Ctx.buffer.size(),
-        &d->lz4Ctx.lz4Prefs);
+    d->lz4Index = {};
+    d->lz4Index.interval = options.indexInterval;
 
-    if (LZ4F_isError(lz4BufferBytes))
-        throw std::runtime_error("LZ4F_compressBegin: " + std::to_string(lz4BufferBytes));
+    if (options.indexInterval)
+        d->lz4Index.addSeekPoint(0);
 
-    // flush the LZ4 buffer contents to the ZIP
-    d->writeToCurrentZIPEntry(d->lz4Ctx.buffer.data(), lz4BufferBytes);
-
-    d->entryInfo.bytesWritten += lz4BufferBytes;
-    d->entryInfo.lz4CompressedBytesWritten += lz4BufferBytes;
+    if (options.compressionThreads)
+    {
+        // The workers produce complete frames, no header needed here.
+        d->startCompressPool(options.compressionThreads);
+    }
+    else
+    {
+        // write the LZ4 frame header
+        d->writeLZ4FrameHeader();
+        d->entryInfo.bytesWritten += d->entryInfo.lz4CompressedBytesWritten;
+    }
 
     // std::make_unique() does not work here because it's not a friend of ZipEntryWriteHandle
     return std::unique_ptr<ZipEntryWriteHandle>(new ZipEntryWriteHandle(this));
@@ -300,6 +924,22 @@ size_t ZipCreator::writeToCurrentEntry(const u8 *inputData, size_t inputSize)
             break;
 
         case ZipEntryInfo::LZ4:
+            if (d->lz4Index.interval)
+            {
+                d->maybeStartNewLZ4Frame();
+                d->lz4Index.scanner.feed(inputData, inputSize);
+                d->lz4Index.uncompressedBytes += inputSize;
+                ++d->lz4Index.writes;
+            }
+
+            if (d->compressPool.isRunning())
+            {
+                d->writeToCompressPool(inputData, inputSize);
+                bytesWritten = inputSize;
+                d->entryInfo.bytesWritten += inputSize;
+                break;
+            }
+
             while (bytesWritten < inputSize)
             {
                 size_t bytesLeft = inputSize - bytesWritten;
@@ -338,26 +978,27 @@ void ZipCreator::closeCurrentEntry()
 
     if (d->entryInfo.type == ZipEntryInfo::LZ4)
     {
-        // flush whatever remains within internal buffers
-        size_t const compressedSize = LZ4F_compressEnd(
-            d->lz4Ctx.ctx,
-            d->lz4Ctx.buffer.data(), d->lz4Ctx.buffer.size(),
-            nullptr);
-
-        if (LZ4F_isError(compressedSize))
-            throw std::runtime_error("LZ4F_compressEnd: " + std::to_string(compressedSize));
-
-        // flush the LZ4 buffer contents to the ZIP
-        size_t bytesWritten = d->writeToCurrentZIPEntry(d->lz4Ctx.buffer.data(), compressedSize);
-
-        d->entryInfo.bytesWritten += bytesWritten;
-        d->entryInfo.lz4CompressedBytesWritten += compressedSize;
+        if (d->compressPool.isRunning())
+            d->finishCompressPool();
+        else
+            d->entryInfo.bytesWritten += d->writeLZ4FrameEnd();
     }
 
     if (auto err = mz_zip_writer_entry_close(d->mz_zipWriter))
         throw std::runtime_error("mz_zip_writer_entry_close: " + std::to_string(err));
 
     d->entryInfo.isOpen = false;
+
+    // Write the random access index of the LZ4 entry. The entryInfo of the
+    // LZ4 entry is restored afterwards.
+    if (d->entryInfo.type == ZipEntryInfo::LZ4 && d->lz4Index.interval)
+    {
+        auto lz4EntryInfo = d->entryInfo;
+        auto indexData = serialize_listfile_index(d->lz4Index.index);
+        d->lz4Index = {};
+        add_file_to_archive(this, index_entry_name(lz4EntryInfo.name), indexData);
+        d->entryInfo = lz4EntryInfo;
+    }
 }
 
 //
@@ -484,7 +1125,13 @@ std::unique_ptr<WriteHandle> SplitZipCreator::createListfileEntry()
             break;
 
         case ZipEntryInfo::LZ4:
-            wh = d->zipCreator.createLZ4Entry(memberName, d->setup.compressLevel);
+            {
+                LZ4EntryOptions options;
+                options.compressLevel = d->setup.compressLevel;
+                options.indexInterval = d->setup.lz4IndexInterval;
+                options.compressionThreads = d->setup.compressionThreads;
+                wh = d->zipCreator.createLZ4Entry(memberName, options);
+            }
             break;
     }
 
@@ -578,21 +1225,229 @@ size_t SplitZipWriteHandle::write(const u8 *data, size_t size)
 // ZipReader
 //
 
-size_t ZipReadHandle::read(u8 *dest, size_t maxSize)
+namespace
 {
-    return m_zipReader->readCurrentEntry(dest, maxSize);
-}
 
-size_t ZipReadHandle::seek(size_t pos)
+struct ReadAheadBuffer
 {
-    std::string currentName = m_zipReader->currentEntryName();
-    // rewind by reopening
+    std::vector<u8> data;
+    size_t used = 0u;
+    size_t pos = 0u;
+    // Set by SplitZipReader if the buffer contains the first data of a new
+    // archive part.
+    std::string archiveName;
+};
+
+// Background thread filling a bounded queue of buffers using the given fill
+// function. The fill function sets ReadAheadBuffer::used, an empty buffer
+// without an archiveName signals the end of the data. Exceptions thrown by the
+// fill function end the thread and are rethrown by read() after all buffers
+// filled before the error have been consumed.
+class ReadAheadThread
+{
+    public:
+        using FillFunction = std::function<void (ReadAheadBuffer &buffer)>;
+        using ArchiveChangedFunction = std::function<void (const std::string &archiveName)>;
+
+        ~ReadAheadThread()
+        {
+            stop();
+        }
+
+        bool isRunning() const
+        {
+            return thread_.joinable();
+        }
+
+        void start(const ReadAheadOptions &options, FillFunction fill)
+        {
+            assert(!isRunning());
+
+            free_.clear();
+            ready_.clear();
+            quit_ = false;
+            done_ = false;
+            error_ = {};
+
+            for (size_t i=0; i<std::max(options.bufferCount, static_cast<size_t>(1u)); ++i)
+            {
+                ReadAheadBuffer buffer;
+                buffer.data.resize(std::max(options.bufferSize, static_cast<size_t>(1u)));
+                free_.emplace_back(std::move(buffer));
+            }
+
+            thread_ = std::thread(&ReadAheadThread::loop, this, std::move(fill));
+        }
+
+        void stop()
+        {
+            if (!isRunning())
+                return;
+
+            {
+                std::unique_lock<std::mutex> guard(mutex_);
+                quit_ = true;
+            }
+
+            cv_.notify_all();
+            thread_.join();
+            ready_.clear();
+            free_.clear();
+        }
+
+        // Blocks until maxSize bytes have been copied or the end of the data
+        // is reached. archiveChanged is invoked before data from a buffer with
+        // a non-empty archiveName is copied.
+        size_t read(u8 *dest, size_t maxSize, const ArchiveChangedFunction &archiveChanged = {})
+        {
+            size_t retval = 0u;
+
+            while (retval < maxSize)
+            {
+                std::unique_lock<std::mutex> guard(mutex_);
+                cv_.wait(guard, [this] { return !ready_.empty() || done_; });
+
+                if (ready_.empty())
+                {
+                    if (error_)
+                    {
+                        auto error = error_;
+                        error_ = {};
+                        std::rethrow_exception(error);
+                    }
+
+                    break;
+                }
+
+                auto &buffer = ready_.front();
+                guard.unlock();
+
+                // The front buffer is only modified by the consumer, no need
+                // to hold the lock while copying.
+                if (buffer.pos == 0u && !buffer.archiveName.empty() && archiveChanged)
+                    archiveChanged(buffer.archiveName);
+
+                size_t toCopy = std::min(buffer.used - buffer.pos, maxSize - retval);
+                std::memcpy(dest + retval, buffer.data.data() + buffer.pos, toCopy);
+                buffer.pos += toCopy;
+                retval += toCopy;
+
+                if (buffer.pos == buffer.used)
+                {
+                    guard.lock();
+                    buffer.archiveName = {};
+                    free_.emplace_back(std::move(ready_.front()));
+                    ready_.pop_front();
+                    guard.unlock();
+                    cv_.notify_all();
+                }
+            }
+
+            return retval;
+        }
+
+    private:
+        void loop(FillFunction fill)
+        {
+#ifdef __linux__
+            prctl(PR_SET_NAME,"zip_read_ahead",0,0,0);
+#endif
+
+            while (true)
+            {
+                ReadAheadBuffer buffer;
+
+                {
+                    std::unique_lock<std::mutex> guard(mutex_);
+                    cv_.wait(guard, [this] { return !free_.empty() || quit_; });
+
+                    if (quit_)
+                        break;
+
+                    buffer = std::move(free_.front());
+                    free_.pop_front();
+                }
+
+                buffer.used = 0u;
+                buffer.pos = 0u;
+
+                try
+                {
+                    fill(buffer);
+                }
+                catch (...)
+                {
+                    std::unique_lock<std::mutex> guard(mutex_);
+                    error_ = std::current_exception();
+                    done_ = true;
+                    guard.unlock();
+                    cv_.notify_all();
+                    break;
+                }
+
+                std::unique_lock<std::mutex> guard(mutex_);
+
+                // Empty buffers marking an archive change are passed on.
+                if (buffer.used == 0u && buffer.archiveName.empty())
+                {
+                    done_ = true;
+                    guard.unlock();
+                    cv_.notify_all();
+                    break;
+                }
+
+                ready_.emplace_back(std::move(buffer));
+                guard.unlock();
+                cv_.notify_all();
+            }
+        }
+
+        std::thread thread_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<ReadAheadBuffer> free_;
+        std::deque<ReadAheadBuffer> ready_;
+        bool quit_ = false;
+        bool done_ = false;
+        std::exception_ptr error_;
+};
+
+} // end anon namespace
+
+size_t ZipReadHandle::read(u8 *dest, size_t maxSize)
+{
+    return m_zipReader->readCurrentEntry(dest, maxSize);
+}
+
+size_t ZipReadHandle::seek(size_t pos)
+{
+    std::string currentName = m_zipReader->currentEntryName();
+    // rewind by reopening
     m_zipReader->closeCurrentEntry();
     m_zipReader->openEntry(currentName);
 
-    std::vector<u8> buffer(util::Megabytes(1));
     size_t totalBytesRead = 0u;
 
+    // Jump to the closest seek point in front of pos if the entry has an
+    // index.
+    const auto &index = m_zipReader->entryIndex();
+
+    auto it = std::upper_bound(
+        std::begin(index), std::end(index), pos,
+        [] (size_t value, const ListfileIndexEntry &entry)
+        {
+            return value < entry.uncompressedOffset;
+        });
+
+    if (it != std::begin(index))
+    {
+        --it;
+        m_zipReader->jumpToIndexEntry(*it);
+        totalBytesRead = it->uncompressedOffset;
+    }
+
+    std::vector<u8> buffer(util::Megabytes(1));
+
     while (totalBytesRead < pos)
     {
         auto bytesRead = read(buffer.data(), std::min(buffer.size(), pos-totalBytesRead));
@@ -641,6 +1496,7 @@ struct ZipReader::Private
 
     explicit Private(ZipReader *q_)
         : entryReadHandle(q_)
+        , logger(get_logger("ZipReader"))
     {
     }
 
@@ -657,6 +1513,170 @@ struct ZipReader::Private
         return static_cast<size_t>(res);
     }
 
+    size_t readFromCurrentLZ4Entry(u8 *dest, size_t maxSize)
+    {
+        if (!readFromArchiveStream)
+        {
+            size_t bytesRead = readFromCurrentZipEntry(dest, maxSize);
+            std::lock_guard<std::mutex> guard(entryInfoMutex);
+            entryInfo.lz4CompressedBytesRead += bytesRead;
+            return bytesRead;
+        }
+
+        // After jumpToIndexEntry() the entry data is read directly from the
+        // archive stream as minizip keeps track of its own read position.
+        // Stop at the end of the entry data.
+        maxSize = std::min(maxSize, entryInfo.compressedSize - entryInfo.lz4CompressedBytesRead);
+
+        if (maxSize == 0)
+            return 0u;
+
+        s32 res = mz_stream_read(osStream, dest, maxSize);
+
+        if (res < 0)
+            throw std::runtime_error("mz_stream_read: " + std::to_string(res));
+
+        std::lock_guard<std::mutex> guard(entryInfoMutex);
+        entryInfo.lz4CompressedBytesRead += res;
+
+        return static_cast<size_t>(res);
+    }
+
+    // Reads and decompresses entry data in the calling thread.
+    size_t readCurrentEntryDirect(u8 *dest, size_t maxSize)
+    {
+        if (entryInfo.type == ZipEntryInfo::ZIP)
+            return readFromCurrentZipEntry(dest, maxSize);
+
+        assert(entryInfo.type == ZipEntryInfo::LZ4);
+
+        size_t retval = 0u;
+        size_t loop = 0u;
+
+        while (maxSize - retval > 0)
+        {
+            if (lz4Ctx.decompressedView.empty())
+            {
+                //cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": decompressedView is empty, decompressing more data" << endl;
+                //cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": compressedView.size()=" << lz4Ctx.compressedView.size() << endl;
+
+                if (lz4Ctx.compressedView.empty())
+                {
+                    //cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": compressedView is empty, reading more data from zip" << endl;
+
+                    size_t bytesRead = readFromCurrentLZ4Entry(
+                        lz4Ctx.compressedBuffer.data(), lz4Ctx.compressedBuffer.size());
+
+                    lz4Ctx.compressedView = { lz4Ctx.compressedBuffer.data(), bytesRead };
+
+                    //cout << __PRETTY_FUNCTION__ << "read " << bytesRead << " bytes of uncompressed data" << endl;
+
+                    if (bytesRead == 0)
+                        break;
+                }
+
+                assert(!lz4Ctx.compressedView.empty());
+
+                // decompress from compressedBuffer into decompressedBuffer
+
+                size_t decompressedSize = lz4Ctx.decompressedBuffer.size();
+                size_t compressedSize = lz4Ctx.compressedView.size();
+
+                s32 res = LZ4F_decompress(
+                    lz4Ctx.ctx,
+                    lz4Ctx.decompressedBuffer.data(), &decompressedSize, // dest
+                    lz4Ctx.compressedView.data(), &compressedSize,  // source
+                    nullptr); // options
+
+                //if (res == 0)
+                //    cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": LZ4F_decompress returned " << res << endl;
+
+                //cout << __PRETTY_FUNCTION__ << " LZ4F_decompress: "
+                //    << ", compressedSize=" << compressedSize
+                //    << ", decompressedSize=" << decompressedSize
+                //    << ", res=" << res
+                //    << endl;
+
+                if (LZ4F_isError(res))
+                    throw std::runtime_error("LZ4F_decompress: " + std::to_string(res));
+
+                lz4Ctx.decompressedView = { lz4Ctx.decompressedBuffer.data(), decompressedSize };
+                lz4Ctx.compressedView.remove_prefix(compressedSize);
+            }
+
+            size_t toCopy = std::min(lz4Ctx.decompressedView.size(), maxSize - retval);
+            std::memcpy(dest+retval, lz4Ctx.decompressedView.data(), toCopy);
+            lz4Ctx.decompressedView.remove_prefix(toCopy);
+            retval += toCopy;
+
+            /*
+            if (toCopy)
+            {
+                std::cout << __PRETTY_FUNCTION__ << " loop #" << loop
+                    << ": copied " << toCopy << " bytes from decompressed view into dest buffer"
+                    << ", dest[0]=" << std::hex << static_cast<unsigned>(dest[0])
+                    << ", dest[1]=" << std::hex << static_cast<unsigned>(dest[1])
+                    << ", dest[2]=" << std::hex << static_cast<unsigned>(dest[2])
+                    << ", dest[3]=" << std::hex << static_cast<unsigned>(dest[3])
+                    << ", dest[4]=" << std::hex << static_cast<unsigned>(dest[4])
+                    << std::dec
+                    << endl;
+            }
+            */
+
+            ++loop;
+        }
+
+        //cout << __PRETTY_FUNCTION__ << "read of maxSize=" << maxSize
+        //    << " satisfied after " << loop << " loops" << endl;
+
+        return retval;
+    }
+
+    // Loads the random access index of the given LZ4 entry if the archive
+    // contains one. Must be called before opening the LZ4 entry itself.
+    void loadEntryIndex(const std::string &entryName)
+    {
+        if (entryIndexName == entryName)
+            return;
+
+        entryIndex = {};
+        entryIndexName = entryName;
+
+        auto indexName = index_entry_name(entryName);
+
+        if (std::find(std::begin(entryNameCache), std::end(entryNameCache), indexName)
+            == std::end(entryNameCache))
+        {
+            return;
+        }
+
+        try
+        {
+            if (auto err = mz_zip_reader_locate_entry(reader, indexName.c_str(), false))
+                throw std::runtime_error("mz_zip_reader_locate_entry: " + std::to_string(err));
+
+            if (auto err = mz_zip_reader_entry_open(reader))
+                throw std::runtime_error("mz_zip_reader_entry_open: " + std::to_string(err));
+
+            std::vector<u8> indexData;
+            std::vector<u8> buffer(util::Kilobytes(64));
+
+            while (size_t bytesRead = readFromCurrentZipEntry(buffer.data(), buffer.size()))
+                indexData.insert(std::end(indexData), buffer.data(), buffer.data() + bytesRead);
+
+            mz_zip_reader_entry_close(reader);
+
+            entryIndex = deserialize_listfile_index(indexData.data(), indexData.size());
+        }
+        catch (const std::exception &e)
+        {
+            mz_zip_reader_entry_close(reader);
+            logger->warn("Could not load index entry {}: {}", indexName, e.what());
+            entryIndex = {};
+        }
+    }
+
     void *reader = nullptr;
     void *osStream = nullptr;
     std::vector<std::string> entryNameCache;
@@ -665,8 +1685,22 @@ struct ZipReader::Private
     // the vector.
     std::vector<mz_zip_entry> entryInfoCache;
     ZipReadHandle entryReadHandle { nullptr };
+    // Updated by the read-ahead thread. Modifications and reads from other
+    // threads are done under entryInfoMutex.
     ZipEntryInfo entryInfo;
+    mutable std::mutex entryInfoMutex;
     LZ4ReadContext lz4Ctx;
+    // Start of the current entry data in the archive file.
+    s64 entryDataOffset = 0;
+    bool readFromArchiveStream = false;
+    ListfileIndex entryIndex;
+    // Name of the entry entryIndex belongs to.
+    std::string entryIndexName;
+    std::shared_ptr<spdlog::logger> logger;
+    ReadAheadOptions readAheadOptions;
+    // Declared last so the thread is stopped before the members it uses are
+    // destroyed.
+    ReadAheadThread readAhead;
 };
 
 ZipReader::ZipReader()
@@ -704,6 +1738,8 @@ void ZipReader::openArchive(const std::string &archiveName)
     }
 
     d->entryNameCache = {};
+    d->entryIndex = {};
+    d->entryIndexName = {};
     s32 err = MZ_OK;
 
     do
@@ -728,6 +1764,8 @@ void ZipReader::openArchive(const std::string &archiveName)
 
 void ZipReader::closeArchive()
 {
+    d->readAhead.stop();
+
     if (auto err = mz_zip_reader_close(d->reader))
         throw std::runtime_error("mz_zip_reader_close: " + std::to_string(err));
 
@@ -735,6 +1773,8 @@ void ZipReader::closeArchive()
         throw std::runtime_error("mz_stream_os_close: " + std::to_string(err));
 
     d->entryNameCache = {};
+    d->entryIndex = {};
+    d->entryIndexName = {};
 }
 
 std::vector<std::string> ZipReader::entryNameList()
@@ -764,34 +1804,46 @@ inline size_t get_block_size(const LZ4F_frameInfo_t* info)
 
 ZipReadHandle *ZipReader::openEntry(const std::string &name)
 {
+    d->readAhead.stop();
+
+    const bool isLZ4 = (name.size() >= 4
+                        && string_view(name.data() + (name.length() - 4), 4) == ".lz4");
+
+    if (isLZ4)
+        d->loadEntryIndex(name);
+    else
+    {
+        d->entryIndex = {};
+        d->entryIndexName = {};
+    }
+
     if (auto err = mz_zip_reader_locate_entry(d->reader, name.c_str(), false))
         throw std::runtime_error("mz_zip_reader_locate_entry: " + std::to_string(err));
 
     if (auto err = mz_zip_reader_entry_open(d->reader))
         throw std::runtime_error("mz_zip_reader_entry_open: " + std::to_string(err));
 
+    d->entryDataOffset = mz_stream_tell(d->osStream);
+    d->readFromArchiveStream = false;
+
     mz_zip_file *mzEntryInfo = nullptr;
 
     if (auto err = mz_zip_reader_entry_get_info(d->reader, &mzEntryInfo))
         throw std::runtime_error("mz_zip_reader_entry_get_info: " + std::to_string(err));
 
     d->lz4Ctx.clear();
-    d->entryInfo = {};
-    d->entryInfo.name = name;
-    d->entryInfo.compressedSize = mzEntryInfo->compressed_size;
-    d->entryInfo.uncompressedSize = mzEntryInfo->uncompressed_size;
 
-    if (name.size() >= 4)
-    {
-        auto suffix = string_view(name.data() + (name.length() - 4), 4);
+    // Built locally and published at the end so that entryInfo() never
+    // returns a half opened entry.
+    ZipEntryInfo entryInfo;
+    entryInfo.name = name;
+    entryInfo.compressedSize = mzEntryInfo->compressed_size;
+    entryInfo.uncompressedSize = mzEntryInfo->uncompressed_size;
 
-        if (suffix == ".lz4")
-        {
-            d->entryInfo.type = ZipEntryInfo::LZ4;
-        }
-    }
+    if (isLZ4)
+        entryInfo.type = ZipEntryInfo::LZ4;
 
-    if (d->entryInfo.type == ZipEntryInfo::LZ4)
+    if (entryInfo.type == ZipEntryInfo::LZ4)
     {
         size_t bytesRead = d->readFromCurrentZipEntry(
             d->lz4Ctx.compressedBuffer.data(),
@@ -799,7 +1851,7 @@ ZipReadHandle *ZipReader::openEntry(const std::string &name)
 
         //cout << __PRETTY_FUNCTION__ << ": initial read from zip yielded " << bytesRead << " bytes" << endl;
 
-        d->entryInfo.lz4CompressedBytesRead += bytesRead;
+        entryInfo.lz4CompressedBytesRead += bytesRead;
 
         if (bytesRead == 0)
             throw std::runtime_error("ZipReader::openEntry: not enough data to initialise LZ4 decompression");
@@ -835,7 +1887,12 @@ ZipReadHandle *ZipReader::openEntry(const std::string &name)
         d->lz4Ctx.decompressedBuffer.resize(dstCapacity);
     }
 
-    d->entryInfo.isOpen = true;
+    entryInfo.isOpen = true;
+
+    {
+        std::lock_guard<std::mutex> guard(d->entryInfoMutex);
+        d->entryInfo = entryInfo;
+    }
 
     auto result = &d->entryReadHandle;
     assert(result);
@@ -849,6 +1906,8 @@ ZipReadHandle *ZipReader::currentEntry()
 
 void ZipReader::closeCurrentEntry()
 {
+    d->readAhead.stop();
+
     auto err = mz_zip_reader_entry_close(d->reader);
 
     if (err != MZ_OK && err != MZ_CRC_ERROR)
@@ -857,117 +1916,144 @@ void ZipReader::closeCurrentEntry()
 
 size_t ZipReader::readCurrentEntry(u8 *dest, size_t maxSize)
 {
-    if (d->entryInfo.type == ZipEntryInfo::ZIP)
-        return d->readFromCurrentZipEntry(dest, maxSize);
-
-    assert(d->entryInfo.type == ZipEntryInfo::LZ4);
-
-    size_t retval = 0u;
-    size_t loop = 0u;
-
-    while (maxSize - retval > 0)
+    if (!d->readAhead.isRunning())
     {
-        if (d->lz4Ctx.decompressedView.empty())
-        {
-            //cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": decompressedView is empty, decompressing more data" << endl;
-            //cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": compressedView.size()=" << d->lz4Ctx.compressedView.size() << endl;
-
-            if (d->lz4Ctx.compressedView.empty())
-            {
-                //cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": compressedView is empty, reading more data from zip" << endl;
+        if (!d->readAheadOptions.enabled)
+            return d->readCurrentEntryDirect(dest, maxSize);
 
-                size_t bytesRead = d->readFromCurrentZipEntry(
-                    d->lz4Ctx.compressedBuffer.data(), d->lz4Ctx.compressedBuffer.size());
+        d->readAhead.start(d->readAheadOptions, [this] (ReadAheadBuffer &buffer)
+        {
+            buffer.used = d->readCurrentEntryDirect(buffer.data.data(), buffer.data.size());
+        });
+    }
 
-                d->lz4Ctx.compressedView = { d->lz4Ctx.compressedBuffer.data(), bytesRead };
+    return d->readAhead.read(dest, maxSize);
+}
 
-                //cout << __PRETTY_FUNCTION__ << "read " << bytesRead << " bytes of uncompressed data" << endl;
+std::string ZipReader::currentEntryName() const
+{
+    std::lock_guard<std::mutex> guard(d->entryInfoMutex);
+    return d->entryInfo.name;
+}
 
-                if (bytesRead == 0)
-                    break;
-            }
+ZipEntryInfo ZipReader::entryInfo() const
+{
+    std::lock_guard<std::mutex> guard(d->entryInfoMutex);
+    return d->entryInfo;
+}
 
-            assert(!d->lz4Ctx.compressedView.empty());
+std::string ZipReader::firstListfileEntryName()
+{
+    auto entryNames = entryNameList();
 
-            // decompress from compressedBuffer into decompressedBuffer
+    auto it = std::find_if(
+        std::begin(entryNames), std::end(entryNames),
+        [] (const std::string &entryName)
+        {
+            // Anchored at the end to not match the index entries.
+            static const std::regex re(R"foo(.+\.mvlclst(\.lz4)?$)foo");
+            return std::regex_search(entryName, re);
+        });
 
-            size_t decompressedSize = d->lz4Ctx.decompressedBuffer.size();
-            size_t compressedSize = d->lz4Ctx.compressedView.size();
+    return (it != std::end(entryNames) ? *it : std::string{});
+}
 
-            s32 res = LZ4F_decompress(
-                d->lz4Ctx.ctx,
-                d->lz4Ctx.decompressedBuffer.data(), &decompressedSize, // dest
-                d->lz4Ctx.compressedView.data(), &compressedSize,  // source
-                nullptr); // options
+const ListfileIndex &ZipReader::entryIndex() const
+{
+    return d->entryIndex;
+}
 
-            //if (res == 0)
-            //    cout << __PRETTY_FUNCTION__ << " loop #" << loop << ": LZ4F_decompress returned " << res << endl;
+namespace
+{
 
-            //cout << __PRETTY_FUNCTION__ << " LZ4F_decompress: "
-            //    << ", compressedSize=" << compressedSize
-            //    << ", decompressedSize=" << decompressedSize
-            //    << ", res=" << res
-            //    << endl;
+// Returns the last index entry where the given member is less than or equal to
+// value. Index entries are sorted by all of their members.
+const ListfileIndexEntry &find_seek_point(
+    const ListfileIndex &index, u64 value, u64 ListfileIndexEntry::*member)
+{
+    if (index.empty())
+        throw std::runtime_error("ZipReader: current entry has no index");
 
-            if (LZ4F_isError(res))
-                throw std::runtime_error("LZ4F_decompress: " + std::to_string(res));
+    auto it = std::upper_bound(
+        std::begin(index), std::end(index), value,
+        [member] (u64 value, const ListfileIndexEntry &entry)
+        {
+            return value < entry.*member;
+        });
 
-            d->lz4Ctx.decompressedView = { d->lz4Ctx.decompressedBuffer.data(), decompressedSize };
-            d->lz4Ctx.compressedView.remove_prefix(compressedSize);
-        }
+    // The first index entry is always at the start of the entry data.
+    if (it != std::begin(index))
+        --it;
 
-        size_t toCopy = std::min(d->lz4Ctx.decompressedView.size(), maxSize - retval);
-        std::memcpy(dest+retval, d->lz4Ctx.decompressedView.data(), toCopy);
-        d->lz4Ctx.decompressedView.remove_prefix(toCopy);
-        retval += toCopy;
+    return *it;
+}
 
-        /*
-        if (toCopy)
-        {
-            std::cout << __PRETTY_FUNCTION__ << " loop #" << loop
-                << ": copied " << toCopy << " bytes from decompressed view into dest buffer"
-                << ", dest[0]=" << std::hex << static_cast<unsigned>(dest[0])
-                << ", dest[1]=" << std::hex << static_cast<unsigned>(dest[1])
-                << ", dest[2]=" << std::hex << static_cast<unsigned>(dest[2])
-                << ", dest[3]=" << std::hex << static_cast<unsigned>(dest[3])
-                << ", dest[4]=" << std::hex << static_cast<unsigned>(dest[4])
-                << std::dec
-                << endl;
-        }
-        */
+} // end anon namespace
 
-        ++loop;
-    }
+ListfileIndexEntry ZipReader::seekToWrite(u64 writeIndex)
+{
+    auto result = find_seek_point(d->entryIndex, writeIndex, &ListfileIndexEntry::writeIndex);
+    auto name = currentEntryName();
+    closeCurrentEntry();
+    openEntry(name);
+    jumpToIndexEntry(result);
+    return result;
+}
 
-    //cout << __PRETTY_FUNCTION__ << "read of maxSize=" << maxSize
-    //    << " satisfied after " << loop << " loops" << endl;
+ListfileIndexEntry ZipReader::seekToTimetick(u64 timetick)
+{
+    auto result = find_seek_point(d->entryIndex, timetick, &ListfileIndexEntry::timeticks);
+    auto name = currentEntryName();
+    closeCurrentEntry();
+    openEntry(name);
+    jumpToIndexEntry(result);
+    return result;
+}
 
-    return retval;
+ListfileIndexEntry ZipReader::seekToEvent(u64 eventNumber)
+{
+    auto result = find_seek_point(d->entryIndex, eventNumber, &ListfileIndexEntry::events);
+    auto name = currentEntryName();
+    closeCurrentEntry();
+    openEntry(name);
+    jumpToIndexEntry(result);
+    return result;
 }
 
-std::string ZipReader::currentEntryName() const
+void ZipReader::setReadAhead(const ReadAheadOptions &options)
 {
-    return d->entryInfo.name;
+    d->readAheadOptions = options;
 }
 
-const ZipEntryInfo &ZipReader::entryInfo() const
+ReadAheadOptions ZipReader::readAhead() const
 {
-    return d->entryInfo;
+    return d->readAheadOptions;
 }
 
-std::string ZipReader::firstListfileEntryName()
+void ZipReader::jumpToIndexEntry(const ListfileIndexEntry &entry)
 {
-    auto entryNames = entryNameList();
+    assert(d->entryInfo.type == ZipEntryInfo::LZ4);
 
-    auto it = std::find_if(
-        std::begin(entryNames), std::end(entryNames),
-        [] (const std::string &entryName)
-        {
-            static const std::regex re(R"foo(.+\.mvlclst(\.lz4)?)foo");
-            return std::regex_search(entryName, re);
-        });
+    d->readAhead.stop();
 
-    return (it != std::end(entryNames) ? *it : std::string{});
+    // The freshly opened entry is already positioned at the start of the data.
+    if (entry.compressedOffset == 0)
+        return;
+
+    // Each seek point starts a new LZ4 frame.
+    LZ4F_resetDecompressionContext(d->lz4Ctx.ctx);
+    d->lz4Ctx.compressedView = {};
+    d->lz4Ctx.decompressedView = {};
+
+    if (auto err = mz_stream_seek(d->osStream, d->entryDataOffset + entry.compressedOffset, MZ_SEEK_SET))
+        throw std::runtime_error("mz_stream_seek: " + std::to_string(err));
+
+    {
+        std::lock_guard<std::mutex> guard(d->entryInfoMutex);
+        d->entryInfo.lz4CompressedBytesRead = entry.compressedOffset;
+    }
+
+    d->readFromArchiveStream = true;
 }
 
 std::string next_archive_name(const std::string currentArchiveName)
@@ -1000,16 +2086,33 @@ size_t SplitZipReadHandle::seek(size_t pos)
 struct SplitZipReader::Private
 {
     SplitZipReader *q = nullptr;
-    ZipReader zipReader;
+    // Switched to the next part by the read-ahead thread. The switch and the
+    // public accessors are done under readerMutex.
+    std::unique_ptr<ZipReader> zipReader;
+    mutable std::mutex readerMutex;
+    // The next part of a split archive opened ahead of time by the read-ahead
+    // thread.
+    std::unique_ptr<ZipReader> nextZipReader;
+    std::string nextZipReaderArchiveName;
+    bool nextArchivePreopened = false;
     SplitZipReadHandle splitReadHandle;
     bool isSplitEntry = false;
     std::string firstArchiveName;
+    // Archive the data last returned by readCurrentEntry() belongs to.
     std::string currentArchiveName;
+    // Archive opened in zipReader. Ahead of currentArchiveName while the
+    // read-ahead thread is running.
+    std::string readerArchiveName;
     SplitZipReader::ArchiveChangedCallback archiveChangedCallback;
     std::shared_ptr<spdlog::logger> logger;
+    ReadAheadOptions readAheadOptions;
+    // Declared last so the thread is stopped before the members it uses are
+    // destroyed.
+    ReadAheadThread readAhead;
 
     explicit Private(SplitZipReader *q_)
         : q(q_)
+        , zipReader(std::make_unique<ZipReader>())
         , splitReadHandle(q)
         , logger(get_logger("SplitZipReader"))
     {
@@ -1017,11 +2120,135 @@ struct SplitZipReader::Private
 
     std::string nextArchiveName() const
     {
-        auto result = next_archive_name(currentArchiveName);
-        logger->debug("firstArchiveName={}, currentArchvieName={}, nextArchiveName={}",
-            firstArchiveName, currentArchiveName, result);
+        auto result = next_archive_name(readerArchiveName);
+        logger->debug("firstArchiveName={}, readerArchiveName={}, nextArchiveName={}",
+            firstArchiveName, readerArchiveName, result);
         return result;
     }
+
+    void stopReadAhead()
+    {
+        readAhead.stop();
+        nextZipReader.reset();
+        nextZipReaderArchiveName = {};
+        nextArchivePreopened = false;
+    }
+
+    void notifyArchiveChanged(const std::string &archiveName)
+    {
+        currentArchiveName = archiveName;
+        if (archiveChangedCallback)
+            archiveChangedCallback(q, currentArchiveName);
+    }
+
+    // Switches zipReader to the listfile entry of the next archive part.
+    // Returns false if there is no next part.
+    bool openNextArchive()
+    {
+        auto nextArchiveName = this->nextArchiveName();
+
+        if (!util::file_exists(nextArchiveName))
+            return false;
+
+        ZipReadHandle *readHandle = nullptr;
+
+        {
+            std::lock_guard<std::mutex> guard(readerMutex);
+
+            zipReader->closeArchive();
+
+            if (nextZipReader && nextZipReaderArchiveName == nextArchiveName)
+            {
+                // The old, now closed reader is reused for the next preopen.
+                std::swap(zipReader, nextZipReader);
+                nextZipReaderArchiveName = {};
+            }
+            else
+                zipReader->openArchive(nextArchiveName);
+
+            readerArchiveName = nextArchiveName;
+            readHandle = zipReader->openEntry(zipReader->firstListfileEntryName());
+        }
+
+        nextArchivePreopened = false;
+
+        // Have to read past the magic bytes at the start to land on the
+        // first frame or eth packet.
+        auto magic = read_magic_str(*readHandle);
+
+        if (magic != get_filemagic_eth() && magic != get_filemagic_usb())
+            logger->warn("SplitZipReader: archive={}, entry={}: invalid magic bytes at start of file: '{}'!",
+                readerArchiveName, zipReader->firstListfileEntryName(), magic);
+
+        return true;
+    }
+
+    // Opens the part following readerArchiveName in nextZipReader. Errors are
+    // not fatal here: openNextArchive() retries and reports them once the
+    // part is actually needed.
+    void preopenNextArchive()
+    {
+        nextArchivePreopened = true;
+
+        auto nextArchiveName = this->nextArchiveName();
+
+        if (!util::file_exists(nextArchiveName))
+            return;
+
+        try
+        {
+            if (!nextZipReader)
+                nextZipReader = std::make_unique<ZipReader>();
+
+            nextZipReader->openArchive(nextArchiveName);
+            nextZipReaderArchiveName = nextArchiveName;
+        }
+        catch (const std::exception &e)
+        {
+            logger->debug("Could not open next archive part {} ahead of time: {}",
+                nextArchiveName, e.what());
+            nextZipReader.reset();
+            nextZipReaderArchiveName = {};
+        }
+    }
+
+    size_t readSplitEntryDirect(u8 *dest, size_t maxSize)
+    {
+        size_t totalBytesRead = 0u;
+
+        while (totalBytesRead < maxSize)
+        {
+            auto bytesRead = zipReader->readCurrentEntry(dest + totalBytesRead, maxSize - totalBytesRead);
+            totalBytesRead += bytesRead;
+
+            if (bytesRead == 0)
+            {
+                if (!openNextArchive())
+                    break;
+
+                notifyArchiveChanged(readerArchiveName);
+            }
+        }
+
+        return totalBytesRead;
+    }
+
+    // Runs in the read-ahead thread. The first buffer filled from a new
+    // archive part is tagged with the archive name so that the
+    // ArchiveChangedCallback is invoked from the consumer side.
+    void fillReadAheadBuffer(ReadAheadBuffer &buffer)
+    {
+        buffer.used = zipReader->readCurrentEntry(buffer.data.data(), buffer.data.size());
+
+        if (buffer.used == 0u && openNextArchive())
+        {
+            buffer.archiveName = readerArchiveName;
+            buffer.used = zipReader->readCurrentEntry(buffer.data.data(), buffer.data.size());
+        }
+
+        if (!nextArchivePreopened)
+            preopenNextArchive();
+    }
 };
 
 SplitZipReader::SplitZipReader()
@@ -1035,125 +2262,126 @@ SplitZipReader::~SplitZipReader()
 
 void SplitZipReader::openArchive(const std::string &archiveName)
 {
-    d->zipReader.openArchive(archiveName);
+    d->stopReadAhead();
+    d->zipReader->openArchive(archiveName);
     d->firstArchiveName = archiveName;
-    d->currentArchiveName = archiveName;
-    if (d->archiveChangedCallback)
-        d->archiveChangedCallback(this, d->currentArchiveName);
+    d->readerArchiveName = archiveName;
+    d->notifyArchiveChanged(archiveName);
 }
 
 void SplitZipReader::closeArchive()
 {
-    d->zipReader.closeArchive();
+    d->stopReadAhead();
+    d->zipReader->closeArchive();
 }
 
 std::vector<std::string> SplitZipReader::entryNameList()
 {
-    return d->zipReader.entryNameList();
+    std::lock_guard<std::mutex> guard(d->readerMutex);
+    return d->zipReader->entryNameList();
 }
 
 ZipReadHandle *SplitZipReader::openEntry(const std::string &name)
 {
+    d->stopReadAhead();
     d->isSplitEntry = false;
-    return d->zipReader.openEntry(name);
+    // Non-split entries are read ahead by the ZipReader itself.
+    d->zipReader->setReadAhead(d->readAheadOptions);
+    return d->zipReader->openEntry(name);
 }
 
 ZipReadHandle *SplitZipReader::currentEntry()
 {
-    return d->zipReader.currentEntry();
+    std::lock_guard<std::mutex> guard(d->readerMutex);
+    return d->zipReader->currentEntry();
 }
 
 void SplitZipReader::closeCurrentEntry()
 {
-    d->zipReader.closeCurrentEntry();
+    d->stopReadAhead();
+    d->zipReader->closeCurrentEntry();
     d->isSplitEntry = false;
 }
 
 size_t SplitZipReader::readCurrentEntry(u8 *dest, size_t maxSize)
 {
     if (!d->isSplitEntry)
-        return d->zipReader.readCurrentEntry(dest, maxSize);
-
-    size_t totalBytesRead = 0u;
+        return d->zipReader->readCurrentEntry(dest, maxSize);
 
-    while (totalBytesRead < maxSize)
+    if (!d->readAhead.isRunning())
     {
-        auto bytesRead = d->zipReader.readCurrentEntry(dest + totalBytesRead, maxSize - totalBytesRead);
-        totalBytesRead += bytesRead;
+        if (!d->readAheadOptions.enabled)
+            return d->readSplitEntryDirect(dest, maxSize);
 
-        if (bytesRead == 0)
+        d->readAhead.start(d->readAheadOptions, [this] (ReadAheadBuffer &buffer)
         {
-            auto nextArchiveName = d->nextArchiveName();
-
-            if (!util::file_exists(nextArchiveName))
-                break;
-
-            d->zipReader.closeArchive();
-            d->zipReader.openArchive(nextArchiveName);
-            d->currentArchiveName = nextArchiveName;
-            if (d->archiveChangedCallback)
-                d->archiveChangedCallback(this, d->currentArchiveName);
-            auto readHandle = d->zipReader.openEntry(d->zipReader.firstListfileEntryName());
-
-            // Have to read past the magic bytes at the start to land on the
-            // first frame or eth packet.
-            auto magic = read_magic_str(*readHandle);
-
-            if (magic != get_filemagic_eth() && magic != get_filemagic_usb())
-                d->logger->warn("SplitZipReader: archive={}, entry={}: invalid magic bytes at start of file: '{}'!",
-                    d->currentArchiveName, d->zipReader.firstListfileEntryName(), magic);
-        }
+            d->fillReadAheadBuffer(buffer);
+        });
     }
 
-    return totalBytesRead;
+    return d->readAhead.read(dest, maxSize, [this] (const std::string &archiveName)
+    {
+        d->notifyArchiveChanged(archiveName);
+    });
 }
 
 std::string SplitZipReader::currentEntryName() const
 {
-    return d->zipReader.currentEntryName();
+    std::lock_guard<std::mutex> guard(d->readerMutex);
+    return d->zipReader->currentEntryName();
 }
 
-const ZipEntryInfo &SplitZipReader::entryInfo() const
+ZipEntryInfo SplitZipReader::entryInfo() const
 {
-    return d->zipReader.entryInfo();
+    std::lock_guard<std::mutex> guard(d->readerMutex);
+    return d->zipReader->entryInfo();
 }
 
 std::string SplitZipReader::firstListfileEntryName()
 {
-    return d->zipReader.firstListfileEntryName();
+    std::lock_guard<std::mutex> guard(d->readerMutex);
+    return d->zipReader->firstListfileEntryName();
 }
 
 SplitZipReadHandle *SplitZipReader::openFirstListfileEntry()
 {
-    auto name = d->zipReader.firstListfileEntryName();
-    d->zipReader.openEntry(name);
+    d->stopReadAhead();
+    auto name = d->zipReader->firstListfileEntryName();
+    // Split entries are read ahead in readCurrentEntry() to be able to open
+    // the next part in the background.
+    d->zipReader->setReadAhead({});
+    d->zipReader->openEntry(name);
     d->isSplitEntry = true;
     return &d->splitReadHandle;
 }
 
 size_t SplitZipReader::seek(size_t pos)
 {
+    d->stopReadAhead();
+
     if (!d->isSplitEntry)
-        return d->zipReader.currentEntry()->seek(pos);
+        return d->zipReader->currentEntry()->seek(pos);
 
     // Go to the first archive in the series.
-    if (d->currentArchiveName != d->firstArchiveName)
+    if (d->readerArchiveName != d->firstArchiveName)
     {
-        d->zipReader.closeArchive();
-        d->zipReader.openArchive(d->firstArchiveName);
-        d->currentArchiveName = d->firstArchiveName;
-        if (d->archiveChangedCallback)
-            d->archiveChangedCallback(this, d->currentArchiveName);
+        d->zipReader->closeArchive();
+        d->zipReader->openArchive(d->firstArchiveName);
+        d->readerArchiveName = d->firstArchiveName;
     }
-    d->zipReader.closeCurrentEntry();
-    d->zipReader.openEntry(d->zipReader.firstListfileEntryName());
+    else
+        d->zipReader->closeCurrentEntry();
+
+    if (d->currentArchiveName != d->firstArchiveName)
+        d->notifyArchiveChanged(d->firstArchiveName);
 
+    d->zipReader->openEntry(d->zipReader->firstListfileEntryName());
 
     size_t totalBytesRead = 0;
 
     while (totalBytesRead < pos)
     {
-        auto bytesRead = d->zipReader.currentEntry()->seek(pos - totalBytesRead);
+        auto bytesRead = d->zipReader->currentEntry()->seek(pos - totalBytesRead);
         totalBytesRead += bytesRead;
 
         if (bytesRead == 0u)
@@ -1168,6 +2396,16 @@ void SplitZipReader::setArchiveChangedCallback(ArchiveChangedCallback cb)
     d->archiveChangedCallback = cb;
 }
 
+void SplitZipReader::setReadAhead(const ReadAheadOptions &options)
+{
+    d->readAheadOptions = options;
+}
+
+ReadAheadOptions SplitZipReader::readAhead() const
+{
+    return d->readAheadOptions;
+}
+
 } // end namespace listfile
 } // end namespace mvlc
 } // end namespace mesytec
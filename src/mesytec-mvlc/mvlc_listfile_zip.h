@@ -44,6 +44,66 @@ struct MESYTEC_MVLC_EXPORT ZipEntryInfo
     }
 };
 
+// Random access index for LZ4 compressed listfile entries.
+//
+// When enabled the ZipCreator periodically ends the current LZ4 frame and
+// starts a new, independently decodable frame. New frames are only started at
+// the beginning of a write() call once the listfile data written so far ends on
+// a frame or packet boundary. When used by the listfile writer each write
+// corresponds to one readout buffer, so each seek point is a valid starting
+// point for the readout parser. The readout buffer numbers themselves are not
+// part of the listfile data, so seek points are identified by the number of
+// writes instead. Note that the preamble is written separately by the
+// SplitZipCreator and counts as one write.
+//
+// The seek points are stored in an additional uncompressed ZIP entry named
+// '<lz4 entry name>.idx' when the LZ4 entry is closed. ZipReader picks up the
+// index entry and uses it in seek(). Without an index entry seek() decompresses
+// all data in front of the seek target.
+struct MESYTEC_MVLC_EXPORT ListfileIndexEntry
+{
+    // Offset into the uncompressed entry data.
+    u64 uncompressedOffset = 0u;
+    // Offset into the LZ4 compressed entry data.
+    u64 compressedOffset = 0u;
+    // Number of writes to the entry preceding this point.
+    u64 writeIndex = 0u;
+    // Number of UnixTimetick system events preceding this point. Timeticks are
+    // written once per second, so this is the run duration in seconds.
+    u64 timeticks = 0u;
+    // Number of readout events (StackFrames) preceding this point.
+    u64 events = 0u;
+};
+
+using ListfileIndex = std::vector<ListfileIndexEntry>;
+
+// Default spacing of LZ4 index seek points in uncompressed bytes.
+static const size_t DefaultLZ4IndexInterval = util::Megabytes(16);
+
+std::string MESYTEC_MVLC_EXPORT index_entry_name(const std::string &lz4EntryName);
+std::vector<u8> MESYTEC_MVLC_EXPORT serialize_listfile_index(const ListfileIndex &index);
+// Throws on error.
+ListfileIndex MESYTEC_MVLC_EXPORT deserialize_listfile_index(const u8 *data, size_t size);
+
+struct MESYTEC_MVLC_EXPORT LZ4EntryOptions
+{
+    // 0: lz4 default compression
+    int compressLevel = 0;
+
+    // If non-zero a random access index with seek points spaced at least
+    // indexInterval uncompressed bytes apart is written when the entry is
+    // closed.
+    size_t indexInterval = 0;
+
+    // Number of threads compressing the entry data in parallel. The data is
+    // split into independent 4 MiB LZ4 frames which are written to the archive
+    // in order. write() returns once the data has been queued for compression
+    // and only blocks if too many frames are pending. Compression errors are
+    // reported by the following write() or by closeCurrentEntry(). 0
+    // compresses inline in the thread calling write().
+    unsigned compressionThreads = 0;
+};
+
 enum class OverwriteMode
 {
     DontOverwrite,
@@ -73,7 +133,14 @@ class MESYTEC_MVLC_EXPORT ZipCreator
         std::unique_ptr<WriteHandle> createZIPEntry(const std::string &entryName)
         { return createZIPEntry(entryName, 1); } // 1: "super fast compression", 0: store/no compression
 
-        std::unique_ptr<WriteHandle> createLZ4Entry(const std::string &entryName, int compressLevel);
+        std::unique_ptr<WriteHandle> createLZ4Entry(const std::string &entryName, const LZ4EntryOptions &options);
+
+        std::unique_ptr<WriteHandle> createLZ4Entry(const std::string &entryName, int compressLevel)
+        {
+            LZ4EntryOptions options;
+            options.compressLevel = compressLevel;
+            return createLZ4Entry(entryName, options);
+        }
 
         std::unique_ptr<WriteHandle> createLZ4Entry(const std::string &entryName)
         { return createLZ4Entry(entryName, 0); }; // 0: lz4 default compression
@@ -137,6 +204,16 @@ struct MESYTEC_MVLC_EXPORT SplitListfileSetup
     // listfile part.
     std::vector<u8> preamble;
 
+    // Uncompressed bytes between the seek points of the random access index
+    // written for LZ4 listfile entries. 0 disables the index.
+    size_t lz4IndexInterval = 0;
+
+    // Number of threads used to compress LZ4 listfile entries, see
+    // LZ4EntryOptions. Splitting by size is based on the compressed data
+    // written so far and thus lags behind by the frames still being
+    // compressed. ZIP (deflate) entries are always compressed inline.
+    unsigned compressionThreads = 0;
+
     // Called when an archive is created, either manually via createArchive()
     // or automatically due to the file splitting setup.
     OpenArchiveCallback openArchiveCallback;
@@ -208,6 +285,41 @@ class MESYTEC_MVLC_EXPORT SplitZipWriteHandle: public WriteHandle
         SplitZipCreator *creator_ = nullptr;
 };
 
+//
+// ZipReader
+//
+
+// Read-ahead mode for ZipReader and SplitZipReader.
+//
+// When enabled a background thread reads and decompresses the current entry
+// into a bounded queue of bufferCount buffers of bufferSize bytes each.
+// readCurrentEntry() copies from the queue and only blocks if the thread has
+// not caught up yet. The thread is started by the first read from an entry
+// and stopped when the entry is closed, reopened or seeked. Errors
+// encountered by the thread are rethrown from readCurrentEntry() once the
+// data read before the error has been consumed.
+//
+// SplitZipReader additionally opens the next part of a split archive in the
+// background thread so that switching parts does not stall the reader. The
+// ArchiveChangedCallback is still invoked from readCurrentEntry() once the
+// first data from the new part is consumed.
+//
+// While the thread is running only entryInfo(), currentEntryName(),
+// entryNameList(), firstListfileEntryName() and currentEntry() may be called
+// from other threads. They return the state of the thread which can be ahead
+// of the data returned by readCurrentEntry(): the byte counters include data
+// that is still queued and for split archives the entry info can belong to
+// the next part before the ArchiveChangedCallback has been invoked. The
+// pointer returned by SplitZipReader::currentEntry() refers to the part
+// opened by the thread and becomes invalid once the next part is opened. Read
+// split entries through the SplitZipReadHandle only.
+struct MESYTEC_MVLC_EXPORT ReadAheadOptions
+{
+    bool enabled = false;
+    size_t bufferSize = util::Megabytes(1);
+    size_t bufferCount = 8;
+};
+
 class ZipReader;
 
 class MESYTEC_MVLC_EXPORT ZipReadHandle: public ReadHandle
@@ -244,11 +356,31 @@ class MESYTEC_MVLC_EXPORT ZipReader
         void closeCurrentEntry();
         size_t readCurrentEntry(u8 *dest, size_t maxSize);
         std::string currentEntryName() const;
-        const ZipEntryInfo &entryInfo() const;
+        ZipEntryInfo entryInfo() const;
 
         std::string firstListfileEntryName();
 
+        // Random access index of the currently open LZ4 entry. Empty if the
+        // archive does not contain an index for the entry.
+        const ListfileIndex &entryIndex() const;
+
+        // Reopens the current entry and positions it at the last seek point
+        // where writeIndex/timeticks/events is less than or equal to the given
+        // value. Returns the index entry of the seek point. Throws if the
+        // entry has no index.
+        ListfileIndexEntry seekToWrite(u64 writeIndex);
+        ListfileIndexEntry seekToTimetick(u64 timetick);
+        ListfileIndexEntry seekToEvent(u64 eventNumber);
+
+        // Takes effect on the first read after opening, reopening or seeking
+        // an entry.
+        void setReadAhead(const ReadAheadOptions &options);
+        ReadAheadOptions readAhead() const;
+
     private:
+        friend class ZipReadHandle;
+        // Jumps to the seek point right after (re)opening the entry.
+        void jumpToIndexEntry(const ListfileIndexEntry &entry);
         struct Private;
         std::unique_ptr<Private> d;
 };
@@ -292,7 +424,7 @@ class MESYTEC_MVLC_EXPORT SplitZipReader
         void closeCurrentEntry();
         size_t readCurrentEntry(u8 *dest, size_t maxSize);
         std::string currentEntryName() const;
-        const ZipEntryInfo &entryInfo() const;
+        ZipEntryInfo entryInfo() const;
 
         std::string firstListfileEntryName();
 
@@ -301,6 +433,11 @@ class MESYTEC_MVLC_EXPORT SplitZipReader
 
         void setArchiveChangedCallback(ArchiveChangedCallback cb);
 
+        // Takes effect on the first read after opening, reopening or seeking
+        // an entry.
+        void setReadAhead(const ReadAheadOptions &options);
+        ReadAheadOptions readAhead() const;
+
     private:
         friend class SplitZipReadHandle;
         size_t seek(size_t pos);
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <chrono>
 #include <random>
 #include <iostream>
@@ -11,6 +12,7 @@
 
 #include "gtest/gtest.h"
 
+#include "mvlc_eth_interface.h"
 #include "mvlc_listfile_zip.h"
 #include "util/filesystem.h"
 #include "util/fmt.h"
@@ -218,6 +220,455 @@ TEST(mvlc_listfile_zip, LZ4Data)
     ASSERT_TRUE(util::delete_file(archiveName));
 }
 
+namespace
+{
+
+// Listfile data split into buffers the way the readout worker writes them.
+struct TestListfile
+{
+    std::vector<u8> data;
+    // offset of each buffer in data
+    std::vector<size_t> bufferOffsets;
+    // number of timeticks in front of each buffer
+    std::vector<u64> timeticksBefore;
+    // number of readout events in front of each buffer
+    std::vector<u64> eventsBefore;
+
+    std::vector<u8> bufferData(size_t bufferNumber) const
+    {
+        size_t end = bufferNumber + 1 < bufferOffsets.size() ? bufferOffsets[bufferNumber + 1] : data.size();
+        return { data.begin() + bufferOffsets[bufferNumber], data.begin() + end };
+    }
+};
+
+// Generates USB stack frames or ETH packets with a UnixTimetick system event
+// in front of every third buffer. Each ETH packet contains a single stack
+// frame. Sizes are chosen so that headers regularly get split between buffers.
+TestListfile make_test_listfile(ConnectionType type, size_t bufferCount)
+{
+    TestListfile result;
+    std::vector<u32> words;
+    u64 timeticks = 0u;
+    u64 events = 0u;
+    u32 value = 0u;
+
+    auto magic = type == ConnectionType::ETH ? get_filemagic_eth() : get_filemagic_usb();
+
+    for (size_t bufferNumber = 0; bufferNumber < bufferCount; ++bufferNumber)
+    {
+        words.clear();
+
+        if (bufferNumber % 3 == 0)
+        {
+            words.push_back((frame_headers::SystemEvent << frame_headers::TypeShift)
+                            | (system_event::subtype::UnixTimetick << system_event::SubtypeShift)
+                            | 2u);
+            words.push_back(0x1234u);
+            words.push_back(0x5678u);
+        }
+
+        for (size_t i = 0; i < 50; ++i)
+        {
+            u32 dataWords = 100 + (bufferNumber * 7 + i) % 300;
+
+            if (type == ConnectionType::ETH)
+            {
+                words.push_back(eth::make_header0(eth::PacketChannel::Data, i, dataWords + 1));
+                words.push_back(eth::make_header1(0));
+            }
+
+            words.push_back((frame_headers::StackFrame << frame_headers::TypeShift) | dataWords);
+
+            for (u32 j = 0; j < dataWords; ++j)
+                words.push_back(value++ % 1000u);
+        }
+
+        result.bufferOffsets.push_back(result.data.size());
+        result.timeticksBefore.push_back(timeticks);
+        result.eventsBefore.push_back(events);
+        events += 50;
+
+        if (bufferNumber == 0)
+            result.data.insert(result.data.end(), magic, magic + get_filemagic_len());
+
+        auto bytes = reinterpret_cast<const u8 *>(words.data());
+        result.data.insert(result.data.end(), bytes, bytes + words.size() * sizeof(u32));
+
+        if (bufferNumber % 3 == 0)
+            ++timeticks;
+    }
+
+    return result;
+}
+
+std::vector<u8> read_at(ReadHandle &rh, size_t pos, size_t size)
+{
+    std::vector<u8> result(size);
+    EXPECT_EQ(rh.seek(pos), pos);
+    result.resize(rh.read(result.data(), result.size()));
+    return result;
+}
+
+} // end anon namespace
+
+TEST(mvlc_listfile_zip, LZ4Index)
+{
+    for (auto type: { ConnectionType::USB, ConnectionType::ETH })
+    for (unsigned threads: { 0u, 2u })
+    {
+        SCOPED_TRACE(fmt::format("type={}, compressionThreads={}", static_cast<int>(type), threads));
+        const auto listfile = make_test_listfile(type, 300);
+        const std::string archiveName = "mvlc_listfile_zip.test.LZ4Index.zip";
+        const std::string indexedEntry = "listfile.mvlclst.lz4";
+        const std::string plainEntry = "plain.mvlclst.lz4";
+
+        {
+            ZipCreator creator;
+            creator.createArchive(archiveName, OverwriteMode::Overwrite);
+
+            for (const auto &entry: { indexedEntry, plainEntry })
+            {
+                LZ4EntryOptions options;
+                options.compressionThreads = threads;
+
+                if (entry == indexedEntry)
+                    options.indexInterval = util::Megabytes(1);
+
+                auto wh = creator.createLZ4Entry(entry.substr(0, entry.size() - 4), options);
+
+                for (size_t i = 0; i < listfile.bufferOffsets.size(); ++i)
+                {
+                    auto buffer = listfile.bufferData(i);
+                    wh->write(buffer.data(), buffer.size());
+                }
+
+                creator.closeCurrentEntry();
+                ASSERT_EQ(creator.entryInfo().name, entry);
+            }
+        }
+
+        ZipReader reader;
+        reader.openArchive(archiveName);
+
+        std::vector<std::string> expectedEntries = { indexedEntry, index_entry_name(indexedEntry), plainEntry };
+        ASSERT_EQ(reader.entryNameList(), expectedEntries);
+        ASSERT_EQ(reader.firstListfileEntryName(), indexedEntry);
+
+        auto rh = reader.openEntry(indexedEntry);
+        const auto index = reader.entryIndex();
+
+        ASSERT_GT(index.size(), 5u);
+        ASSERT_EQ(index[0].uncompressedOffset, 0u);
+        ASSERT_EQ(index[0].compressedOffset, 0u);
+
+        for (size_t i = 1; i < index.size(); ++i)
+        {
+            const auto &entry = index[i];
+            ASSERT_GT(entry.compressedOffset, index[i-1].compressedOffset);
+            ASSERT_GE(entry.uncompressedOffset - index[i-1].uncompressedOffset, util::Megabytes(1));
+            ASSERT_LT(entry.writeIndex, listfile.bufferOffsets.size());
+            ASSERT_EQ(entry.uncompressedOffset, listfile.bufferOffsets[entry.writeIndex]);
+            ASSERT_EQ(entry.timeticks, listfile.timeticksBefore[entry.writeIndex]);
+            ASSERT_EQ(entry.events, listfile.eventsBefore[entry.writeIndex]);
+        }
+
+        // Sequential reads are not affected by the LZ4 frame restarts.
+        {
+            std::vector<u8> readBuffer(listfile.data.size() + 1);
+            ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), listfile.data.size());
+            readBuffer.resize(listfile.data.size());
+            ASSERT_EQ(readBuffer, listfile.data);
+        }
+
+        const size_t ReadSize = util::Kilobytes(4);
+        const size_t dataSize = listfile.data.size();
+
+        for (const auto &entryName: { indexedEntry, plainEntry })
+        {
+            rh = reader.openEntry(entryName);
+
+            ASSERT_EQ(reader.entryIndex().empty(), entryName == plainEntry);
+
+            for (size_t pos: { size_t(0), size_t(1), index[1].uncompressedOffset - 1,
+                 index[1].uncompressedOffset, index[2].uncompressedOffset + 4321,
+                 dataSize / 2, dataSize - ReadSize, dataSize - 1, size_t(0) })
+            {
+                std::vector<u8> expected(listfile.data.begin() + pos,
+                                         listfile.data.begin() + std::min(pos + ReadSize, dataSize));
+                ASSERT_EQ(read_at(*rh, pos, ReadSize), expected) << "entry=" << entryName << ", pos=" << pos;
+            }
+
+            // seeking past the end returns the entry size
+            ASSERT_EQ(rh->seek(dataSize + 100), dataSize);
+        }
+
+        // Seek by write index, timetick and event number.
+        rh = reader.openEntry(indexedEntry);
+
+        for (u64 writeIndex: { 0u, 1u, 100u, 299u, 1000u })
+        {
+            auto entry = reader.seekToWrite(writeIndex);
+            ASSERT_LE(entry.writeIndex, writeIndex);
+            auto expected = listfile.bufferData(entry.writeIndex);
+            std::vector<u8> readBuffer(expected.size());
+            ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), expected.size());
+            ASSERT_EQ(readBuffer, expected);
+        }
+
+        for (u64 timetick: { 0u, 10u, 50u, 1000u })
+        {
+            auto entry = reader.seekToTimetick(timetick);
+            ASSERT_LE(entry.timeticks, timetick);
+            auto expected = listfile.bufferData(entry.writeIndex);
+            std::vector<u8> readBuffer(expected.size());
+            ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), expected.size());
+            ASSERT_EQ(readBuffer, expected);
+        }
+
+        for (u64 eventNumber: { 0u, 49u, 5000u, 14999u, 100000u })
+        {
+            auto entry = reader.seekToEvent(eventNumber);
+            ASSERT_LE(entry.events, eventNumber);
+            auto expected = listfile.bufferData(entry.writeIndex);
+            std::vector<u8> readBuffer(expected.size());
+            ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), expected.size());
+            ASSERT_EQ(readBuffer, expected);
+        }
+
+        reader.openEntry(plainEntry);
+        ASSERT_THROW(reader.seekToWrite(10), std::runtime_error);
+
+        reader.closeArchive();
+        ASSERT_TRUE(util::delete_file(archiveName));
+    }
+}
+
+TEST(mvlc_listfile_zip, LZ4ParallelCompression)
+{
+    std::vector<u8> outData(util::Megabytes(30));
+
+    for (size_t i=0; i<outData.size(); i++)
+        outData[i] = (i * 7 / 13) % 251u;
+
+    std::string archiveName = "mvlc_listfile_zip.test.LZ4ParallelCompression.zip";
+
+    {
+        ZipCreator creator;
+        creator.createArchive(archiveName, OverwriteMode::Overwrite);
+
+        LZ4EntryOptions options;
+        options.compressionThreads = 3;
+
+        // Writes of varying sizes, some of them larger than the job size.
+        auto wh = creator.createLZ4Entry("outfile0.data", options);
+        std::mt19937 rng(42);
+        size_t offset = 0u;
+
+        while (offset < outData.size())
+        {
+            size_t size = std::min(outData.size() - offset,
+                                   std::uniform_int_distribution<size_t>(1, util::Megabytes(6))(rng));
+            ASSERT_EQ(wh->write(outData.data() + offset, size), size);
+            offset += size;
+        }
+
+        creator.closeCurrentEntry();
+        ASSERT_EQ(creator.entryInfo().bytesWritten, outData.size());
+        ASSERT_LT(creator.entryInfo().lz4CompressedBytesWritten, outData.size());
+
+        // An empty entry still has to contain a valid LZ4 frame.
+        creator.createLZ4Entry("empty.data", options);
+        creator.closeCurrentEntry();
+    }
+
+    {
+        ZipReader reader;
+        reader.openArchive(archiveName);
+
+        auto rh = reader.openEntry("outfile0.data.lz4");
+        std::vector<u8> readBuffer(outData.size() + 1);
+        ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), outData.size());
+        readBuffer.resize(outData.size());
+        ASSERT_EQ(readBuffer, outData);
+
+        rh = reader.openEntry("empty.data.lz4");
+        ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), 0u);
+    }
+
+    ASSERT_TRUE(util::delete_file(archiveName));
+}
+
+TEST(mvlc_listfile_zip, LZ4IndexSerialization)
+{
+    ListfileIndex index = { { 0, 0, 0, 0, 0 }, { 100, 50, 3, 1, 150 }, { 200, 90, 7, 2, 0x0123456789abcdefu } };
+    auto data = serialize_listfile_index(index);
+    auto result = deserialize_listfile_index(data.data(), data.size());
+
+    ASSERT_EQ(result.size(), index.size());
+
+    for (size_t i = 0; i < index.size(); ++i)
+    {
+        ASSERT_EQ(result[i].uncompressedOffset, index[i].uncompressedOffset);
+        ASSERT_EQ(result[i].compressedOffset, index[i].compressedOffset);
+        ASSERT_EQ(result[i].writeIndex, index[i].writeIndex);
+        ASSERT_EQ(result[i].timeticks, index[i].timeticks);
+        ASSERT_EQ(result[i].events, index[i].events);
+    }
+
+    // Values are stored little endian following the magic and the entry count.
+    ASSERT_EQ(data.size(), 8u + 8u + index.size() * 5 * 8u);
+    ASSERT_EQ(data[8], index.size());
+    ASSERT_EQ(data[16 + 2 * 40 + 4 * 8], 0xefu);
+    ASSERT_EQ(data[16 + 2 * 40 + 4 * 8 + 7], 0x01u);
+
+    ASSERT_THROW(deserialize_listfile_index(data.data(), data.size() - 1), std::runtime_error);
+    data[0] = 'X';
+    ASSERT_THROW(deserialize_listfile_index(data.data(), data.size()), std::runtime_error);
+}
+
+TEST(mvlc_listfile_zip, LZ4ReadAhead)
+{
+    const auto listfile = make_test_listfile(ConnectionType::USB, 300);
+    const std::string archiveName = "mvlc_listfile_zip.test.LZ4ReadAhead.zip";
+
+    {
+        ZipCreator creator;
+        creator.createArchive(archiveName, OverwriteMode::Overwrite);
+
+        LZ4EntryOptions options;
+        options.indexInterval = util::Megabytes(1);
+
+        for (const std::string &entry: std::vector<std::string>{ "listfile.mvlclst", "listfile_zip.mvlclst" })
+        {
+            auto wh = (entry == "listfile.mvlclst"
+                       ? creator.createLZ4Entry(entry, options)
+                       : creator.createZIPEntry(entry));
+            wh->write(listfile.data.data(), listfile.data.size());
+            creator.closeCurrentEntry();
+        }
+    }
+
+    ZipReader reader;
+    ReadAheadOptions readAhead;
+    readAhead.enabled = true;
+    readAhead.bufferSize = 4099; // not a multiple of the read sizes
+    readAhead.bufferCount = 3;
+    reader.setReadAhead(readAhead);
+    ASSERT_TRUE(reader.readAhead().enabled);
+    reader.openArchive(archiveName);
+
+    for (const auto &entryName: { "listfile.mvlclst.lz4", "listfile_zip.mvlclst" })
+    {
+        SCOPED_TRACE(entryName);
+
+        // Sequential reads of varying sizes.
+        auto rh = reader.openEntry(entryName);
+        std::vector<u8> readData;
+        std::vector<u8> readBuffer(util::Kilobytes(64));
+        std::mt19937 rng(42);
+
+        while (true)
+        {
+            size_t size = std::uniform_int_distribution<size_t>(1, readBuffer.size())(rng);
+            size_t bytesRead = rh->read(readBuffer.data(), size);
+
+            if (bytesRead == 0)
+                break;
+
+            readData.insert(readData.end(), readBuffer.begin(), readBuffer.begin() + bytesRead);
+        }
+
+        ASSERT_EQ(readData, listfile.data);
+        ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), 0u);
+
+        // Seeking discards the buffers read ahead.
+        const size_t dataSize = listfile.data.size();
+
+        for (size_t pos: { dataSize / 2, size_t(1), dataSize - 100, size_t(0) })
+        {
+            std::vector<u8> expected(listfile.data.begin() + pos,
+                                     listfile.data.begin() + std::min(pos + 10000, dataSize));
+            ASSERT_EQ(read_at(*rh, pos, 10000), expected) << "pos=" << pos;
+        }
+    }
+
+    auto rh = reader.openEntry("listfile.mvlclst.lz4");
+
+    for (u64 writeIndex: { 100u, 10u, 299u })
+    {
+        auto entry = reader.seekToWrite(writeIndex);
+        auto expected = listfile.bufferData(entry.writeIndex);
+        std::vector<u8> readBuffer(expected.size());
+        ASSERT_EQ(rh->read(readBuffer.data(), readBuffer.size()), expected.size());
+        ASSERT_EQ(readBuffer, expected);
+    }
+
+    // Closing with buffers still queued.
+    reader.closeCurrentEntry();
+    reader.closeArchive();
+    ASSERT_TRUE(util::delete_file(archiveName));
+}
+
+TEST(mvlc_listfile_zip, Split_LZ4Index)
+{
+    const auto listfile = make_test_listfile(ConnectionType::USB, 100);
+    const std::string prefix = "mvlc_listfile_zip.test.Split_LZ4Index";
+
+    {
+        SplitListfileSetup setup;
+        setup.entryType = ZipEntryInfo::LZ4;
+        setup.overwriteMode = OverwriteMode::Overwrite;
+        setup.filenamePrefix = prefix;
+        setup.preamble = { listfile.data.begin(), listfile.data.begin() + get_filemagic_len() };
+        setup.lz4IndexInterval = util::Kilobytes(512);
+
+        SplitZipCreator creator;
+        creator.createArchive(setup);
+        auto wh = creator.createListfileEntry();
+
+        for (size_t i = 0; i < listfile.bufferOffsets.size(); ++i)
+        {
+            auto buffer = listfile.bufferData(i);
+
+            if (i == 0)
+                buffer.erase(buffer.begin(), buffer.begin() + get_filemagic_len());
+
+            wh->write(buffer.data(), buffer.size());
+        }
+
+        creator.closeArchive();
+    }
+
+    SplitZipReader reader;
+    reader.openArchive(prefix + ".zip");
+
+    auto entryName = reader.firstListfileEntryName();
+    ASSERT_EQ(entryName, util::basename(prefix) + ".mvlclst.lz4");
+    auto rh = reader.openFirstListfileEntry();
+
+    ZipReader zipReader;
+    zipReader.openArchive(prefix + ".zip");
+    zipReader.openEntry(entryName);
+    ASSERT_GT(zipReader.entryIndex().size(), 1u);
+
+    // The preamble is the first write, write indexes are shifted by one.
+    for (const auto &entry: zipReader.entryIndex())
+    {
+        if (entry.writeIndex == 0)
+            continue;
+        ASSERT_EQ(entry.uncompressedOffset, listfile.bufferOffsets[entry.writeIndex - 1]);
+        ASSERT_EQ(entry.events, listfile.eventsBefore[entry.writeIndex - 1]);
+    }
+
+    size_t pos = listfile.data.size() / 2;
+    std::vector<u8> expected(listfile.data.begin() + pos, listfile.data.begin() + pos + 1000);
+    ASSERT_EQ(read_at(*rh, pos, 1000), expected);
+
+    reader.closeArchive();
+    zipReader.closeArchive();
+    ASSERT_TRUE(util::delete_file(prefix + ".zip"));
+}
+
 TEST(mvlc_listfile_zip, Split_CreateArchive)
 {
 
@@ -559,6 +1010,116 @@ TEST(mvlc_listfile_zip, Split_Read)
         ASSERT_TRUE(util::delete_file(part));
 }
 
+TEST(mvlc_listfile_zip, Split_ReadAhead)
+{
+    const auto listfile = make_test_listfile(ConnectionType::USB, 200);
+    const std::string prefix = "mvlc_listfile_zip.test.Split_ReadAhead";
+    std::vector<std::string> parts;
+
+    {
+        SplitListfileSetup setup;
+        setup.entryType = ZipEntryInfo::LZ4;
+        setup.overwriteMode = OverwriteMode::Overwrite;
+        setup.splitMode = ZipSplitMode::SplitBySize;
+        setup.splitSize = util::Kilobytes(16); // the test data compresses well
+        setup.filenamePrefix = prefix;
+        setup.preamble = { listfile.data.begin(), listfile.data.begin() + get_filemagic_len() };
+        setup.openArchiveCallback = [&parts] (SplitZipCreator *creator)
+        {
+            parts.push_back(creator->archiveName());
+        };
+
+        SplitZipCreator creator;
+        creator.createArchive(setup);
+        auto wh = creator.createListfileEntry();
+
+        for (size_t i = 0; i < listfile.bufferOffsets.size(); ++i)
+        {
+            auto buffer = listfile.bufferData(i);
+
+            if (i == 0)
+                buffer.erase(buffer.begin(), buffer.begin() + get_filemagic_len());
+
+            wh->write(buffer.data(), buffer.size());
+        }
+
+        creator.closeArchive();
+    }
+
+    ASSERT_GT(parts.size(), 2u);
+
+    for (bool enabled: { false, true })
+    {
+        SCOPED_TRACE(fmt::format("readAhead={}", enabled));
+
+        std::vector<std::string> archiveChanges;
+        ReadAheadOptions readAhead;
+        readAhead.enabled = enabled;
+        readAhead.bufferSize = util::Kilobytes(100);
+        readAhead.bufferCount = 2;
+
+        SplitZipReader reader;
+        reader.setReadAhead(readAhead);
+        reader.setArchiveChangedCallback(
+            [&archiveChanges] (SplitZipReader *, const std::string &archiveName)
+            {
+                archiveChanges.push_back(archiveName);
+            });
+        reader.openArchive(parts[0]);
+        auto rh = reader.openFirstListfileEntry();
+
+        // openArchive() reports the first part, the following parts are
+        // reported once their first data is returned.
+        std::vector<u8> readData(get_filemagic_len());
+        ASSERT_EQ(rh->read(readData.data(), readData.size()), readData.size());
+        ASSERT_EQ(archiveChanges, std::vector<std::string>{ parts[0] });
+
+        // The entry info may be queried while the read-ahead thread switches
+        // parts. Each part has its own entry name.
+        std::atomic<bool> quitPolling(false);
+        std::atomic<size_t> badEntryInfos(0);
+
+        std::thread poller([&]
+        {
+            while (!quitPolling)
+            {
+                auto entryInfo = reader.entryInfo();
+                auto entryNames = reader.entryNameList();
+
+                if (!entryInfo.isOpen || entryInfo.name.empty()
+                    || reader.currentEntryName().empty() || entryNames.empty())
+                {
+                    ++badEntryInfos;
+                }
+            }
+        });
+
+        std::vector<u8> readBuffer(util::Kilobytes(32));
+
+        while (size_t bytesRead = rh->read(readBuffer.data(), readBuffer.size()))
+            readData.insert(readData.end(), readBuffer.begin(), readBuffer.begin() + bytesRead);
+
+        quitPolling = true;
+        poller.join();
+        ASSERT_EQ(badEntryInfos, 0u);
+
+        // The magic bytes at the start of the following parts are skipped.
+        ASSERT_EQ(readData, listfile.data);
+        ASSERT_EQ(archiveChanges, parts);
+
+        // Seeking goes back to the first part.
+        archiveChanges.clear();
+        std::vector<u8> expected(listfile.data.begin() + 1000, listfile.data.begin() + 2000);
+        ASSERT_EQ(read_at(*rh, 1000, 1000), expected);
+        ASSERT_EQ(archiveChanges, std::vector<std::string>{ parts[0] });
+
+        reader.closeArchive();
+    }
+
+    for (const auto &part: parts)
+        ASSERT_TRUE(util::delete_file(part));
+}
+
 #if 0
 TEST(mvlc_listfile_zip, MinizipCreate)
 {
@@ -1,6 +1,3 @@
-#include <chrono>
-#include <thread>
-#include <zmq.hpp>
 #include "mesytec-mvlc/mvlc_listfile_zmq_ganil.h"
 #include "mesytec-mvlc/util/logging.h"
 
@@ -11,43 +8,38 @@ namespace mvlc
 namespace listfile
 {
 
+namespace
+{
+
+ZmqPublisherOptions make_options(const std::string &zmqBindUrl, const std::chrono::milliseconds &sendTimeout)
+{
+    ZmqPublisherOptions options;
+    options.bindUrl = zmqBindUrl;
+    options.sendTimeout = sendTimeout;
+    return options;
+}
+
+} // end anon namespace
+
 struct ZmqGanilWriteHandle::Private
 {
     std::shared_ptr<spdlog::logger> logger;
-    zmq::context_t ctx;
-    zmq::socket_t pub;
+    ZmqBufferPublisher publisher;
 
-    Private()
+    explicit Private(const ZmqPublisherOptions &options)
         : logger(get_logger("mvlc_listfile_zmq_ganil"))
-        , ctx()
-        , pub(ctx, ZMQ_PUB)
+        , publisher(options)
     {}
 };
 
-ZmqGanilWriteHandle::ZmqGanilWriteHandle(const std::string &zmqBindUrl)
-    : d(std::make_unique<Private>())
+ZmqGanilWriteHandle::ZmqGanilWriteHandle(const std::string &zmqBindUrl, const std::chrono::milliseconds &sendTimeout)
+    : ZmqGanilWriteHandle(make_options(zmqBindUrl, sendTimeout))
 {
-    // linger equal to 0 for a fast socket shutdown
-    int linger = 0;
-#if CPPZMQ_VERSION > ZMQ_MAKE_VERSION(4, 7, 0)
-    d->pub.set(zmq::sockopt::linger, linger);
-#else
-    d->pub.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-#endif
+}
 
-    try
-    {
-        d->pub.bind(zmqBindUrl.c_str());
-        d->logger->info("zmq server listening on {}", zmqBindUrl);
-        // Hack to give clients time to connect. TODO: implement a real solution
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    }
-    catch (const zmq::error_t &e)
-    {
-        d->logger->error("Error binding zmq socket to {}: {}", zmqBindUrl, e.what());
-        throw std::runtime_error(
-            fmt::format("Error binding zmq socket to {}: {}", zmqBindUrl, e.what()));
-    }
+ZmqGanilWriteHandle::ZmqGanilWriteHandle(const ZmqPublisherOptions &options)
+    : d(std::make_unique<Private>(options))
+{
 }
 
 ZmqGanilWriteHandle::~ZmqGanilWriteHandle()
@@ -57,23 +49,23 @@ ZmqGanilWriteHandle::~ZmqGanilWriteHandle()
 
 size_t ZmqGanilWriteHandle::write(const u8 *data, size_t size)
 {
-    try
-    {
-        d->logger->trace("Publishing message of size {}", size);
-        // TODO: fix the depcrecation warning
-#if CPPZMQ_VERSION >= ZMQ_MAKE_VERSION(4, 3, 1)
-        if (auto sendResult = d->pub.send(zmq::const_buffer{ data, size }))
-            return sendResult.value();
-        return {};
-#else
-        return d->pub.send(data, size);
-#endif
-    }
-    catch (const zmq::error_t &e)
-    {
-        throw std::runtime_error(
-            fmt::format("Failed publishing listfile data on zmq socket: {}", e.what()));
-    }
+    d->logger->trace("Publishing message of size {}", size);
+
+    if (d->publisher.publishCopy(data, size))
+        return size;
+
+    d->logger->warn("Publishing a message of size {} failed or timed out, data was discarded", size);
+    return 0;
+}
+
+size_t ZmqGanilWriteHandle::waitForSubscribers(size_t minSubscribers, const std::chrono::milliseconds &timeout)
+{
+    return d->publisher.waitForSubscribers(minSubscribers, timeout);
+}
+
+ZmqBufferPublisher &ZmqGanilWriteHandle::publisher()
+{
+    return d->publisher;
 }
 
 } // end namespace listfile
@@ -1,9 +1,11 @@
 #ifndef __MESYTEC_MVLC_LISTFILE_ZMQ_H__
 #define __MESYTEC_MVLC_LISTFILE_ZMQ_H__
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include "mesytec-mvlc/mvlc_listfile.h"
+#include "mesytec-mvlc/mvlc_zmq_publisher.h"
 
 namespace mesytec
 {
@@ -12,13 +14,32 @@ namespace mvlc
 namespace listfile
 {
 
+// Publishes the written listfile data via ZmqBufferPublisher. The data is
+// copied into the ZMQ messages as the written memory is not owned by the
+// handle.
+//
+// write() blocks if a subscriber reaches the send high water mark. After
+// sendTimeout the data is discarded, counted in the sendTimeouts counter of
+// the publisher and write() returns 0. This way a stalled subscriber cannot
+// block the readout forever. Pass a negative timeout to wait forever.
 class MESYTEC_MVLC_EXPORT ZmqGanilWriteHandle: public WriteHandle
 {
     public:
-        ZmqGanilWriteHandle(const std::string &zmqBindUrl = "tcp://*:5575");
+        static constexpr std::chrono::milliseconds DefaultSendTimeout = std::chrono::milliseconds(1000);
+
+        ZmqGanilWriteHandle(const std::string &zmqBindUrl = "tcp://*:5575",
+                            const std::chrono::milliseconds &sendTimeout = DefaultSendTimeout);
+
+        // Uses the options as given, including ZmqPublisherOptions::sendTimeout.
+        explicit ZmqGanilWriteHandle(const ZmqPublisherOptions &options);
         ~ZmqGanilWriteHandle() override;
         size_t write(const u8 *data, size_t size) override;
 
+        // See ZmqBufferPublisher::waitForSubscribers().
+        size_t waitForSubscribers(size_t minSubscribers, const std::chrono::milliseconds &timeout);
+
+        ZmqBufferPublisher &publisher();
+
     private:
         struct Private;
         std::unique_ptr<Private> d;
@@ -1,5 +1,4 @@
 #include <chrono>
-#include <thread>
 #include <zmq.hpp>
 #include "gtest/gtest.h"
 #include "mvlc_listfile_zmq_ganil.h"
@@ -27,9 +26,9 @@ TEST(mvlc_listfile_zmq_ganil, TestListfileZmqGanil)
 
     EXPECT_NO_THROW(sub.connect("tcp://localhost:5575"));
 
-    // Hack to give zmq time to connect. Removing this entirely makes the
-    // receive tests below fail.
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    // Wait for the subscription to arrive at the publisher. Data published
+    // before that would be lost.
+    ASSERT_EQ(pub.waitForSubscribers(1, std::chrono::seconds(5)), 1u);
 
     // Publish N messages of increasing size.
     for (int i=1; i<=100; ++i)
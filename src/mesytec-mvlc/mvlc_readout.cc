@@ -170,7 +170,13 @@ namespace
             switch (lfParams.compression)
             {
                 case ListfileParams::Compression::LZ4:
-                    return lfZip.createLZ4Entry(lfParams.listfilename + ".mvlclst", lfParams.compressionLevel);
+                {
+                    listfile::LZ4EntryOptions options;
+                    options.compressLevel = lfParams.compressionLevel;
+                    options.indexInterval = lfParams.lz4IndexInterval;
+                    options.compressionThreads = lfParams.compressionThreads;
+                    return lfZip.createLZ4Entry(lfParams.listfilename + ".mvlclst", options);
+                }
 
                 case ListfileParams::Compression::ZIP:
                     return lfZip.createZIPEntry(lfParams.listfilename + ".mvlclst", lfParams.compressionLevel);
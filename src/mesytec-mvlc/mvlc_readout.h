@@ -33,6 +33,12 @@ struct MESYTEC_MVLC_EXPORT ListfileParams
     Compression compression = Compression::LZ4;
     // compression level, the higher the better compression but also the slower
     int compressionLevel = 0;
+    // spacing of the random access index seek points for LZ4 listfiles. 0
+    // disables the index.
+    size_t lz4IndexInterval = 0;
+    // number of threads compressing LZ4 listfiles in parallel. 0 compresses
+    // in the listfile writer thread.
+    unsigned compressionThreads = 0;
 };
 
 class MESYTEC_MVLC_EXPORT MVLCReadout
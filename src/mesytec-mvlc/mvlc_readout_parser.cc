@@ -32,6 +32,7 @@
 
 #include "mvlc_buffer_validators.h"
 #include "mvlc_constants.h"
+#include "mvlc_frame_scan.h"
 #include "mvlc_impl_eth.h"
 #include "util/io_util.h"
 #include "util/logging.h"
@@ -68,6 +69,14 @@ namespace
 {
     using StackCT = StackCommand::CommandType;
 
+    // The parser functions are called per buffer, packet or event. Avoid the
+    // logger registry lookup on each call.
+    const std::shared_ptr<spdlog::logger> &parser_logger()
+    {
+        static CachedLogger logger("readout_parser");
+        return logger.get();
+    }
+
     ModuleReadoutStructure parse_module_readout_commands(const std::vector<StackCommand> &commands)
     {
         enum State { Prefix, Dynamic, Suffix };
@@ -165,7 +174,7 @@ namespace
             }
             else
             {
-                auto logger = get_logger("readout_parser");
+                auto &logger = parser_logger();
                 logger->debug("parse_module_readout_commands: ignoring unhandled readout command {}",
                               to_string(cmd));
             }
@@ -197,6 +206,33 @@ ReadoutParserState::ReadoutStructure build_readout_structure(
     return result;
 }
 
+void resize_counters(
+    ReadoutParserCounters &counters,
+    const ReadoutParserState::ReadoutStructure &readoutStructure)
+{
+    const size_t eventCount = readoutStructure.size();
+
+    if (counters.eventHits.size() < eventCount)
+        counters.eventHits.resize(eventCount);
+
+    if (counters.groupHits.size() < eventCount)
+        counters.groupHits.resize(eventCount);
+
+    if (counters.groupSizes.size() < eventCount)
+        counters.groupSizes.resize(eventCount);
+
+    for (size_t ei=0; ei<eventCount; ++ei)
+    {
+        const size_t moduleCount = readoutStructure[ei].size();
+
+        if (counters.groupHits[ei].size() < moduleCount)
+            counters.groupHits[ei].resize(moduleCount);
+
+        if (counters.groupSizes[ei].size() < moduleCount)
+            counters.groupSizes[ei].resize(moduleCount);
+    }
+}
+
 const char *get_parse_result_name(const ParseResult &pr)
 {
     switch (pr)
@@ -265,14 +301,6 @@ const char *get_parse_result_name(const ParseResult &pr)
 namespace
 {
 
-class end_of_buffer: public std::runtime_error
-{
-    public:
-        explicit end_of_buffer(const char *arg): std::runtime_error(arg) {}
-        explicit end_of_buffer(const std::string &s): std::runtime_error(s) {}
-        end_of_buffer(): std::runtime_error("end_of_buffer") {}
-};
-
 using WorkBuffer = ReadoutParserState::WorkBuffer;
 
 inline void ensure_free_space(WorkBuffer &workBuffer, size_t freeWords)
@@ -281,25 +309,87 @@ inline void ensure_free_space(WorkBuffer &workBuffer, size_t freeWords)
         workBuffer.buffer.resize(workBuffer.buffer.size() + freeWords);
 }
 
-inline void copy_to_workbuffer(
+inline u32 module_data_size(const ModuleReadoutSpans &spans)
+{
+    return spans.prefixSpan.size + spans.dynamicSpan.size + spans.suffixSpan.size;
+}
+
+// Offset of the first module data word in the workBuffer.
+inline u32 module_data_offset(const ModuleReadoutSpans &spans)
+{
+    if (spans.prefixSpan.size)
+        return spans.prefixSpan.offset;
+    else if (spans.dynamicSpan.size)
+        return spans.dynamicSpan.offset;
+    else if (spans.suffixSpan.size)
+        return spans.suffixSpan.offset;
+    return 0;
+}
+
+// Zero copy mode: copies the module data referenced in the input buffer into
+// the space reserved for it in the workBuffer.
+inline void materialize_module_data(ReadoutParserState &state, size_t moduleIndex)
+{
+    auto &directData = state.directModuleData[moduleIndex];
+
+    if (!directData)
+        return;
+
+    const auto &spans = state.readoutDataSpans[moduleIndex];
+
+    std::copy(directData, directData + module_data_size(spans),
+              state.workBuffer.buffer.data() + module_data_offset(spans));
+
+    directData = nullptr;
+}
+
+// Copies wordsToCopy words of data belonging to the current module from the
+// source into the workBuffer.
+//
+// In zero copy mode the words are not actually copied as long as all the
+// module words seen so far are contiguous in the input. Space in the
+// workBuffer is reserved anyway so that the data can be materialized later
+// if the module turns out to be fragmented.
+//
+// Returns false if the source does not contain enough words.
+inline bool copy_to_workbuffer(
     ReadoutParserState &state, basic_string_view<u32> &source, size_t wordsToCopy)
 {
     assert(source.size() >= wordsToCopy);
 
     if (source.size() < wordsToCopy)
-        throw end_of_buffer();
+        return false;
 
     auto &dest = state.workBuffer;
 
     ensure_free_space(dest, wordsToCopy);
 
-    std::copy(
-        std::begin(source), std::begin(source) + wordsToCopy,
-        dest.buffer.data() + dest.used);
+    bool doCopy = true;
+
+    if (state.zeroCopy)
+    {
+        auto &directData = state.directModuleData[state.moduleIndex];
+        u32 moduleWords = module_data_size(state.readoutDataSpans[state.moduleIndex]);
+
+        if (moduleWords == 0)
+            directData = source.data();
+        else if (directData && directData + moduleWords != source.data())
+            materialize_module_data(state, state.moduleIndex);
+
+        doCopy = !directData;
+    }
+
+    if (doCopy)
+    {
+        std::copy(
+            std::begin(source), std::begin(source) + wordsToCopy,
+            dest.buffer.data() + dest.used);
+    }
 
     source.remove_prefix(wordsToCopy);
     state.workBuffer.used += wordsToCopy;
     state.curStackFrame.wordsLeft -= wordsToCopy;
+    return true;
 }
 
 } // end anon namespace
@@ -322,6 +412,7 @@ ReadoutParserState make_readout_parser(
 
     result.readoutDataSpans.resize(maxGroupCount);
     result.moduleDataBuffer.resize(maxGroupCount);
+    result.directModuleData.resize(maxGroupCount);
 
     ensure_free_space(result.workBuffer, InitialWorkerBufferSize);
 
@@ -335,6 +426,25 @@ inline void clear_readout_data_spans(std::vector<ModuleReadoutSpans> &spans)
     std::fill(spans.begin(), spans.end(), ModuleReadoutSpans{});
 }
 
+// Zero copy mode: the data of an event that is still in progress must not
+// reference the current input buffer as the buffer will be gone when parsing
+// continues with the next one. Called when leaving the buffer level parse
+// functions.
+inline void materialize_event_data(ReadoutParserState &state)
+{
+    if (!state.zeroCopy || state.eventIndex < 0)
+        return;
+
+    for (size_t mi=0; mi<state.directModuleData.size(); ++mi)
+        materialize_module_data(state, mi);
+}
+
+struct MaterializeEventDataGuard
+{
+    ReadoutParserState &state;
+    ~MaterializeEventDataGuard() { materialize_event_data(state); }
+};
+
 inline bool is_event_in_progress(const ReadoutParserState &state)
 {
     return state.eventIndex >= 0;
@@ -358,7 +468,7 @@ inline ParseResult parser_begin_event(ReadoutParserState &state, u32 frameHeader
 
     if (frameInfo.type != frame_headers::StackFrame)
     {
-        auto logger = get_logger("readout_parser");
+        auto &logger = parser_logger();
         logger->warn("NotAStackFrame: 0x{:008x}", frameHeader);
         return ParseResult::NotAStackFrame;
     }
@@ -367,13 +477,14 @@ inline ParseResult parser_begin_event(ReadoutParserState &state, u32 frameHeader
 
     if (eventIndex < 0 || static_cast<unsigned>(eventIndex) >= state.readoutStructure.size())
     {
-        auto logger = get_logger("readout_parser");
+        auto &logger = parser_logger();
         logger->warn("parser_begin_event: StackIndexOutOfRange ({})", eventIndex);
         return ParseResult::StackIndexOutOfRange;
     }
 
     state.workBuffer.used = 0;
     clear_readout_data_spans(state.readoutDataSpans);
+    std::fill(state.directModuleData.begin(), state.directModuleData.end(), nullptr);
 
     state.eventIndex = eventIndex;
     state.moduleIndex = 0;
@@ -386,18 +497,22 @@ inline ParseResult parser_begin_event(ReadoutParserState &state, u32 frameHeader
 }
 
 // Checks if the input iterator points to a system frame header. If true the
-// systemEvent callback is invoked with the frame header + frame data and true
-// is returned. Also the iterator will be placed on the next word after the
-// system frame.
-// Otherwise the iterator is left unmodified and false is returned.
+// systemEvent callback is invoked with the frame header + frame data and
+// 'handled' is set to true. Also the iterator will be placed on the next word
+// after the system frame.
+// Otherwise the iterator is left unmodified and 'handled' is set to false.
 //
-// Throws end_of_buffer() if the system frame exceeds the input buffer size.
-inline bool try_handle_system_event(
+// Returns UnexpectedEndOfBuffer if the system frame exceeds the input buffer
+// size, Ok otherwise.
+inline ParseResult try_handle_system_event(
     ReadoutParserState &state,
     ReadoutParserCallbacks &callbacks,
     ReadoutParserCounters &counters,
-    basic_string_view<u32> &input)
+    basic_string_view<u32> &input,
+    bool &handled)
 {
+    handled = false;
+
     if (!input.empty())
     {
         u32 frameHeader = input[0];
@@ -408,9 +523,12 @@ inline bool try_handle_system_event(
 
             // It should be guaranteed that the whole frame fits into the buffer.
             if (input.size() <= frameInfo.len)
-                throw end_of_buffer(fmt::format(
-                    "SystemEvent frame (0x{:08x}) size ({}) exceeds input buffer size ({}).",
-                        frameHeader, frameInfo.len, input.size()));
+            {
+                auto &logger = parser_logger();
+                logger->debug("SystemEvent frame (0x{:08x}) size ({}) exceeds input buffer size ({}).",
+                              frameHeader, frameInfo.len, input.size());
+                return ParseResult::UnexpectedEndOfBuffer;
+            }
 
             u8 subtype = system_event::extract_subtype(frameHeader);
             ++counters.systemEvents[subtype];
@@ -423,11 +541,11 @@ inline bool try_handle_system_event(
                 input.data(), frameInfo.len + 1);
 
             input.remove_prefix(frameInfo.len + 1);
-            return true;
+            handled = true;
         }
     }
 
-    return false;
+    return ParseResult::Ok;
 }
 
 // Search forward until a header with the wanted frame type is found.
@@ -441,44 +559,22 @@ inline bool try_handle_system_event(
 inline const u32 *find_stack_frame_header(
     basic_string_view<u32> &input, u8 wantedFrameType)
 {
-    auto is_accepted_frame_type = [] (u8 frameType) -> bool
-    {
-        return (frameType == frame_headers::StackFrame
-                || frameType == frame_headers::StackContinuation);
-    };
-
-#if 0
-    if (!input.empty())
-    {
-        assert(is_accepted_frame_type(extract_frame_info(input[0]).type));
-    }
-#endif
-
-    while (!input.empty())
-    {
-        auto frameInfo = extract_frame_info(input[0]);
+    // If the frame does not fit into the current input sequence we cannot
+    // skip past it. As an example this can happen when parsing a lossfull
+    // sequence of eth packets and trying to find the next StackFrame to
+    // continue parsing. This case is counted as NoStackFrameFound on the
+    // outside.
+    static const auto acceptedFrameTypes = frame_scan::make_frame_type_mask(
+        { frame_headers::StackFrame, frame_headers::StackContinuation });
 
-        if (frameInfo.type == wantedFrameType)
-            return input.data();
+    auto follow = frame_scan::follow_frames(
+        input.data(), input.data() + input.size(),
+        acceptedFrameTypes, frame_scan::make_frame_type_mask({ wantedFrameType }));
 
-        if (!is_accepted_frame_type(frameInfo.type))
-            return nullptr;
+    input.remove_prefix(follow.pos - input.data());
 
-        if (input.size() <= frameInfo.len)
-        {
-            // The frame does not fit into the current input sequence so we
-            // cannot skip past it. As an example this can happen when parsing
-            // a lossfull sequence of eth packets and trying to find the next
-            // StackFrame to continue parsing.
-            // Old handling was to throw and count the exception on the outside.
-            // New handling is to return nullptr and count the result as
-            // NoStackFrameFound.
-            //throw end_of_buffer("find_stack_frame_header: buffer size exceeded");
-            return nullptr;
-        }
-
-        input.remove_prefix(frameInfo.len + 1);
-    }
+    if (follow.result == frame_scan::FollowResult::StopType)
+        return input.data();
 
     return nullptr;
 }
@@ -501,450 +597,465 @@ ParseResult parse_readout_contents(
     bool is_eth,
     u32 bufferNumber)
 {
-    auto logger = get_logger("readout_parser");
+    auto &logger = parser_logger();
 
     auto originalInputView = input;
 
-    try
+    // Ordinary, expected condition when parsing lossfull data. Signalled via
+    // the return value instead of an exception to keep this path cheap.
+    auto end_of_buffer = [&] (const char *where)
     {
-        const u32 *inputBegin = input.data();
+        logger->debug("unexpected end of buffer: {}", where);
+        log_buffer(logger, spdlog::level::trace, originalInputView, "originalInputView");
+        return ParseResult::UnexpectedEndOfBuffer;
+    };
 
-        while (!input.empty())
-        {
-            const u32 *lastIterPosition = input.data();
+    const u32 *inputBegin = input.data();
+
+    while (!input.empty())
+    {
+        const u32 *lastIterPosition = input.data();
 
-            // Find a stack frame matching the current parser state. Return if no
-            // matching frame is detected at the current iterator position.
-            if (!state.curStackFrame)
+        // Find a stack frame matching the current parser state. Return if no
+        // matching frame is detected at the current iterator position.
+        if (!state.curStackFrame)
+        {
+            // If there's no open stack frame there should be no open block
+            // frame either. Also data from any open blocks must've been
+            // consumed previously or the block frame should have been manually
+            // invalidated.
+            assert(!state.curBlockFrame);
+            if (state.curBlockFrame)
+                return ParseResult::UnexpectedOpenBlockFrame;
+
+            // USB buffers from replays can contain system frames alongside
+            // readout generated frames. For ETH buffers the system frames are
+            // handled further up in parse_readout_buffer() and may not be
+            // handled here because the packets payload can start with
+            // continuation data from the last frame right away which could
+            // match the signature of a system frame (0xFA) whereas data from
+            // USB buffers always starts on a frame header.
+            if (!is_eth)
             {
-                // If there's no open stack frame there should be no open block
-                // frame either. Also data from any open blocks must've been
-                // consumed previously or the block frame should have been manually
-                // invalidated.
-                assert(!state.curBlockFrame);
-                if (state.curBlockFrame)
-                    return ParseResult::UnexpectedOpenBlockFrame;
-
-                // USB buffers from replays can contain system frames alongside
-                // readout generated frames. For ETH buffers the system frames are
-                // handled further up in parse_readout_buffer() and may not be
-                // handled here because the packets payload can start with
-                // continuation data from the last frame right away which could
-                // match the signature of a system frame (0xFA) whereas data from
-                // USB buffers always starts on a frame header.
-                if (!is_eth && try_handle_system_event(state, callbacks, counters, input))
+                bool handled = false;
+
+                if (try_handle_system_event(state, callbacks, counters, input, handled) != ParseResult::Ok)
+                    return end_of_buffer("system event frame");
+
+                if (handled)
                     continue;
+            }
 
-                if (is_event_in_progress(state))
-                {
-                    // Leave the frame header in the buffer for now. In case of an
-                    // 'early error return' the caller can modify the state and
-                    // retry parsing from the same position.
+            if (is_event_in_progress(state))
+            {
+                // Leave the frame header in the buffer for now. In case of an
+                // 'early error return' the caller can modify the state and
+                // retry parsing from the same position.
 
-                    if (input.empty())
-                        throw end_of_buffer("next stack frame header in event");
+                if (input.empty())
+                    return end_of_buffer("next stack frame header in event");
 
-                    auto frameInfo = extract_frame_info(input[0]);
+                auto frameInfo = extract_frame_info(input[0]);
 
-                    if (frameInfo.type != frame_headers::StackContinuation)
-                    {
-                        logger->trace("NotAStackContinuation:"
-                                 " curStackFrame.wordsLeft={}"
-                                 " , curBlockFrame.wordsLeft={}"
-                                 ", eventIndex={}, moduleIndex={}"
-                                 ", inputOffset={}",
-                                 state.curStackFrame.wordsLeft,
-                                 state.curBlockFrame.wordsLeft,
-                                 state.eventIndex,
-                                 state.moduleIndex,
-                                 input.data() - inputBegin
-                                 );
-                        return ParseResult::NotAStackContinuation;
-                    }
+                if (frameInfo.type != frame_headers::StackContinuation)
+                {
+                    logger->trace("NotAStackContinuation:"
+                             " curStackFrame.wordsLeft={}"
+                             " , curBlockFrame.wordsLeft={}"
+                             ", eventIndex={}, moduleIndex={}"
+                             ", inputOffset={}",
+                             state.curStackFrame.wordsLeft,
+                             state.curBlockFrame.wordsLeft,
+                             state.eventIndex,
+                             state.moduleIndex,
+                             input.data() - inputBegin
+                             );
+                    return ParseResult::NotAStackContinuation;
+                }
 
-                    if (frameInfo.stack - 1 != state.eventIndex)
-                        return ParseResult::StackIndexChanged;
+                if (frameInfo.stack - 1 != state.eventIndex)
+                    return ParseResult::StackIndexChanged;
 
-                    // The stack frame is ok and can now be extracted from the
-                    // buffer.
-                    state.curStackFrame = ReadoutParserState::FrameParseState{ input[0] };
-                    logger->trace("new curStackFrame: 0x{:008x}", state.curStackFrame.header);
-                    input.remove_prefix(1);
+                // The stack frame is ok and can now be extracted from the
+                // buffer.
+                state.curStackFrame = ReadoutParserState::FrameParseState{ input[0] };
+                logger->trace("new curStackFrame: 0x{:008x}", state.curStackFrame.header);
+                input.remove_prefix(1);
 
-                    if (state.curStackFrame.wordsLeft == 0)
-                    {
-                        // This is the case with a StackContinuation header of
-                        // length 0 (e.g. 0xF9010000 for stack 1).
-                        // This implicitly ends the current block frame if any.
-                        // This means that although the current block frame has
-                        // the continue bit set there's no follow up frame
-                        // present.
-                        // The code below (switch-case over the group/module
-                        // parts) checks the current block frame for the
-                        // continue bit and tries to read the next part if it
-                        // is set. To avoid this the block frame is cleared
-                        // here.
-                        //cout << "Hello empty stackFrame!" << endl;
-                        logger->warn("got an empty stack frame: 0x{:008x}",
-                                 state.curStackFrame.header);
-                        ++counters.emptyStackFrames;
-                        state.curBlockFrame = ReadoutParserState::FrameParseState{};
-                    }
-                }
-                else
+                if (state.curStackFrame.wordsLeft == 0)
                 {
-                    // No event is in progress either because the last one was
-                    // parsed completely or because of internal buffer loss during
-                    // a DAQ run or because of external network packet loss.
-                    // We now need to find the next StackFrame header starting from
-                    // the current iterator position and hand that to
-                    // parser_begin_event().
-                    const u32 *prevIterPtr = input.data();
+                    // This is the case with a StackContinuation header of
+                    // length 0 (e.g. 0xF9010000 for stack 1).
+                    // This implicitly ends the current block frame if any.
+                    // This means that although the current block frame has
+                    // the continue bit set there's no follow up frame
+                    // present.
+                    // The code below (switch-case over the group/module
+                    // parts) checks the current block frame for the
+                    // continue bit and tries to read the next part if it
+                    // is set. To avoid this the block frame is cleared
+                    // here.
+                    //cout << "Hello empty stackFrame!" << endl;
+                    logger->warn("got an empty stack frame: 0x{:008x}",
+                             state.curStackFrame.header);
+                    ++counters.emptyStackFrames;
+                    state.curBlockFrame = ReadoutParserState::FrameParseState{};
+                }
+            }
+            else
+            {
+                // No event is in progress either because the last one was
+                // parsed completely or because of internal buffer loss during
+                // a DAQ run or because of external network packet loss.
+                // We now need to find the next StackFrame header starting from
+                // the current iterator position and hand that to
+                // parser_begin_event().
+                const u32 *prevIterPtr = input.data();
 
-                    const u32 *nextStackFrame = find_stack_frame_header(
-                        input, frame_headers::StackFrame);
+                const u32 *nextStackFrame = find_stack_frame_header(
+                    input, frame_headers::StackFrame);
 
-                    if (!nextStackFrame)
-                        return ParseResult::NoStackFrameFound;
+                if (!nextStackFrame)
+                    return ParseResult::NoStackFrameFound;
 
-                    assert(input.data() == nextStackFrame);
+                assert(input.data() == nextStackFrame);
 
-                    auto stackFrameOffset = nextStackFrame - prevIterPtr;
-                    logger->trace("found next StackFrame: @{} 0x{:008x} (searchOffset={})",
-                              reinterpret_cast<const void *>(nextStackFrame),
-                              *nextStackFrame, stackFrameOffset);
+                auto stackFrameOffset = nextStackFrame - prevIterPtr;
+                logger->trace("found next StackFrame: @{} 0x{:008x} (searchOffset={})",
+                          reinterpret_cast<const void *>(nextStackFrame),
+                          *nextStackFrame, stackFrameOffset);
 
-                    auto unusedWords = nextStackFrame - prevIterPtr;
+                auto unusedWords = nextStackFrame - prevIterPtr;
 
-                    counters.unusedBytes += unusedWords * sizeof(u32);
+                counters.unusedBytes += unusedWords * sizeof(u32);
 
-                    if (unusedWords)
-                        logger->debug("skipped over {} words while searching for the next"
-                                  " stack frame header", unusedWords);
+                if (unusedWords)
+                    logger->debug("skipped over {} words while searching for the next"
+                              " stack frame header", unusedWords);
 
-                    if (input.empty())
-                        throw end_of_buffer("stack frame header of new event");
+                if (input.empty())
+                    return end_of_buffer("stack frame header of new event");
 
-                    auto pr = parser_begin_event(state, *nextStackFrame);
+                auto pr = parser_begin_event(state, *nextStackFrame);
 
-                    if (pr != ParseResult::Ok)
-                    {
-                        logger->warn("error from parser_begin_event, iter offset={}, bufferNumber={}: {}",
-                                 nextStackFrame - inputBegin,
-                                 bufferNumber,
-                                 get_parse_result_name(pr)
-                                 );
-                        return pr;
-                    }
+                if (pr != ParseResult::Ok)
+                {
+                    logger->warn("error from parser_begin_event, iter offset={}, bufferNumber={}: {}",
+                             nextStackFrame - inputBegin,
+                             bufferNumber,
+                             get_parse_result_name(pr)
+                             );
+                    return pr;
+                }
 
-                    input.remove_prefix(1); // eat the StackFrame marking the beginning of the event
+                input.remove_prefix(1); // eat the StackFrame marking the beginning of the event
 
-                    assert(is_event_in_progress(state));
-                }
+                assert(is_event_in_progress(state));
             }
+        }
 
-            assert(is_event_in_progress(state));
-            assert(0 <= state.eventIndex
-                   && static_cast<size_t>(state.eventIndex) < state.readoutStructure.size());
+        assert(is_event_in_progress(state));
+        assert(0 <= state.eventIndex
+               && static_cast<size_t>(state.eventIndex) < state.readoutStructure.size());
 
-            const auto &moduleReadoutInfos = state.readoutStructure[state.eventIndex];
-            const auto moduleCount = moduleReadoutInfos.size();
+        const auto &moduleReadoutInfos = state.readoutStructure[state.eventIndex];
+        const auto moduleCount = moduleReadoutInfos.size();
 
-            // Check for the case where a stack frame for an event is produced but
-            // the event does not contain any modules. This can happen for example
-            // when a periodic event is added without any modules.
-            // The frame header for the event should have length 0.
-            if (moduleReadoutInfos.empty())
+        // Check for the case where a stack frame for an event is produced but
+        // the event does not contain any modules. This can happen for example
+        // when a periodic event is added without any modules.
+        // The frame header for the event should have length 0.
+        if (moduleReadoutInfos.empty())
+        {
+            auto fi = extract_frame_info(state.curStackFrame.header);
+            if (fi.len != 0u)
             {
-                auto fi = extract_frame_info(state.curStackFrame.header);
-                if (fi.len != 0u)
-                {
-                    logger->warn("No modules in event {} but got a non-empty "
-                             "stack frame of len {} (header=0x{:008x})",
-                             state.eventIndex, fi.len, state.curStackFrame.header);
-                    parser_clear_event_state(state);
-                    return ParseResult::UnexpectedNonEmptyStackFrame;
-                }
-
-                logger->trace("parser_clear_event_state because moduleReadoutInfos.empty(), eventIndex={}",
-                          state.eventIndex);
+                logger->warn("No modules in event {} but got a non-empty "
+                         "stack frame of len {} (header=0x{:008x})",
+                         state.eventIndex, fi.len, state.curStackFrame.header);
                 parser_clear_event_state(state);
-                return ParseResult::Ok;
+                return ParseResult::UnexpectedNonEmptyStackFrame;
             }
 
-            if (static_cast<size_t>(state.moduleIndex) >= moduleCount)
-                return ParseResult::GroupIndexOutOfRange;
+            logger->trace("parser_clear_event_state because moduleReadoutInfos.empty(), eventIndex={}",
+                      state.eventIndex);
+            parser_clear_event_state(state);
+            return ParseResult::Ok;
+        }
+
+        if (static_cast<size_t>(state.moduleIndex) >= moduleCount)
+            return ParseResult::GroupIndexOutOfRange;
+
 
+        const auto &moduleParts = moduleReadoutInfos[state.moduleIndex];
 
-            const auto &moduleParts = moduleReadoutInfos[state.moduleIndex];
+        if (is_empty(moduleParts))
+        {
+            // Skip over groups/modules which have no data producing
+            // readout commands.
+            ++state.moduleIndex;
+        }
+        else
+        {
+            assert(!is_empty(moduleReadoutInfos[state.moduleIndex]));
 
-            if (is_empty(moduleParts))
+#if 0
+            if (state.groupParseState == ReadoutParserState::Initial)
             {
-                // Skip over groups/modules which have no data producing
-                // readout commands.
-                ++state.moduleIndex;
+                if (!is_dynamic(moduleReadoutInfos[state.moduleIndex]))
+                    state.groupParseState = ReadoutParserState::Fixed;
+                else
+                    state.groupParseState = ReadoutParserState::Dynamic;
             }
-            else
+#endif
+
+            auto &moduleSpans = state.readoutDataSpans[state.moduleIndex];
+
+            if (state.groupParseState == ReadoutParserState::Prefix)
             {
-                assert(!is_empty(moduleReadoutInfos[state.moduleIndex]));
+                //assert(!is_dynamic(moduleReadoutInfos[state.moduleIndex]));
+                //assert(moduleParts.len >= 0);
 
-#if 0
-                if (state.groupParseState == ReadoutParserState::Initial)
+                if (moduleSpans.prefixSpan.size < static_cast<u32>(moduleParts.prefixLen))
                 {
-                    if (!is_dynamic(moduleReadoutInfos[state.moduleIndex]))
-                        state.groupParseState = ReadoutParserState::Fixed;
-                    else
-                        state.groupParseState = ReadoutParserState::Dynamic;
+                    // record the offset of the first word of this span
+                    if (moduleSpans.prefixSpan.size == 0)
+                        moduleSpans.prefixSpan.offset = state.workBuffer.used;
+
+                    u32 wordsLeftInSpan = moduleParts.prefixLen - moduleSpans.prefixSpan.size;
+                    assert(wordsLeftInSpan);
+                    u32 wordsToCopy = std::min({
+                        wordsLeftInSpan,
+                            static_cast<u32>(state.curStackFrame.wordsLeft),
+                            static_cast<u32>(input.size())});
+
+                    if (!copy_to_workbuffer(state, input, wordsToCopy))
+                        return end_of_buffer("module prefix");
+
+                    moduleSpans.prefixSpan.size += wordsToCopy;
                 }
-#endif
 
-                auto &moduleSpans = state.readoutDataSpans[state.moduleIndex];
+                assert(moduleSpans.prefixSpan.size <= static_cast<u32>(moduleParts.prefixLen));
 
-                if (state.groupParseState == ReadoutParserState::Prefix)
+                if (moduleSpans.prefixSpan.size == static_cast<u32>(moduleParts.prefixLen))
                 {
-                    //assert(!is_dynamic(moduleReadoutInfos[state.moduleIndex]));
-                    //assert(moduleParts.len >= 0);
-
-                    if (moduleSpans.prefixSpan.size < static_cast<u32>(moduleParts.prefixLen))
+                    if (moduleParts.hasDynamic)
                     {
-                        // record the offset of the first word of this span
-                        if (moduleSpans.prefixSpan.size == 0)
-                            moduleSpans.prefixSpan.offset = state.workBuffer.used;
-
-                        u32 wordsLeftInSpan = moduleParts.prefixLen - moduleSpans.prefixSpan.size;
-                        assert(wordsLeftInSpan);
-                        u32 wordsToCopy = std::min({
-                            wordsLeftInSpan,
-                                static_cast<u32>(state.curStackFrame.wordsLeft),
-                                static_cast<u32>(input.size())});
-
-                        copy_to_workbuffer(state, input, wordsToCopy);
-                        moduleSpans.prefixSpan.size += wordsToCopy;
+                        state.groupParseState = ReadoutParserState::Dynamic;
+                        continue;
                     }
-
-                    assert(moduleSpans.prefixSpan.size <= static_cast<u32>(moduleParts.prefixLen));
-
-                    if (moduleSpans.prefixSpan.size == static_cast<u32>(moduleParts.prefixLen))
+                    else if (moduleParts.suffixLen != 0)
                     {
-                        if (moduleParts.hasDynamic)
-                        {
-                            state.groupParseState = ReadoutParserState::Dynamic;
-                            continue;
-                        }
-                        else if (moduleParts.suffixLen != 0)
-                        {
-                            state.groupParseState = ReadoutParserState::Suffix;
-                            continue;
-                        }
-                        else
-                        {
-                            // We're done with this module as it does have neither
-                            // dynamic nor suffix parts.
-                            state.moduleIndex++;
-                            state.groupParseState = ReadoutParserState::Prefix;
-                        }
+                        state.groupParseState = ReadoutParserState::Suffix;
+                        continue;
+                    }
+                    else
+                    {
+                        // We're done with this module as it does have neither
+                        // dynamic nor suffix parts.
+                        state.moduleIndex++;
+                        state.groupParseState = ReadoutParserState::Prefix;
                     }
                 }
-                else if (state.groupParseState == ReadoutParserState::Dynamic)
+            }
+            else if (state.groupParseState == ReadoutParserState::Dynamic)
+            {
+                if (state.curStackFrame.wordsLeft > 0 && !state.curBlockFrame)
                 {
-                    if (state.curStackFrame.wordsLeft > 0 && !state.curBlockFrame)
+                    if (input.empty())
                     {
-                        if (input.empty())
-                        {
-                            // Need more data to read in the next block frame header.
-                            return ParseResult::Ok;
-                        }
+                        // Need more data to read in the next block frame header.
+                        return ParseResult::Ok;
+                    }
 
-                        // Peek the potential block frame header
-                        state.curBlockFrame = ReadoutParserState::FrameParseState{ input[0] };
+                    // Peek the potential block frame header
+                    state.curBlockFrame = ReadoutParserState::FrameParseState{ input[0] };
 
-                        logger->trace("state.curBlockFrame.header=0x{:x}", state.curBlockFrame.header);
+                    logger->trace("state.curBlockFrame.header=0x{:x}", state.curBlockFrame.header);
 
-                        if (state.curBlockFrame.info().type != frame_headers::BlockRead)
-                        {
-                            // Verbose debug output
+                    if (state.curBlockFrame.info().type != frame_headers::BlockRead)
+                    {
+                        // Verbose debug output
 #if 0
-                            s64 currentOffset = input.data() - originalInputView.data();
-                            s64 logStartOffset = std::max(currentOffset - 400, static_cast<s64>(0));
-                            size_t logWordCount = std::min(input.size(), static_cast<size_t>(400u + 100lu));
+                        s64 currentOffset = input.data() - originalInputView.data();
+                        s64 logStartOffset = std::max(currentOffset - 400, static_cast<s64>(0));
+                        size_t logWordCount = std::min(input.size(), static_cast<size_t>(400u + 100lu));
 
-                            basic_string_view<u32> logView(
-                                originalInputView.data() + logStartOffset,
-                                logWordCount);
+                        basic_string_view<u32> logView(
+                            originalInputView.data() + logStartOffset,
+                            logWordCount);
 
-                            util::log_buffer(std::cout, logView, "input around the non block frame header");
+                        util::log_buffer(std::cout, logView, "input around the non block frame header");
 
-                            //util::log_buffer(std::cout, input, "input (the part that's left to parse)");
-                            //cout << "offset=" << (input.data() - originalInputView.data()) << endl;
-                            //std::terminate();
+                        //util::log_buffer(std::cout, input, "input (the part that's left to parse)");
+                        //cout << "offset=" << (input.data() - originalInputView.data()) << endl;
+                        //std::terminate();
 #endif
 
-                            logger->warn("NotABlockFrame: frameType=0x{:x}, frameHeader=0x{:008x}",
-                                      state.curBlockFrame.info().type,
-                                      state.curBlockFrame.header);
-
-                            state.curBlockFrame = ReadoutParserState::FrameParseState{};
-                            parser_clear_event_state(state);
-                            return ParseResult::NotABlockFrame;
-                        }
+                        logger->warn("NotABlockFrame: frameType=0x{:x}, frameHeader=0x{:008x}",
+                                  state.curBlockFrame.info().type,
+                                  state.curBlockFrame.header);
 
-                        // Block frame header is ok, consume it taking care of
-                        // the outer stack frame word count as well.
-                        input.remove_prefix(1);
-                        state.curStackFrame.consumeWord();
+                        state.curBlockFrame = ReadoutParserState::FrameParseState{};
+                        parser_clear_event_state(state);
+                        return ParseResult::NotABlockFrame;
                     }
 
-                    // record the offset of the first word of this span
-                    if (moduleSpans.dynamicSpan.size == 0)
-                        moduleSpans.dynamicSpan.offset = state.workBuffer.used;
+                    // Block frame header is ok, consume it taking care of
+                    // the outer stack frame word count as well.
+                    if (!state.curStackFrame.consumeWord())
+                        return end_of_buffer("block frame header");
 
-                    u32 wordsToCopy = std::min(
-                        static_cast<u32>(state.curBlockFrame.wordsLeft),
-                        static_cast<u32>(input.size()));
+                    input.remove_prefix(1);
+                }
 
-                    copy_to_workbuffer(state, input, wordsToCopy);
-                    moduleSpans.dynamicSpan.size += wordsToCopy;
-                    state.curBlockFrame.wordsLeft -= wordsToCopy;
+                // record the offset of the first word of this span
+                if (moduleSpans.dynamicSpan.size == 0)
+                    moduleSpans.dynamicSpan.offset = state.workBuffer.used;
 
-                    if (state.curBlockFrame.wordsLeft == 0
-                        && !(state.curBlockFrame.info().flags & frame_flags::Continue))
-                    {
-                        if (moduleParts.suffixLen == 0)
-                        {
-                            // No suffix, we're done with the module
-                            state.moduleIndex++;
-                            state.groupParseState = ReadoutParserState::Prefix;
-                        }
-                        else
-                        {
-                            state.groupParseState = ReadoutParserState::Suffix;
-                            continue;
-                        }
-                    }
-                }
-                else if (state.groupParseState == ReadoutParserState::Suffix)
-                {
-                    if (moduleSpans.suffixSpan.size < moduleParts.suffixLen)
-                    {
-                        // record the offset of the first word of this span
-                        if (moduleSpans.suffixSpan.size == 0)
-                            moduleSpans.suffixSpan.offset = state.workBuffer.used;
-
-                        u32 wordsLeftInSpan = moduleParts.suffixLen - moduleSpans.suffixSpan.size;
-                        assert(wordsLeftInSpan);
-                        u32 wordsToCopy = std::min({
-                            wordsLeftInSpan,
-                                static_cast<u32>(state.curStackFrame.wordsLeft),
-                                static_cast<u32>(input.size())});
-
-                        copy_to_workbuffer(state, input, wordsToCopy);
-                        moduleSpans.suffixSpan.size += wordsToCopy;
-                    }
+                u32 wordsToCopy = std::min(
+                    static_cast<u32>(state.curBlockFrame.wordsLeft),
+                    static_cast<u32>(input.size()));
+
+                if (!copy_to_workbuffer(state, input, wordsToCopy))
+                    return end_of_buffer("module dynamic part");
+
+                moduleSpans.dynamicSpan.size += wordsToCopy;
+                state.curBlockFrame.wordsLeft -= wordsToCopy;
 
-                    if (moduleSpans.suffixSpan.size >= moduleParts.suffixLen)
+                if (state.curBlockFrame.wordsLeft == 0
+                    && !(state.curBlockFrame.info().flags & frame_flags::Continue))
+                {
+                    if (moduleParts.suffixLen == 0)
                     {
-                        // Done with the module
+                        // No suffix, we're done with the module
                         state.moduleIndex++;
                         state.groupParseState = ReadoutParserState::Prefix;
                     }
+                    else
+                    {
+                        state.groupParseState = ReadoutParserState::Suffix;
+                        continue;
+                    }
                 }
             }
-
-            // Skip over modules that do not have any readout data.
-            // Note: modules that are disabled in the vme config are handled this way.
-            while (state.moduleIndex < static_cast<int>(moduleCount)
-                   && is_empty(moduleReadoutInfos[state.moduleIndex]))
+            else if (state.groupParseState == ReadoutParserState::Suffix)
             {
-                ++state.moduleIndex;
-            }
+                if (moduleSpans.suffixSpan.size < moduleParts.suffixLen)
+                {
+                    // record the offset of the first word of this span
+                    if (moduleSpans.suffixSpan.size == 0)
+                        moduleSpans.suffixSpan.offset = state.workBuffer.used;
 
-            auto update_part_size_info = [] (ReadoutParserCounters::PartSizeInfo &sizeInfo, size_t size)
-            {
-                sizeInfo.min = std::min(sizeInfo.min, static_cast<size_t>(size));
-                sizeInfo.max = std::max(sizeInfo.max, static_cast<size_t>(size));
-                sizeInfo.sum += size;
-            };
+                    u32 wordsLeftInSpan = moduleParts.suffixLen - moduleSpans.suffixSpan.size;
+                    assert(wordsLeftInSpan);
+                    u32 wordsToCopy = std::min({
+                        wordsLeftInSpan,
+                            static_cast<u32>(state.curStackFrame.wordsLeft),
+                            static_cast<u32>(input.size())});
 
-            if (state.moduleIndex >= static_cast<int>(moduleCount))
-            {
-                assert(!state.curBlockFrame);
+                    if (!copy_to_workbuffer(state, input, wordsToCopy))
+                        return end_of_buffer("module suffix");
 
-                // All modules have been processed and the event can be flushed.
+                    moduleSpans.suffixSpan.size += wordsToCopy;
+                }
 
-                // Transform the offset based ModuleReadoutSpans into pointer
-                // based ModuleData structures, then invoke the eventData()
-                // callback.
-                for (unsigned mi = 0; mi < moduleCount; ++mi)
+                if (moduleSpans.suffixSpan.size >= moduleParts.suffixLen)
                 {
-                    const auto &moduleSpans = state.readoutDataSpans[mi];
-                    auto &moduleData = state.moduleDataBuffer[mi];
+                    // Done with the module
+                    state.moduleIndex++;
+                    state.groupParseState = ReadoutParserState::Prefix;
+                }
+            }
+        }
 
-                    u32 startOffset = 0;
+        // Skip over modules that do not have any readout data.
+        // Note: modules that are disabled in the vme config are handled this way.
+        while (state.moduleIndex < static_cast<int>(moduleCount)
+               && is_empty(moduleReadoutInfos[state.moduleIndex]))
+        {
+            ++state.moduleIndex;
+        }
 
-                    if (moduleSpans.prefixSpan.size)
-                        startOffset = moduleSpans.prefixSpan.offset;
-                    else if (moduleSpans.dynamicSpan.size)
-                        startOffset = moduleSpans.dynamicSpan.offset;
-                    else if (moduleSpans.suffixSpan.size)
-                        startOffset = moduleSpans.suffixSpan.offset;
+        auto update_part_size_info = [] (ReadoutParserCounters::PartSizeInfo &sizeInfo, size_t size)
+        {
+            sizeInfo.min = std::min(sizeInfo.min, static_cast<size_t>(size));
+            sizeInfo.max = std::max(sizeInfo.max, static_cast<size_t>(size));
+            sizeInfo.sum += size;
+        };
 
-                    u32 dataSize = (moduleSpans.prefixSpan.size
-                                    + moduleSpans.dynamicSpan.size
-                                    + moduleSpans.suffixSpan.size);
+        if (state.moduleIndex >= static_cast<int>(moduleCount))
+        {
+            assert(!state.curBlockFrame);
+
+            // All modules have been processed and the event can be flushed.
+
+            // Transform the offset based ModuleReadoutSpans into pointer
+            // based ModuleData structures, then invoke the eventData()
+            // callback.
+            // Sized by resize_counters() at the start of the parse call.
+            assert(static_cast<size_t>(state.eventIndex) < counters.groupHits.size());
+            auto &groupHits = counters.groupHits[state.eventIndex];
+            auto &groupSizes = counters.groupSizes[state.eventIndex];
+            assert(groupHits.size() >= moduleCount && groupSizes.size() >= moduleCount);
 
+            for (unsigned mi = 0; mi < moduleCount; ++mi)
+            {
+                const auto &moduleSpans = state.readoutDataSpans[mi];
+                auto &moduleData = state.moduleDataBuffer[mi];
+                const u32 *directData = state.zeroCopy ? state.directModuleData[mi] : nullptr;
+                u32 dataSize = module_data_size(moduleSpans);
+
+                if (directData)
+                    moduleData.data = { directData, dataSize };
+                else
+                {
                     moduleData.data =
                     {
-                        state.workBuffer.buffer.data() + startOffset,
+                        state.workBuffer.buffer.data() + module_data_offset(moduleSpans),
                         dataSize
                     };
+                }
 
-                    moduleData.prefixSize = moduleSpans.prefixSpan.size;
-                    moduleData.dynamicSize = moduleSpans.dynamicSpan.size;
-                    moduleData.suffixSize = moduleSpans.suffixSpan.size;
-                    assert(mi < moduleReadoutInfos.size());
-                    moduleData.hasDynamic = moduleReadoutInfos[mi].hasDynamic;
+                moduleData.prefixSize = moduleSpans.prefixSpan.size;
+                moduleData.dynamicSize = moduleSpans.dynamicSpan.size;
+                moduleData.suffixSize = moduleSpans.suffixSpan.size;
+                assert(mi < moduleReadoutInfos.size());
+                moduleData.hasDynamic = moduleReadoutInfos[mi].hasDynamic;
 
-                    const auto partIndex = std::make_pair(state.eventIndex, mi);
+                if (dataSize)
+                {
+                    if (directData)
+                        ++counters.moduleDataZeroCopies;
+                    else
+                        ++counters.moduleDataCopies;
 
-                    if (dataSize)
-                    {
-                        // FIXME (performance):
-                        ++counters.groupHits[partIndex];
-                        // FIXME (performance):
-                        update_part_size_info(counters.groupSizes[partIndex], dataSize);
-                    }
+                    ++groupHits[mi];
+                    update_part_size_info(groupSizes[mi], dataSize);
                 }
+            }
 
-                auto frameInfo = extract_frame_info(state.curStackFrame.header);
-                auto crateId = frameInfo.ctrl;
-
-                //spdlog::warn("crateId={}, state.crateIndex={}", crateId, state.crateIndex);
-                //assert(crateId == state.crateIndex);
+            auto frameInfo = extract_frame_info(state.curStackFrame.header);
+            auto crateId = frameInfo.ctrl;
 
-                callbacks.eventData(
-                    state.userContext,
-                    crateId, state.eventIndex,
-                    state.moduleDataBuffer.data(), moduleCount);
+            //spdlog::warn("crateId={}, state.crateIndex={}", crateId, state.crateIndex);
+            //assert(crateId == state.crateIndex);
 
-                ++counters.eventHits[state.eventIndex];
+            callbacks.eventData(
+                state.userContext,
+                crateId, state.eventIndex,
+                state.moduleDataBuffer.data(), moduleCount);
 
-                logger->trace("parser_clear_event_state because event is done, eventIndex={}",
-                          state.eventIndex);
+            ++counters.eventHits[state.eventIndex];
 
-                parser_clear_event_state(state);
-            }
+            logger->trace("parser_clear_event_state because event is done, eventIndex={}",
+                      state.eventIndex);
 
-            if (input.data() == lastIterPosition)
-                return ParseResult::ParseReadoutContentsNotAdvancing;
+            parser_clear_event_state(state);
         }
 
-        return ParseResult::Ok;
-    }
-    catch (const end_of_buffer &e)
-    {
-        logger->debug("caught end_of_buffer: {}", e.what());
-        log_buffer(logger, spdlog::level::trace, originalInputView, "originalInputView");
-        throw;
+        if (input.data() == lastIterPosition)
+            return ParseResult::ParseReadoutContentsNotAdvancing;
     }
 
     return ParseResult::Ok;
@@ -965,10 +1076,13 @@ ParseResult parse_eth_packet(
     basic_string_view<u32> input,
     u32 bufferNumber)
 {
-    auto logger = get_logger("readout_parser");
+    auto &logger = parser_logger();
 
     if (input.size() < eth::HeaderWords)
-        throw end_of_buffer("ETH header words");
+    {
+        logger->debug("unexpected end of buffer: ETH header words");
+        return ParseResult::UnexpectedEndOfBuffer;
+    }
 
     eth::PayloadHeaderInfo ethHdrs{ input[0], input[1] };
 
@@ -999,7 +1113,11 @@ ParseResult parse_eth_packet(
         // the eth headers. parse_readout_contents() will be called with this
         // iterator position and will be able to find a StackFrame from there.
         if (input.size() < ethHdrs.nextHeaderPointer())
-            throw end_of_buffer("ETH next header pointer");
+        {
+            logger->debug("unexpected end of buffer: ETH next header pointer {} exceeds packet payload size {}",
+                          ethHdrs.nextHeaderPointer(), input.size());
+            return ParseResult::UnexpectedEndOfBuffer;
+        }
 
         input.remove_prefix(ethHdrs.nextHeaderPointer());
         counters.unusedBytes += ethHdrs.nextHeaderPointer() * sizeof(u32);
@@ -1010,37 +1128,21 @@ ParseResult parse_eth_packet(
                       ethHdrs.nextHeaderPointer() * sizeof(u32));
     }
 
-    try
+    while (!input.empty())
     {
-        while (!input.empty())
-        {
-            const u32 *lastInputPosition = input.data();
+        const u32 *lastInputPosition = input.data();
 
-            auto pr = parse_readout_contents(
-                state, callbacks, counters, input, true, bufferNumber);
+        auto pr = parse_readout_contents(
+            state, callbacks, counters, input, true, bufferNumber);
 
-            if (pr != ParseResult::Ok)
-                return pr;
-
-            logger->trace("end parsing packet {}, dataWords={}",
-                      ethHdrs.packetNumber(), ethHdrs.dataWordCount());
+        if (pr != ParseResult::Ok)
+            return pr;
 
-            if (input.data() == lastInputPosition)
-                return ParseResult::ParseEthPacketNotAdvancing;
-        }
-    }
-    catch (const std::exception &e)
-    {
-        logger->debug("end parsing packet {}, dataWords={}, exception={}",
-                  ethHdrs.packetNumber(), ethHdrs.dataWordCount(),
-                  e.what());
-        throw;
-    }
-    catch (...)
-    {
-        logger->debug("end_parsing packet {}, dataWords={}, caught an unknown exception!",
+        logger->trace("end parsing packet {}, dataWords={}",
                   ethHdrs.packetNumber(), ethHdrs.dataWordCount());
-        throw;
+
+        if (input.data() == lastInputPosition)
+            return ParseResult::ParseEthPacketNotAdvancing;
     }
 
     return {};
@@ -1053,7 +1155,7 @@ ParseResult parse_readout_buffer(
     ReadoutParserCounters &counters,
     u32 bufferNumber, const u32 *buffer, size_t bufferWords)
 {
-    auto logger = get_logger("readout_parser");
+    auto &logger = parser_logger();
 
     logger->trace("begin: bufferNumber={}, buffer={}, bufferWords={}",
               bufferNumber, reinterpret_cast<const void *>(buffer), bufferWords);
@@ -1078,12 +1180,9 @@ ParseResult parse_readout_buffer(
                 break;
         }
     }
-    catch (const end_of_buffer &e)
-    {
-        return ParseResult::UnexpectedEndOfBuffer;
-    }
     catch (...)
     {
+        // Exceptions thrown from the user supplied callbacks end up here.
         return ParseResult::UnhandledException;
     }
 
@@ -1102,9 +1201,11 @@ ParseResult parse_readout_buffer_eth(
 {
     const size_t bufferBytes = bufferWords * sizeof(u32);
 
-    auto logger = get_logger("readout_parser");
+    auto &logger = parser_logger();
 
     logger->trace("begin parsing ETH buffer {}, size={} bytes", bufferNumber, bufferBytes);
+    MaterializeEventDataGuard materializeGuard{state};
+    resize_counters(counters, state.readoutStructure);
 
     s64 bufferLoss = calc_buffer_loss(bufferNumber, state.lastBufferNumber);
     state.lastBufferNumber = bufferNumber;
@@ -1124,6 +1225,17 @@ ParseResult parse_readout_buffer_eth(
     basic_string_view<u32> input(buffer, bufferWords);
     std::vector<basic_string_view<u32>> packetViews;
 
+    // The remaining input cannot be interpreted: discard it and return.
+    auto end_of_buffer = [&] (const char *where)
+    {
+        logger->debug("end parsing ETH buffer {}, size={} bytes, unexpected end of buffer: {}",
+                      bufferNumber, bufferBytes, where);
+        parser_clear_event_state(state);
+        counters.unusedBytes += input.size() * sizeof(u32);
+        count_parse_result(counters, ParseResult::UnexpectedEndOfBuffer);
+        return ParseResult::UnexpectedEndOfBuffer;
+    };
+
     try
     {
         while (!input.empty())
@@ -1133,11 +1245,16 @@ ParseResult parse_readout_buffer_eth(
             // ETH readout data consists of a mix of SystemEvent frames and raw
             // packet data starting with ETH header0.
 
-            if (try_handle_system_event(state, callbacks, counters, input))
+            bool handled = false;
+
+            if (try_handle_system_event(state, callbacks, counters, input, handled) != ParseResult::Ok)
+                return end_of_buffer("system event frame");
+
+            if (handled)
                 continue;
 
             if (input.size() < eth::HeaderWords)
-                throw end_of_buffer("ETH header words");
+                return end_of_buffer("ETH header words");
 
             // At this point the buffer iterator is positioned on the first of the
             // two ETH payload header words.
@@ -1162,7 +1279,7 @@ ParseResult parse_readout_buffer_eth(
             size_t packetWords = eth::HeaderWords + ethHdrs.dataWordCount();
 
             if (input.size() < packetWords)
-                throw end_of_buffer("ETH packet data exceeds input buffer size");
+                return end_of_buffer("ETH packet data exceeds input buffer size");
 
             if (state.lastPacketNumber >= 0)
             {
@@ -1336,9 +1453,11 @@ ParseResult parse_readout_buffer_usb(
 {
     const size_t bufferBytes = bufferWords * sizeof(u32);
 
-    auto logger = get_logger("readout_parser");
+    auto &logger = parser_logger();
 
     logger->trace("begin parsing USB buffer {}, size={} bytes", bufferNumber, bufferBytes);
+    MaterializeEventDataGuard materializeGuard{state};
+    resize_counters(counters, state.readoutStructure);
 
     s64 bufferLoss = calc_buffer_loss(bufferNumber, state.lastBufferNumber);
     state.lastBufferNumber = bufferNumber;
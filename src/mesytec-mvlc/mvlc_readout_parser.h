@@ -195,8 +195,6 @@ inline bool is_empty(const ModuleReadoutSpans &spans)
             && spans.suffixSpan.size == 0);
 }
 
-struct end_of_frame: public std::exception {};
-
 enum class ParseResult
 {
     Ok,
@@ -221,6 +219,9 @@ enum class ParseResult
     ParseEthBufferNotAdvancing,
     ParseEthPacketNotAdvancing,
 
+    // The input ended in the middle of a frame, an ETH header or an ETH
+    // packet. Also returned if an ETH next header pointer points past the end
+    // of the packet.
     UnexpectedEndOfBuffer,
     UnhandledException,
     UnknownBufferType,
@@ -231,12 +232,16 @@ enum class ParseResult
 MESYTEC_MVLC_EXPORT const char *get_parse_result_name(const ParseResult &pr);
 
 // Helper enabling the use of std::pair as the key in std::unordered_map.
+// Combines the hashes in an order dependent way so that swapped pairs do not
+// collide.
 struct PairHash
 {
     template <typename T1, typename T2>
         std::size_t operator() (const std::pair<T1, T2> &pair) const
         {
-            return std::hash<T1>()(pair.first) ^ std::hash<T2>()(pair.second);
+            std::size_t h = std::hash<T1>()(pair.first);
+            h ^= std::hash<T2>()(pair.second) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h;
         }
 };
 
@@ -281,6 +286,12 @@ struct MESYTEC_MVLC_EXPORT ReadoutParserCounters
     // MVLC sometimes generates them.
     u32 emptyStackFrames = 0;
 
+    // Number of non-empty modules passed to the eventData callback via a copy
+    // in the workBuffer and directly referencing the input buffer
+    // (ReadoutParserState::zeroCopy) respectively.
+    u64 moduleDataCopies = 0;
+    u64 moduleDataZeroCopies = 0;
+
     struct PartSizeInfo
     {
         size_t min = std::numeric_limits<size_t>::max();
@@ -288,19 +299,35 @@ struct MESYTEC_MVLC_EXPORT ReadoutParserCounters
         size_t sum = 0u;
     };
 
-    using GroupPartHits = std::unordered_map<std::pair<int, int>, size_t, PairHash>;
-    using GroupPartSizes = std::unordered_map<std::pair<int, int>, PartSizeInfo, PairHash>;
+    // The per event and per module counters are stored in flat arrays sized
+    // from the readout structure of the parser (see resize_counters()). They
+    // are indexed by eventIndex and [eventIndex][moduleIndex] respectively.
+    using EventHits = std::vector<size_t>;
+    using GroupPartHits = std::vector<std::vector<size_t>>;
+    using GroupPartSizes = std::vector<std::vector<PartSizeInfo>>;
 
     // Event hit counts by eventIndex
-    std::unordered_map<int, size_t> eventHits;
+    EventHits eventHits;
 
-    // Part specific hit counts by (eventIndex, moduleIndex)
+    // Part specific hit counts by [eventIndex][moduleIndex]
     GroupPartHits groupHits;
 
-    // Part specific event size information by (eventIndex, moduleIndex)
+    // Part specific event size information by [eventIndex][moduleIndex]
     GroupPartSizes groupSizes;
 };
 
+inline bool operator==(const ReadoutParserCounters::PartSizeInfo &a,
+                       const ReadoutParserCounters::PartSizeInfo &b)
+{
+    return a.min == b.min && a.max == b.max && a.sum == b.sum;
+}
+
+inline bool operator!=(const ReadoutParserCounters::PartSizeInfo &a,
+                       const ReadoutParserCounters::PartSizeInfo &b)
+{
+    return !(a == b);
+}
+
 struct MESYTEC_MVLC_EXPORT ReadoutParserState
 {
     // Helper structure keeping track of the number of words left in a MVLC
@@ -318,19 +345,23 @@ struct MESYTEC_MVLC_EXPORT ReadoutParserState
         inline explicit operator bool() const { return wordsLeft; }
         inline FrameInfo info() const { return extract_frame_info(header); }
 
-        inline void consumeWord()
+        // Both return false and leave the frame state unmodified if the
+        // frame does not contain enough words.
+        inline bool consumeWord()
         {
             if (wordsLeft == 0)
-                throw end_of_frame();
+                return false;
             --wordsLeft;
+            return true;
         }
 
-        inline void consumeWords(size_t count)
+        inline bool consumeWords(size_t count)
         {
             if (wordsLeft < count)
-                throw end_of_frame();
+                return false;
 
             wordsLeft -= count;
+            return true;
         }
 
         u32 header;
@@ -366,6 +397,18 @@ struct MESYTEC_MVLC_EXPORT ReadoutParserState
     // eventData callback.
     std::vector<ModuleData> moduleDataBuffer;
 
+    // If enabled modules whose data words are contiguous in the input buffer
+    // are passed to the eventData callback without copying: ModuleData::data
+    // then points directly into the input buffer. Fragmented module data
+    // (e.g. split across stack frames or ETH packets) and data of events
+    // spanning multiple input buffers is still assembled in the workBuffer.
+    // In both cases the data is only valid during the eventData callback.
+    bool zeroCopy = false;
+
+    // Zero copy mode: per module pointer to the first data word in the input
+    // buffer or nullptr if the module data has been copied to the workBuffer.
+    std::vector<const u32 *> directModuleData;
+
     // Per event preparsed group/module readout info.
     ReadoutStructure readoutStructure;
 
@@ -449,6 +492,21 @@ MESYTEC_MVLC_EXPORT ParseResult parse_readout_buffer_usb(
 MESYTEC_MVLC_EXPORT ReadoutParserState::ReadoutStructure build_readout_structure(
     const std::vector<StackCommandBuilder> &readoutStacks);
 
+// Grows the per event and per module counter arrays to cover the given
+// readout structure. Existing counts are kept. Called by the parse functions
+// so default constructed counters can be passed in.
+MESYTEC_MVLC_EXPORT void resize_counters(
+    ReadoutParserCounters &counters,
+    const ReadoutParserState::ReadoutStructure &readoutStructure);
+
+// Returns counters sized to match the readout structure of the given parser.
+inline ReadoutParserCounters make_readout_parser_counters(const ReadoutParserState &state)
+{
+    ReadoutParserCounters result;
+    resize_counters(result, state.readoutStructure);
+    return result;
+}
+
 inline s64 calc_buffer_loss(u32 bufferNumber, u32 lastBufferNumber)
 {
     s64 diff = bufferNumber - lastBufferNumber;
@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include "mvlc_constants.h"
+#include "mvlc_readout_parser.h"
+#include "mvlc_readout_parser_util.h"
+#include "mvlc_util.h"
+#include "vme_constants.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::readout_parser;
+
+namespace
+{
+
+// Stack 1: module0 is a block read only, module1 has a single word prefix
+// followed by a block read.
+std::vector<StackCommandBuilder> make_readout_stacks()
+{
+    StackCommandBuilder readoutStack;
+    readoutStack.beginGroup("module0");
+    readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+    readoutStack.beginGroup("module1");
+    readoutStack.addVMERead(0, vme_amods::A32, VMEDataWidth::D32);
+    readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+
+    return { readoutStack };
+}
+
+const std::vector<u32> Module0Data = { 0x10000001, 0x10000002, 0x10000003 };
+const std::vector<u32> Module1Data = { 0x20000000, 0x20000001, 0x20000002 };
+
+struct Collector
+{
+    std::vector<std::vector<u32>> modules;
+    std::vector<const u32 *> pointers;
+    size_t events = 0;
+
+    ReadoutParserCallbacks callbacks()
+    {
+        ReadoutParserCallbacks result;
+
+        result.eventData = [this] (void *, int, int, const ModuleData *moduleDataList, unsigned moduleCount)
+        {
+            ++events;
+            modules.clear();
+            pointers.clear();
+
+            for (unsigned mi=0; mi<moduleCount; ++mi)
+            {
+                const auto &md = moduleDataList[mi];
+                modules.emplace_back(md.data.data, md.data.data + md.data.size);
+                pointers.push_back(md.data.data);
+            }
+        };
+
+        return result;
+    }
+};
+
+}
+
+TEST(readout_parser, ZeroCopySingleBuffer)
+{
+    // module0 data is contiguous in the input, module1 data is interrupted by
+    // the block read frame header.
+    std::vector<u32> input =
+    {
+        make_frame_header(frame_headers::StackFrame, 9, 1),
+        make_frame_header(frame_headers::BlockRead, 3),
+        Module0Data[0], Module0Data[1], Module0Data[2],
+        Module1Data[0],
+        make_frame_header(frame_headers::BlockRead, 2),
+        Module1Data[1], Module1Data[2],
+    };
+
+    for (bool zeroCopy: { false, true })
+    {
+        auto state = make_readout_parser(make_readout_stacks());
+        state.zeroCopy = zeroCopy;
+        ReadoutParserCounters counters;
+        Collector collector;
+        auto callbacks = collector.callbacks();
+
+        auto pr = parse_readout_buffer(ConnectionType::USB, state, callbacks, counters,
+                                       1, input.data(), input.size());
+
+        ASSERT_EQ(pr, ParseResult::Ok);
+        ASSERT_EQ(collector.events, 1);
+        ASSERT_EQ(collector.modules.size(), 2);
+        ASSERT_EQ(collector.modules[0], Module0Data);
+        ASSERT_EQ(collector.modules[1], Module1Data);
+
+        if (zeroCopy)
+        {
+            ASSERT_EQ(collector.pointers[0], input.data() + 2);
+            ASSERT_EQ(counters.moduleDataZeroCopies, 1);
+            ASSERT_EQ(counters.moduleDataCopies, 1);
+        }
+        else
+        {
+            ASSERT_EQ(counters.moduleDataZeroCopies, 0);
+            ASSERT_EQ(counters.moduleDataCopies, 2);
+        }
+    }
+}
+
+TEST(readout_parser, ZeroCopyEventSpanningBuffers)
+{
+    // The event is split across two USB buffers. The first buffer is
+    // overwritten before the second one is parsed so module0 data has to be
+    // copied out of it when leaving the parser.
+    std::vector<u32> buffer0 =
+    {
+        make_frame_header(frame_headers::StackFrame, 4, 1, frame_flags::Continue),
+        make_frame_header(frame_headers::BlockRead, 3),
+        Module0Data[0], Module0Data[1], Module0Data[2],
+    };
+
+    std::vector<u32> buffer1 =
+    {
+        make_frame_header(frame_headers::StackContinuation, 4, 1),
+        Module1Data[0],
+        make_frame_header(frame_headers::BlockRead, 2),
+        Module1Data[1], Module1Data[2],
+    };
+
+    auto state = make_readout_parser(make_readout_stacks());
+    state.zeroCopy = true;
+    ReadoutParserCounters counters;
+    Collector collector;
+    auto callbacks = collector.callbacks();
+
+    auto pr = parse_readout_buffer(ConnectionType::USB, state, callbacks, counters,
+                                   1, buffer0.data(), buffer0.size());
+    ASSERT_EQ(pr, ParseResult::Ok);
+    ASSERT_EQ(collector.events, 0);
+
+    std::fill(buffer0.begin(), buffer0.end(), 0xdeadbeef);
+
+    pr = parse_readout_buffer(ConnectionType::USB, state, callbacks, counters,
+                              2, buffer1.data(), buffer1.size());
+    ASSERT_EQ(pr, ParseResult::Ok);
+    ASSERT_EQ(collector.events, 1);
+    ASSERT_EQ(collector.modules[0], Module0Data);
+    ASSERT_EQ(collector.modules[1], Module1Data);
+    ASSERT_EQ(counters.moduleDataZeroCopies, 0);
+    ASSERT_EQ(counters.moduleDataCopies, 2);
+}
+
+TEST(readout_parser, HitAndSizeCounters)
+{
+    std::vector<u32> input =
+    {
+        make_frame_header(frame_headers::StackFrame, 9, 1),
+        make_frame_header(frame_headers::BlockRead, 3),
+        Module0Data[0], Module0Data[1], Module0Data[2],
+        Module1Data[0],
+        make_frame_header(frame_headers::BlockRead, 2),
+        Module1Data[1], Module1Data[2],
+    };
+
+    auto state = make_readout_parser(make_readout_stacks());
+    auto counters = make_readout_parser_counters(state);
+
+    ASSERT_EQ(counters.eventHits, ReadoutParserCounters::EventHits({ 0 }));
+    ASSERT_EQ(counters.groupHits, ReadoutParserCounters::GroupPartHits({ { 0, 0 } }));
+    ASSERT_EQ(counters.groupSizes.size(), 1);
+    ASSERT_EQ(counters.groupSizes[0].size(), 2);
+
+    // Default constructed counters are sized by the parser.
+    ReadoutParserCounters defaultCounters;
+    Collector collector;
+    auto callbacks = collector.callbacks();
+
+    for (u32 bufferNumber: { 1, 2 })
+    {
+        ASSERT_EQ(parse_readout_buffer(ConnectionType::USB, state, callbacks, counters,
+                                       bufferNumber, input.data(), input.size()), ParseResult::Ok);
+    }
+
+    state = make_readout_parser(make_readout_stacks());
+
+    ASSERT_EQ(parse_readout_buffer(ConnectionType::USB, state, callbacks, defaultCounters,
+                                   1, input.data(), input.size()), ParseResult::Ok);
+
+    ASSERT_EQ(collector.events, 3);
+    ASSERT_EQ(counters.eventHits, ReadoutParserCounters::EventHits({ 2 }));
+    ASSERT_EQ(counters.groupHits, ReadoutParserCounters::GroupPartHits({ { 2, 2 } }));
+    ASSERT_EQ(counters.groupSizes[0][0].min, 3);
+    ASSERT_EQ(counters.groupSizes[0][0].max, 3);
+    ASSERT_EQ(counters.groupSizes[0][0].sum, 6);
+    ASSERT_EQ(counters.groupSizes[0][1].sum, 6);
+    ASSERT_EQ(defaultCounters.eventHits, ReadoutParserCounters::EventHits({ 1 }));
+    ASSERT_EQ(defaultCounters.groupHits, ReadoutParserCounters::GroupPartHits({ { 1, 1 } }));
+
+    merge_counters(counters, defaultCounters);
+
+    ASSERT_EQ(counters.eventHits, ReadoutParserCounters::EventHits({ 3 }));
+    ASSERT_EQ(counters.groupHits, ReadoutParserCounters::GroupPartHits({ { 3, 3 } }));
+    ASSERT_EQ(counters.groupSizes[0][1].min, 3);
+    ASSERT_EQ(counters.groupSizes[0][1].sum, 9);
+}
+
+// run_readout_parser() merges its counters into the shared ones instead of
+// overwriting them, so a reset done by another thread is kept.
+TEST(readout_parser, RunReadoutParserKeepsCounterReset)
+{
+    std::vector<u32> input =
+    {
+        make_frame_header(frame_headers::StackFrame, 9, 1),
+        make_frame_header(frame_headers::BlockRead, 3),
+        Module0Data[0], Module0Data[1], Module0Data[2],
+        Module1Data[0],
+        make_frame_header(frame_headers::BlockRead, 2),
+        Module1Data[1], Module1Data[2],
+    };
+
+    auto state = make_readout_parser(make_readout_stacks());
+    Protected<ReadoutParserCounters> counters;
+    ReadoutBufferQueues queues(util::Kilobytes(4), 2);
+    ReadoutParserCallbacks callbacks;
+    callbacks.eventData = [] (void *, int, int, const ModuleData *, unsigned) {};
+    std::atomic<bool> quit(false);
+
+    std::thread parserThread(run_readout_parser, std::ref(state), std::ref(counters),
+                             std::ref(queues), std::ref(callbacks), std::ref(quit));
+
+    auto parse_one = [&] (u32 bufferNumber)
+    {
+        auto buffer = queues.emptyBufferQueue().dequeue_blocking();
+        buffer->clear();
+        buffer->setType(ConnectionType::USB);
+        buffer->setBufferNumber(bufferNumber);
+
+        for (u32 word: input)
+            buffer->push_back(word);
+
+        queues.filledBufferQueue().enqueue(buffer);
+
+        for (int i=0; i<200 && counters.copy().buffersProcessed == 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    };
+
+    parse_one(1);
+    ASSERT_EQ(counters.copy().buffersProcessed, 1u);
+
+    counters.access().ref() = {};
+
+    parse_one(2);
+    quit = true;
+    parserThread.join();
+
+    auto result = counters.copy();
+    ASSERT_EQ(result.buffersProcessed, 1u);
+    ASSERT_EQ(result.bytesProcessed, input.size() * sizeof(u32));
+    ASSERT_EQ(result.eventHits.size(), 1u);
+    ASSERT_EQ(result.eventHits[0], 1u);
+}
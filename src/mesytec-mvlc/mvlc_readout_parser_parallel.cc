@@ -0,0 +1,916 @@
+#include "mvlc_readout_parser_parallel.h"
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "mvlc_eth_interface.h"
+#include "mvlc_impl_eth.h"
+#include "mvlc_readout_parser_util.h"
+#include "util/logging.h"
+#include "util/string_view.hpp"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace readout_parser
+{
+
+namespace
+{
+
+// Input buffer owned by a chunk. The storage is either a copy of the input
+// data or has been taken over from a ReadoutBuffer.
+struct ChunkBuffer
+{
+    u32 bufferNumber;
+    ReadoutBufferStorage storage;
+    size_t words;
+
+    const u32 *data() const { return reinterpret_cast<const u32 *>(storage.data()); }
+};
+
+// Ordered mode: events and system events recorded by the workers. For readout
+// events 'first' and 'count' refer to entries in Chunk::modules, for system
+// events to words in Chunk::storage.
+struct RecordedEvent
+{
+    bool isSystemEvent;
+    int crateIndex;
+    int eventIndex;
+    size_t first;
+    u32 count;
+};
+
+// The data pointer of the ModuleData is replaced by an offset into either one
+// of the chunk input buffers (zero copy parsing) or into Chunk::storage.
+struct RecordedModule
+{
+    ModuleData moduleData;
+    size_t offset;
+    s32 bufferIndex; // -1 for Chunk::storage
+};
+
+struct Chunk
+{
+    u64 sequence = 0;
+    ConnectionType bufferType = ConnectionType::USB;
+
+    // True if the chunk does not start at a resynchronization point. Parsing
+    // then continues with the final parser state of the previous chunk.
+    bool continuesPrevious = false;
+
+    // Buffer and ETH packet numbers directly preceding the chunk. Used to
+    // seed the parser state so that loss accounting works across chunks.
+    u32 previousBufferNumber = 0;
+    s32 previousPacketNumber = -1;
+
+    std::vector<ChunkBuffer> buffers;
+    size_t inputWords = 0;
+
+    // ETH only: truncated copy of the first packet of the next chunk holding
+    // the trailing words of the last event of this chunk.
+    std::vector<u32> trailer;
+    u32 trailerBufferNumber = 0;
+
+    // ETH only: number of words in the first packet of this chunk that have
+    // been parsed as part of the previous chunks trailer.
+    size_t leadingWords = 0;
+
+    ReadoutParserState state;
+    ReadoutParserCounters counters;
+
+    std::vector<RecordedEvent> events;
+    std::vector<RecordedModule> modules;
+    std::vector<u32> storage;
+    // Index of the buffer currently being parsed, -1 for the trailer.
+    s32 currentBuffer = -1;
+
+    bool parsed = false;
+
+    size_t inputBytes() const { return inputWords * sizeof(u32); }
+};
+
+inline void clear_event_state(ReadoutParserState &state)
+{
+    state.eventIndex = -1;
+    state.moduleIndex = -1;
+    state.curStackFrame = ReadoutParserState::FrameParseState{};
+    state.curBlockFrame = ReadoutParserState::FrameParseState{};
+    state.groupParseState = ReadoutParserState::Prefix;
+    state.workBuffer.used = 0;
+}
+
+// Returns the number of the last ETH packet fully contained in the buffer or
+// lastPacketNumber if there is no such packet. Steps through the buffer the
+// same way parse_readout_buffer_eth() does.
+s32 last_eth_packet_number(const u32 *buffer, size_t bufferWords, s32 lastPacketNumber)
+{
+    basic_string_view<u32> input(buffer, bufferWords);
+
+    while (!input.empty())
+    {
+        if (get_frame_type(input[0]) == frame_headers::SystemEvent)
+        {
+            auto len = extract_frame_info(input[0]).len;
+
+            if (input.size() <= len)
+                break;
+
+            input.remove_prefix(len + 1);
+            continue;
+        }
+
+        if (input.size() < eth::HeaderWords)
+            break;
+
+        eth::PayloadHeaderInfo ethHdrs{ input[0], input[1] };
+        size_t packetWords = eth::HeaderWords + ethHdrs.dataWordCount();
+
+        if (input.size() < packetWords)
+            break;
+
+        lastPacketNumber = ethHdrs.packetNumber();
+        input.remove_prefix(packetWords);
+    }
+
+    return lastPacketNumber;
+}
+
+} // end anon namespace
+
+bool is_parser_resync_point(
+    ConnectionType bufferType,
+    u32 bufferNumber, const u32 *buffer, size_t bufferWords,
+    u32 previousBufferNumber, s32 previousPacketNumber,
+    size_t *trailingWords)
+{
+    if (trailingWords)
+        *trailingWords = 0;
+
+    // The parser clears its state on internal buffer loss.
+    if (calc_buffer_loss(bufferNumber, previousBufferNumber) != 0)
+        return true;
+
+    basic_string_view<u32> input(buffer, bufferWords);
+    bool systemEventSeen = false;
+
+    // System events do not modify the event parsing state.
+    while (!input.empty() && get_frame_type(input[0]) == frame_headers::SystemEvent)
+    {
+        auto len = extract_frame_info(input[0]).len;
+
+        if (input.size() <= len)
+            return false;
+
+        input.remove_prefix(len + 1);
+        systemEventSeen = true;
+    }
+
+    if (input.empty())
+        return false;
+
+    if (bufferType == ConnectionType::USB)
+        return get_frame_type(input[0]) == frame_headers::StackFrame;
+
+    if (input.size() < eth::HeaderWords)
+        return false;
+
+    eth::PayloadHeaderInfo ethHdrs{ input[0], input[1] };
+
+    if (!ethHdrs.isNextHeaderPointerPresent())
+        return false;
+
+    size_t nextHeaderPointer = ethHdrs.nextHeaderPointer();
+
+    if (nextHeaderPointer >= ethHdrs.dataWordCount()
+        || eth::HeaderWords + nextHeaderPointer >= input.size())
+    {
+        return false;
+    }
+
+    if (get_frame_type(input[eth::HeaderWords + nextHeaderPointer]) != frame_headers::StackFrame)
+        return false;
+
+    if (nextHeaderPointer == 0)
+        return true;
+
+    // With packet loss in front of the packet the parser clears its state and
+    // resumes at the next header pointer.
+    if (previousPacketNumber >= 0
+        && eth::calc_packet_loss(previousPacketNumber, ethHdrs.packetNumber()) != 0)
+    {
+        return true;
+    }
+
+    // The words in front of the stack frame header complete the previous
+    // event. The previous chunk has to parse them before any system event
+    // contained in this buffer is delivered, which cannot be done here.
+    if (systemEventSeen)
+        return false;
+
+    if (trailingWords)
+        *trailingWords = nextHeaderPointer;
+
+    return true;
+}
+
+struct ParallelReadoutParser::Private
+{
+    // Copy of the prototype state without the workBuffer contents.
+    ReadoutParserState prototype;
+    size_t workBufferSize = 0;
+    ReadoutParserCallbacks &callbacks;
+    Protected<ReadoutParserCounters> &counters;
+    ParallelParserOptions options;
+
+    mutable std::mutex mutex;
+    std::condition_variable workCv;     // new work or quit
+    std::condition_variable chunkCv;    // chunk parsed or retired
+    std::vector<std::unique_ptr<Chunk>> chunkStorage;
+    std::vector<Chunk *> freeChunks;
+    // Recycled ChunkBuffer storage.
+    std::vector<ReadoutBufferStorage> spareStorage;
+    std::deque<Chunk *> workQueue;
+    // Submitted chunks that have not been retired yet in sequence order.
+    std::deque<Chunk *> inFlight;
+    // Final parser state of the most recently retired chunk.
+    ReadoutParserState carryState;
+    bool quit = false;
+    // First exception thrown by a user callback. failed is set together with
+    // eptr and can be checked without locking the mutex.
+    std::exception_ptr eptr;
+    std::atomic<bool> failed;
+
+    // Serializes event delivery and chunk retirement.
+    std::mutex deliveryMutex;
+    std::vector<ModuleData> moduleDataBuffer;
+
+    // State of the thread calling parseBuffer().
+    Chunk *pending = nullptr;
+    std::atomic<bool> hasPending;
+    u64 nextSequence = 0;
+    bool inputSeen = false;
+    u32 lastBufferNumber = 0;
+    s32 lastPacketNumber = -1;
+
+    std::vector<std::thread> workers;
+
+    Private(ReadoutParserCallbacks &callbacks_, Protected<ReadoutParserCounters> &counters_)
+        : callbacks(callbacks_)
+        , counters(counters_)
+        , failed(false)
+        , hasPending(false)
+    {}
+
+    Chunk *acquireChunk();
+    void addBuffer(ConnectionType bufferType, u32 bufferNumber,
+                   const u32 *buffer, size_t bufferWords,
+                   ReadoutBuffer *source);
+    void submitPending();
+    void workerLoop();
+    void parseChunk(Chunk &chunk);
+    void deliverChunk(Chunk &chunk);
+    void waitForChunks();
+    void storeException(std::exception_ptr e);
+    void retireChunks();
+};
+
+Chunk *ParallelReadoutParser::Private::acquireChunk()
+{
+    Chunk *chunk = nullptr;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        chunkCv.wait(lock, [this] { return !freeChunks.empty(); });
+        chunk = freeChunks.back();
+        freeChunks.pop_back();
+    }
+
+    chunk->buffers.clear();
+    chunk->inputWords = 0;
+    chunk->trailer.clear();
+    chunk->leadingWords = 0;
+    chunk->counters = {};
+    chunk->events.clear();
+    chunk->modules.clear();
+    chunk->storage.clear();
+    chunk->parsed = false;
+
+    // Keep the workBuffer allocation around, reset everything else to the
+    // prototype state.
+    auto workBuffer = std::move(chunk->state.workBuffer);
+    chunk->state = prototype;
+    chunk->state.workBuffer = std::move(workBuffer);
+
+    if (chunk->state.workBuffer.buffer.size() < workBufferSize)
+        chunk->state.workBuffer.buffer.resize(workBufferSize);
+
+    chunk->state.workBuffer.used = 0;
+
+    return chunk;
+}
+
+void ParallelReadoutParser::Private::submitPending()
+{
+    if (!pending)
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        inFlight.push_back(pending);
+        workQueue.push_back(pending);
+    }
+
+    workCv.notify_one();
+    pending = nullptr;
+    hasPending = false;
+}
+
+void ParallelReadoutParser::Private::workerLoop()
+{
+#ifdef __linux__
+    prctl(PR_SET_NAME,"parser_worker",0,0,0);
+#endif
+
+    while (true)
+    {
+        Chunk *chunk = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workCv.wait(lock, [this] { return quit || !workQueue.empty(); });
+
+            if (workQueue.empty())
+                break;
+
+            chunk = workQueue.front();
+            workQueue.pop_front();
+
+            if (chunk->continuesPrevious)
+            {
+                // Take over the final state of the previous chunk. Chunks are
+                // taken from the work queue in order so the previous chunk is
+                // either being parsed, parsed or already retired.
+                chunkCv.wait(lock, [this, chunk]
+                {
+                    auto it = std::find_if(std::begin(inFlight), std::end(inFlight),
+                        [chunk] (const Chunk *c) { return c->sequence + 1 == chunk->sequence; });
+                    return it == std::end(inFlight) || (*it)->parsed;
+                });
+
+                auto it = std::find_if(std::begin(inFlight), std::end(inFlight),
+                    [chunk] (const Chunk *c) { return c->sequence + 1 == chunk->sequence; });
+
+                if (it != std::end(inFlight))
+                    std::swap(chunk->state, (*it)->state);
+                else
+                    std::swap(chunk->state, carryState);
+            }
+        }
+
+        // Once a callback threw the remaining chunks are only retired, not
+        // parsed, so that no more callbacks are invoked.
+        if (!failed)
+        {
+            try
+            {
+                parseChunk(*chunk);
+            }
+            catch (...)
+            {
+                storeException(std::current_exception());
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            chunk->parsed = true;
+        }
+
+        chunkCv.notify_all();
+        retireChunks();
+    }
+}
+
+void ParallelReadoutParser::Private::parseChunk(Chunk &chunk)
+{
+    auto &state = chunk.state;
+
+    if (!chunk.continuesPrevious)
+    {
+        state.lastBufferNumber = chunk.previousBufferNumber;
+        state.lastPacketNumber = chunk.previousPacketNumber;
+    }
+
+    ReadoutParserCallbacks workerCallbacks;
+
+    if (options.ordered)
+    {
+        Chunk *c = &chunk;
+
+        workerCallbacks.eventData = [c] (
+            void *, int crateIndex, int eventIndex,
+            const ModuleData *moduleDataList, unsigned moduleCount)
+        {
+            // Zero copy module data can only point into the current buffer.
+            const u32 *inputBegin = nullptr;
+            const u32 *inputEnd = nullptr;
+
+            if (c->currentBuffer >= 0)
+            {
+                inputBegin = c->buffers[c->currentBuffer].data();
+                inputEnd = inputBegin + c->buffers[c->currentBuffer].words;
+            }
+
+            c->events.push_back({ false, crateIndex, eventIndex, c->modules.size(), moduleCount });
+
+            for (unsigned mi=0; mi<moduleCount; ++mi)
+            {
+                RecordedModule rm{ moduleDataList[mi], 0, -1 };
+                const u32 *data = rm.moduleData.data.data;
+
+                if (data >= inputBegin && data < inputEnd)
+                {
+                    rm.offset = data - inputBegin;
+                    rm.bufferIndex = c->currentBuffer;
+                }
+                else
+                {
+                    rm.offset = c->storage.size();
+                    c->storage.insert(std::end(c->storage), data, data + rm.moduleData.data.size);
+                }
+
+                rm.moduleData.data.data = nullptr;
+                c->modules.emplace_back(rm);
+            }
+        };
+
+        workerCallbacks.systemEvent = [c] (void *, int crateIndex, const u32 *header, u32 size)
+        {
+            c->events.push_back({ true, crateIndex, -1, c->storage.size(), size });
+            c->storage.insert(std::end(c->storage), header, header + size);
+        };
+    }
+    else
+    {
+        // parse_readout_buffer() swallows exceptions thrown by the callbacks.
+        // Store the first one so that finish() can rethrow it.
+        workerCallbacks.eventData = [this] (
+            void *userContext, int crateIndex, int eventIndex,
+            const ModuleData *moduleDataList, unsigned moduleCount)
+        {
+            try
+            {
+                callbacks.eventData(userContext, crateIndex, eventIndex, moduleDataList, moduleCount);
+            }
+            catch (...)
+            {
+                storeException(std::current_exception());
+                throw;
+            }
+        };
+
+        workerCallbacks.systemEvent = [this] (void *userContext, int crateIndex, const u32 *header, u32 size)
+        {
+            try
+            {
+                callbacks.systemEvent(userContext, crateIndex, header, size);
+            }
+            catch (...)
+            {
+                storeException(std::current_exception());
+                throw;
+            }
+        };
+    }
+
+    for (size_t bi=0; bi<chunk.buffers.size() && !failed; ++bi)
+    {
+        const auto &buffer = chunk.buffers[bi];
+        chunk.currentBuffer = bi;
+
+        parse_readout_buffer(
+            chunk.bufferType, state, workerCallbacks, chunk.counters,
+            buffer.bufferNumber, buffer.data(), buffer.words);
+    }
+
+    chunk.currentBuffer = -1;
+
+    if (!chunk.trailer.empty() && !failed)
+    {
+        // Only keep the counts resulting from completed events. The trailer
+        // packet itself is accounted for by the next chunk.
+        auto &counters = chunk.counters;
+        auto saved = counters;
+
+        parse_readout_buffer(
+            chunk.bufferType, state, workerCallbacks, counters,
+            chunk.trailerBufferNumber, chunk.trailer.data(), chunk.trailer.size());
+
+        counters.internalBufferLoss = saved.internalBufferLoss;
+        counters.buffersProcessed = saved.buffersProcessed;
+        counters.bytesProcessed = saved.bytesProcessed;
+        counters.unusedBytes = saved.unusedBytes;
+        counters.ethPacketsProcessed = saved.ethPacketsProcessed;
+        counters.ethPacketLoss = saved.ethPacketLoss;
+        counters.parseResults = saved.parseResults;
+    }
+
+    if (chunk.leadingWords)
+    {
+        // The parser skipped the leading words of the first packet which were
+        // parsed as part of the previous chunk.
+        auto &unusedBytes = chunk.counters.unusedBytes;
+        unusedBytes -= std::min(unusedBytes, static_cast<u64>(chunk.leadingWords * sizeof(u32)));
+    }
+}
+
+void ParallelReadoutParser::Private::storeException(std::exception_ptr e)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (!eptr)
+    {
+        get_logger("readout_parser")->error(
+            "ParallelReadoutParser: exception from a parser callback, no more callbacks will be invoked");
+        eptr = e;
+        failed = true;
+    }
+}
+
+void ParallelReadoutParser::Private::deliverChunk(Chunk &chunk)
+{
+    if (options.ordered && !failed)
+    {
+        try
+        {
+            for (const auto &event: chunk.events)
+            {
+                if (event.isSystemEvent)
+                {
+                    callbacks.systemEvent(
+                        prototype.userContext, event.crateIndex,
+                        chunk.storage.data() + event.first, event.count);
+                    continue;
+                }
+
+                moduleDataBuffer.resize(event.count);
+
+                for (u32 mi=0; mi<event.count; ++mi)
+                {
+                    const auto &rm = chunk.modules[event.first + mi];
+                    auto &md = moduleDataBuffer[mi];
+                    md = rm.moduleData;
+                    md.data.data = (rm.bufferIndex >= 0
+                                    ? chunk.buffers[rm.bufferIndex].data()
+                                    : chunk.storage.data()) + rm.offset;
+                }
+
+                callbacks.eventData(
+                    prototype.userContext, event.crateIndex, event.eventIndex,
+                    moduleDataBuffer.data(), event.count);
+            }
+        }
+        catch (...)
+        {
+            storeException(std::current_exception());
+        }
+    }
+
+    merge_counters(counters.access().ref(), chunk.counters);
+}
+
+// Delivers and retires parsed chunks in sequence order. Only one thread at a
+// time does the delivery. Other threads finishing a chunk in the meantime
+// return immediately, the recheck at the end makes sure their chunks are not
+// left behind.
+void ParallelReadoutParser::Private::retireChunks()
+{
+    auto next_ready = [this] () -> Chunk *
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!inFlight.empty() && inFlight.front()->parsed)
+            return inFlight.front();
+        return nullptr;
+    };
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> deliveryLock(deliveryMutex, std::try_to_lock);
+
+            if (!deliveryLock)
+                return;
+
+            while (auto chunk = next_ready())
+            {
+                deliverChunk(*chunk);
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    inFlight.pop_front();
+                    std::swap(carryState, chunk->state);
+
+                    for (auto &buffer: chunk->buffers)
+                        spareStorage.emplace_back(std::move(buffer.storage));
+
+                    chunk->buffers.clear();
+                    freeChunks.push_back(chunk);
+                }
+
+                chunkCv.notify_all();
+            }
+        }
+
+        if (!next_ready())
+            return;
+    }
+}
+
+ParallelReadoutParser::ParallelReadoutParser(
+    const ReadoutParserState &prototype,
+    ReadoutParserCallbacks &callbacks,
+    Protected<ReadoutParserCounters> &counters,
+    const ParallelParserOptions &options)
+    : d(std::make_unique<Private>(callbacks, counters))
+{
+    d->prototype = prototype;
+    d->workBufferSize = prototype.workBuffer.buffer.size();
+    d->prototype.workBuffer = {};
+    clear_event_state(d->prototype);
+    d->options = options;
+
+    if (!d->options.workerCount)
+        d->options.workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    if (!d->options.maxChunksInFlight)
+        d->options.maxChunksInFlight = 2 * d->options.workerCount + 1;
+
+    d->lastBufferNumber = d->prototype.lastBufferNumber;
+    d->lastPacketNumber = d->prototype.lastPacketNumber;
+
+    for (unsigned i=0; i<d->options.maxChunksInFlight; ++i)
+    {
+        d->chunkStorage.emplace_back(std::make_unique<Chunk>());
+        d->freeChunks.push_back(d->chunkStorage.back().get());
+    }
+
+    for (unsigned i=0; i<d->options.workerCount; ++i)
+        d->workers.emplace_back(std::thread(&Private::workerLoop, d.get()));
+
+    get_logger("readout_parser")->debug(
+        "ParallelReadoutParser: started {} workers, ordered={}, maxChunksInFlight={}",
+        d->options.workerCount, d->options.ordered, d->options.maxChunksInFlight);
+}
+
+ParallelReadoutParser::~ParallelReadoutParser()
+{
+    d->waitForChunks();
+
+    {
+        std::unique_lock<std::mutex> lock(d->mutex);
+        d->quit = true;
+    }
+
+    d->workCv.notify_all();
+
+    for (auto &t: d->workers)
+        if (t.joinable())
+            t.join();
+}
+
+void ParallelReadoutParser::Private::addBuffer(
+    ConnectionType bufferType, u32 bufferNumber,
+    const u32 *buffer, size_t bufferWords,
+    ReadoutBuffer *source)
+{
+    size_t trailingWords = 0;
+    bool resync = true;
+
+    if (inputSeen)
+    {
+        resync = is_parser_resync_point(
+            bufferType, bufferNumber, buffer, bufferWords,
+            lastBufferNumber, lastPacketNumber, &trailingWords);
+    }
+
+    if (pending && (pending->bufferType != bufferType
+                    || (resync && pending->inputBytes() >= options.minChunkSize)))
+    {
+        if (trailingWords && pending->bufferType == bufferType)
+        {
+            // Append a copy of the first packet truncated to the trailing
+            // words. The next header pointer is cleared as the packet does
+            // not contain any further frame headers.
+            eth::PayloadHeaderInfo ethHdrs{ buffer[0], buffer[1] };
+            u32 header0 = ethHdrs.header0 & ~(eth::header0::NumDataWordsMask << eth::header0::NumDataWordsShift);
+            header0 |= (trailingWords & eth::header0::NumDataWordsMask) << eth::header0::NumDataWordsShift;
+            u32 header1 = ethHdrs.header1 | (eth::header1::HeaderPointerMask << eth::header1::HeaderPointerShift);
+
+            pending->trailer = { header0, header1 };
+            pending->trailer.insert(std::end(pending->trailer),
+                                    buffer + eth::HeaderWords,
+                                    buffer + eth::HeaderWords + trailingWords);
+            pending->trailerBufferNumber = bufferNumber;
+        }
+        else
+            trailingWords = 0;
+
+        submitPending();
+    }
+    else if (!pending && trailingWords)
+    {
+        // The previous chunk has already been submitted without the trailing
+        // words of its last event. Continue with its final state instead.
+        resync = false;
+        trailingWords = 0;
+    }
+    else
+        trailingWords = 0;
+
+    if (!pending)
+    {
+        auto chunk = acquireChunk();
+        chunk->sequence = nextSequence++;
+        chunk->bufferType = bufferType;
+        chunk->continuesPrevious = inputSeen && !resync;
+        chunk->previousBufferNumber = lastBufferNumber;
+        chunk->previousPacketNumber = lastPacketNumber;
+        chunk->leadingWords = trailingWords;
+        pending = chunk;
+        hasPending = true;
+    }
+
+    inputSeen = true;
+
+    if (calc_buffer_loss(bufferNumber, lastBufferNumber) != 0)
+        lastPacketNumber = -1;
+
+    lastBufferNumber = bufferNumber;
+
+    if (bufferType == ConnectionType::ETH)
+        lastPacketNumber = last_eth_packet_number(buffer, bufferWords, lastPacketNumber);
+
+    ChunkBuffer chunkBuffer{ bufferNumber, {}, bufferWords };
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (!spareStorage.empty())
+        {
+            chunkBuffer.storage = std::move(spareStorage.back());
+            spareStorage.pop_back();
+        }
+    }
+
+    if (source)
+    {
+        // Hand a storage vector of at least the same size back to the
+        // source buffer.
+        if (chunkBuffer.storage.size() < source->capacity())
+            chunkBuffer.storage.resize(source->capacity());
+        std::swap(chunkBuffer.storage, source->buffer());
+        source->clear();
+    }
+    else
+    {
+        auto bytes = reinterpret_cast<const u8 *>(buffer);
+        chunkBuffer.storage.assign(bytes, bytes + bufferWords * sizeof(u32));
+    }
+
+    pending->buffers.emplace_back(std::move(chunkBuffer));
+    pending->inputWords += bufferWords;
+}
+
+void ParallelReadoutParser::parseBuffer(
+    ConnectionType bufferType, u32 bufferNumber,
+    const u32 *buffer, size_t bufferWords)
+{
+    if (bufferWords)
+        d->addBuffer(bufferType, bufferNumber, buffer, bufferWords, nullptr);
+}
+
+void ParallelReadoutParser::takeBuffer(ReadoutBuffer &buffer)
+{
+    auto view = buffer.viewU32();
+
+    if (!view.empty())
+    {
+        d->addBuffer(static_cast<ConnectionType>(buffer.type()), buffer.bufferNumber(),
+                     view.data(), view.size(), &buffer);
+    }
+}
+
+void ParallelReadoutParser::flush()
+{
+    d->submitPending();
+}
+
+void ParallelReadoutParser::Private::waitForChunks()
+{
+    submitPending();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    chunkCv.wait(lock, [this] { return inFlight.empty(); });
+}
+
+void ParallelReadoutParser::finish()
+{
+    d->waitForChunks();
+
+    if (auto e = exception())
+        std::rethrow_exception(e);
+}
+
+bool ParallelReadoutParser::idle() const
+{
+    std::unique_lock<std::mutex> lock(d->mutex);
+    return !d->hasPending && d->inFlight.empty();
+}
+
+std::exception_ptr ParallelReadoutParser::exception() const
+{
+    std::unique_lock<std::mutex> lock(d->mutex);
+    return d->eptr;
+}
+
+unsigned ParallelReadoutParser::workerCount() const
+{
+    return d->options.workerCount;
+}
+
+void run_readout_parser_parallel(
+    ParallelReadoutParser &parser,
+    ReadoutBufferQueues &bufferQueues,
+    std::atomic<bool> &quit)
+{
+#ifdef __linux__
+    prctl(PR_SET_NAME,"readout_parser",0,0,0);
+#endif
+
+    auto logger = get_logger("readout_parser");
+
+    auto &filled = bufferQueues.filledBufferQueue();
+    auto &empty = bufferQueues.emptyBufferQueue();
+
+    logger->debug("run_readout_parser_parallel() entering loop, workers={}", parser.workerCount());
+
+    try
+    {
+        while (!quit)
+        {
+            if (parser.exception())
+            {
+                logger->error("run_readout_parser_parallel(): parser callback threw an exception, leaving loop");
+                break;
+            }
+
+            auto buffer = filled.dequeue(std::chrono::milliseconds(100), nullptr);
+
+            if (!buffer)
+            {
+                // No new input: make sure the data received so far is parsed.
+                parser.flush();
+                continue;
+            }
+
+            if (buffer->empty())
+            {
+                logger->warn("run_readout_parser_parallel(): got an empty buffer, skipping");
+                empty.enqueue(buffer);
+                continue;
+            }
+
+            try
+            {
+                parser.takeBuffer(*buffer);
+                empty.enqueue(buffer);
+            }
+            catch (...)
+            {
+                empty.enqueue(buffer);
+                throw;
+            }
+        }
+
+        parser.finish();
+    }
+    catch (const std::exception &e)
+    {
+        logger->error("run_readout_parser_parallel() caught an exception: {}", e.what());
+    }
+
+    logger->debug("run_readout_parser_parallel() left loop");
+}
+
+} // end namespace readout_parser
+} // end namespace mvlc
+} // end namespace mesytec
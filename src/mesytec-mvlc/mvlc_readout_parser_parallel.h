@@ -0,0 +1,162 @@
+#ifndef __MESYTEC_MVLC_MVLC_READOUT_PARSER_PARALLEL_H__
+#define __MESYTEC_MVLC_MVLC_READOUT_PARSER_PARALLEL_H__
+
+#include <atomic>
+#include <exception>
+#include <memory>
+
+#include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mesytec-mvlc/mvlc_readout_parser.h"
+#include "mesytec-mvlc/readout_buffer_queues.h"
+#include "mesytec-mvlc/util/protected.h"
+#include "mesytec-mvlc/util/storage_sizes.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace readout_parser
+{
+
+// Multi-threaded readout parser intended for offline processing, e.g. listfile
+// replays.
+//
+// The incoming buffer stream is split into chunks at safe resynchronization
+// points: buffers starting with a fresh 0xF3 StackFrame header while no event
+// can be in progress. For ETH data the first packet of a buffer has to point to
+// such a header. The trailing words of the previous event in front of that
+// header are additionally parsed as part of the previous chunk. Buffers
+// directly following internal buffer loss are also resynchronization points as
+// the parser restarts from scratch in this case.
+//
+// Each chunk is parsed by one of the worker threads using its own copy of the
+// ReadoutParserState. Chunks not starting at a resynchronization point (e.g.
+// after flush() was called in the middle of an event) continue parsing with the
+// final state of the previous chunk.
+//
+// Ordered mode (the default): parsed events and system events are recorded by
+// the workers and the user callbacks are invoked serially, in input order, one
+// chunk at a time. This yields the same callback sequence as the serial
+// parser. The callbacks are invoked from the worker threads, not from the
+// thread calling parseBuffer().
+//
+// Unordered mode: the workers invoke the user callbacks directly while
+// parsing. This avoids recording the event data but the callbacks are invoked
+// concurrently from multiple threads and events of different chunks are
+// interleaved. The callbacks have to be thread-safe.
+//
+// The counters of each chunk are merged into the shared counters object in
+// input order. For intact data the merged counters equal the ones produced by
+// the serial parser. With ETH packet loss or corrupted data the
+// unusedBytes/parseResults accounting of chunk boundary packets may differ
+// slightly.
+
+struct ParallelParserOptions
+{
+    // Number of parser threads. 0 uses std::thread::hardware_concurrency().
+    unsigned workerCount = 0;
+
+    // Deliver events in input order. Set to false to let the workers invoke
+    // the (thread-safe!) callbacks directly.
+    bool ordered = true;
+
+    // Chunks are only split at resynchronization points once they contain at
+    // least this many bytes of input data.
+    size_t minChunkSize = util::Megabytes(4);
+
+    // Maximum number of chunks being buffered or processed at the same time.
+    // 0 uses 2 * workerCount + 1. Limits the memory used by the parser.
+    unsigned maxChunksInFlight = 0;
+};
+
+class MESYTEC_MVLC_EXPORT ParallelReadoutParser
+{
+    public:
+        // The prototype parser state is copied for each chunk. An event in
+        // progress in the prototype is discarded. The callbacks and counters
+        // objects must outlive the parser.
+        ParallelReadoutParser(
+            const ReadoutParserState &prototype,
+            ReadoutParserCallbacks &callbacks,
+            Protected<ReadoutParserCounters> &counters,
+            const ParallelParserOptions &options = {});
+
+        // Waits for all chunks like finish() but does not rethrow a stored
+        // callback exception.
+        ~ParallelReadoutParser();
+
+        ParallelReadoutParser(const ParallelReadoutParser &) = delete;
+        ParallelReadoutParser &operator=(const ParallelReadoutParser &) = delete;
+
+        // Copies the buffer contents into the current chunk. Once a
+        // resynchronization point is reached the chunk is handed to the
+        // workers. Blocks if maxChunksInFlight chunks are being processed.
+        void parseBuffer(ConnectionType bufferType, u32 bufferNumber,
+                         const u32 *buffer, size_t bufferWords);
+
+        void parseBuffer(const ReadoutBuffer &buffer)
+        {
+            auto view = buffer.viewU32();
+            parseBuffer(static_cast<ConnectionType>(buffer.type()),
+                        buffer.bufferNumber(), view.data(), view.size());
+        }
+
+        // Like parseBuffer() but takes over the storage of the buffer instead
+        // of copying the data. The buffer is left empty, holding recycled
+        // storage of the same capacity.
+        void takeBuffer(ReadoutBuffer &buffer);
+
+        // Hands the currently accumulated input data to the workers.
+        void flush();
+
+        // Flushes and waits until all chunks have been parsed and their events
+        // have been delivered. Rethrows the exception thrown by a user
+        // callback, if any.
+        void finish();
+
+        // True if there is no buffered input data and no chunk is in flight.
+        bool idle() const;
+
+        // First exception thrown by a user callback, either during ordered
+        // event delivery or by a worker thread in unordered mode. No more
+        // callbacks are invoked once an exception was caught. Remaining input
+        // is still consumed but not parsed.
+        std::exception_ptr exception() const;
+
+        unsigned workerCount() const;
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+// Driver function equivalent to run_readout_parser() using a
+// ParallelReadoutParser. Buffer storage is taken over by the parser using
+// takeBuffer() and the buffers are returned to the empty queue right away. If
+// no buffer arrives within 100ms the pending input data is flushed to the
+// workers.
+// On quit all input data taken from the queue is parsed and delivered before
+// the function returns. The loop is left early if a parser callback threw, the
+// exception is logged and remains available via parser.exception().
+void MESYTEC_MVLC_EXPORT run_readout_parser_parallel(
+    ParallelReadoutParser &parser,
+    ReadoutBufferQueues &bufferQueues,
+    std::atomic<bool> &quit);
+
+// Returns true if the given buffer is a resynchronization point for the
+// parallel parser. previousBufferNumber and previousPacketNumber (ETH only, -1
+// if unknown) refer to the buffer directly preceding the input buffer. If
+// trailingWords is non-null it is set to the number of ETH payload words in
+// front of the first stack frame header of the buffer. These words belong to
+// the previous event.
+MESYTEC_MVLC_EXPORT bool is_parser_resync_point(
+    ConnectionType bufferType,
+    u32 bufferNumber, const u32 *buffer, size_t bufferWords,
+    u32 previousBufferNumber, s32 previousPacketNumber,
+    size_t *trailingWords = nullptr);
+
+} // end namespace readout_parser
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_MVLC_READOUT_PARSER_PARALLEL_H__ */
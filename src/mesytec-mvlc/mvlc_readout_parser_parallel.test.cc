@@ -0,0 +1,575 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include "mvlc_constants.h"
+#include "mvlc_eth_interface.h"
+#include "mvlc_readout_parser_parallel.h"
+#include "mvlc_readout_parser_util.h"
+#include "mvlc_util.h"
+#include "vme_constants.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::readout_parser;
+
+namespace
+{
+
+std::vector<StackCommandBuilder> make_readout_stacks()
+{
+    StackCommandBuilder readoutStack;
+    readoutStack.beginGroup("module0");
+    readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+    readoutStack.beginGroup("module1");
+    readoutStack.addVMEBlockRead(0, vme_amods::MBLT64, 0xffff);
+
+    return { readoutStack };
+}
+
+// Generates a stream of top level frames: readout events for stack 1 with two
+// block read modules and, if withSystemEvents is set, occasional system
+// events. Every fourth event is split into a StackFrame and a
+// StackContinuation.
+std::vector<u32> generate_frames(size_t eventCount, bool withSystemEvents, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<u32> sizeDist(1, 60);
+    std::vector<u32> result;
+    u32 value = 0;
+
+    auto add_block = [&] (u32 size)
+    {
+        result.push_back(make_frame_header(frame_headers::BlockRead, size));
+        for (u32 i=0; i<size; ++i)
+            result.push_back(value++);
+    };
+
+    for (size_t ei=0; ei<eventCount; ++ei)
+    {
+        if (withSystemEvents && ei % 50 == 25)
+        {
+            result.push_back(make_system_event_header(system_event::subtype::UnixTimetick, 2));
+            result.push_back(value++);
+            result.push_back(value++);
+        }
+
+        u32 size0 = sizeDist(rng);
+        u32 size1 = sizeDist(rng);
+
+        if (ei % 4 == 3)
+        {
+            result.push_back(make_frame_header(frame_headers::StackFrame, size0 + 1, 1, frame_flags::Continue));
+            add_block(size0);
+            result.push_back(make_frame_header(frame_headers::StackContinuation, size1 + 1, 1));
+            add_block(size1);
+        }
+        else
+        {
+            result.push_back(make_frame_header(frame_headers::StackFrame, size0 + size1 + 2, 1));
+            add_block(size0);
+            add_block(size1);
+        }
+    }
+
+    return result;
+}
+
+// Splits the frames into USB buffers on frame boundaries.
+std::vector<std::vector<u32>> make_usb_buffers(const std::vector<u32> &frames, size_t bufferWords)
+{
+    std::vector<std::vector<u32>> result;
+    std::vector<u32> buffer;
+    size_t pos = 0;
+
+    while (pos < frames.size())
+    {
+        size_t frameWords = extract_frame_info(frames[pos]).len + 1;
+        buffer.insert(std::end(buffer), frames.begin() + pos, frames.begin() + pos + frameWords);
+        pos += frameWords;
+
+        if (buffer.size() >= bufferWords || pos >= frames.size())
+            result.emplace_back(std::move(buffer));
+    }
+
+    return result;
+}
+
+// Packs the frames into ETH packets with correct next header pointers. Every
+// seventh buffer starts with a system event.
+std::vector<std::vector<u32>> make_eth_buffers(
+    const std::vector<u32> &frames, size_t packetDataWords, size_t packetsPerBuffer)
+{
+    std::vector<std::vector<u32>> result;
+    std::vector<u32> buffer;
+    size_t nextFrameOffset = 0;
+    size_t pos = 0;
+    size_t packetsInBuffer = 0;
+    u16 packetNumber = 0;
+
+    while (pos < frames.size())
+    {
+        if (packetsInBuffer == 0 && result.size() % 7 == 3)
+        {
+            buffer.push_back(make_system_event_header(system_event::subtype::UnixTimetick, 1));
+            buffer.push_back(0x1234);
+        }
+
+        size_t dataWords = std::min(frames.size() - pos, packetDataWords);
+        u16 headerPointer = eth::header1::NoHeaderPointerPresent;
+
+        while (nextFrameOffset < pos + dataWords)
+        {
+            if (headerPointer == eth::header1::NoHeaderPointerPresent)
+                headerPointer = nextFrameOffset - pos;
+            nextFrameOffset += extract_frame_info(frames[nextFrameOffset]).len + 1;
+        }
+
+        buffer.push_back(eth::make_header0(eth::PacketChannel::Data, packetNumber++, dataWords));
+        buffer.push_back(eth::make_header1(headerPointer));
+        buffer.insert(std::end(buffer), frames.begin() + pos, frames.begin() + pos + dataWords);
+        pos += dataWords;
+
+        if (++packetsInBuffer >= packetsPerBuffer || pos >= frames.size())
+        {
+            result.emplace_back(std::move(buffer));
+            packetsInBuffer = 0;
+        }
+    }
+
+    return result;
+}
+
+// Serializes the callback invocations so that results can be compared.
+struct Recorder
+{
+    std::mutex mutex;
+    std::vector<std::vector<u32>> events;
+
+    ReadoutParserCallbacks callbacks()
+    {
+        ReadoutParserCallbacks result;
+
+        result.eventData = [this] (void *, int crateIndex, int eventIndex,
+                                   const ModuleData *moduleDataList, unsigned moduleCount)
+        {
+            std::vector<u32> event = { 0xeeeeeeee, static_cast<u32>(crateIndex), static_cast<u32>(eventIndex) };
+
+            for (unsigned mi=0; mi<moduleCount; ++mi)
+            {
+                const auto &md = moduleDataList[mi];
+                event.push_back(md.data.size);
+                event.push_back(md.dynamicSize);
+                event.insert(std::end(event), md.data.data, md.data.data + md.data.size);
+            }
+
+            std::lock_guard<std::mutex> guard(mutex);
+            events.emplace_back(std::move(event));
+        };
+
+        result.systemEvent = [this] (void *, int crateIndex, const u32 *header, u32 size)
+        {
+            std::vector<u32> event = { 0x5555555, static_cast<u32>(crateIndex) };
+            event.insert(std::end(event), header, header + size);
+
+            std::lock_guard<std::mutex> guard(mutex);
+            events.emplace_back(std::move(event));
+        };
+
+        return result;
+    }
+};
+
+struct Input
+{
+    ConnectionType type;
+    std::vector<std::vector<u32>> buffers;
+    std::vector<u32> bufferNumbers;
+};
+
+Input make_input(ConnectionType type, std::vector<std::vector<u32>> &&buffers)
+{
+    Input result{ type, std::move(buffers), {} };
+
+    for (size_t i=0; i<result.buffers.size(); ++i)
+        result.bufferNumbers.push_back(i + 1);
+
+    return result;
+}
+
+void parse_serial(const Input &input, Recorder &recorder, ReadoutParserCounters &counters)
+{
+    auto state = make_readout_parser(make_readout_stacks());
+    auto callbacks = recorder.callbacks();
+
+    for (size_t i=0; i<input.buffers.size(); ++i)
+    {
+        const auto &buffer = input.buffers[i];
+        parse_readout_buffer(input.type, state, callbacks, counters,
+                             input.bufferNumbers[i], buffer.data(), buffer.size());
+    }
+}
+
+void parse_parallel(
+    const Input &input, Recorder &recorder, ReadoutParserCounters &countersDest,
+    ParallelParserOptions options, bool flushEachBuffer = false)
+{
+    auto state = make_readout_parser(make_readout_stacks());
+    auto callbacks = recorder.callbacks();
+    Protected<ReadoutParserCounters> counters;
+
+    {
+        ParallelReadoutParser parser(state, callbacks, counters, options);
+
+        for (size_t i=0; i<input.buffers.size(); ++i)
+        {
+            const auto &buffer = input.buffers[i];
+            parser.parseBuffer(input.type, input.bufferNumbers[i], buffer.data(), buffer.size());
+
+            if (flushEachBuffer)
+                parser.flush();
+        }
+
+        parser.finish();
+        ASSERT_TRUE(parser.idle());
+        ASSERT_FALSE(parser.exception());
+    }
+
+    countersDest = counters.copy();
+}
+
+void expect_counters_equal(const ReadoutParserCounters &a, const ReadoutParserCounters &b)
+{
+    EXPECT_EQ(a.internalBufferLoss, b.internalBufferLoss);
+    EXPECT_EQ(a.buffersProcessed, b.buffersProcessed);
+    EXPECT_EQ(a.bytesProcessed, b.bytesProcessed);
+    EXPECT_EQ(a.unusedBytes, b.unusedBytes);
+    EXPECT_EQ(a.ethPacketsProcessed, b.ethPacketsProcessed);
+    EXPECT_EQ(a.ethPacketLoss, b.ethPacketLoss);
+    EXPECT_EQ(a.systemEvents, b.systemEvents);
+    EXPECT_EQ(a.parseResults, b.parseResults);
+    EXPECT_EQ(a.moduleDataCopies, b.moduleDataCopies);
+    EXPECT_EQ(a.moduleDataZeroCopies, b.moduleDataZeroCopies);
+    EXPECT_EQ(a.eventHits, b.eventHits);
+    EXPECT_EQ(a.groupHits, b.groupHits);
+    EXPECT_EQ(a.groupSizes, b.groupSizes);
+}
+
+void compare_ordered(const Input &input, ParallelParserOptions options, bool flushEachBuffer = false)
+{
+    Recorder serial, parallel;
+    ReadoutParserCounters serialCounters, parallelCounters;
+
+    parse_serial(input, serial, serialCounters);
+    parse_parallel(input, parallel, parallelCounters, options, flushEachBuffer);
+
+    ASSERT_GT(serial.events.size(), 0);
+    ASSERT_EQ(serial.events.size(), parallel.events.size());
+    ASSERT_EQ(serial.events, parallel.events);
+    expect_counters_equal(serialCounters, parallelCounters);
+}
+
+}
+
+TEST(readout_parser_parallel, ResyncPointsUSB)
+{
+    std::vector<u32> stackFrame = { make_frame_header(frame_headers::StackFrame, 0, 1) };
+    std::vector<u32> continuation = { make_frame_header(frame_headers::StackContinuation, 0, 1) };
+    std::vector<u32> sysEventThenStackFrame =
+    {
+        make_system_event_header(system_event::subtype::UnixTimetick, 1), 0,
+        make_frame_header(frame_headers::StackFrame, 0, 1),
+    };
+
+    auto is_resync = [] (const std::vector<u32> &buffer, u32 bufferNumber = 2)
+    {
+        return is_parser_resync_point(ConnectionType::USB, bufferNumber,
+                                      buffer.data(), buffer.size(), 1, -1);
+    };
+
+    ASSERT_TRUE(is_resync(stackFrame));
+    ASSERT_FALSE(is_resync(continuation));
+    ASSERT_TRUE(is_resync(sysEventThenStackFrame));
+    // Internal buffer loss
+    ASSERT_TRUE(is_resync(continuation, 3));
+}
+
+TEST(readout_parser_parallel, ResyncPointsETH)
+{
+    const u32 f3 = make_frame_header(frame_headers::StackFrame, 1, 1);
+    const u32 f9 = make_frame_header(frame_headers::StackContinuation, 1, 1);
+    size_t trailingWords = 0;
+
+    auto is_resync = [&trailingWords] (const std::vector<u32> &buffer, s32 previousPacketNumber = 9)
+    {
+        return is_parser_resync_point(ConnectionType::ETH, 2, buffer.data(), buffer.size(),
+                                      1, previousPacketNumber, &trailingWords);
+    };
+
+    // Packet starting with a stack frame.
+    ASSERT_TRUE(is_resync({ eth::make_header0(eth::PacketChannel::Data, 10, 2), eth::make_header1(0), f3, 0 }));
+    ASSERT_EQ(trailingWords, 0);
+
+    // Two trailing words of the previous event in front of the stack frame.
+    ASSERT_TRUE(is_resync({ eth::make_header0(eth::PacketChannel::Data, 10, 4), eth::make_header1(2), 0, 0, f3, 0 }));
+    ASSERT_EQ(trailingWords, 2);
+
+    // Same but with packet loss in front of the packet: nothing to complete.
+    ASSERT_TRUE(is_resync({ eth::make_header0(eth::PacketChannel::Data, 12, 4), eth::make_header1(2), 0, 0, f3, 0 }));
+    ASSERT_EQ(trailingWords, 0);
+
+    // Continuation frame or no header at all.
+    ASSERT_FALSE(is_resync({ eth::make_header0(eth::PacketChannel::Data, 10, 2), eth::make_header1(0), f9, 0 }));
+    ASSERT_FALSE(is_resync({ eth::make_header0(eth::PacketChannel::Data, 10, 2),
+                             eth::make_header1(eth::header1::NoHeaderPointerPresent), 0, 0 }));
+
+    // System event followed by a packet with trailing words.
+    ASSERT_FALSE(is_resync({ make_system_event_header(system_event::subtype::UnixTimetick, 1), 0,
+                             eth::make_header0(eth::PacketChannel::Data, 10, 4), eth::make_header1(2), 0, 0, f3, 0 }));
+}
+
+TEST(readout_parser_parallel, OrderedMatchesSerialUSB)
+{
+    std::mt19937 rng(1);
+    auto input = make_input(ConnectionType::USB, make_usb_buffers(generate_frames(5000, true, rng), 256));
+
+    ParallelParserOptions options;
+    options.workerCount = 4;
+    options.minChunkSize = 0;
+
+    compare_ordered(input, options);
+
+    options.minChunkSize = util::Kilobytes(8);
+    compare_ordered(input, options);
+}
+
+TEST(readout_parser_parallel, OrderedMatchesSerialETH)
+{
+    std::mt19937 rng(2);
+    auto input = make_input(ConnectionType::ETH, make_eth_buffers(generate_frames(5000, false, rng), 100, 3));
+
+    ParallelParserOptions options;
+    options.workerCount = 4;
+    options.minChunkSize = 0;
+
+    compare_ordered(input, options);
+
+    options.minChunkSize = util::Kilobytes(8);
+    compare_ordered(input, options);
+}
+
+TEST(readout_parser_parallel, OrderedMatchesSerialZeroCopy)
+{
+    std::mt19937 rng(3);
+    auto input = make_input(ConnectionType::ETH, make_eth_buffers(generate_frames(2000, false, rng), 100, 3));
+
+    Recorder serial, parallel;
+    ReadoutParserCounters serialCounters, parallelCounters;
+
+    {
+        auto state = make_readout_parser(make_readout_stacks());
+        state.zeroCopy = true;
+        auto callbacks = serial.callbacks();
+
+        for (size_t i=0; i<input.buffers.size(); ++i)
+            parse_readout_buffer(input.type, state, callbacks, serialCounters,
+                                 input.bufferNumbers[i], input.buffers[i].data(), input.buffers[i].size());
+    }
+
+    {
+        auto state = make_readout_parser(make_readout_stacks());
+        state.zeroCopy = true;
+        auto callbacks = parallel.callbacks();
+        Protected<ReadoutParserCounters> counters;
+        ParallelParserOptions options;
+        options.workerCount = 3;
+        options.minChunkSize = 0;
+
+        ParallelReadoutParser parser(state, callbacks, counters, options);
+
+        for (size_t i=0; i<input.buffers.size(); ++i)
+            parser.parseBuffer(input.type, input.bufferNumbers[i], input.buffers[i].data(), input.buffers[i].size());
+
+        parser.finish();
+        parallelCounters = counters.copy();
+    }
+
+    ASSERT_EQ(serial.events, parallel.events);
+    expect_counters_equal(serialCounters, parallelCounters);
+}
+
+// Flushing after each buffer forces chunks to start in the middle of events.
+// These have to continue with the state of the previous chunk.
+TEST(readout_parser_parallel, FlushInsideEvents)
+{
+    ParallelParserOptions options;
+    options.workerCount = 4;
+    options.minChunkSize = util::Megabytes(1);
+
+    std::mt19937 rng(4);
+    compare_ordered(
+        make_input(ConnectionType::USB, make_usb_buffers(generate_frames(2000, true, rng), 100)),
+        options, true);
+    compare_ordered(
+        make_input(ConnectionType::ETH, make_eth_buffers(generate_frames(2000, false, rng), 50, 2)),
+        options, true);
+}
+
+TEST(readout_parser_parallel, Unordered)
+{
+    std::mt19937 rng(5);
+    auto input = make_input(ConnectionType::ETH, make_eth_buffers(generate_frames(5000, false, rng), 100, 3));
+
+    Recorder serial, parallel;
+    ReadoutParserCounters serialCounters, parallelCounters;
+
+    ParallelParserOptions options;
+    options.workerCount = 4;
+    options.minChunkSize = 0;
+    options.ordered = false;
+
+    parse_serial(input, serial, serialCounters);
+    parse_parallel(input, parallel, parallelCounters, options);
+
+    std::sort(std::begin(serial.events), std::end(serial.events));
+    std::sort(std::begin(parallel.events), std::end(parallel.events));
+
+    ASSERT_EQ(serial.events, parallel.events);
+    expect_counters_equal(serialCounters, parallelCounters);
+}
+
+// Dropped buffers and ETH packets: the same events have to be produced.
+TEST(readout_parser_parallel, LossyInput)
+{
+    std::mt19937 rng(6);
+    auto ethBuffers = make_eth_buffers(generate_frames(5000, false, rng), 100, 3);
+
+    // Drop every 13th packet by removing it from its buffer.
+    size_t packetIndex = 0;
+
+    for (auto &buffer: ethBuffers)
+    {
+        std::vector<u32> dest;
+        size_t pos = 0;
+
+        while (pos < buffer.size())
+        {
+            size_t partWords = get_frame_type(buffer[pos]) == frame_headers::SystemEvent
+                ? extract_frame_info(buffer[pos]).len + 1
+                : eth::HeaderWords + eth::PayloadHeaderInfo{ buffer[pos], buffer[pos + 1] }.dataWordCount();
+
+            if (get_frame_type(buffer[pos]) == frame_headers::SystemEvent || ++packetIndex % 13 != 0)
+                dest.insert(std::end(dest), buffer.begin() + pos, buffer.begin() + pos + partWords);
+
+            pos += partWords;
+        }
+
+        buffer = std::move(dest);
+    }
+
+    auto input = make_input(ConnectionType::ETH, std::move(ethBuffers));
+
+    // Internal buffer loss.
+    for (size_t i=0; i<input.bufferNumbers.size(); ++i)
+        input.bufferNumbers[i] += i / 20;
+
+    Recorder serial, parallel;
+    ReadoutParserCounters serialCounters, parallelCounters;
+
+    ParallelParserOptions options;
+    options.workerCount = 4;
+    options.minChunkSize = 0;
+
+    parse_serial(input, serial, serialCounters);
+    parse_parallel(input, parallel, parallelCounters, options);
+
+    ASSERT_EQ(serial.events, parallel.events);
+    EXPECT_EQ(serialCounters.internalBufferLoss, parallelCounters.internalBufferLoss);
+    EXPECT_EQ(serialCounters.ethPacketLoss, parallelCounters.ethPacketLoss);
+    EXPECT_EQ(serialCounters.eventHits, parallelCounters.eventHits);
+    EXPECT_EQ(serialCounters.buffersProcessed, parallelCounters.buffersProcessed);
+}
+
+TEST(readout_parser_parallel, RunDriver)
+{
+    std::mt19937 rng(7);
+    auto input = make_input(ConnectionType::USB, make_usb_buffers(generate_frames(2000, true, rng), 256));
+
+    Recorder serial, parallel;
+    ReadoutParserCounters serialCounters;
+    parse_serial(input, serial, serialCounters);
+
+    auto state = make_readout_parser(make_readout_stacks());
+    auto callbacks = parallel.callbacks();
+    Protected<ReadoutParserCounters> counters;
+    ReadoutBufferQueues queues(util::Kilobytes(4), 4);
+    std::atomic<bool> quit(false);
+
+    ParallelParserOptions options;
+    options.workerCount = 2;
+    options.minChunkSize = 0;
+
+    ParallelReadoutParser parser(state, callbacks, counters, options);
+    std::thread parserThread(run_readout_parser_parallel, std::ref(parser), std::ref(queues), std::ref(quit));
+
+    for (size_t i=0; i<input.buffers.size(); ++i)
+    {
+        auto buffer = queues.emptyBufferQueue().dequeue_blocking();
+        buffer->clear();
+        buffer->setType(ConnectionType::USB);
+        buffer->setBufferNumber(input.bufferNumbers[i]);
+
+        for (u32 word: input.buffers[i])
+            buffer->push_back(word);
+
+        queues.filledBufferQueue().enqueue(buffer);
+    }
+
+    while (!queues.filledBufferQueue().empty())
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    quit = true;
+    parserThread.join();
+
+    ASSERT_TRUE(parser.idle());
+    ASSERT_EQ(serial.events, parallel.events);
+    expect_counters_equal(serialCounters, counters.copy());
+}
+
+// A throwing callback must not terminate the process. The exception is stored
+// and rethrown by finish() in both delivery modes.
+TEST(readout_parser_parallel, CallbackException)
+{
+    std::mt19937 rng(8);
+    auto input = make_input(ConnectionType::USB, make_usb_buffers(generate_frames(2000, true, rng), 256));
+
+    for (bool ordered: { true, false })
+    {
+        auto state = make_readout_parser(make_readout_stacks());
+        Protected<ReadoutParserCounters> counters;
+        std::atomic<unsigned> calls(0);
+
+        ReadoutParserCallbacks callbacks;
+        callbacks.eventData = [&calls] (void *, int, int, const ModuleData *, unsigned)
+        {
+            if (++calls == 100)
+                throw std::runtime_error("callback error");
+        };
+        callbacks.systemEvent = [] (void *, int, const u32 *, u32) {};
+
+        ParallelParserOptions options;
+        options.workerCount = 4;
+        options.minChunkSize = 0;
+        options.ordered = ordered;
+
+        ParallelReadoutParser parser(state, callbacks, counters, options);
+
+        for (size_t i=0; i<input.buffers.size(); ++i)
+        {
+            const auto &buffer = input.buffers[i];
+            parser.parseBuffer(input.type, input.bufferNumbers[i], buffer.data(), buffer.size());
+        }
+
+        ASSERT_THROW(parser.finish(), std::runtime_error);
+        ASSERT_TRUE(parser.idle());
+        ASSERT_TRUE(parser.exception());
+    }
+}
@@ -4,6 +4,7 @@
 #include <sys/prctl.h>
 #endif
 
+#include <algorithm>
 #include <iostream>
 
 #include "util/fmt.h"
@@ -34,6 +35,22 @@ void run_readout_parser(
     auto &filled = bufferQueues.filledBufferQueue();
     auto &empty = bufferQueues.emptyBufferQueue();
 
+    // The parser updates local counters which are merged into the shared
+    // counters after each buffer. This way the shared counters are only locked
+    // for the duration of the merge, not for the whole parse_readout_buffer()
+    // call, and changes made to them by other threads, e.g. a reset, are not
+    // overwritten. Resetting via assignment from zeroCounters keeps the
+    // allocated vectors.
+    ReadoutParserCounters localCounters;
+    resize_counters(localCounters, state.readoutStructure);
+    const auto zeroCounters = localCounters;
+
+    auto publish_counters = [&]
+    {
+        merge_counters(counters.access().ref(), localCounters);
+        localCounters = zeroCounters;
+    };
+
     try
     {
         logger->debug("run_readout_parser() entering loop");
@@ -69,17 +86,19 @@ void run_readout_parser(
                     static_cast<ConnectionType>(buffer->type()),
                     state,
                     parserCallbacks,
-                    counters.access().ref(),
+                    localCounters,
                     buffer->bufferNumber(),
                     bufferView.data(),
                     bufferView.size());
 
                 empty.enqueue(buffer);
+                publish_counters();
             }
             catch (...)
             {
                 logger->warn("run_readout_parser(): caught an exception; rethrowing");
                 empty.enqueue(buffer);
+                publish_counters();
                 throw;
             }
         }
@@ -98,42 +117,112 @@ void run_readout_parser(
     logger->debug("run_readout_parser() left loop");
 }
 
+void merge_counters(ReadoutParserCounters &dest, const ReadoutParserCounters &src)
+{
+    dest.internalBufferLoss += src.internalBufferLoss;
+    dest.buffersProcessed += src.buffersProcessed;
+    dest.bytesProcessed += src.bytesProcessed;
+    dest.unusedBytes += src.unusedBytes;
+    dest.ethPacketsProcessed += src.ethPacketsProcessed;
+    dest.ethPacketLoss += src.ethPacketLoss;
+
+    for (size_t i=0; i<dest.systemEvents.size(); ++i)
+        dest.systemEvents[i] += src.systemEvents[i];
+
+    for (size_t i=0; i<dest.parseResults.size(); ++i)
+        dest.parseResults[i] += src.parseResults[i];
+
+    dest.parserExceptions += src.parserExceptions;
+    dest.emptyStackFrames += src.emptyStackFrames;
+    dest.moduleDataCopies += src.moduleDataCopies;
+    dest.moduleDataZeroCopies += src.moduleDataZeroCopies;
+
+    if (dest.eventHits.size() < src.eventHits.size())
+        dest.eventHits.resize(src.eventHits.size());
+
+    for (size_t ei=0; ei<src.eventHits.size(); ++ei)
+        dest.eventHits[ei] += src.eventHits[ei];
+
+    if (dest.groupHits.size() < src.groupHits.size())
+        dest.groupHits.resize(src.groupHits.size());
+
+    for (size_t ei=0; ei<src.groupHits.size(); ++ei)
+    {
+        auto &destHits = dest.groupHits[ei];
+        const auto &srcHits = src.groupHits[ei];
+
+        if (destHits.size() < srcHits.size())
+            destHits.resize(srcHits.size());
+
+        for (size_t mi=0; mi<srcHits.size(); ++mi)
+            destHits[mi] += srcHits[mi];
+    }
+
+    if (dest.groupSizes.size() < src.groupSizes.size())
+        dest.groupSizes.resize(src.groupSizes.size());
+
+    for (size_t ei=0; ei<src.groupSizes.size(); ++ei)
+    {
+        auto &destSizes = dest.groupSizes[ei];
+        const auto &srcSizes = src.groupSizes[ei];
+
+        if (destSizes.size() < srcSizes.size())
+            destSizes.resize(srcSizes.size());
+
+        for (size_t mi=0; mi<srcSizes.size(); ++mi)
+        {
+            auto &sizes = destSizes[mi];
+            sizes.min = std::min(sizes.min, srcSizes[mi].min);
+            sizes.max = std::max(sizes.max, srcSizes[mi].max);
+            sizes.sum += srcSizes[mi].sum;
+        }
+    }
+}
+
 std::ostream &print_counters(std::ostream &out, const ReadoutParserCounters &counters)
 {
     auto print_hits_and_sizes = [&out] (
         const ReadoutParserCounters::GroupPartHits &hits,
         const ReadoutParserCounters::GroupPartSizes &sizes)
     {
-        if (!hits.empty())
-        {
-            out << "module hits: ";
+        out << "module hits: ";
 
-            for (const auto &kv: hits)
+        for (size_t ei=0; ei<hits.size(); ++ei)
+        {
+            for (size_t mi=0; mi<hits[ei].size(); ++mi)
             {
-                out << fmt::format(
-                    "eventIndex={}, group/moduleIndex={}, hits={}; ",
-                    kv.first.first, kv.first.second, kv.second);
+                if (hits[ei][mi])
+                {
+                    out << fmt::format(
+                        "eventIndex={}, group/moduleIndex={}, hits={}; ",
+                        ei, mi, hits[ei][mi]);
+                }
             }
-
-            out << endl;
         }
 
-        if (!sizes.empty())
-        {
-            out << "module data sizes: ";
+        out << endl;
 
-            for (const auto &kv: sizes)
+        out << "module data sizes: ";
+
+        for (size_t ei=0; ei<sizes.size() && ei<hits.size(); ++ei)
+        {
+            for (size_t mi=0; mi<sizes[ei].size() && mi<hits[ei].size(); ++mi)
             {
-                out << fmt::format(
-                    "eventIndex={}, group/moduleIndex={}, min={}, max={}, avg={:.2f}; ",
-                    kv.first.first, kv.first.second,
-                    kv.second.min,
-                    kv.second.max,
-                    kv.second.sum / static_cast<double>(hits.at(kv.first)));
+                if (hits[ei][mi])
+                {
+                    const auto &sizeInfo = sizes[ei][mi];
+
+                    out << fmt::format(
+                        "eventIndex={}, group/moduleIndex={}, min={}, max={}, avg={:.2f}; ",
+                        ei, mi,
+                        sizeInfo.min,
+                        sizeInfo.max,
+                        sizeInfo.sum / static_cast<double>(hits[ei][mi]));
+                }
             }
-
-            out << endl;
         }
+
+        out << endl;
     };
 
     out << "internalBufferLoss=" << counters.internalBufferLoss << endl;
@@ -169,10 +258,15 @@ std::ostream &print_counters(std::ostream &out, const ReadoutParserCounters &cou
 
     out << "parserExceptions=" << counters.parserExceptions << endl;
     out << "emptyStackFrames=" << counters.emptyStackFrames << endl;
+    out << "moduleDataCopies=" << counters.moduleDataCopies << endl;
+    out << "moduleDataZeroCopies=" << counters.moduleDataZeroCopies << endl;
 
     out << "eventHits: ";
-    for (const auto &kv: counters.eventHits)
-        out << fmt::format("ei={}, hits={}, ", kv.first, kv.second);
+    for (size_t ei=0; ei<counters.eventHits.size(); ++ei)
+    {
+        if (counters.eventHits[ei])
+            out << fmt::format("ei={}, hits={}, ", ei, counters.eventHits[ei]);
+    }
     out << endl;
 
     print_hits_and_sizes(counters.groupHits, counters.groupSizes);
@@ -37,6 +37,11 @@ void MESYTEC_MVLC_EXPORT run_readout_parser(
     readout_parser::ReadoutParserCallbacks &parserCallbacks,
     std::atomic<bool> &quit);
 
+// Adds the counter values from src to dest. Used to combine the counters of
+// multiple parser instances, e.g. from the ParallelReadoutParser workers.
+MESYTEC_MVLC_EXPORT void merge_counters(
+    ReadoutParserCounters &dest, const ReadoutParserCounters &src);
+
 MESYTEC_MVLC_EXPORT std::ostream &print_counters(
     std::ostream &out, const ReadoutParserCounters &counters);
 
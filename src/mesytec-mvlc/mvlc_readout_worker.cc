@@ -74,6 +74,7 @@
 #include "mvlc_dialog_util.h"
 #include "mvlc_eth_interface.h"
 #include "mvlc_factory.h"
+#include "mvlc_frame_scan.h"
 #include "mvlc_listfile_util.h"
 #include "mvlc_usb_interface.h"
 #include "util/fmt.h"
@@ -193,9 +194,16 @@ ReadoutInitResults MESYTEC_MVLC_EXPORT init_readout(
     return ret;
 }
 
-void MESYTEC_MVLC_EXPORT listfile_buffer_writer(
+namespace
+{
+
+// Writer loop implementation. Templated on the buffer queues type so that the
+// ReadoutWorker can use lock-free SPSC queues internally while
+// listfile_buffer_writer() keeps working with the default ReadoutBufferQueues.
+template<typename BufferQueues>
+void listfile_buffer_writer_impl(
     listfile::WriteHandle *lfh,
-    ReadoutBufferQueues &bufferQueues,
+    BufferQueues &bufferQueues,
     Protected<ListfileWriterCounters> &protectedState)
 {
 #ifdef __linux__
@@ -291,6 +299,16 @@ void MESYTEC_MVLC_EXPORT listfile_buffer_writer(
                  writes, bytesWritten);
 }
 
+} // end anon namespace
+
+void MESYTEC_MVLC_EXPORT listfile_buffer_writer(
+    listfile::WriteHandle *lfh,
+    ReadoutBufferQueues &bufferQueues,
+    Protected<ListfileWriterCounters> &protectedState)
+{
+    listfile_buffer_writer_impl(lfh, bufferQueues, protectedState);
+}
+
 namespace
 {
 
@@ -476,19 +494,30 @@ struct ReadoutWorker::Private
     eth::MVLC_ETH_Interface *mvlcETH = nullptr;
     usb::MVLC_USB_Interface *mvlcUSB = nullptr;
     ReadoutBufferQueues *snoopQueues = nullptr;
+    SnoopFanout *snoopFanout = nullptr;
     std::vector<u32> stackTriggers;
     StackCommandBuilder mcstDaqStart;
     StackCommandBuilder mcstDaqStop;
     unsigned mcstMaxTries = 3;
     Protected<Counters> counters;
     std::thread readoutThread;
-    ReadoutBufferQueues listfileQueues;
+    // Single producer (the readout thread) and single consumer (the listfile
+    // writer thread) for both the filled and the empty queue.
+    SPSCReadoutBufferQueues listfileQueues;
     std::shared_ptr<listfile::WriteHandle> lfh;
     ReadoutBuffer localBuffer;
     ReadoutBuffer previousData;
     ReadoutBuffer *outputBuffer_ = nullptr;
     u32 nextOutputBufferNumber = 1u;
 
+    // Optional dedicated eth receiver thread. The readout loop holds on to a
+    // partially consumed batch if the current output buffer is full.
+    bool ethReceiverEnabled = false;
+    eth::PacketReceiverOptions ethReceiverOptions;
+    std::unique_ptr<eth::PacketReceiver> ethReceiver;
+    eth::PacketBatch *ethBatch = nullptr;
+    size_t ethBatchIndex = 0u;
+
     std::shared_ptr<spdlog::logger> logger;
     std::vector<std::shared_ptr<ReadoutLoopPlugin>> plugins_;
     std::shared_ptr<ReadoutDurationPlugin> runDurationPlugin_;
@@ -528,7 +557,9 @@ struct ReadoutWorker::Private
     {
         if (!outputBuffer_)
         {
-            if (snoopQueues)
+            if (snoopFanout)
+                outputBuffer_ = snoopFanout->getEmptyBuffer();
+            else if (snoopQueues)
                 outputBuffer_ = snoopQueues->emptyBufferQueue().dequeue();
 
             if (!outputBuffer_)
@@ -546,8 +577,13 @@ struct ReadoutWorker::Private
     {
         if (outputBuffer_ && outputBuffer_ != &localBuffer)
         {
-            assert(snoopQueues);
-            snoopQueues->emptyBufferQueue().enqueue(outputBuffer_);
+            if (snoopFanout)
+                snoopFanout->putBackUnused(outputBuffer_);
+            else
+            {
+                assert(snoopQueues);
+                snoopQueues->emptyBufferQueue().enqueue(outputBuffer_);
+            }
         }
 
         outputBuffer_ = nullptr;
@@ -564,11 +600,20 @@ struct ReadoutWorker::Private
 
             if (outputBuffer_ != &localBuffer)
             {
-                assert(snoopQueues);
-                snoopQueues->filledBufferQueue().enqueue(outputBuffer_);
+                if (snoopFanout)
+                    snoopFanout->publish(outputBuffer_);
+                else
+                {
+                    assert(snoopQueues);
+                    snoopQueues->filledBufferQueue().enqueue(outputBuffer_);
+                }
             }
             else
+            {
+                if (snoopFanout)
+                    snoopFanout->publishMissed();
                 counters.access()->snoopMissedBuffers++;
+            }
 
             counters.access()->buffersFlushed++;
             outputBuffer_ = nullptr;
@@ -582,6 +627,11 @@ struct ReadoutWorker::Private
     std::error_code readout(size_t &bytesTransferred);
     std::error_code readout_usb(usb::MVLC_USB_Interface *mvlcUSB, size_t &bytesTransferred);
     std::error_code readout_eth(eth::MVLC_ETH_Interface *mvlcETH, size_t &bytesTransferred);
+    std::error_code readout_eth_receiver(size_t &bytesTransferred);
+    std::error_code appendEthPacket(ReadoutBuffer &destBuffer, eth::PacketReadResult &result,
+                                    StackHits &stackHits, size_t &totalBytesTransferred);
+    void updateEthCounters(const StackHits &stackHits);
+    void stopEthReceiver();
 
     bool registerPlugin(std::shared_ptr<ReadoutLoopPlugin> plugin)
     {
@@ -690,6 +740,39 @@ unsigned ReadoutWorker::getMcstMaxTries() const
     return d->mcstMaxTries;
 }
 
+bool ReadoutWorker::setEthPacketReceiverEnabled(bool enable, const eth::PacketReceiverOptions &options)
+{
+    auto stateAccess = d->state.access();
+
+    if (stateAccess.ref() != State::Idle)
+        return false;
+
+    d->ethReceiverEnabled = enable;
+    d->ethReceiverOptions = options;
+    return true;
+}
+
+bool ReadoutWorker::isEthPacketReceiverEnabled() const
+{
+    return d->ethReceiverEnabled;
+}
+
+bool ReadoutWorker::setSnoopFanout(SnoopFanout *fanout)
+{
+    auto stateAccess = d->state.access();
+
+    if (stateAccess.ref() != State::Idle)
+        return false;
+
+    d->snoopFanout = fanout;
+    return true;
+}
+
+SnoopFanout *ReadoutWorker::snoopFanout()
+{
+    return d->snoopFanout;
+}
+
 void ReadoutWorker::Private::loop(std::promise<std::error_code> promise)
 {
 #ifdef __linux__
@@ -719,6 +802,15 @@ void ReadoutWorker::Private::loop(std::promise<std::error_code> promise)
                 setState(State::Idle);
                 return;
             }
+
+            if (ethReceiverEnabled)
+            {
+                logger->info("Using the dedicated eth packet receiver thread (batchCount={}, cpu={})",
+                             ethReceiverOptions.batchCount, ethReceiverOptions.cpu);
+                ethReceiver = std::make_unique<eth::PacketReceiver>(
+                    mvlcETH, &mvlc.getLocks().dataMutex(), ethReceiverOptions);
+                ethReceiver->start();
+            }
             break;
 
         case ConnectionType::USB:
@@ -736,7 +828,7 @@ void ReadoutWorker::Private::loop(std::promise<std::error_code> promise)
     Protected<ListfileWriterCounters> writerCounters;
 
     auto writerThread = std::thread(
-        listfile_buffer_writer,
+        listfile_buffer_writer_impl<SPSCReadoutBufferQueues>,
         lfh.get(),
         std::ref(listfileQueues),
         std::ref(writerCounters));
@@ -891,6 +983,8 @@ void ReadoutWorker::Private::loop(std::promise<std::error_code> promise)
 
     logger->debug("terminateReadout() took {}ms to complete", terminateDuration.count());
 
+    stopEthReceiver();
+
     // Invoke readoutStop() on the plugins
     {
         listfile::ReadoutBufferWriteHandle wh(*getOutputBuffer());
@@ -1165,15 +1259,6 @@ std::error_code ReadoutWorker::Private::terminateReadout()
     return ec;
 }
 
-// Note: in addition to stack frames this includes SystemEvent frames. These
-// are written into the readout buffers by the listfile_write_* functions.
-inline bool is_valid_readout_frame(const FrameInfo &frameInfo)
-{
-    return (frameInfo.type == frame_headers::StackFrame
-            || frameInfo.type == frame_headers::StackContinuation
-            || frameInfo.type == frame_headers::SystemEvent);
-}
-
 // Ensure that the readBuffer contains only complete frames. In other words: if
 // a frame starts then it should fully fit into the readBuffer. Trailing data
 // is moved to the tempBuffer.
@@ -1182,88 +1267,81 @@ inline bool is_valid_readout_frame(const FrameInfo &frameInfo)
 // frame is found at the end of the buffer move the trailing bytes to the
 // tempBuffer and shrink the readBuffer accordingly.
 //
-// Note that invalid data words (ones that do not pass
-// is_valid_readout_frame()) are just skipped and left in the buffer without
+// Note that invalid data words (ones that are not headers of one of the
+// frame_scan::readout_frame_types()) are skipped using
+// frame_scan::find_frame_header() and left in the buffer without
 // modification. This has to be taken into account on the analysis side.
-// TODO: replace with fixup_buffer() from mvlc_util.h (it cannot count framing errors! :<)
+//
+// Counters are accumulated locally and published once per buffer.
 inline void fixup_usb_buffer(
     ReadoutBuffer &readBuffer,
     ReadoutBuffer &tempBuffer,
     Protected<ReadoutWorker::Counters> &counters)
 {
-    auto view = readBuffer.viewU8();
+    static const auto readoutTypes = frame_scan::readout_frame_types();
 
-    while (!view.empty())
+    auto view = readBuffer.viewU32();
+    const u32 *pos = view.data();
+    const u32 *end = pos + view.size();
+
+    size_t framingErrors = 0u;
+    StackHits stackHits = {};
+
+    while (pos < end)
     {
-        if (view.size() >= sizeof(u32))
+        if (!frame_scan::frame_type_matches(*pos, readoutTypes))
         {
-            FrameInfo frameInfo = {};
-            u32 frameHeader = 0u;
+            // Unexpected or invalid frame type. This should not happen if the
+            // incoming MVLC data and the readout code are correct. Skip to the
+            // next plausible frame header.
+            const u32 *next = frame_scan::find_frame_header(pos + 1, end, readoutTypes);
+            framingErrors += next - pos;
 
-            while (view.size() >= sizeof(u32))
+            if (next == end)
             {
-                // Can peek and check the next frame header
-                frameHeader = *reinterpret_cast<const u32 *>(&view[0]);
-                frameInfo = extract_frame_info(frameHeader);
+                auto logger = get_logger("readout_worker");
+                logger->warn("usb: invalid readout frame: frameHeader=0x{:08x}", *pos);
+            }
 
-                if (is_valid_readout_frame(frameInfo))
-                    break;
+            pos = next;
+            continue;
+        }
 
-#if 0
-                auto offset = &view[0] - readBuffer.data();
-                auto wordOffset = offset / sizeof(u32);
-
-                std::cout << fmt::format(
-                    "!is_valid_readout_frame: buffer #{},  byteOffset={}, "
-                    "wordOffset={}, frameHeader=0x{:008x}",
-                    readBuffer.bufferNumber(),
-                    offset, wordOffset, frameHeader) << std::endl;
-#endif
-                counters.access()->usbFramingErrors++;
-
-                // Unexpected or invalid frame type. This should not happen
-                // if the incoming MVLC data and the readout code are
-                // correct.
-                // Consume the invalid frame header word and try again with the
-                // next word.
-                view.remove_prefix(sizeof(u32));
-            }
+        auto frameInfo = extract_frame_info(*pos);
 
-            if (!is_valid_readout_frame(frameInfo))
-            {
-                auto logger = get_logger("readout_worker");
-                logger->warn("usb: invalid readout frame: frameHeader=0x{:08x}", frameHeader);
+        // Check if the full frame including the header is in the
+        // readBuffer. If not stop and move the trailing data to the
+        // tempBuffer.
+        if (frameInfo.len + 1u > static_cast<size_t>(end - pos))
+            break;
 
-                // The above loop was not able to find a valid readout frame.
-                // Go to the top of the outer loop and let that handle any
-                // possible leftover bytes on the next iteration.
-                continue;
-            }
+        if (frameInfo.type == frame_headers::StackFrame
+            || frameInfo.type == frame_headers::StackContinuation)
+        {
+            ++stackHits[frameInfo.stack];
+        }
 
-            // Check if the full frame including the header is in the
-            // readBuffer. If not move the trailing data to the tempBuffer.
-            if ((frameInfo.len + 1u) * sizeof(u32) > view.size())
-            {
-                std::memcpy(
-                    tempBuffer.data(),
-                    view.data(),
-                    view.size());
-                tempBuffer.setUsed(view.size());
-                readBuffer.setUsed(readBuffer.used() - view.size());
-                counters.access()->usbTempMovedBytes += view.size();
-                return;
-            }
+        // Skip over the frameHeader and the frame contents.
+        pos += frameInfo.len + 1;
+    }
 
-            if (frameInfo.type == frame_headers::StackFrame
-                || frameInfo.type == frame_headers::StackContinuation)
-            {
-                ++counters.access()->stackHits[frameInfo.stack];
-            }
+    // Move the incomplete frame and any trailing partial word.
+    const u8 *tail = reinterpret_cast<const u8 *>(pos);
+    const size_t tailBytes = (readBuffer.data() + readBuffer.used()) - tail;
 
-            // Skip over the frameHeader and the frame contents.
-            view.remove_prefix((frameInfo.len + 1) * sizeof(u32));
-        }
+    if (tailBytes)
+    {
+        std::memcpy(tempBuffer.data(), tail, tailBytes);
+        tempBuffer.setUsed(tailBytes);
+        readBuffer.setUsed(readBuffer.used() - tailBytes);
     }
+
+    auto ca = counters.access();
+    ca->usbFramingErrors += framingErrors;
+    ca->usbTempMovedBytes += tailBytes;
+
+    for (size_t i=0; i<stackHits.size(); ++i)
+        ca->stackHits[i] += stackHits[i];
 }
 
 static const std::chrono::milliseconds FlushBufferTimeout(500);
@@ -1285,6 +1363,8 @@ std::error_code ReadoutWorker::Private::readout(size_t &bytesTransferred)
 
     if (mvlcUSB)
         ec = readout_usb(mvlcUSB, bytesTransferred);
+    else if (ethReceiver)
+        ec = readout_eth_receiver(bytesTransferred);
     else
         ec = readout_eth(mvlcETH, bytesTransferred);
 
@@ -1398,57 +1478,45 @@ std::error_code ReadoutWorker::Private::readout_eth(
     auto destBuffer = getOutputBuffer();
     std::error_code ec;
     std::array<size_t, stacks::StackCount> stackHits = {};
+    std::array<eth::PacketReadResult, eth::ReadPacketsMaxBatchSize> packetResults;
 
     {
         auto dataGuard = mvlc.getLocks().lockData();
 
         while (destBuffer->free() >= eth::JumboFrameMaxSize)
         {
-            auto result = mvlcETH->read_packet(
+            // Receive a batch of packets. Each packet is placed into its own
+            // slot of size ReadPacketsSlotSize in the free space of the
+            // destBuffer.
+            const size_t packetCount = mvlcETH->read_packets(
                 Pipe::Data,
                 destBuffer->data() + destBuffer->used(),
-                destBuffer->free());
+                destBuffer->free(),
+                packetResults.data(),
+                packetResults.size());
 
-            ec = result.ec;
-            destBuffer->use(result.bytesTransferred);
-            totalBytesTransferred += result.bytesTransferred;
+            for (size_t packetIndex=0; packetIndex<packetCount; ++packetIndex)
+            {
+                auto &result = packetResults[packetIndex];
 
 #if 0
-            if (this->firstPacketDebugDump)
-            {
-                cout << "first received readout eth packet:" << endl;
-                cout << fmt::format("header0=0x{:08x}", result.header0()) << endl;
-                cout << fmt::format("header1=0x{:08x}", result.header1()) << endl;
-                cout << "  packetNumber=" << result.packetNumber() << endl;
-                cout << "  dataWordCount=" << result.dataWordCount() << endl;
-                cout << "  lostPackets=" << result.lostPackets << endl;
-                cout << "  nextHeaderPointer=" << result.nextHeaderPointer() << endl;
-                this->firstPacketDebugDump = false;
-            }
+                if (this->firstPacketDebugDump)
+                {
+                    cout << "first received readout eth packet:" << endl;
+                    cout << fmt::format("header0=0x{:08x}", result.header0()) << endl;
+                    cout << fmt::format("header1=0x{:08x}", result.header1()) << endl;
+                    cout << "  packetNumber=" << result.packetNumber() << endl;
+                    cout << "  dataWordCount=" << result.dataWordCount() << endl;
+                    cout << "  lostPackets=" << result.lostPackets << endl;
+                    cout << "  nextHeaderPointer=" << result.nextHeaderPointer() << endl;
+                    this->firstPacketDebugDump = false;
+                }
 #endif
 
-            if (result.ec == ErrorType::ConnectionError)
-                return result.ec;
+                ec = appendEthPacket(*destBuffer, result, stackHits, totalBytesTransferred);
 
-            if (result.ec == MVLCErrorCode::ShortRead)
-            {
-                counters.access()->ethShortReads++;
-                continue;
-            }
-
-            // Record stack hits in the local counters array.
-            count_stack_hits(result, stackHits);
-
-            // A crude way of handling packets with residual bytes at the end. Just
-            // subtract the residue from buffer->used which means the residual
-            // bytes will be overwritten by the next packets data. This will at
-            // least keep the structure somewhat intact assuming that the
-            // dataWordCount in header0 is correct. Note that this case does not
-            // happen, the MVLC never generates packets with residual bytes.
-            if (unlikely(result.leftoverBytes()))
-            {
-                //std::cout << "Oi! There's residue here!" << std::endl; // TODO: log a warning instead of using cout
-                destBuffer->setUsed(destBuffer->used() - result.leftoverBytes());
+                if (ec == ErrorType::ConnectionError)
+                    return ec;
             }
 
             auto elapsed = std::chrono::steady_clock::now() - tStart;
@@ -1458,21 +1526,149 @@ std::error_code ReadoutWorker::Private::readout_eth(
         }
     } // with dataGuard
 
-    // Copy the ethernet pipe stats and the stack hits into the Counters
-    // structure. The getPipeStats() access is thread-safe in the eth
-    // implementation.
+    updateEthCounters(stackHits);
+
+    return ec;
+}
+
+// Variant of readout_eth() consuming the packet batches produced by the eth
+// receiver thread instead of reading from the socket.
+std::error_code ReadoutWorker::Private::readout_eth_receiver(size_t &totalBytesTransferred)
+{
+    auto tStart = std::chrono::steady_clock::now();
+    totalBytesTransferred = 0u;
+    auto destBuffer = getOutputBuffer();
+    std::error_code ec;
+    StackHits stackHits = {};
+
+    while (destBuffer->free() >= eth::JumboFrameMaxSize)
     {
-        auto c = counters.access();
+        auto elapsed = std::chrono::steady_clock::now() - tStart;
 
-        c->ethStats = mvlcETH->getPipeStats();
+        if (elapsed >= FlushBufferTimeout)
+            break;
+
+        if (!ethBatch)
+        {
+            auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                FlushBufferTimeout - elapsed);
 
-        for (size_t stack=0; stack<stackHits.size(); ++stack)
-            c->stackHits[stack] += stackHits[stack];
+            if (!(ethBatch = ethReceiver->nextBatch(timeout)))
+            {
+                ec = make_error_code(MVLCErrorCode::SocketReadTimeout);
+                break;
+            }
+
+            ethBatchIndex = 0u;
+        }
+
+        while (ethBatchIndex < ethBatch->packetCount
+               && destBuffer->free() >= eth::JumboFrameMaxSize)
+        {
+            auto &result = ethBatch->results[ethBatchIndex++];
+            ec = appendEthPacket(*destBuffer, result, stackHits, totalBytesTransferred);
+
+            if (ec == ErrorType::ConnectionError)
+                break;
+        }
+
+        if (ethBatchIndex >= ethBatch->packetCount)
+        {
+            ethReceiver->releaseBatch(ethBatch);
+            ethBatch = nullptr;
+        }
+
+        if (ec == ErrorType::ConnectionError)
+            return ec;
     }
 
+    updateEthCounters(stackHits);
+
     return ec;
 }
 
+// Appends the packet data to destBuffer and records stack hits. The packet
+// data may already be located directly after the used part of destBuffer,
+// otherwise it is moved there. Returns the packets error code.
+std::error_code ReadoutWorker::Private::appendEthPacket(
+    ReadoutBuffer &destBuffer, eth::PacketReadResult &result,
+    StackHits &stackHits, size_t &totalBytesTransferred)
+{
+    u8 *dest = destBuffer.data() + destBuffer.used();
+
+    if (result.bytesTransferred && result.buffer != dest)
+    {
+        std::memmove(dest, result.buffer, result.bytesTransferred);
+        result.buffer = dest;
+    }
+
+    destBuffer.use(result.bytesTransferred);
+    totalBytesTransferred += result.bytesTransferred;
+
+    if (result.ec == ErrorType::ConnectionError)
+        return result.ec;
+
+    if (result.ec == MVLCErrorCode::ShortRead)
+    {
+        counters.access()->ethShortReads++;
+        return result.ec;
+    }
+
+    // Record stack hits in the local counters array.
+    count_stack_hits(result, stackHits);
+
+    // A crude way of handling packets with residual bytes at the end. Just
+    // subtract the residue from buffer->used which means the residual
+    // bytes will be overwritten by the next packets data. This will at
+    // least keep the structure somewhat intact assuming that the
+    // dataWordCount in header0 is correct. Note that this case does not
+    // happen, the MVLC never generates packets with residual bytes.
+    if (unlikely(result.leftoverBytes()))
+    {
+        //std::cout << "Oi! There's residue here!" << std::endl; // TODO: log a warning instead of using cout
+        destBuffer.setUsed(destBuffer.used() - result.leftoverBytes());
+    }
+
+    return result.ec;
+}
+
+// Copy the ethernet pipe stats and the stack hits into the Counters
+// structure. The getPipeStats() access is lock-free in the eth implementation
+// so the snapshot is taken before locking the counters.
+void ReadoutWorker::Private::updateEthCounters(const StackHits &stackHits)
+{
+    auto ethStats = mvlcETH->getPipeStats();
+    eth::PacketReceiverCounters receiverCounters = {};
+
+    if (ethReceiver)
+        receiverCounters = ethReceiver->counters();
+
+    auto c = counters.access();
+
+    c->ethStats = ethStats;
+
+    if (ethReceiver)
+        c->ethReceiverCounters = receiverCounters;
+
+    for (size_t stack=0; stack<stackHits.size(); ++stack)
+        c->stackHits[stack] += stackHits[stack];
+}
+
+void ReadoutWorker::Private::stopEthReceiver()
+{
+    if (!ethReceiver)
+        return;
+
+    ethReceiver->stop();
+
+    // Data still in the ring at this point arrived after the termination
+    // sequence completed. It is dropped the same way as data left in the
+    // socket buffer is dropped in the non-receiver case.
+    ethBatch = nullptr;
+    counters.access()->ethReceiverCounters = ethReceiver->counters();
+    ethReceiver.reset();
+}
+
 ReadoutWorker::~ReadoutWorker()
 {
 }
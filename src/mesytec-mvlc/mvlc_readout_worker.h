@@ -7,12 +7,14 @@
 
 #include "mesytec-mvlc/mesytec-mvlc_export.h"
 #include "mesytec-mvlc/mvlc_eth_interface.h"
+#include "mesytec-mvlc/mvlc_eth_receiver.h"
 #include "mesytec-mvlc/mvlc.h"
 #include "mesytec-mvlc/mvlc_impl_eth.h"
 #include "mesytec-mvlc/mvlc_listfile.h"
 #include "mesytec-mvlc/mvlc_readout_config.h"
 #include "mesytec-mvlc/mvlc_stack_executor.h"
 #include "mesytec-mvlc/readout_buffer_queues.h"
+#include "mesytec-mvlc/snoop_fanout.h"
 #include "mesytec-mvlc/util/protected.h"
 #include "mvlc_constants.h"
 
@@ -154,7 +156,9 @@ class MESYTEC_MVLC_EXPORT ReadoutWorker
 
             // Number of buffers that could not be added to the snoop queue
             // because no free buffer was available. This is the number of
-            // buffers the analysis/snoop side did not see.
+            // buffers the analysis/snoop side did not see. With a SnoopFanout
+            // each consumer additionally counts the buffers it missed because
+            // its own queue was full.
             size_t snoopMissedBuffers;
 
             // Number of times we did not land on an expected frame header
@@ -177,6 +181,8 @@ class MESYTEC_MVLC_EXPORT ReadoutWorker
 
             std::array<size_t, stacks::StackCount> stackHits = {};
             std::array<eth::PipeStats, PipeCount> ethStats;
+            // Only updated if the eth packet receiver thread is enabled.
+            eth::PacketReceiverCounters ethReceiverCounters = {};
             std::error_code ec;
             std::exception_ptr eptr;
             ListfileWriterCounters listfileWriterCounters = {};
@@ -242,6 +248,23 @@ class MESYTEC_MVLC_EXPORT ReadoutWorker
         void setMcstMaxTries(unsigned maxTries);
         unsigned getMcstMaxTries() const;
 
+        // ETH only: use a dedicated thread to move datagrams from the data
+        // socket into a pre-allocated ring of packet batches. The readout loop
+        // then consumes the ring instead of reading from the socket itself.
+        // This way stalls in the readout loop (buffer flushing, plugins,
+        // counter updates) do not immediately fill up the kernel receive
+        // buffer. Returns false and does nothing unless the worker is Idle.
+        // Default: disabled.
+        bool setEthPacketReceiverEnabled(bool enable, const eth::PacketReceiverOptions &options = {});
+        bool isEthPacketReceiverEnabled() const;
+
+        // Optional: publish the readout buffers via a SnoopFanout instead of
+        // the snoopQueues passed to the constructor. This allows multiple
+        // independent consumers of the readout data. The fanout must outlive
+        // the readout. Returns false if the readout is not idle.
+        bool setSnoopFanout(SnoopFanout *fanout);
+        SnoopFanout *snoopFanout();
+
         bool registerReadoutLoopPlugin(const std::shared_ptr<ReadoutLoopPlugin> &plugin);
         std::vector<std::shared_ptr<ReadoutLoopPlugin>> readoutLoopPlugins() const;
 
@@ -30,6 +30,7 @@ struct MVLCReplay::Private
     Protected<readout_parser::ReadoutParserCounters> parserCounters;
     std::thread parserThread;
     std::atomic<bool> parserQuit;
+    std::unique_ptr<readout_parser::ParallelReadoutParser> parallelParser;
 
     std::unique_ptr<ReplayWorker> replayWorker;
 
@@ -189,10 +190,47 @@ std::error_code MVLCReplay::resume()
     return d->replayWorker->resume();
 }
 
+std::error_code MVLCReplay::enableParallelParser(
+    const readout_parser::ParallelParserOptions &options)
+{
+    if (d->replayWorker->state() != ReplayWorker::State::Idle)
+        return make_error_code(ReplayWorkerError::ReplayNotIdle);
+
+    if (d->parserThread.joinable())
+    {
+        d->parserQuit = true;
+        d->parserThread.join();
+        d->parserQuit = false;
+    }
+
+    d->parallelParser.reset();
+    d->parallelParser = std::make_unique<readout_parser::ParallelReadoutParser>(
+        d->readoutParser, d->parserCallbacks, d->parserCounters, options);
+
+    d->parserThread = std::thread(
+        readout_parser::run_readout_parser_parallel,
+        std::ref(*d->parallelParser),
+        std::ref(d->snoopQueues),
+        std::ref(d->parserQuit)
+        );
+
+    return {};
+}
+
 bool MVLCReplay::finished()
 {
     return (d->replayWorker->state() == ReplayWorker::State::Idle
-            && d->replayWorker->snoopQueues()->filledBufferQueue().empty());
+            && d->replayWorker->snoopQueues()->filledBufferQueue().empty()
+            && (!d->parallelParser || d->parallelParser->idle()));
+}
+
+std::error_code MVLCReplay::setReadAhead(const listfile::ReadAheadOptions &options)
+{
+    if (d->replayWorker->state() != ReplayWorker::State::Idle)
+        return make_error_code(ReplayWorkerError::ReplayNotIdle);
+
+    d->lfZip.setReadAhead(options);
+    return {};
 }
 
 ReplayWorker::State MVLCReplay::workerState() const
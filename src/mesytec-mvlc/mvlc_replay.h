@@ -5,7 +5,9 @@
 
 #include "mesytec-mvlc/mesytec-mvlc_export.h"
 
+#include "mesytec-mvlc/mvlc_listfile_zip.h"
 #include "mesytec-mvlc/mvlc_readout_parser.h"
+#include "mesytec-mvlc/mvlc_readout_parser_parallel.h"
 #include "mesytec-mvlc/mvlc_replay_worker.h"
 
 namespace mesytec
@@ -31,6 +33,20 @@ class MESYTEC_MVLC_EXPORT MVLCReplay
 
         bool finished();
 
+        // Replaces the single threaded readout parser with a
+        // ParallelReadoutParser. Has to be called while the replay is idle,
+        // e.g. before start(). In ordered mode (the default) the parser
+        // callbacks are still invoked serially and in input order but from
+        // the parser worker threads.
+        std::error_code enableParallelParser(
+            const readout_parser::ParallelParserOptions &options = {});
+
+        // Enables reading and decompressing the listfile archive in a
+        // background thread, see listfile::ReadAheadOptions. Only applies to
+        // replays created from an archive name. Has to be called while the
+        // replay is idle. Default: disabled.
+        std::error_code setReadAhead(const listfile::ReadAheadOptions &options);
+
         ReplayWorker::State workerState() const;
         // FIXME: waitableState() == Idle and finished() which checks the
         // internal buffer queue should return the same result at the same
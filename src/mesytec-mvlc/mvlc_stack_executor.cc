@@ -3,10 +3,10 @@
 #ifndef __APPLE__
 #include <bits/c++config.h>
 #endif
-#include <spdlog/spdlog.h>
 
 #include "mvlc_constants.h"
 #include "mvlc_readout_parser.h"
+#include "util/logging.h"
 #include "vme_constants.h"
 
 
@@ -15,6 +15,52 @@ namespace mesytec
 namespace mvlc
 {
 
+namespace
+{
+
+using CT = StackCommand::CommandType;
+
+// Commands executed by the MVLC. run_command() ignores all other commands
+// and they are not encoded into batched stacks either.
+bool is_vme_command(const StackCommand &cmd)
+{
+    switch (cmd.type)
+    {
+        case CT::VMERead:
+        case CT::VMEReadSwapped:
+        case CT::VMEReadMem:
+        case CT::VMEReadMemSwapped:
+        case CT::VMEWrite:
+            return true;
+
+        default:
+            break;
+    }
+
+    return false;
+}
+
+bool is_vme_block_read(const StackCommand &cmd)
+{
+    return is_vme_command(cmd) && cmd.type != CT::VMEWrite && vme_amods::is_block_mode(cmd.amod);
+}
+
+std::error_code frame_flags_to_error(u8 frameFlags)
+{
+    if (frameFlags & frame_flags::Timeout)
+        return MVLCErrorCode::NoVMEResponse;
+
+    if (frameFlags & frame_flags::BusError)
+        return MVLCErrorCode::VMEBusError;
+
+    if (frameFlags & frame_flags::SyntaxError)
+        return MVLCErrorCode::StackSyntaxError;
+
+    return {};
+}
+
+}
+
 CommandExecResult run_command(
     MVLC &mvlc,
     const StackCommand &cmd,
@@ -112,11 +158,207 @@ CommandExecResult run_command(
             break;
     }
 
-    spdlog::trace("run_command: cmd={}, ec={}", to_string(cmd), result.ec.message());
+    get_logger("stack_executor")->trace("run_command: cmd={}, ec={}", to_string(cmd), result.ec.message());
+
+    return result;
+}
+
+std::vector<CommandExecResult> parse_response_list(
+    const std::vector<StackCommand> &commands,
+    const std::vector<u32> &responseBuffer)
+{
+    // Gather the contents of the StackFrame and its continuation frames.
+    std::vector<u32> contents;
+    u8 frameFlags = 0u;
+
+    for (size_t pos = 0; pos < responseBuffer.size(); )
+    {
+        auto frameInfo = extract_frame_info(responseBuffer[pos]);
+        auto frameEnd = std::min(pos + 1 + frameInfo.len, responseBuffer.size());
+        frameFlags |= frameInfo.flags;
+
+        std::copy(std::begin(responseBuffer) + pos + 1, std::begin(responseBuffer) + frameEnd,
+                  std::back_inserter(contents));
+
+        pos = frameEnd;
+
+        if (!(frameInfo.flags & frame_flags::Continue))
+            break;
+    }
+
+    const auto vmeError = frame_flags_to_error(frameFlags);
+    auto it = std::begin(contents);
+    const auto end = std::end(contents);
+
+    // Skip the reference marker.
+    if (it != end)
+        ++it;
+
+    std::vector<CommandExecResult> results;
+    results.reserve(commands.size());
+    bool errorAttributed = false;
+
+    for (const auto &cmd: commands)
+    {
+        CommandExecResult result = {};
+        result.cmd = cmd;
+
+        if (is_vme_command(cmd))
+        {
+            if (is_vme_block_read(cmd))
+            {
+                // One or more BlockRead frames linked via the Continue flag.
+                while (it != end && is_blockread_buffer(*it))
+                {
+                    auto frameInfo = extract_frame_info(*it++);
+                    auto count = std::min(static_cast<size_t>(frameInfo.len), static_cast<size_t>(end - it));
+
+                    std::copy(it, it + count, std::back_inserter(result.response));
+                    it += count;
+
+                    if (!result.ec)
+                        result.ec = frame_flags_to_error(frameInfo.flags);
+
+                    if (!(frameInfo.flags & frame_flags::Continue))
+                        break;
+                }
+            }
+            else if (cmd.type != CT::VMEWrite)
+            {
+                if (it != end)
+                {
+                    u32 value = *it++;
+
+                    // The MVLC continues executing the stack after a VME
+                    // error. A failed single read yields 0xffffff00 with the
+                    // stack line number in the lowest byte.
+                    if (vmeError && (value & 0xffffff00u) == 0xffffff00u)
+                        result.ec = vmeError;
+
+                    if (cmd.dataWidth == VMEDataWidth::D16)
+                        value &= 0xffffu;
+
+                    result.response.push_back(value);
+                }
+                else
+                    result.ec = make_error_code(MVLCErrorCode::UnexpectedResponseSize);
+            }
+
+            errorAttributed = errorAttributed || result.ec == ErrorType::VMEError;
+        }
+
+        results.emplace_back(std::move(result));
+    }
+
+    // The response does not tell which write failed, so if the error could
+    // not be attributed to a read it is reported for all writes.
+    if (vmeError && !errorAttributed)
+    {
+        for (auto &result: results)
+        {
+            if (result.cmd.type == CT::VMEWrite)
+                result.ec = vmeError;
+        }
+    }
+
+    return results;
+}
+
+namespace detail
+{
+
+std::vector<std::vector<StackCommand>> split_commands(
+    const std::vector<StackCommand> &commands,
+    const CommandExecOptions &options,
+    u16 immediateStackMaxSize)
+{
+    // StackStart, StackEnd and the reference marker added by stack_transaction().
+    const size_t StackOverhead = 2 + get_encoded_size(CT::WriteMarker);
+
+    std::vector<std::vector<StackCommand>> result;
+    std::vector<StackCommand> part;
+    size_t partSize = StackOverhead;
+
+    auto finish_part = [&] ()
+    {
+        if (!part.empty())
+        {
+            result.emplace_back(std::move(part));
+            part.clear();
+            partSize = StackOverhead;
+        }
+    };
+
+    for (const auto &cmd: commands)
+    {
+        const size_t cmdSize = is_vme_command(cmd) ? get_encoded_size(cmd) : 0u;
+
+        if (StackOverhead + cmdSize > immediateStackMaxSize)
+            throw std::runtime_error(fmt::format(
+                    "split_commands: command '{}' does not fit into the immediate stack size of {} words",
+                    to_string(cmd), immediateStackMaxSize));
+
+        // Delays have to be done in software between stack executions. Block
+        // reads are kept separate as their response size is not known up
+        // front.
+        if (options.noBatching
+            || (cmd.type == CT::SoftwareDelay && !options.ignoreDelays)
+            || is_vme_block_read(cmd))
+        {
+            finish_part();
+            result.emplace_back(std::vector<StackCommand>{ cmd });
+            continue;
+        }
+
+        if (partSize + cmdSize > immediateStackMaxSize)
+            finish_part();
+
+        part.push_back(cmd);
+        partSize += cmdSize;
+    }
+
+    finish_part();
 
     return result;
 }
 
+std::error_code stack_transaction(
+    MVLC &mvlc,
+    const std::vector<StackCommand> &commands,
+    std::vector<u32> &responseBuffer)
+{
+    StackCommandBuilder stackBuilder;
+    stackBuilder.addWriteMarker(mvlc.nextStackReference());
+
+    for (const auto &cmd: commands)
+    {
+        if (is_vme_command(cmd))
+            stackBuilder.addCommand(cmd);
+    }
+
+    responseBuffer.clear();
+
+    if (auto ec = mvlc.stackTransaction(stackBuilder, responseBuffer))
+        return ec;
+
+    for (size_t pos = 0; pos < responseBuffer.size(); )
+    {
+        auto frameInfo = extract_frame_info(responseBuffer[pos]);
+
+        if (auto ec = frame_flags_to_error(frameInfo.flags))
+            return ec;
+
+        if (!(frameInfo.flags & frame_flags::Continue))
+            break;
+
+        pos += frameInfo.len + 1;
+    }
+
+    return {};
+}
+
+} // end namespace detail
+
 std::vector<CommandExecResult> run_commands(
     MVLC &mvlc,
     const std::vector<StackCommand> &commands,
@@ -126,17 +368,57 @@ std::vector<CommandExecResult> run_commands(
     std::vector<CommandExecResult> results;
     results.reserve(commands.size());
 
-    for (const auto &cmd: commands)
+    auto should_abort = [&options] (const std::error_code &ec)
     {
-        auto result = run_command(mvlc, cmd, options);
+        return ec && (ec != ErrorType::VMEError || !options.continueOnVMEError);
+    };
 
-        results.push_back(result);
+    for (const auto &part: detail::split_commands(commands, options))
+    {
+        const bool isBatch = std::count_if(std::begin(part), std::end(part), is_vme_command) > 1;
 
-        if (result.ec)
+        if (!isBatch)
         {
-            if (result.ec != ErrorType::VMEError || !options.continueOnVMEError)
-                break;
+            // Single commands and delays.
+            for (const auto &cmd: part)
+            {
+                auto result = run_command(mvlc, cmd, options);
+
+                results.push_back(result);
+
+                if (should_abort(result.ec))
+                    return results;
+            }
+
+            continue;
+        }
+
+        std::vector<u32> response;
+        auto ec = detail::stack_transaction(mvlc, part, response);
+
+        get_logger("stack_executor")->trace(
+            "run_commands: executed {} commands in a single stack transaction, response size={}, ec={}",
+            part.size(), response.size(), ec.message());
+
+        if (!ec || ec == ErrorType::VMEError)
+        {
+            auto partResults = parse_response_list(part, response);
+            std::move(std::begin(partResults), std::end(partResults), std::back_inserter(results));
+        }
+        else
+        {
+            for (const auto &cmd: part)
+            {
+                CommandExecResult result = {};
+                result.cmd = cmd;
+                if (is_vme_command(cmd))
+                    result.ec = ec;
+                results.emplace_back(std::move(result));
+            }
         }
+
+        if (should_abort(ec))
+            break;
     }
 
     return results;
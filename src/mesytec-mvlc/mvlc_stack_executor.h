@@ -22,8 +22,9 @@
 
 /* Utilities for direct command stack execution.
  *
- * execute_commands() and execute_stack() can make optimal use of the available
- * stack memory to execute an unlimited number of VME commands.
+ * run_commands() packs consecutive VME commands into as few immediate stack
+ * transactions as fit into the reserved immediate stack memory. The combined
+ * stack responses are split back into per command results.
  */
 
 namespace mesytec
@@ -43,6 +44,12 @@ struct MESYTEC_MVLC_EXPORT CommandExecOptions
     // Set to true to ignore any SoftwareDelay commands.
     bool ignoreDelays = false;
 
+    // Set to true to execute each command in its own stack transaction.
+    // Batched execution cannot attribute VME errors to individual commands:
+    // all VME commands of a failed batch carry the error and the commands
+    // following the failed one in the same batch have already been executed.
+    bool noBatching = false;
+
     // If disabled command execution will be aborted when a VME bus error is
     // encountered.
     bool continueOnVMEError = false;
@@ -59,6 +66,42 @@ MESYTEC_MVLC_EXPORT std::vector<CommandExecResult> run_commands(
     const CommandExecOptions &options = {});
 
 
+// Splits the response of a stack transaction executing the given commands
+// into per command results. The response is expected to start with a
+// StackFrame header followed by the reference marker of the transaction.
+// Commands that are not executed via stacks (e.g. SoftwareDelay) yield an
+// empty result.
+//
+// VME errors are attributed to the failing reads and block reads. The MVLC
+// does not report which write failed, so an error that cannot be attributed
+// to a read is reported for all writes of the stack.
+MESYTEC_MVLC_EXPORT std::vector<CommandExecResult> parse_response_list(
+    const std::vector<StackCommand> &commands,
+    const std::vector<u32> &responseBuffer);
+
+namespace detail
+{
+
+// Splits the commands into parts which can each be executed as a single
+// immediate stack transaction of at most immediateStackMaxSize words
+// (including the reference marker, StackStart and StackEnd). SoftwareDelay
+// commands and VME block reads are placed in their own parts. Throws
+// std::runtime_error if a single command does not fit into the stack size.
+MESYTEC_MVLC_EXPORT std::vector<std::vector<StackCommand>> split_commands(
+    const std::vector<StackCommand> &commands,
+    const CommandExecOptions &options = {},
+    u16 immediateStackMaxSize = stacks::ImmediateStackReservedWords);
+
+// Executes the commands as a single immediate stack transaction. A reference
+// marker is prepended to the stack. Returns the first VME error flagged in
+// the response frames if the transaction itself succeeded.
+MESYTEC_MVLC_EXPORT std::error_code stack_transaction(
+    MVLC &mvlc,
+    const std::vector<StackCommand> &commands,
+    std::vector<u32> &responseBuffer);
+
+} // end namespace detail
+
 inline std::vector<CommandExecResult> run_commands(
     MVLC &mvlc,
     const StackCommandBuilder &stackBuilder,
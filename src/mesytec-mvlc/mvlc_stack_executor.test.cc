@@ -28,8 +28,6 @@ Out &log_buffer(Out &out, const std::vector<u32> &buffer, const std::string &hea
 }
 
 
-#if 0
-
 TEST(mvlc_stack_executor, SplitCommandsOptions)
 {
     const u32 vmeBase = 0x0;
@@ -192,4 +190,113 @@ TEST(mvlc_stack_executor, SplitCommandsSoftwareDelays)
     ASSERT_EQ(parts[0][0].type, StackCommand::CommandType::SoftwareDelay);
     ASSERT_EQ(parts[1][0].type, StackCommand::CommandType::SoftwareDelay);
 }
-#endif
+
+TEST(mvlc_stack_executor, SplitCommandsBlockReads)
+{
+    StackCommandBuilder stack;
+    stack.addVMEWrite(0x1000, 1, vme_amods::A32, VMEDataWidth::D16);
+    stack.addVMEBlockRead(0x0, vme_amods::MBLT64, 100);
+    stack.addVMEWrite(0x1002, 1, vme_amods::A32, VMEDataWidth::D16);
+    stack.addVMEWrite(0x1004, 1, vme_amods::A32, VMEDataWidth::D16);
+
+    auto parts = detail::split_commands(stack.getCommands());
+
+    ASSERT_EQ(parts.size(), 3);
+    ASSERT_EQ(parts[0].size(), 1);
+    ASSERT_EQ(parts[1].size(), 1);
+    ASSERT_EQ(parts[1][0].type, StackCT::VMERead);
+    ASSERT_EQ(parts[2].size(), 2);
+}
+
+TEST(mvlc_stack_executor, ParseResponseList)
+{
+    StackCommandBuilder stack;
+    stack.addVMEWrite(0x1000, 1, vme_amods::A32, VMEDataWidth::D16);
+    stack.addVMERead(0x1002, vme_amods::A32, VMEDataWidth::D16);
+    stack.addSoftwareDelay(std::chrono::milliseconds(100));
+    stack.addVMERead(0x1004, vme_amods::A32, VMEDataWidth::D32);
+    stack.addVMEBlockRead(0x0, vme_amods::MBLT64, 100);
+    stack.addVMEWrite(0x1006, 1, vme_amods::A32, VMEDataWidth::D16);
+
+    const auto commands = stack.getCommands();
+
+    // StackFrame split into a continuation frame in the middle of the block
+    // read which itself consists of two BlockRead frames.
+    std::vector<u32> response =
+    {
+        make_frame_header(frame_headers::StackFrame, 6, 0, frame_flags::Continue),
+        0xcafe0001u,                                            // reference marker
+        0x1234abcdu,                                            // D16 read
+        0x87654321u,                                            // D32 read
+        make_frame_header(frame_headers::BlockRead, 2, 0, frame_flags::Continue),
+        0x11111111u, 0x22222222u,
+        make_frame_header(frame_headers::StackContinuation, 2),
+        make_frame_header(frame_headers::BlockRead, 1),
+        0x33333333u,
+    };
+
+    {
+        auto results = parse_response_list(commands, response);
+
+        ASSERT_EQ(results.size(), commands.size());
+
+        for (size_t i=0; i<results.size(); ++i)
+        {
+            ASSERT_EQ(results[i].cmd, commands[i]);
+            ASSERT_FALSE(results[i].ec);
+        }
+
+        ASSERT_TRUE(results[0].response.empty());
+        ASSERT_EQ(results[1].response, std::vector<u32>{ 0xabcdu });
+        ASSERT_TRUE(results[2].response.empty());
+        ASSERT_EQ(results[3].response, std::vector<u32>{ 0x87654321u });
+        ASSERT_EQ(results[4].response, (std::vector<u32>{ 0x11111111u, 0x22222222u, 0x33333333u }));
+        ASSERT_TRUE(results[5].response.empty());
+    }
+
+    // A VME error that cannot be attributed to a read is reported for the
+    // writes.
+    response[0] |= static_cast<u32>(frame_flags::BusError) << frame_headers::FrameFlagsShift;
+
+    {
+        auto results = parse_response_list(commands, response);
+
+        ASSERT_EQ(results.size(), commands.size());
+        ASSERT_EQ(results[0].ec, MVLCErrorCode::VMEBusError);
+        ASSERT_FALSE(results[1].ec);
+        ASSERT_FALSE(results[2].ec);
+        ASSERT_FALSE(results[3].ec);
+        ASSERT_FALSE(results[4].ec);
+        ASSERT_EQ(results[5].ec, MVLCErrorCode::VMEBusError);
+    }
+
+    // A failed single read yields 0xffffff00 with the stack line number in the
+    // lowest byte. The error is attributed to that read only.
+    {
+        auto errorResponse = response;
+        errorResponse[3] = 0xffffff07u;
+
+        auto results = parse_response_list(commands, errorResponse);
+
+        ASSERT_EQ(results.size(), commands.size());
+        ASSERT_FALSE(results[0].ec);
+        ASSERT_FALSE(results[1].ec);
+        ASSERT_EQ(results[3].ec, MVLCErrorCode::VMEBusError);
+        ASSERT_EQ(results[3].response, std::vector<u32>{ 0xffffff07u });
+        ASSERT_FALSE(results[5].ec);
+    }
+
+    // Truncated response
+    {
+        std::vector<u32> shortResponse =
+        {
+            make_frame_header(frame_headers::StackFrame, 1),
+            0xcafe0001u,
+        };
+
+        auto results = parse_response_list(commands, shortResponse);
+        ASSERT_EQ(results.size(), commands.size());
+        ASSERT_FALSE(results[0].ec);
+        ASSERT_EQ(results[1].ec, MVLCErrorCode::UnexpectedResponseSize);
+    }
+}
@@ -21,10 +21,12 @@
 #include "mvlc_util.h"
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
 #include "mvlc_constants.h"
+#include "mvlc_frame_scan.h"
 #include "util/fmt.h"
 #include "util/string_util.h"
 #include "util/string_view.hpp"
@@ -260,8 +262,8 @@ std::string trigger_to_string(const stacks::Trigger &trigger)
 }
 
 // Follows the framing structure inside the buffer until an incomplete frame
-// which doesn't fit into the buffer is detected. The incomplete data is moved
-// over to the tempBuffer so that the readBuffer ends with a complete frame.
+// which doesn't fit into the buffer is detected. Returns the number of bytes
+// in front of the incomplete frame.
 //
 // The input buffer must start with a frame header (skip_count will be called
 // with the first word of the input buffer on the first iteration).
@@ -270,55 +272,70 @@ std::string trigger_to_string(const stacks::Trigger &trigger)
 // frame header or 0 if there is not enough data left in the input iterator to
 // determine the frames size.
 // Signature of SkipCountFunc:  u32 skip_count(const basic_string_view<const u8> &view);
-// Returns the number of trailing bytes copied from msgBuf into tmpBuf.
 template<typename SkipCountFunc>
-size_t fixup_buffer(
+size_t complete_frames_size(
     const u8 *msgBuf, size_t msgUsed,
-    std::vector<u8> &tmpBuf,
     SkipCountFunc skip_count)
 {
     using namespace nonstd;
     auto view = basic_string_view<const u8>(msgBuf, msgUsed);
 
-    while (!view.empty())
+    while (view.size() >= sizeof(u32))
     {
-        if (view.size() >= sizeof(u32))
-        {
-            u32 wordsToSkip = skip_count(view);
+        u32 wordsToSkip = skip_count(view);
 
-            //cout << "wordsToSkip=" << wordsToSkip << ", view.size()=" << view.size() << ", in words:" << view.size() / sizeof(u32));
+        //cout << "wordsToSkip=" << wordsToSkip << ", view.size()=" << view.size() << ", in words:" << view.size() / sizeof(u32));
 
-            if (wordsToSkip == 0 || wordsToSkip > view.size() / sizeof(u32))
-            {
-                tmpBuf.reserve(tmpBuf.size() + view.size());
-                std::copy(std::begin(view), std::end(view), std::back_inserter(tmpBuf));
-                return view.size();
-            }
+        if (wordsToSkip == 0 || wordsToSkip > view.size() / sizeof(u32))
+            break;
 
-            // Skip over the SystemEvent frame or the ETH packet data.
-            view.remove_prefix(wordsToSkip * sizeof(u32));
-        }
+        // Skip over the SystemEvent frame or the ETH packet data.
+        view.remove_prefix(wordsToSkip * sizeof(u32));
     }
 
-    return 0u;
+    // Either an incomplete frame or a trailing partial word.
+    return msgUsed - view.size();
 }
 
-size_t fixup_buffer_mvlc_usb(const u8 *buf, size_t bufUsed, std::vector<u8> &tmpBuf)
+// Moves the incomplete data at the end of msgBuf over to tmpBuf so that the
+// readBuffer ends with a complete frame. Returns the number of trailing bytes
+// copied from msgBuf into tmpBuf.
+inline size_t move_trailing_data(
+    const u8 *msgBuf, size_t msgUsed, size_t completeSize, std::vector<u8> &tmpBuf)
 {
-    using namespace nonstd;
-    auto skip_func = [] (const basic_string_view<const u8> &view) -> u32
+    const size_t tailBytes = msgUsed - completeSize;
+    tmpBuf.insert(tmpBuf.end(), msgBuf + completeSize, msgBuf + msgUsed);
+    return tailBytes;
+}
+
+// Follows the USB frame structure. Words which are not known frame headers
+// are skipped by scanning forward to the next plausible header. The skipped
+// words are counted as complete data. buf must be 4-byte aligned.
+size_t complete_frames_size_mvlc_usb(const u8 *buf, size_t bufUsed)
+{
+    const u32 *begin = reinterpret_cast<const u32 *>(buf);
+    const u32 *pos = begin;
+    const u32 *end = pos + bufUsed / sizeof(u32);
+    const auto knownTypes = frame_scan::known_frame_types();
+
+    while (true)
     {
-        if (view.size() < sizeof(u32))
-            return 0u;
+        auto follow = frame_scan::follow_frames(pos, end, knownTypes);
 
-        u32 header = *reinterpret_cast<const u32 *>(view.data());
-        return 1u + extract_frame_info(header).len;
-    };
+        if (follow.result != frame_scan::FollowResult::InvalidHeader)
+        {
+            // Either the end of the data or an incomplete frame.
+            pos = follow.pos;
+            break;
+        }
 
-    return fixup_buffer(buf, bufUsed, tmpBuf, skip_func);
+        pos = frame_scan::find_frame_header(follow.pos + 1, end, knownTypes);
+    }
+
+    return (pos - begin) * sizeof(u32);
 }
 
-size_t fixup_buffer_mvlc_eth(const u8 *buf, size_t bufUsed, std::vector<u8> &tmpBuf)
+size_t complete_frames_size_mvlc_eth(const u8 *buf, size_t bufUsed)
 {
     using namespace nonstd;
     auto skip_func = [](const basic_string_view<const u8> &view) -> u32
@@ -326,15 +343,18 @@ size_t fixup_buffer_mvlc_eth(const u8 *buf, size_t bufUsed, std::vector<u8> &tmp
         if (view.size() < sizeof(u32))
             return 0u;
 
-        // Either a SystemEvent header or the first of the two ETH packet headers
-        u32 header = *reinterpret_cast<const u32 *>(view.data());
+        // Either a SystemEvent header or the first of the two ETH packet headers.
+        // The data is not necessarily 4-byte aligned, so memcpy the words out.
+        u32 header = 0;
+        std::memcpy(&header, view.data(), sizeof(header));
 
         if (get_frame_type(header) == frame_headers::SystemEvent)
             return 1u + extract_frame_info(header).len;
 
         if (view.size() >= 2 * sizeof(u32))
         {
-            u32 header1 = *reinterpret_cast<const u32 *>(view.data() + sizeof(u32));
+            u32 header1 = 0;
+            std::memcpy(&header1, view.data() + sizeof(u32), sizeof(header1));
             eth::PayloadHeaderInfo ethHdrs{ header, header1 };
             return eth::HeaderWords + ethHdrs.dataWordCount();
         }
@@ -343,7 +363,18 @@ size_t fixup_buffer_mvlc_eth(const u8 *buf, size_t bufUsed, std::vector<u8> &tmp
         return 0u;
     };
 
-    return fixup_buffer(buf, bufUsed, tmpBuf, skip_func);
+    return complete_frames_size(buf, bufUsed, skip_func);
+}
+
+// The incomplete frame and any trailing partial word are moved to tmpBuf.
+size_t fixup_buffer_mvlc_usb(const u8 *buf, size_t bufUsed, std::vector<u8> &tmpBuf)
+{
+    return move_trailing_data(buf, bufUsed, complete_frames_size_mvlc_usb(buf, bufUsed), tmpBuf);
+}
+
+size_t fixup_buffer_mvlc_eth(const u8 *buf, size_t bufUsed, std::vector<u8> &tmpBuf)
+{
+    return move_trailing_data(buf, bufUsed, complete_frames_size_mvlc_eth(buf, bufUsed), tmpBuf);
 }
 
 } // end namespace mvlc
@@ -68,6 +68,30 @@ inline FrameInfo extract_frame_info(u32 header)
     return result;
 }
 
+// Builds a frame header word, the inverse of extract_frame_info() for
+// non-SystemEvent frames. Used to generate MVLC data in tests and emulators.
+inline u32 make_frame_header(u8 type, u16 len, u8 stack = 0, u8 flags = 0, u8 ctrl = 0)
+{
+    using namespace frame_headers;
+
+    return (static_cast<u32>(type) << TypeShift)
+        | ((flags & FrameFlagsMask) << FrameFlagsShift)
+        | ((stack & StackNumMask) << StackNumShift)
+        | ((ctrl & CtrlIdMask) << CtrlIdShift)
+        | ((len & LengthMask) << LengthShift);
+}
+
+// Builds a SystemEvent frame header word.
+inline u32 make_system_event_header(u8 subtype, u16 len, u8 ctrl = 0)
+{
+    using namespace system_event;
+
+    return (static_cast<u32>(frame_headers::SystemEvent) << frame_headers::TypeShift)
+        | ((ctrl & CtrlIdMask) << CtrlIdShift)
+        | ((subtype & SubtypeMask) << SubtypeShift)
+        | ((len & LengthMask) << LengthShift);
+}
+
 inline u8 extract_frame_flags(u32 header)
 {
     return extract_frame_info(header).flags;
@@ -101,6 +125,21 @@ std::string MESYTEC_MVLC_EXPORT trigger_to_string(const stacks::Trigger &trigger
 size_t MESYTEC_MVLC_EXPORT fixup_buffer_mvlc_usb(const u8 *buf, size_t bufUsed, std::vector<u8> &tmpBuf);
 size_t MESYTEC_MVLC_EXPORT fixup_buffer_mvlc_eth(const u8 *buf, size_t bufUsed, std::vector<u8> &tmpBuf);
 
+// Return the number of leading bytes of buf made up of complete frames (USB)
+// or packets (ETH). This is the part of the buffer left in place by the
+// fixup_buffer functions above. The USB variant scans the data word by word
+// and requires buf to be 4-byte aligned.
+size_t MESYTEC_MVLC_EXPORT complete_frames_size_mvlc_usb(const u8 *buf, size_t bufUsed);
+size_t MESYTEC_MVLC_EXPORT complete_frames_size_mvlc_eth(const u8 *buf, size_t bufUsed);
+
+inline size_t complete_frames_size(ConnectionType bufferType, const u8 *buf, size_t bufUsed)
+{
+    if (bufferType == ConnectionType::ETH)
+        return complete_frames_size_mvlc_eth(buf, bufUsed);
+
+    return complete_frames_size_mvlc_usb(buf, bufUsed);
+}
+
 inline size_t fixup_buffer(
     ConnectionType bufferType,
     const u8 *msgBuf, size_t msgUsed,
@@ -0,0 +1,316 @@
+#include "mvlc_zmq_publisher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <zmq.hpp>
+
+#include "mesytec-mvlc/util/logging.h"
+#include "mesytec-mvlc/util/perf.h"
+#include "mesytec-mvlc/util/protected.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+
+namespace
+{
+
+using ReleaseFunction = ZmqBufferPublisher::ReleaseFunction;
+
+// Upper bound for a single blocking send. Subscriptions are processed in
+// between so that new and departed subscribers are noticed while blocked.
+static const int SendTimeoutSlice_ms = 100;
+
+// Free function passed to zmq_msg_init_data(). Called by libzmq once the
+// message data is not referenced anymore.
+void release_message_data(void * /*data*/, void *hint)
+{
+    std::unique_ptr<ReleaseFunction> release(static_cast<ReleaseFunction *>(hint));
+
+    if (*release)
+        (*release)();
+}
+
+void set_socket_option(void *socket, int option, int value)
+{
+    if (zmq_setsockopt(socket, option, &value, sizeof(value)) != 0)
+    {
+        throw std::runtime_error(fmt::format(
+            "ZmqBufferPublisher: zmq_setsockopt({}): {}", option, zmq_strerror(zmq_errno())));
+    }
+}
+
+} // end anon namespace
+
+struct ZmqBufferPublisher::Private
+{
+    ZmqPublisherOptions options;
+    std::shared_ptr<spdlog::logger> logger;
+    // Declared before the socket so that pending messages are released while
+    // the context is terminated.
+    zmq::context_t ctx;
+    zmq::socket_t pub;
+    size_t subscribers = 0u;
+    Protected<ZmqPublisherCounters> counters;
+
+    explicit Private(const ZmqPublisherOptions &options_)
+        : options(options_)
+        , logger(get_logger("zmq_publisher"))
+        , ctx()
+        , pub(ctx, ZMQ_XPUB)
+        , counters()
+    {}
+
+    void *handle() { return static_cast<void *>(pub); }
+
+    // Reads pending subscription messages from the XPUB socket. The first
+    // byte is 1 for subscribe and 0 for unsubscribe messages.
+    void processSubscriptions()
+    {
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        bool changed = false;
+
+        while (zmq_msg_recv(&msg, handle(), ZMQ_DONTWAIT) >= 0)
+        {
+            if (zmq_msg_size(&msg) == 0)
+                continue;
+
+            const u8 type = *static_cast<const u8 *>(zmq_msg_data(&msg));
+
+            if (type == 1)
+                ++subscribers;
+            else if (type == 0 && subscribers > 0)
+                --subscribers;
+
+            changed = true;
+        }
+
+        zmq_msg_close(&msg);
+
+        if (changed)
+        {
+            logger->debug("subscriptions: {}", subscribers);
+            counters.access()->subscribers = subscribers;
+        }
+    }
+
+    // Takes ownership of the message. Returns false if the send timeout
+    // expired.
+    bool send(zmq_msg_t *msg)
+    {
+        const size_t size = zmq_msg_size(msg);
+        const auto tStart = std::chrono::steady_clock::now();
+        bool blocked = false;
+
+        while (true)
+        {
+            processSubscriptions();
+
+            // Blocks for at most SendTimeoutSlice_ms if a subscriber reached
+            // the high water mark.
+            if (zmq_msg_send(msg, handle(), 0) >= 0)
+            {
+                auto c = counters.access();
+                ++c->messagesPublished;
+                c->bytesPublished += size;
+                return true;
+            }
+
+            const int err = zmq_errno();
+
+            if (err != EAGAIN && err != EINTR)
+            {
+                zmq_msg_close(msg);
+                throw std::runtime_error(fmt::format(
+                    "ZmqBufferPublisher: zmq_msg_send: {}", zmq_strerror(err)));
+            }
+
+            if (!blocked)
+            {
+                blocked = true;
+                ++counters.access()->sendBlocked;
+            }
+
+            if (options.sendTimeout.count() >= 0
+                && std::chrono::steady_clock::now() - tStart >= options.sendTimeout)
+            {
+                // Releases the message data.
+                zmq_msg_close(msg);
+                ++counters.access()->sendTimeouts;
+                logger->warn("send timeout, discarding message of size {}", size);
+                return false;
+            }
+        }
+    }
+};
+
+ZmqBufferPublisher::ZmqBufferPublisher(const ZmqPublisherOptions &options)
+    : d(std::make_unique<Private>(options))
+{
+    set_socket_option(d->handle(), ZMQ_LINGER, 0);
+    set_socket_option(d->handle(), ZMQ_SNDHWM, options.sendHighWaterMark);
+    set_socket_option(d->handle(), ZMQ_SNDTIMEO, SendTimeoutSlice_ms);
+    set_socket_option(d->handle(), ZMQ_XPUB_NODROP, 1);
+    // Pass on all subscription and unsubscription messages, not only the
+    // first/last one per topic.
+#ifdef ZMQ_XPUB_VERBOSER
+    set_socket_option(d->handle(), ZMQ_XPUB_VERBOSER, 1);
+#else
+    set_socket_option(d->handle(), ZMQ_XPUB_VERBOSE, 1);
+#endif
+
+    if (zmq_bind(d->handle(), options.bindUrl.c_str()) != 0)
+    {
+        auto msg = fmt::format("Error binding zmq socket to {}: {}",
+                               options.bindUrl, zmq_strerror(zmq_errno()));
+        d->logger->error(msg);
+        throw std::runtime_error(msg);
+    }
+
+    d->logger->info("zmq publisher listening on {}", options.bindUrl);
+}
+
+ZmqBufferPublisher::~ZmqBufferPublisher()
+{
+    d->logger->info("Closing zmq publisher");
+}
+
+size_t ZmqBufferPublisher::waitForSubscribers(size_t minSubscribers, const std::chrono::milliseconds &timeout)
+{
+    const auto tEnd = std::chrono::steady_clock::now() + timeout;
+
+    while (true)
+    {
+        d->processSubscriptions();
+
+        auto now = std::chrono::steady_clock::now();
+
+        if (d->subscribers >= minSubscribers || now >= tEnd)
+            break;
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(tEnd - now);
+        long timeout_ms = std::max<long>(remaining.count(), 1);
+        zmq_pollitem_t item = { d->handle(), 0, ZMQ_POLLIN, 0 };
+
+        if (zmq_poll(&item, 1, timeout_ms) < 0
+            && zmq_errno() != EINTR)
+        {
+            throw std::runtime_error(fmt::format(
+                "ZmqBufferPublisher: zmq_poll: {}", zmq_strerror(zmq_errno())));
+        }
+    }
+
+    return d->subscribers;
+}
+
+size_t ZmqBufferPublisher::subscriberCount()
+{
+    d->processSubscriptions();
+    return d->subscribers;
+}
+
+bool ZmqBufferPublisher::publish(const u8 *data, size_t size, ReleaseFunction release)
+{
+    // libzmq does not call the free function for empty messages.
+    if (!size)
+    {
+        if (release)
+            release();
+        return true;
+    }
+
+    auto hint = new ReleaseFunction(std::move(release));
+    zmq_msg_t msg;
+
+    if (zmq_msg_init_data(&msg, const_cast<u8 *>(data), size, release_message_data, hint) != 0)
+    {
+        release_message_data(nullptr, hint);
+        throw std::runtime_error(fmt::format(
+            "ZmqBufferPublisher: zmq_msg_init_data: {}", zmq_strerror(zmq_errno())));
+    }
+
+    return d->send(&msg);
+}
+
+bool ZmqBufferPublisher::publish(ReadoutBuffer *buffer, ReadoutBufferQueues::QueueType &emptyQueue)
+{
+    auto view = buffer->viewU8();
+
+    return publish(view.data(), view.size(), [buffer, &emptyQueue] ()
+    {
+        emptyQueue.enqueue(buffer);
+    });
+}
+
+bool ZmqBufferPublisher::publish(SnoopBufferRef &&ref)
+{
+    auto view = ref->viewU8();
+    // std::function requires copyable callables.
+    auto shared = std::make_shared<SnoopBufferRef>(std::move(ref));
+
+    return publish(view.data(), view.size(), [shared] ()
+    {
+        shared->reset();
+    });
+}
+
+bool ZmqBufferPublisher::publishCopy(const u8 *data, size_t size)
+{
+    zmq_msg_t msg;
+
+    if (zmq_msg_init_size(&msg, size) != 0)
+    {
+        throw std::runtime_error(fmt::format(
+            "ZmqBufferPublisher: zmq_msg_init_size: {}", zmq_strerror(zmq_errno())));
+    }
+
+    std::memcpy(zmq_msg_data(&msg), data, size);
+
+    return d->send(&msg);
+}
+
+void ZmqBufferPublisher::run(ReadoutBufferQueues &bufferQueues)
+{
+    auto &filled = bufferQueues.filledBufferQueue();
+    auto &empty = bufferQueues.emptyBufferQueue();
+
+    d->logger->debug("zmq_publisher entering publish loop");
+
+    try
+    {
+        while (true)
+        {
+            auto buffer = filled.dequeue_blocking();
+
+            if (unlikely(!buffer))
+                break;
+
+            // sentinel check
+            if (unlikely(buffer->empty()))
+            {
+                empty.enqueue(buffer);
+                break;
+            }
+
+            publish(buffer, empty);
+        }
+    }
+    catch (const std::runtime_error &e)
+    {
+        d->counters.access()->eptr = std::current_exception();
+        d->logger->error("zmq_publisher caught a std::runtime_error: {}", e.what());
+    }
+
+    d->logger->debug("zmq_publisher left publish loop");
+}
+
+ZmqPublisherCounters ZmqBufferPublisher::counters() const
+{
+    return d->counters.access().copy();
+}
+
+} // end namespace mvlc
+} // end namespace mesytec
@@ -0,0 +1,119 @@
+#ifndef __MESYTEC_MVLC_MVLC_ZMQ_PUBLISHER_H__
+#define __MESYTEC_MVLC_MVLC_ZMQ_PUBLISHER_H__
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mesytec-mvlc/readout_buffer_queues.h"
+#include "mesytec-mvlc/snoop_fanout.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+
+struct MESYTEC_MVLC_EXPORT ZmqPublisherOptions
+{
+    std::string bindUrl = "tcp://*:5575";
+
+    // Maximum number of messages queued per subscriber (ZMQ_SNDHWM). Once a
+    // subscriber reaches the limit publishing blocks instead of dropping
+    // messages.
+    int sendHighWaterMark = 16;
+
+    // Maximum time a publish call blocks because of the high water mark. The
+    // message is discarded and counted in sendTimeouts afterwards. Negative
+    // values wait forever.
+    std::chrono::milliseconds sendTimeout = std::chrono::milliseconds(-1);
+};
+
+struct MESYTEC_MVLC_EXPORT ZmqPublisherCounters
+{
+    size_t messagesPublished = 0;
+    size_t bytesPublished = 0;
+
+    // Number of publish calls that had to wait because a subscriber reached
+    // the high water mark.
+    size_t sendBlocked = 0;
+
+    // Number of messages discarded because sendTimeout expired.
+    size_t sendTimeouts = 0;
+
+    // Current number of subscriptions. Equal to the number of subscribers if
+    // each subscribes to a single topic.
+    size_t subscribers = 0;
+
+    // Set if run() was terminated by an exception.
+    std::exception_ptr eptr;
+};
+
+// Publishes readout buffers on a ZMQ XPUB socket without copying the buffer
+// data. libzmq references the buffer memory until the message has been sent to
+// all subscribers and then calls a release function from one of its io
+// threads, e.g. to return the buffer to its empty queue.
+//
+// Unlike a plain PUB socket messages are not dropped when a subscriber falls
+// behind (ZMQ_XPUB_NODROP). Instead publishing blocks which in turn creates
+// backpressure on the buffer producer.
+//
+// Subscribers are SUB sockets connecting to the bind url. Use
+// waitForSubscribers() to make sure data published afterwards reaches them.
+//
+// Not thread-safe: use a single thread for publishing. Buffers and queues
+// passed to publish() must outlive the publisher. Everything throws
+// std::runtime_error on ZMQ errors.
+class MESYTEC_MVLC_EXPORT ZmqBufferPublisher
+{
+    public:
+        using ReleaseFunction = std::function<void ()>;
+
+        explicit ZmqBufferPublisher(const ZmqPublisherOptions &options = {});
+        ~ZmqBufferPublisher();
+
+        ZmqBufferPublisher(const ZmqBufferPublisher &) = delete;
+        ZmqBufferPublisher &operator=(const ZmqBufferPublisher &) = delete;
+
+        // Connection readiness handshake. A subscription only arrives once the
+        // connection to the subscriber is fully established. Waits until at
+        // least minSubscribers subscriptions have been received or the timeout
+        // expires. Returns the current number of subscriptions.
+        size_t waitForSubscribers(size_t minSubscribers, const std::chrono::milliseconds &timeout);
+        size_t subscriberCount();
+
+        // Zero copy publishing of the given memory. release is called once
+        // libzmq is done with the data, also if the message could not be
+        // sent. Returns false if the send timeout expired.
+        bool publish(const u8 *data, size_t size, ReleaseFunction release);
+
+        // Publishes the used part of the buffer. The buffer is enqueued onto
+        // emptyQueue afterwards. The queue must allow enqueueing from another
+        // thread, i.e. ThreadSafeQueue or MPMCQueue.
+        bool publish(ReadoutBuffer *buffer, ReadoutBufferQueues::QueueType &emptyQueue);
+
+        // Publishes a buffer shared via a SnoopFanout. The reference is
+        // released once the message has been sent.
+        bool publish(SnoopBufferRef &&ref);
+
+        // Copies the data into the message.
+        bool publishCopy(const u8 *data, size_t size);
+
+        // Publisher stage analogous to listfile_buffer_writer(): publishes
+        // filled buffers until an empty sentinel buffer is dequeued. Buffers
+        // are returned to the empty queue once sent.
+        void run(ReadoutBufferQueues &bufferQueues);
+
+        ZmqPublisherCounters counters() const;
+
+    private:
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_MVLC_ZMQ_PUBLISHER_H__ */
@@ -0,0 +1,135 @@
+#include <chrono>
+#include <thread>
+#include <zmq.hpp>
+#include "gtest/gtest.h"
+#include "mvlc_zmq_publisher.h"
+
+using namespace mesytec::mvlc;
+
+namespace
+{
+
+zmq::socket_t make_subscriber(zmq::context_t &ctx, const std::string &url, int rcvhwm = 1000)
+{
+    zmq::socket_t sub(ctx, ZMQ_SUB);
+    int timeout = 2000; // milliseconds
+    zmq_setsockopt(static_cast<void *>(sub), ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+    zmq_setsockopt(static_cast<void *>(sub), ZMQ_RCVHWM, &rcvhwm, sizeof(rcvhwm));
+    zmq_setsockopt(static_cast<void *>(sub), ZMQ_SUBSCRIBE, "", 0);
+    zmq_connect(static_cast<void *>(sub), url.c_str());
+    return sub;
+}
+
+// Returns the received message data or an empty vector on timeout.
+std::vector<u32> receive(zmq::socket_t &sub)
+{
+    zmq_msg_t msg;
+    zmq_msg_init(&msg);
+    std::vector<u32> result;
+
+    if (zmq_msg_recv(&msg, static_cast<void *>(sub), 0) >= 0)
+    {
+        auto data = static_cast<const u32 *>(zmq_msg_data(&msg));
+        result.assign(data, data + zmq_msg_size(&msg) / sizeof(u32));
+    }
+
+    zmq_msg_close(&msg);
+    return result;
+}
+
+}
+
+TEST(mvlc_zmq_publisher, ZeroCopyBuffersReturnToQueue)
+{
+    ZmqPublisherOptions options;
+    options.bindUrl = "tcp://*:5576";
+
+    ZmqBufferPublisher pub(options);
+    ReadoutBufferQueues queues(1024, 4);
+
+    zmq::context_t ctx;
+    auto sub0 = make_subscriber(ctx, "tcp://localhost:5576");
+    auto sub1 = make_subscriber(ctx, "tcp://localhost:5576");
+
+    ASSERT_EQ(pub.waitForSubscribers(2, std::chrono::seconds(5)), 2u);
+
+    for (u32 i=0; i<100; ++i)
+    {
+        // Blocks until a previously published buffer has been released.
+        auto buffer = queues.emptyBufferQueue().dequeue(std::chrono::seconds(5));
+        ASSERT_NE(buffer, nullptr);
+        buffer->clear();
+        buffer->push_back(i);
+        ASSERT_TRUE(pub.publish(buffer, queues.emptyBufferQueue()));
+
+        for (auto sub: { &sub0, &sub1 })
+        {
+            auto data = receive(*sub);
+            ASSERT_EQ(data.size(), 1u);
+            ASSERT_EQ(data[0], i);
+        }
+    }
+
+    auto counters = pub.counters();
+    ASSERT_EQ(counters.messagesPublished, 100u);
+    ASSERT_EQ(counters.bytesPublished, 100u * sizeof(u32));
+    ASSERT_EQ(counters.sendTimeouts, 0u);
+    ASSERT_EQ(counters.subscribers, 2u);
+
+    // The release function runs in a zmq io thread once the message was sent
+    // to both subscribers.
+    auto tEnd = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+    while (queues.emptyBufferQueue().size() < queues.bufferCount()
+           && std::chrono::steady_clock::now() < tEnd)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_EQ(queues.emptyBufferQueue().size(), queues.bufferCount());
+}
+
+TEST(mvlc_zmq_publisher, BackpressureInsteadOfDrops)
+{
+    ZmqPublisherOptions options;
+    options.bindUrl = "tcp://*:5577";
+    options.sendHighWaterMark = 1;
+    options.sendTimeout = std::chrono::milliseconds(200);
+
+    ZmqBufferPublisher pub(options);
+
+    zmq::context_t ctx;
+    auto sub = make_subscriber(ctx, "tcp://localhost:5577", 1);
+
+    ASSERT_EQ(pub.waitForSubscribers(1, std::chrono::seconds(5)), 1u);
+
+    // The subscriber does not read. Once the queues and socket buffers are
+    // full publishing times out instead of silently dropping messages.
+    std::vector<u32> data(util::Kilobytes(64) / sizeof(u32), 0u);
+    size_t published = 0u;
+
+    while (published < 10000)
+    {
+        data[0] = published;
+
+        if (!pub.publishCopy(reinterpret_cast<const u8 *>(data.data()), data.size() * sizeof(u32)))
+            break;
+
+        ++published;
+    }
+
+    ASSERT_LT(published, 10000u);
+
+    auto counters = pub.counters();
+    ASSERT_EQ(counters.messagesPublished, published);
+    ASSERT_EQ(counters.sendTimeouts, 1u);
+    ASSERT_GE(counters.sendBlocked, 1u);
+
+    // Every published message arrives in order.
+    for (size_t i=0; i<published; ++i)
+    {
+        auto received = receive(sub);
+        ASSERT_EQ(received.size(), data.size());
+        ASSERT_EQ(received[0], i);
+    }
+}
@@ -1 +1,342 @@
 #include "readout_buffer.h"
+
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#ifndef __WIN32
+#include <sys/mman.h>
+#endif
+
+namespace mesytec
+{
+namespace mvlc
+{
+
+namespace
+{
+
+// Huge page size assumed for MAP_HUGETLB mappings. Mapping sizes must be a
+// multiple of it.
+static const size_t HugePageSize = 2u << 20;
+
+struct Allocation
+{
+    u8 *data = nullptr;
+    size_t size = 0;
+    bool isMapped = false;
+};
+
+size_t round_up(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+size_t effective_alignment(const BufferStorageOptions &options)
+{
+    size_t result = BufferStorageOptions::CacheLineSize;
+
+    while (result < options.alignment)
+        result <<= 1;
+
+    return result;
+}
+
+#ifndef __WIN32
+Allocation map_anonymous(size_t size, BufferStorageOptions::HugePages hugePages)
+{
+    using HugePages = BufferStorageOptions::HugePages;
+    Allocation result;
+
+#ifdef MAP_HUGETLB
+    if (hugePages == HugePages::Explicit)
+    {
+        result.size = round_up(size, HugePageSize);
+        void *mem = ::mmap(nullptr, result.size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (mem != MAP_FAILED)
+        {
+            result.data = reinterpret_cast<u8 *>(mem);
+            result.isMapped = true;
+            return result;
+        }
+    }
+#endif
+
+    result.size = round_up(size, BufferStorageOptions::PageSize);
+    void *mem = ::mmap(nullptr, result.size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED)
+        throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    // Advisory only, fails if THP is disabled in the kernel.
+    ::madvise(mem, result.size, MADV_HUGEPAGE);
+#endif
+
+    result.data = reinterpret_cast<u8 *>(mem);
+    result.isMapped = true;
+    return result;
+}
+#endif
+
+Allocation allocate(size_t size, const BufferStorageOptions &options)
+{
+    Allocation result;
+
+    if (size == 0)
+        return result;
+
+#ifndef __WIN32
+    if (options.hugePages != BufferStorageOptions::HugePages::None)
+        return map_anonymous(size, options.hugePages);
+#endif
+
+    // Note: the memory is intentionally not touched here, see
+    // BufferStorageOptions.
+    result.size = size;
+    result.data = reinterpret_cast<u8 *>(
+        ::operator new(size, std::align_val_t(effective_alignment(options))));
+    return result;
+}
+
+void deallocate(u8 *data, size_t size, bool isMapped, const BufferStorageOptions &options)
+{
+    if (!data)
+        return;
+
+#ifndef __WIN32
+    if (isMapped)
+    {
+        ::munmap(data, size);
+        return;
+    }
+#else
+    (void) isMapped;
+#endif
+
+    (void) size;
+    ::operator delete(data, std::align_val_t(effective_alignment(options)));
+}
+
+} // end anon namespace
+
+ReadoutBufferStorage::ReadoutBufferStorage(size_t size, const BufferStorageOptions &options)
+    : m_options(options)
+{
+    resize(size);
+}
+
+ReadoutBufferStorage::~ReadoutBufferStorage()
+{
+    release();
+}
+
+ReadoutBufferStorage::ReadoutBufferStorage(const ReadoutBufferStorage &other)
+    : m_options(other.m_options)
+{
+    assign(other.begin(), other.end());
+}
+
+ReadoutBufferStorage &ReadoutBufferStorage::operator=(const ReadoutBufferStorage &other)
+{
+    if (this != &other)
+        assign(other.begin(), other.end());
+    return *this;
+}
+
+ReadoutBufferStorage::ReadoutBufferStorage(ReadoutBufferStorage &&other) noexcept
+{
+    swap(other);
+}
+
+ReadoutBufferStorage &ReadoutBufferStorage::operator=(ReadoutBufferStorage &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        swap(other);
+    }
+    return *this;
+}
+
+void ReadoutBufferStorage::resize(size_t size)
+{
+    if (size > m_capacity)
+        reserve(std::max(size, m_capacity + m_capacity / 2));
+    m_size = size;
+}
+
+void ReadoutBufferStorage::resize(size_t size, u8 value)
+{
+    const size_t oldSize = m_size;
+    resize(size);
+
+    if (size > oldSize)
+        std::memset(m_data + oldSize, value, size - oldSize);
+}
+
+void ReadoutBufferStorage::reserve(size_t capacity)
+{
+    if (capacity > m_capacity)
+        reallocate(capacity);
+}
+
+void ReadoutBufferStorage::assign(const u8 *first, const u8 *last)
+{
+    const size_t size = last - first;
+
+    if (size > m_capacity)
+    {
+        // Drop the old contents instead of copying them over.
+        m_size = 0;
+        reserve(size);
+    }
+
+    if (size)
+        std::memmove(m_data, first, size);
+    m_size = size;
+}
+
+u8 &ReadoutBufferStorage::at(size_t i)
+{
+    if (i >= m_size)
+        throw std::out_of_range("ReadoutBufferStorage::at()");
+    return m_data[i];
+}
+
+const u8 &ReadoutBufferStorage::at(size_t i) const
+{
+    if (i >= m_size)
+        throw std::out_of_range("ReadoutBufferStorage::at()");
+    return m_data[i];
+}
+
+ReadoutBufferStorage::iterator ReadoutBufferStorage::makeGap(const_iterator pos, size_t count)
+{
+    assert(begin() <= pos && pos <= end());
+    const size_t offset = pos - begin();
+    const size_t tail = m_size - offset;
+
+    resize(m_size + count);
+
+    if (tail)
+        std::memmove(m_data + offset + count, m_data + offset, tail);
+
+    return m_data + offset;
+}
+
+ReadoutBufferStorage::iterator ReadoutBufferStorage::insert(const_iterator pos, size_t count, u8 value)
+{
+    auto dest = makeGap(pos, count);
+    std::memset(dest, value, count);
+    return dest;
+}
+
+ReadoutBufferStorage::iterator ReadoutBufferStorage::erase(const_iterator first, const_iterator last)
+{
+    assert(begin() <= first && first <= last && last <= end());
+    const size_t offset = first - begin();
+    const size_t count = last - first;
+    const size_t tail = m_size - offset - count;
+
+    if (count && tail)
+        std::memmove(m_data + offset, m_data + offset + count, tail);
+
+    m_size -= count;
+    return m_data + offset;
+}
+
+void ReadoutBufferStorage::swap(ReadoutBufferStorage &other) noexcept
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_capacity, other.m_capacity);
+    std::swap(m_allocSize, other.m_allocSize);
+    std::swap(m_isMapped, other.m_isMapped);
+    std::swap(m_options, other.m_options);
+}
+
+void ReadoutBufferStorage::reallocate(size_t capacity)
+{
+    auto alloc = allocate(capacity, m_options);
+
+    if (m_size)
+        std::memcpy(alloc.data, m_data, m_size);
+
+    deallocate(m_data, m_allocSize, m_isMapped, m_options);
+
+    m_data = alloc.data;
+    m_allocSize = alloc.size;
+    m_isMapped = alloc.isMapped;
+    // Use the page rounding of mappings as additional capacity.
+    m_capacity = alloc.isMapped ? alloc.size : capacity;
+}
+
+void ReadoutBufferStorage::release()
+{
+    deallocate(m_data, m_allocSize, m_isMapped, m_options);
+    m_data = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+    m_allocSize = 0;
+    m_isMapped = false;
+}
+
+ReadoutBuffer::ReadoutBuffer(const ReadoutBuffer &other)
+    : m_type(other.m_type)
+    , m_number(other.m_number)
+    , m_buffer(other.capacity(), other.m_buffer.options())
+    , m_used(other.m_used)
+{
+    if (m_used)
+        std::memcpy(m_buffer.data(), other.m_buffer.data(), m_used);
+}
+
+ReadoutBuffer &ReadoutBuffer::operator=(const ReadoutBuffer &other)
+{
+    if (this != &other)
+    {
+        // Drop the old contents so that a reallocation does not copy them.
+        m_buffer.clear();
+        m_buffer.resize(other.capacity());
+
+        if (other.m_used)
+            std::memcpy(m_buffer.data(), other.m_buffer.data(), other.m_used);
+
+        m_type = other.m_type;
+        m_number = other.m_number;
+        m_used = other.m_used;
+    }
+
+    return *this;
+}
+
+ReadoutBuffer::ReadoutBuffer(ReadoutBuffer &&other) noexcept
+    : m_type(other.m_type)
+    , m_number(other.m_number)
+    , m_buffer(std::move(other.m_buffer))
+    , m_used(other.m_used)
+{
+    other.m_used = 0;
+}
+
+ReadoutBuffer &ReadoutBuffer::operator=(ReadoutBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        m_type = other.m_type;
+        m_number = other.m_number;
+        m_buffer = std::move(other.m_buffer);
+        m_used = other.m_used;
+        other.m_used = 0;
+    }
+
+    return *this;
+}
+
+} // end namespace mvlc
+} // end namespace mesytec
@@ -1,7 +1,10 @@
 #ifndef __MESYTEC_MVLC_UTIL_READOUT_BUFFER_H__
 #define __MESYTEC_MVLC_UTIL_READOUT_BUFFER_H__
 
+#include <algorithm>
 #include <cassert>
+#include <iterator>
+#include <type_traits>
 #include <vector>
 
 #include "mesytec-mvlc/mesytec-mvlc_export.h"
@@ -13,6 +16,143 @@ namespace mesytec
 namespace mvlc
 {
 
+// Allocation options for ReadoutBufferStorage.
+//
+// Buffer memory is not initialized and not touched when allocated. The kernel
+// backs the pages on first write, so the memory ends up on the NUMA node of
+// the thread filling the buffer, e.g. the readout thread, instead of the
+// thread that created the buffer queues.
+struct MESYTEC_MVLC_EXPORT BufferStorageOptions
+{
+    static constexpr size_t CacheLineSize = 64;
+    static constexpr size_t PageSize = 4096;
+
+    enum class HugePages
+    {
+        // Regular heap allocation.
+        None,
+        // Anonymous mapping advised to be backed by transparent huge pages.
+        Transparent,
+        // MAP_HUGETLB mapping using the preallocated huge page pool
+        // (/proc/sys/vm/nr_hugepages). Falls back to Transparent if the pool
+        // is exhausted.
+        Explicit,
+    };
+
+    // Alignment of the buffer data. Must be a power of two, values below the
+    // cache line size are raised to it. Use PageSize for O_DIRECT I/O.
+    // Mappings are always page aligned.
+    size_t alignment = CacheLineSize;
+    HugePages hugePages = HugePages::None;
+};
+
+// Owning byte buffer implementing the commonly used parts of the
+// std::vector<u8> interface. Unlike std::vector, resize(size) leaves the new
+// bytes uninitialized. Copy construction uses the options of the source
+// buffer, assignment keeps the options of the target.
+class MESYTEC_MVLC_EXPORT ReadoutBufferStorage
+{
+    public:
+        using value_type = u8;
+        using iterator = u8 *;
+        using const_iterator = const u8 *;
+
+        ReadoutBufferStorage() = default;
+        explicit ReadoutBufferStorage(size_t size, const BufferStorageOptions &options = {});
+        ~ReadoutBufferStorage();
+
+        ReadoutBufferStorage(const ReadoutBufferStorage &other);
+        ReadoutBufferStorage &operator=(const ReadoutBufferStorage &other);
+
+        ReadoutBufferStorage(ReadoutBufferStorage &&other) noexcept;
+        ReadoutBufferStorage &operator=(ReadoutBufferStorage &&other) noexcept;
+
+        size_t size() const { return m_size; }
+        size_t capacity() const { return m_capacity; }
+        bool empty() const { return m_size == 0; }
+
+        u8 *data() { return m_data; }
+        const u8 *data() const { return m_data; }
+
+        iterator begin() { return m_data; }
+        iterator end() { return m_data + m_size; }
+        const_iterator begin() const { return m_data; }
+        const_iterator end() const { return m_data + m_size; }
+        const_iterator cbegin() const { return begin(); }
+        const_iterator cend() const { return end(); }
+
+        u8 &operator[](size_t i) { assert(i < m_size); return m_data[i]; }
+        const u8 &operator[](size_t i) const { assert(i < m_size); return m_data[i]; }
+
+        // Throw std::out_of_range if i >= size().
+        u8 &at(size_t i);
+        const u8 &at(size_t i) const;
+
+        u8 &front() { assert(m_size); return m_data[0]; }
+        const u8 &front() const { assert(m_size); return m_data[0]; }
+        u8 &back() { assert(m_size); return m_data[m_size - 1]; }
+        const u8 &back() const { assert(m_size); return m_data[m_size - 1]; }
+
+        // Existing contents are kept, new bytes are left uninitialized.
+        // Capacity grows geometrically.
+        void resize(size_t size);
+        // Like std::vector::resize(): new bytes are set to value.
+        void resize(size_t size, u8 value);
+        void reserve(size_t capacity);
+        void clear() { m_size = 0; }
+
+        void assign(const u8 *first, const u8 *last);
+
+        void push_back(u8 value)
+        {
+            resize(m_size + 1);
+            m_data[m_size - 1] = value;
+        }
+
+        void pop_back() { assert(m_size); --m_size; }
+
+        // The inserted range must not point into this storage.
+        template<typename ForwardIt>
+        iterator insert(const_iterator pos, ForwardIt first, ForwardIt last)
+        {
+            const size_t count = std::distance(first, last);
+            auto dest = makeGap(pos, count);
+            std::copy(first, last, dest);
+            return dest;
+        }
+
+        iterator insert(const_iterator pos, size_t count, u8 value);
+        iterator insert(const_iterator pos, u8 value) { return insert(pos, 1u, value); }
+
+        iterator erase(const_iterator first, const_iterator last);
+        iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+
+        void swap(ReadoutBufferStorage &other) noexcept;
+
+        const BufferStorageOptions &options() const { return m_options; }
+
+    private:
+        // Moves the contents starting at pos count bytes towards the end.
+        // Returns a pointer to the uninitialized gap.
+        iterator makeGap(const_iterator pos, size_t count);
+        void reallocate(size_t capacity);
+        void release();
+
+        u8 *m_data = nullptr;
+        size_t m_size = 0;
+        size_t m_capacity = 0;
+        // Size of the heap allocation or mapping. May be larger than capacity
+        // due to page rounding.
+        size_t m_allocSize = 0;
+        bool m_isMapped = false;
+        BufferStorageOptions m_options;
+};
+
+inline void swap(ReadoutBufferStorage &a, ReadoutBufferStorage &b) noexcept
+{
+    a.swap(b);
+}
+
 class MESYTEC_MVLC_EXPORT ReadoutBuffer
 {
     public:
@@ -20,10 +160,19 @@ class MESYTEC_MVLC_EXPORT ReadoutBuffer
         // stream.
         static const s32 EndOfStream = -1;
 
-        explicit ReadoutBuffer(size_t capacity = 0)
-            : m_buffer(capacity)
+        explicit ReadoutBuffer(size_t capacity = 0, const BufferStorageOptions &options = {})
+            : m_buffer(capacity, options)
         { }
 
+        // Copies keep the capacity of the source buffer but only copy the
+        // used() part of the data.
+        ReadoutBuffer(const ReadoutBuffer &other);
+        ReadoutBuffer &operator=(const ReadoutBuffer &other);
+
+        // A moved-from buffer is empty and has zero capacity.
+        ReadoutBuffer(ReadoutBuffer &&other) noexcept;
+        ReadoutBuffer &operator=(ReadoutBuffer &&other) noexcept;
+
         s32 type() const { return m_type; }
         void setType(s32 t) { m_type = t; }
         void setType(ConnectionType t) { setType(static_cast<s32>(t)); }
@@ -58,8 +207,8 @@ class MESYTEC_MVLC_EXPORT ReadoutBuffer
             m_used = bytes;
         }
 
-        const std::vector<u8> &buffer() const { return m_buffer; }
-        std::vector<u8> &buffer() { return m_buffer; }
+        const ReadoutBufferStorage &buffer() const { return m_buffer; }
+        ReadoutBufferStorage &buffer() { return m_buffer; }
 
         const u8 *data() const { return buffer().data(); }
         u8 *data() { return buffer().data(); }
@@ -90,7 +239,7 @@ class MESYTEC_MVLC_EXPORT ReadoutBuffer
     private:
         s32 m_type = static_cast<s32>(ConnectionType::ETH);
         size_t m_number = 0;
-        std::vector<u8> m_buffer;
+        ReadoutBufferStorage m_buffer;
         size_t m_used = 0;
 };
 
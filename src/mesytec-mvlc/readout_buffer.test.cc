@@ -0,0 +1,201 @@
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+
+#include "readout_buffer.h"
+#include "readout_buffer_queues.h"
+
+using namespace mesytec::mvlc;
+
+namespace
+{
+
+bool is_aligned(const void *ptr, size_t alignment)
+{
+    return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+std::vector<BufferStorageOptions> all_storage_options()
+{
+    using HugePages = BufferStorageOptions::HugePages;
+
+    return
+    {
+        {},
+        { BufferStorageOptions::PageSize, HugePages::None },
+        { BufferStorageOptions::CacheLineSize, HugePages::Transparent },
+        // Falls back to THP if no huge pages are configured.
+        { BufferStorageOptions::CacheLineSize, HugePages::Explicit },
+    };
+}
+
+}
+
+TEST(readout_buffer, StorageGrowKeepsContents)
+{
+    for (const auto &options: all_storage_options())
+    {
+        SCOPED_TRACE(static_cast<int>(options.hugePages));
+        SCOPED_TRACE(options.alignment);
+
+        ReadoutBufferStorage storage(100, options);
+        ASSERT_EQ(storage.size(), 100u);
+        ASSERT_GE(storage.capacity(), 100u);
+        ASSERT_TRUE(is_aligned(storage.data(), std::max(options.alignment, BufferStorageOptions::CacheLineSize)));
+
+        std::iota(storage.begin(), storage.end(), 0);
+
+        storage.resize(util::Megabytes(3));
+        ASSERT_EQ(storage.size(), util::Megabytes(3));
+        ASSERT_TRUE(is_aligned(storage.data(), std::max(options.alignment, BufferStorageOptions::CacheLineSize)));
+
+        for (size_t i=0; i<100; ++i)
+            ASSERT_EQ(storage[i], static_cast<u8>(i));
+
+        // Shrinking keeps the allocation.
+        auto data = storage.data();
+        storage.resize(10);
+        ASSERT_EQ(storage.data(), data);
+        ASSERT_GE(storage.capacity(), util::Megabytes(3));
+
+        storage.clear();
+        ASSERT_TRUE(storage.empty());
+    }
+}
+
+TEST(readout_buffer, StorageCopyAndMove)
+{
+    BufferStorageOptions options;
+    options.alignment = BufferStorageOptions::PageSize;
+
+    ReadoutBufferStorage a(1000, options);
+    std::iota(a.begin(), a.end(), 0);
+
+    ReadoutBufferStorage b(a);
+    ASSERT_NE(b.data(), a.data());
+    ASSERT_TRUE(std::equal(a.begin(), a.end(), b.begin(), b.end()));
+    ASSERT_EQ(b.options().alignment, options.alignment);
+
+    auto data = a.data();
+    ReadoutBufferStorage c(std::move(a));
+    ASSERT_EQ(c.data(), data);
+    ASSERT_TRUE(a.empty());
+    ASSERT_EQ(a.data(), nullptr);
+
+    ReadoutBufferStorage d;
+    d = c;
+    ASSERT_TRUE(std::equal(c.begin(), c.end(), d.begin(), d.end()));
+
+    std::swap(c, d);
+    ASSERT_TRUE(std::equal(c.begin(), c.end(), b.begin(), b.end()));
+
+    const u8 bytes[] = { 1, 2, 3 };
+    d.assign(bytes, bytes + 3);
+    ASSERT_EQ(d.size(), 3u);
+    ASSERT_EQ(d[2], 3u);
+}
+
+// The parts of the std::vector<u8> interface used on ReadoutBuffer::buffer().
+TEST(readout_buffer, StorageVectorInterface)
+{
+    ReadoutBufferStorage s;
+    std::vector<u8> v;
+
+    for (u8 i=0; i<10; ++i)
+    {
+        s.push_back(i);
+        v.push_back(i);
+    }
+
+    const u8 bytes[] = { 100, 101, 102 };
+    s.insert(s.begin() + 2, std::begin(bytes), std::end(bytes));
+    v.insert(v.begin() + 2, std::begin(bytes), std::end(bytes));
+    s.insert(s.end(), v.begin(), v.begin() + 4);
+    v.insert(v.end(), v.begin(), v.begin() + 4);
+    s.insert(s.begin(), 3u, 200);
+    v.insert(v.begin(), 3u, 200);
+    s.insert(s.begin() + 1, 201);
+    v.insert(v.begin() + 1, 201);
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), v.begin(), v.end()));
+
+    s.erase(s.begin() + 3, s.begin() + 7);
+    v.erase(v.begin() + 3, v.begin() + 7);
+    s.erase(s.begin());
+    v.erase(v.begin());
+    s.pop_back();
+    v.pop_back();
+    ASSERT_TRUE(std::equal(s.cbegin(), s.cend(), v.begin(), v.end()));
+
+    s.resize(s.size() + 5, 0xaa);
+    v.resize(v.size() + 5, 0xaa);
+    ASSERT_TRUE(std::equal(s.begin(), s.end(), v.begin(), v.end()));
+
+    ASSERT_EQ(s.front(), v.front());
+    ASSERT_EQ(s.back(), v.back());
+    ASSERT_EQ(s.at(4), v.at(4));
+    ASSERT_THROW(s.at(s.size()), std::out_of_range);
+}
+
+TEST(readout_buffer, ReadoutBufferPushBack)
+{
+    ReadoutBuffer buffer;
+    ASSERT_EQ(buffer.capacity(), 0u);
+
+    for (u32 i=0; i<10000; ++i)
+        buffer.push_back(i);
+
+    ASSERT_EQ(buffer.used(), 10000 * sizeof(u32));
+    auto view = buffer.viewU32();
+
+    for (u32 i=0; i<10000; ++i)
+        ASSERT_EQ(view[i], i);
+
+    ReadoutBuffer copy(buffer);
+    ASSERT_EQ(copy.used(), buffer.used());
+    ASSERT_TRUE(std::equal(buffer.viewU8().begin(), buffer.viewU8().end(), copy.data()));
+
+    // Copies keep the capacity, only the used part is copied.
+    ReadoutBuffer large(util::Megabytes(1));
+    large.setType(ConnectionType::USB);
+    large.setBufferNumber(42);
+    large.push_back(0x12345678u);
+
+    ReadoutBuffer assigned;
+    assigned = large;
+    ASSERT_EQ(assigned.capacity(), large.capacity());
+    ASSERT_EQ(assigned.used(), sizeof(u32));
+    ASSERT_EQ(assigned.viewU32()[0], 0x12345678u);
+    ASSERT_EQ(assigned.type(), large.type());
+    ASSERT_EQ(assigned.bufferNumber(), 42u);
+
+    ReadoutBuffer moved(std::move(large));
+    ASSERT_EQ(moved.used(), sizeof(u32));
+    ASSERT_EQ(moved.viewU32()[0], 0x12345678u);
+    ASSERT_TRUE(large.empty());
+    ASSERT_EQ(large.capacity(), 0u);
+}
+
+TEST(readout_buffer, QueuesUseStorageOptions)
+{
+    BufferStorageOptions options;
+    options.alignment = BufferStorageOptions::PageSize;
+    options.hugePages = BufferStorageOptions::HugePages::Transparent;
+
+    SPSCReadoutBufferQueues queues(util::Kilobytes(64), 4, options);
+    ASSERT_EQ(queues.bufferCount(), 4u);
+
+    for (size_t i=0; i<queues.bufferCount(); ++i)
+    {
+        auto buffer = queues.emptyBufferQueue().dequeue();
+        ASSERT_NE(buffer, nullptr);
+        ASSERT_EQ(buffer->capacity(), util::Kilobytes(64));
+        ASSERT_TRUE(is_aligned(buffer->data(), BufferStorageOptions::PageSize));
+        ASSERT_EQ(buffer->buffer().options().hugePages, options.hugePages);
+    }
+
+    // Buffer types without storage options.
+    ReadoutBufferQueues_<std::vector<u32>> vectorQueues(16, 2);
+    ASSERT_EQ(vectorQueues.emptyBufferQueue().dequeue()->size(), 16u);
+}
@@ -1,8 +1,11 @@
 #ifndef __MESYTEC_MVLC_UTIL_READOUT_BUFFER_QUEUES_H__
 #define __MESYTEC_MVLC_UTIL_READOUT_BUFFER_QUEUES_H__
 
+#include <type_traits>
+
 #include "mesytec-mvlc/mesytec-mvlc_export.h"
 #include "mesytec-mvlc/readout_buffer.h"
+#include "mesytec-mvlc/util/lockfree_queue.h"
 #include "mesytec-mvlc/util/storage_sizes.h"
 #include "mesytec-mvlc/util/threadsafequeue.h"
 
@@ -11,14 +14,40 @@ namespace mesytec
 namespace mvlc
 {
 
-template<typename BufferType> class ReadoutBufferQueues_
+// Pair of buffer queues: empty buffers are taken from the empty queue, filled
+// and then put onto the filled queue. The consumer returns them to the empty
+// queue once it's done.
+//
+// QueueType_ defaults to the mutex based ThreadSafeQueue which allows any
+// number of producers and consumers. Use SPSCQueue if each of the two queues
+// has exactly one producer and one consumer thread, MPMCQueue for the general
+// case. Bounded queue types are constructed with a capacity of bufferCount.
+//
+// The buffers are constructed in place from bufferCapacity and, if BufferType
+// supports it, storageOptions. Buffer memory is only touched once a buffer is
+// filled, see BufferStorageOptions.
+template<typename BufferType, typename QueueType_ = ThreadSafeQueue<BufferType *>>
+class ReadoutBufferQueues_
 {
     public:
-        using QueueType = ThreadSafeQueue<BufferType *>;
+        using QueueType = QueueType_;
 
-        explicit ReadoutBufferQueues_(size_t bufferCapacity = util::Megabytes(1), size_t bufferCount = 10)
-            : m_bufferStorage(bufferCount, BufferType(bufferCapacity))
+        explicit ReadoutBufferQueues_(
+            size_t bufferCapacity = util::Megabytes(1), size_t bufferCount = 10,
+            const BufferStorageOptions &storageOptions = {})
+            : m_filledBuffers(make_queue(bufferCount))
+            , m_emptyBuffers(make_queue(bufferCount))
         {
+            m_bufferStorage.reserve(bufferCount);
+
+            for (size_t i=0; i<bufferCount; ++i)
+            {
+                if constexpr (std::is_constructible<BufferType, size_t, const BufferStorageOptions &>::value)
+                    m_bufferStorage.emplace_back(bufferCapacity, storageOptions);
+                else
+                    m_bufferStorage.emplace_back(bufferCapacity);
+            }
+
             for (auto &buffer: m_bufferStorage)
                 m_emptyBuffers.enqueue(&buffer);
         }
@@ -28,12 +57,22 @@ template<typename BufferType> class ReadoutBufferQueues_
         size_t bufferCount() { return m_bufferStorage.size(); }
 
     private:
+        static QueueType make_queue(size_t capacity)
+        {
+            if constexpr (std::is_constructible<QueueType, size_t>::value)
+                return QueueType(capacity);
+            else
+                return QueueType();
+        }
+
         QueueType m_filledBuffers;
         QueueType m_emptyBuffers;
         std::vector<BufferType> m_bufferStorage;
 };
 
 using ReadoutBufferQueues = ReadoutBufferQueues_<ReadoutBuffer>;
+using SPSCReadoutBufferQueues = ReadoutBufferQueues_<ReadoutBuffer, SPSCQueue<ReadoutBuffer *>>;
+using MPMCReadoutBufferQueues = ReadoutBufferQueues_<ReadoutBuffer, MPMCQueue<ReadoutBuffer *>>;
 
 } // end namespace mvlc
 } // end namespace mesytec
@@ -0,0 +1,225 @@
+#include "snoop_fanout.h"
+
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+
+namespace mesytec
+{
+namespace mvlc
+{
+
+SnoopBufferRef::SnoopBufferRef(SnoopFanout *fanout, ReadoutBuffer *buffer)
+    : m_fanout(fanout)
+    , m_buffer(buffer)
+{
+}
+
+SnoopBufferRef::~SnoopBufferRef()
+{
+    reset();
+}
+
+SnoopBufferRef::SnoopBufferRef(SnoopBufferRef &&other) noexcept
+    : m_fanout(other.m_fanout)
+    , m_buffer(other.m_buffer)
+{
+    other.m_fanout = nullptr;
+    other.m_buffer = nullptr;
+}
+
+SnoopBufferRef &SnoopBufferRef::operator=(SnoopBufferRef &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        std::swap(m_fanout, other.m_fanout);
+        std::swap(m_buffer, other.m_buffer);
+    }
+    return *this;
+}
+
+void SnoopBufferRef::reset()
+{
+    if (m_fanout && m_buffer)
+        m_fanout->release(m_buffer);
+
+    m_fanout = nullptr;
+    m_buffer = nullptr;
+}
+
+SnoopConsumer::SnoopConsumer(SnoopFanout *fanout, const std::string &name, size_t maxQueuedBuffers)
+    : m_fanout(fanout)
+    , m_name(name)
+    , m_queue(maxQueuedBuffers)
+{
+}
+
+SnoopBufferRef SnoopConsumer::dequeue()
+{
+    if (auto buffer = m_queue.dequeue())
+        return SnoopBufferRef(m_fanout, buffer);
+    return {};
+}
+
+SnoopBufferRef SnoopConsumer::dequeue(const std::chrono::milliseconds &timeout)
+{
+    if (auto buffer = m_queue.dequeue(timeout))
+        return SnoopBufferRef(m_fanout, buffer);
+    return {};
+}
+
+struct SnoopFanout::Private
+{
+    std::vector<ReadoutBuffer> bufferStorage;
+    // Per buffer reference count, indexed like bufferStorage.
+    std::unique_ptr<std::atomic<unsigned>[]> refCounts;
+    // Filled by the producer and the consumer threads releasing buffers.
+    MPMCQueue<ReadoutBuffer *> emptyBuffers;
+
+    // Guards the consumer list. Held while publishing so that consumers can
+    // be removed safely.
+    mutable std::mutex consumersMutex;
+    std::vector<std::unique_ptr<SnoopConsumer>> consumers;
+
+    Private(size_t bufferCount)
+        : refCounts(std::make_unique<std::atomic<unsigned>[]>(bufferCount))
+        , emptyBuffers(bufferCount)
+    {
+    }
+
+    std::atomic<unsigned> &refCount(const ReadoutBuffer *buffer)
+    {
+        assert(bufferStorage.data() <= buffer && buffer < bufferStorage.data() + bufferStorage.size());
+        return refCounts[buffer - bufferStorage.data()];
+    }
+};
+
+SnoopFanout::SnoopFanout(size_t bufferCapacity, size_t bufferCount, const BufferStorageOptions &storageOptions)
+    : d(std::make_unique<Private>(bufferCount))
+{
+    d->bufferStorage.reserve(bufferCount);
+
+    for (size_t i=0; i<bufferCount; ++i)
+    {
+        d->bufferStorage.emplace_back(bufferCapacity, storageOptions);
+        d->refCounts[i] = 0;
+        d->emptyBuffers.enqueue(&d->bufferStorage.back());
+    }
+}
+
+SnoopFanout::~SnoopFanout()
+{
+}
+
+SnoopConsumer *SnoopFanout::addConsumer(const std::string &name, size_t maxQueuedBuffers)
+{
+    std::unique_ptr<SnoopConsumer> consumer(
+        new SnoopConsumer(this, name, std::max(maxQueuedBuffers, size_t(1))));
+    auto result = consumer.get();
+
+    std::lock_guard<std::mutex> guard(d->consumersMutex);
+    d->consumers.emplace_back(std::move(consumer));
+    return result;
+}
+
+void SnoopFanout::removeConsumer(SnoopConsumer *consumer)
+{
+    std::unique_ptr<SnoopConsumer> removed;
+
+    {
+        std::lock_guard<std::mutex> guard(d->consumersMutex);
+
+        auto it = std::find_if(std::begin(d->consumers), std::end(d->consumers),
+                               [consumer] (const auto &c) { return c.get() == consumer; });
+
+        if (it == std::end(d->consumers))
+            return;
+
+        removed = std::move(*it);
+        d->consumers.erase(it);
+    }
+
+    // No more buffers are published to the consumer now.
+    ReadoutBuffer *buffer = nullptr;
+
+    while (removed->m_queue.try_dequeue(buffer))
+        release(buffer);
+}
+
+std::vector<SnoopConsumer *> SnoopFanout::consumers() const
+{
+    std::lock_guard<std::mutex> guard(d->consumersMutex);
+    std::vector<SnoopConsumer *> result;
+
+    for (const auto &consumer: d->consumers)
+        result.push_back(consumer.get());
+
+    return result;
+}
+
+ReadoutBuffer *SnoopFanout::getEmptyBuffer()
+{
+    return d->emptyBuffers.dequeue();
+}
+
+void SnoopFanout::publish(ReadoutBuffer *buffer)
+{
+    auto &refCount = d->refCount(buffer);
+
+    // The producer holds a reference while publishing so that consumers
+    // releasing the buffer early cannot return it to the pool.
+    refCount = 1;
+
+    {
+        std::lock_guard<std::mutex> guard(d->consumersMutex);
+
+        for (auto &consumer: d->consumers)
+        {
+            refCount.fetch_add(1, std::memory_order_relaxed);
+
+            if (consumer->m_queue.try_enqueue(buffer))
+                ++consumer->m_receivedBuffers;
+            else
+            {
+                refCount.fetch_sub(1, std::memory_order_relaxed);
+                ++consumer->m_missedBuffers;
+            }
+        }
+    }
+
+    release(buffer);
+}
+
+void SnoopFanout::putBackUnused(ReadoutBuffer *buffer)
+{
+    assert(d->refCount(buffer) == 0);
+    d->emptyBuffers.enqueue(buffer);
+}
+
+void SnoopFanout::publishMissed()
+{
+    std::lock_guard<std::mutex> guard(d->consumersMutex);
+
+    for (auto &consumer: d->consumers)
+        ++consumer->m_missedBuffers;
+}
+
+size_t SnoopFanout::bufferCount() const
+{
+    return d->bufferStorage.size();
+}
+
+size_t SnoopFanout::emptyBufferCount() const
+{
+    return d->emptyBuffers.size();
+}
+
+void SnoopFanout::release(ReadoutBuffer *buffer)
+{
+    if (d->refCount(buffer).fetch_sub(1, std::memory_order_acq_rel) == 1)
+        d->emptyBuffers.enqueue(buffer);
+}
+
+} // end namespace mvlc
+} // end namespace mesytec
@@ -0,0 +1,152 @@
+#ifndef __MESYTEC_MVLC_SNOOP_FANOUT_H__
+#define __MESYTEC_MVLC_SNOOP_FANOUT_H__
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mesytec-mvlc/mesytec-mvlc_export.h"
+#include "mesytec-mvlc/readout_buffer.h"
+#include "mesytec-mvlc/util/lockfree_queue.h"
+#include "mesytec-mvlc/util/storage_sizes.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+
+class SnoopFanout;
+
+// Read-only reference to a buffer published by a SnoopFanout. Releases the
+// buffer when destroyed or reset. Once all consumers have released a buffer
+// it is returned to the fanouts pool of empty buffers.
+class MESYTEC_MVLC_EXPORT SnoopBufferRef
+{
+    public:
+        SnoopBufferRef() = default;
+        ~SnoopBufferRef();
+
+        SnoopBufferRef(SnoopBufferRef &&other) noexcept;
+        SnoopBufferRef &operator=(SnoopBufferRef &&other) noexcept;
+
+        SnoopBufferRef(const SnoopBufferRef &) = delete;
+        SnoopBufferRef &operator=(const SnoopBufferRef &) = delete;
+
+        const ReadoutBuffer *get() const { return m_buffer; }
+        const ReadoutBuffer *operator->() const { return m_buffer; }
+        const ReadoutBuffer &operator*() const { return *m_buffer; }
+        explicit operator bool() const { return m_buffer != nullptr; }
+
+        void reset();
+
+    private:
+        friend class SnoopConsumer;
+        SnoopBufferRef(SnoopFanout *fanout, ReadoutBuffer *buffer);
+
+        SnoopFanout *m_fanout = nullptr;
+        ReadoutBuffer *m_buffer = nullptr;
+};
+
+// A consumer registered with a SnoopFanout. Each consumer has its own bounded
+// queue of published buffers. If the queue is full when a buffer is published
+// the consumer misses that buffer, the producer and the other consumers are
+// not affected.
+//
+// Buffers must be dequeued from a single thread per consumer.
+class MESYTEC_MVLC_EXPORT SnoopConsumer
+{
+    public:
+        const std::string &name() const { return m_name; }
+        size_t maxQueuedBuffers() const { return m_queue.capacity(); }
+        size_t queuedBuffers() const { return m_queue.size(); }
+
+        // Returns an empty reference if no buffer is available.
+        SnoopBufferRef dequeue();
+        SnoopBufferRef dequeue(const std::chrono::milliseconds &timeout);
+
+        // Number of buffers added to the queue of this consumer.
+        size_t receivedBuffers() const { return m_receivedBuffers; }
+
+        // Number of buffers this consumer did not see, either because its
+        // queue was full or because the producer had no empty buffer to fill.
+        size_t missedBuffers() const { return m_missedBuffers; }
+
+    private:
+        friend class SnoopFanout;
+        SnoopConsumer(SnoopFanout *fanout, const std::string &name, size_t maxQueuedBuffers);
+
+        SnoopFanout *m_fanout;
+        std::string m_name;
+        SPSCQueue<ReadoutBuffer *> m_queue;
+        std::atomic<size_t> m_receivedBuffers{0};
+        std::atomic<size_t> m_missedBuffers{0};
+};
+
+// Shares readout buffers with any number of consumers without copying, e.g.
+// an online analysis, a network publisher and a rate monitor.
+//
+// The producer takes an empty buffer from the pool, fills it and publishes
+// it. Publishing adds the buffer to the queue of each consumer with space
+// left and sets the buffers reference count accordingly. Consumers hold on to
+// the buffer via SnoopBufferRef. The buffer returns to the pool once the last
+// consumer releases it.
+//
+// The producer side must be used from a single thread. Consumers can be
+// added at any time. Remove consumers only after their thread has stopped
+// dequeueing. SnoopBufferRefs must not outlive the fanout.
+class MESYTEC_MVLC_EXPORT SnoopFanout
+{
+    public:
+        explicit SnoopFanout(
+            size_t bufferCapacity = util::Megabytes(1), size_t bufferCount = 20,
+            const BufferStorageOptions &storageOptions = {});
+        ~SnoopFanout();
+
+        SnoopFanout(const SnoopFanout &) = delete;
+        SnoopFanout &operator=(const SnoopFanout &) = delete;
+
+        // Registers a consumer queueing at most maxQueuedBuffers buffers. The
+        // returned pointer stays valid until the consumer is removed or the
+        // fanout is destroyed.
+        SnoopConsumer *addConsumer(const std::string &name, size_t maxQueuedBuffers = 4);
+
+        // Unregisters the consumer and releases its queued buffers.
+        void removeConsumer(SnoopConsumer *consumer);
+
+        std::vector<SnoopConsumer *> consumers() const;
+
+        // Producer side.
+
+        // Returns an empty buffer from the pool or nullptr if all buffers are
+        // in use.
+        ReadoutBuffer *getEmptyBuffer();
+
+        // Shares the buffer with all consumers. Ownership of the buffer passes
+        // back to the fanout.
+        void publish(ReadoutBuffer *buffer);
+
+        // Returns a buffer obtained via getEmptyBuffer() without publishing it.
+        void putBackUnused(ReadoutBuffer *buffer);
+
+        // To be called if the producer could not get an empty buffer and the
+        // data went elsewhere. Counts a missed buffer for each consumer.
+        void publishMissed();
+
+        size_t bufferCount() const;
+        size_t emptyBufferCount() const;
+
+    private:
+        friend class SnoopBufferRef;
+        friend class SnoopConsumer;
+        void release(ReadoutBuffer *buffer);
+
+        struct Private;
+        std::unique_ptr<Private> d;
+};
+
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_SNOOP_FANOUT_H__ */
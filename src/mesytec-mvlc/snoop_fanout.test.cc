@@ -0,0 +1,185 @@
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "snoop_fanout.h"
+
+using namespace mesytec::mvlc;
+
+namespace
+{
+
+ReadoutBuffer *fill_buffer(SnoopFanout &fanout, u32 value)
+{
+    auto buffer = fanout.getEmptyBuffer();
+
+    if (buffer)
+    {
+        buffer->clear();
+        buffer->push_back(value);
+    }
+
+    return buffer;
+}
+
+}
+
+TEST(snoop_fanout, SharedBufferReturnsAfterLastRelease)
+{
+    SnoopFanout fanout(1024, 4);
+    auto a = fanout.addConsumer("a", 2);
+    auto b = fanout.addConsumer("b", 2);
+
+    ASSERT_EQ(fanout.consumers().size(), 2u);
+    ASSERT_EQ(fanout.emptyBufferCount(), 4u);
+
+    fanout.publish(fill_buffer(fanout, 42));
+    ASSERT_EQ(fanout.emptyBufferCount(), 3u);
+
+    auto refA = a->dequeue();
+    auto refB = b->dequeue();
+    ASSERT_TRUE(refA);
+    ASSERT_TRUE(refB);
+    ASSERT_EQ(refA.get(), refB.get());
+    ASSERT_EQ(refA->viewU32()[0], 42u);
+
+    refA.reset();
+    ASSERT_EQ(fanout.emptyBufferCount(), 3u);
+
+    // Moving the reference does not release the buffer.
+    auto moved = std::move(refB);
+    ASSERT_FALSE(refB);
+    ASSERT_EQ(fanout.emptyBufferCount(), 3u);
+
+    moved.reset();
+    ASSERT_EQ(fanout.emptyBufferCount(), 4u);
+
+    ASSERT_EQ(a->receivedBuffers(), 1u);
+    ASSERT_EQ(b->receivedBuffers(), 1u);
+    ASSERT_EQ(a->missedBuffers(), 0u);
+    ASSERT_EQ(b->missedBuffers(), 0u);
+}
+
+TEST(snoop_fanout, PerConsumerLossyBound)
+{
+    SnoopFanout fanout(1024, 8);
+    auto slow = fanout.addConsumer("slow", 1);
+    auto fast = fanout.addConsumer("fast", 4);
+
+    for (u32 i=0; i<3; ++i)
+        fanout.publish(fill_buffer(fanout, i));
+
+    ASSERT_EQ(slow->queuedBuffers(), 1u);
+    ASSERT_EQ(slow->receivedBuffers(), 1u);
+    ASSERT_EQ(slow->missedBuffers(), 2u);
+
+    ASSERT_EQ(fast->queuedBuffers(), 3u);
+    ASSERT_EQ(fast->receivedBuffers(), 3u);
+    ASSERT_EQ(fast->missedBuffers(), 0u);
+
+    // Buffers only queued by the fast consumer.
+    ASSERT_EQ(fanout.emptyBufferCount(), 5u);
+
+    for (u32 i=0; i<3; ++i)
+        ASSERT_EQ(fast->dequeue()->viewU32()[0], i);
+
+    ASSERT_FALSE(fast->dequeue());
+    ASSERT_EQ(fanout.emptyBufferCount(), 7u);
+
+    ASSERT_EQ(slow->dequeue()->viewU32()[0], 0u);
+    ASSERT_EQ(fanout.emptyBufferCount(), 8u);
+
+    fanout.publishMissed();
+    ASSERT_EQ(slow->missedBuffers(), 3u);
+    ASSERT_EQ(fast->missedBuffers(), 1u);
+}
+
+TEST(snoop_fanout, NoConsumersAndRemoval)
+{
+    SnoopFanout fanout(1024, 2);
+
+    fanout.publish(fill_buffer(fanout, 1));
+    ASSERT_EQ(fanout.emptyBufferCount(), 2u);
+
+    auto buffer = fanout.getEmptyBuffer();
+    ASSERT_EQ(fanout.emptyBufferCount(), 1u);
+    fanout.putBackUnused(buffer);
+    ASSERT_EQ(fanout.emptyBufferCount(), 2u);
+
+    auto consumer = fanout.addConsumer("c", 2);
+    fanout.publish(fill_buffer(fanout, 1));
+    fanout.publish(fill_buffer(fanout, 2));
+    ASSERT_EQ(fanout.emptyBufferCount(), 0u);
+    ASSERT_EQ(fanout.getEmptyBuffer(), nullptr);
+
+    auto ref = consumer->dequeue();
+
+    // Removing the consumer releases the queued buffer but not the one still
+    // referenced.
+    fanout.removeConsumer(consumer);
+    ASSERT_TRUE(fanout.consumers().empty());
+    ASSERT_EQ(fanout.emptyBufferCount(), 1u);
+
+    ref.reset();
+    ASSERT_EQ(fanout.emptyBufferCount(), 2u);
+}
+
+TEST(snoop_fanout, ConcurrentConsumers)
+{
+    const u32 BufferCount = 10000;
+    SnoopFanout fanout(1024, 16);
+    std::vector<SnoopConsumer *> consumers;
+    std::vector<std::thread> threads;
+    std::vector<u32> lastValues(4, 0u);
+    std::atomic<bool> done(false);
+
+    for (size_t i=0; i<lastValues.size(); ++i)
+        consumers.push_back(fanout.addConsumer("consumer" + std::to_string(i), 1 + i));
+
+    for (size_t i=0; i<consumers.size(); ++i)
+    {
+        threads.emplace_back([&, i]
+        {
+            while (true)
+            {
+                auto ref = consumers[i]->dequeue(std::chrono::milliseconds(1));
+
+                if (ref)
+                {
+                    // Values are strictly increasing even if buffers are missed.
+                    u32 value = ref->viewU32()[0];
+                    EXPECT_GT(value, lastValues[i]);
+                    lastValues[i] = value;
+                }
+                else if (done)
+                    break;
+            }
+        });
+    }
+
+    size_t producerMissed = 0u;
+
+    for (u32 value=1; value<=BufferCount; ++value)
+    {
+        if (auto buffer = fill_buffer(fanout, value))
+            fanout.publish(buffer);
+        else
+        {
+            fanout.publishMissed();
+            ++producerMissed;
+        }
+    }
+
+    done = true;
+
+    for (auto &t: threads)
+        t.join();
+
+    for (auto consumer: consumers)
+    {
+        ASSERT_EQ(consumer->receivedBuffers() + consumer->missedBuffers(), BufferCount);
+        ASSERT_GE(consumer->missedBuffers(), producerMissed);
+    }
+
+    ASSERT_EQ(fanout.emptyBufferCount(), fanout.bufferCount());
+}
@@ -0,0 +1,401 @@
+#ifndef __MESYTEC_MVLC_UTIL_LOCKFREE_QUEUE_H__
+#define __MESYTEC_MVLC_UTIL_LOCKFREE_QUEUE_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mesytec
+{
+namespace mvlc
+{
+
+// Bounded lock-free queues with the same interface as ThreadSafeQueue. The
+// non-blocking paths (enqueue into a non-full queue, dequeue from a
+// non-empty queue) never take a lock. The blocking dequeue variants spin for
+// a short while before parking the calling thread on a condition variable.
+// Producers only touch the mutex if a consumer is actually parked.
+//
+// Note: enqueue() blocks if the queue is full. When used for buffer queues
+// the capacity must be at least the number of buffers in circulation.
+
+namespace lockfree_detail
+{
+
+static constexpr size_t CacheLineSize = 64;
+
+// Number of times a waiting thread checks the wait condition before parking.
+static const unsigned SpinCount = 1024;
+
+// Parks threads on a condition variable until notified. Keeps track of the
+// number of parked threads so that notify() is cheap if nobody is waiting.
+class Parker
+{
+    public:
+        template<typename Pred>
+        bool wait_for(Pred pred, const std::chrono::milliseconds &timeout)
+        {
+            for (unsigned i=0; i<SpinCount; ++i)
+            {
+                if (pred())
+                    return true;
+
+                if (i % 64 == 63)
+                    std::this_thread::yield();
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            // The seq_cst increment pairs with the fence in notify(): either
+            // the producer sees the sleeper or the predicate sees the data.
+            m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool result = m_cond.wait_for(lock, timeout, pred);
+            m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+            return result;
+        }
+
+        template<typename Pred>
+        void wait(Pred pred)
+        {
+            while (!wait_for(pred, std::chrono::milliseconds(100))) ;
+        }
+
+        void notify()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (m_sleepers.load(std::memory_order_relaxed) > 0)
+            {
+                // Lock and unlock to make sure the sleeper is either not yet
+                // evaluating the predicate or already waiting.
+                { std::lock_guard<std::mutex> guard(m_mutex); }
+                m_cond.notify_all();
+            }
+        }
+
+    private:
+        std::atomic<unsigned> m_sleepers{0};
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+};
+
+} // end namespace lockfree_detail
+
+// Bounded, cache-line padded single-producer/single-consumer ring buffer. At
+// any point in time at most one thread may enqueue and at most one thread may
+// dequeue. The producing/consuming thread may change as long as the hand-over
+// is properly synchronized (e.g. via thread join or future::get()).
+template<typename T>
+class SPSCQueue
+{
+    public:
+        using value_type = T;
+        using size_type = size_t;
+
+        explicit SPSCQueue(size_t capacity = 1024)
+            : m_slots(capacity + 1)
+        {}
+
+        SPSCQueue(const SPSCQueue &) = delete;
+        SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+        bool try_enqueue(const T &value)
+        {
+            const size_t tail = m_tail.load(std::memory_order_relaxed);
+            const size_t next = increment(tail);
+
+            if (next == m_cachedHead)
+            {
+                m_cachedHead = m_head.load(std::memory_order_acquire);
+
+                if (next == m_cachedHead)
+                    return false;
+            }
+
+            m_slots[tail] = value;
+            m_tail.store(next, std::memory_order_release);
+            m_notEmpty.notify();
+            return true;
+        }
+
+        void enqueue(const T &value)
+        {
+            while (!try_enqueue(value))
+                m_notFull.wait([this] { return !full(); });
+        }
+
+        bool try_dequeue(T &dest)
+        {
+            const size_t head = m_head.load(std::memory_order_relaxed);
+
+            if (head == m_cachedTail)
+            {
+                m_cachedTail = m_tail.load(std::memory_order_acquire);
+
+                if (head == m_cachedTail)
+                    return false;
+            }
+
+            dest = m_slots[head];
+            m_head.store(increment(head), std::memory_order_release);
+            m_notFull.notify();
+            return true;
+        }
+
+        // Dequeue operation returning defaultValue if the queue is empty.
+        T dequeue(const T &defaultValue = {})
+        {
+            T result;
+
+            if (try_dequeue(result))
+                return result;
+
+            return defaultValue;
+        }
+
+        // Dequeue operation spinning and then waiting in case the queue is
+        // empty. The given defaultValue is returned in case the wait times out
+        // and the queue is still empty.
+        T dequeue(const std::chrono::milliseconds &timeout, const T &defaultValue = {})
+        {
+            T result;
+
+            if (try_dequeue(result))
+                return result;
+
+            if (m_notEmpty.wait_for([this] { return !empty(); }, timeout)
+                && try_dequeue(result))
+            {
+                return result;
+            }
+
+            return defaultValue;
+        }
+
+        T dequeue_blocking()
+        {
+            T result;
+
+            while (!try_dequeue(result))
+                m_notEmpty.wait([this] { return !empty(); });
+
+            return result;
+        }
+
+        bool empty() const
+        {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        bool full() const
+        {
+            return increment(m_tail.load(std::memory_order_acquire)) == m_head.load(std::memory_order_acquire);
+        }
+
+        size_type size() const
+        {
+            const size_t head = m_head.load(std::memory_order_acquire);
+            const size_t tail = m_tail.load(std::memory_order_acquire);
+            return tail >= head ? tail - head : m_slots.size() - head + tail;
+        }
+
+        size_type capacity() const { return m_slots.size() - 1; }
+
+    private:
+        size_t increment(size_t index) const
+        {
+            return ++index == m_slots.size() ? 0 : index;
+        }
+
+        std::vector<T> m_slots;
+
+        // Consumer side
+        alignas(lockfree_detail::CacheLineSize) std::atomic<size_t> m_head{0};
+        size_t m_cachedTail = 0;
+
+        // Producer side
+        alignas(lockfree_detail::CacheLineSize) std::atomic<size_t> m_tail{0};
+        size_t m_cachedHead = 0;
+
+        alignas(lockfree_detail::CacheLineSize) lockfree_detail::Parker m_notEmpty;
+        lockfree_detail::Parker m_notFull;
+};
+
+// Bounded multi-producer/multi-consumer queue based on Dmitry Vyukov's
+// sequence numbered ring buffer. The capacity is rounded up to the next power
+// of two.
+template<typename T>
+class MPMCQueue
+{
+    public:
+        using value_type = T;
+        using size_type = size_t;
+
+        explicit MPMCQueue(size_t capacity = 1024)
+            : m_cells(round_up_pow2(capacity))
+            , m_mask(m_cells.size() - 1)
+        {
+            for (size_t i=0; i<m_cells.size(); ++i)
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        MPMCQueue(const MPMCQueue &) = delete;
+        MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+        bool try_enqueue(const T &value)
+        {
+            size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+            Cell *cell = nullptr;
+
+            while (true)
+            {
+                cell = &m_cells[pos & m_mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+                if (diff == 0)
+                {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false; // full
+                else
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+
+            cell->data = value;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            m_notEmpty.notify();
+            return true;
+        }
+
+        void enqueue(const T &value)
+        {
+            while (!try_enqueue(value))
+                m_notFull.wait([this] { return size() < capacity(); });
+        }
+
+        bool try_dequeue(T &dest)
+        {
+            size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+            Cell *cell = nullptr;
+
+            while (true)
+            {
+                cell = &m_cells[pos & m_mask];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+                if (diff == 0)
+                {
+                    if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false; // empty
+                else
+                    pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+
+            dest = cell->data;
+            cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+            m_notFull.notify();
+            return true;
+        }
+
+        T dequeue(const T &defaultValue = {})
+        {
+            T result;
+
+            if (try_dequeue(result))
+                return result;
+
+            return defaultValue;
+        }
+
+        T dequeue(const std::chrono::milliseconds &timeout, const T &defaultValue = {})
+        {
+            T result;
+
+            if (try_dequeue(result))
+                return result;
+
+            auto tEnd = std::chrono::steady_clock::now() + timeout;
+
+            // Another consumer may take the element between the wakeup and
+            // the try_dequeue() call, so loop until the deadline.
+            while (true)
+            {
+                auto now = std::chrono::steady_clock::now();
+
+                if (now >= tEnd)
+                    break;
+
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(tEnd - now);
+
+                if (m_notEmpty.wait_for([this] { return !empty(); }, remaining)
+                    && try_dequeue(result))
+                {
+                    return result;
+                }
+            }
+
+            return try_dequeue(result) ? result : defaultValue;
+        }
+
+        T dequeue_blocking()
+        {
+            T result;
+
+            while (!try_dequeue(result))
+                m_notEmpty.wait([this] { return !empty(); });
+
+            return result;
+        }
+
+        bool empty() const { return size() == 0; }
+
+        // Approximate under concurrent modification.
+        size_type size() const
+        {
+            size_t enq = m_enqueuePos.load(std::memory_order_acquire);
+            size_t deq = m_dequeuePos.load(std::memory_order_acquire);
+            return enq > deq ? enq - deq : 0u;
+        }
+
+        size_type capacity() const { return m_cells.size(); }
+
+    private:
+        static size_t round_up_pow2(size_t v)
+        {
+            size_t result = 2;
+            while (result < v)
+                result <<= 1;
+            return result;
+        }
+
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::vector<Cell> m_cells;
+        const size_t m_mask;
+
+        alignas(lockfree_detail::CacheLineSize) std::atomic<size_t> m_enqueuePos{0};
+        alignas(lockfree_detail::CacheLineSize) std::atomic<size_t> m_dequeuePos{0};
+
+        alignas(lockfree_detail::CacheLineSize) lockfree_detail::Parker m_notEmpty;
+        lockfree_detail::Parker m_notFull;
+};
+
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_UTIL_LOCKFREE_QUEUE_H__ */
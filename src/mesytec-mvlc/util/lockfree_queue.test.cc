@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "mesytec-mvlc/readout_buffer_queues.h"
+#include "mesytec-mvlc/util/lockfree_queue.h"
+
+using namespace mesytec::mvlc;
+
+template<typename T>
+class LockfreeQueueTest: public ::testing::Test {};
+
+using QueueTypes = ::testing::Types<SPSCQueue<int>, MPMCQueue<int>>;
+TYPED_TEST_SUITE(LockfreeQueueTest, QueueTypes);
+
+TYPED_TEST(LockfreeQueueTest, Basic)
+{
+    TypeParam queue(4);
+
+    ASSERT_TRUE(queue.empty());
+    ASSERT_EQ(queue.dequeue(), int{});
+    ASSERT_EQ(queue.dequeue(std::chrono::milliseconds(1), -1), -1);
+
+    queue.enqueue(42);
+
+    ASSERT_FALSE(queue.empty());
+    ASSERT_EQ(queue.size(), 1);
+
+    queue.enqueue(21);
+
+    ASSERT_FALSE(queue.empty());
+    ASSERT_EQ(queue.size(), 2);
+
+    ASSERT_EQ(queue.dequeue(), 42);
+    ASSERT_EQ(queue.size(), 1);
+    ASSERT_EQ(queue.dequeue(std::chrono::milliseconds(1), -1), 21);
+    ASSERT_EQ(queue.size(), 0);
+    ASSERT_TRUE(queue.empty());
+}
+
+TYPED_TEST(LockfreeQueueTest, Full)
+{
+    TypeParam queue(4);
+
+    for (size_t i=0; i<queue.capacity(); ++i)
+        ASSERT_TRUE(queue.try_enqueue(i));
+
+    ASSERT_FALSE(queue.try_enqueue(-1));
+    ASSERT_EQ(queue.size(), queue.capacity());
+
+    for (size_t i=0; i<queue.capacity(); ++i)
+        ASSERT_EQ(queue.dequeue_blocking(), static_cast<int>(i));
+
+    ASSERT_TRUE(queue.empty());
+}
+
+// Producer pushes more values than the queue can hold, forcing both sides to
+// wait for each other. Values have to arrive complete and in order.
+TYPED_TEST(LockfreeQueueTest, ProducerConsumer)
+{
+    static const int ValueCount = 100000;
+    TypeParam queue(8);
+
+    std::thread producer([&queue]
+    {
+        for (int i=1; i<=ValueCount; ++i)
+            queue.enqueue(i);
+    });
+
+    int expected = 1;
+
+    while (expected <= ValueCount)
+    {
+        int value = queue.dequeue(std::chrono::milliseconds(1000));
+        ASSERT_EQ(value, expected);
+        ++expected;
+    }
+
+    producer.join();
+    ASSERT_TRUE(queue.empty());
+}
+
+TEST(lockfree_queue, ReadoutBufferQueues)
+{
+    SPSCReadoutBufferQueues queues(1024, 4);
+
+    ASSERT_EQ(queues.bufferCount(), 4);
+    ASSERT_EQ(queues.emptyBufferQueue().size(), 4);
+    ASSERT_EQ(queues.emptyBufferQueue().capacity(), 4);
+    ASSERT_TRUE(queues.filledBufferQueue().empty());
+
+    auto buffer = queues.emptyBufferQueue().dequeue_blocking();
+    ASSERT_NE(buffer, nullptr);
+    ASSERT_EQ(buffer->capacity(), 1024);
+    queues.filledBufferQueue().enqueue(buffer);
+    ASSERT_EQ(queues.filledBufferQueue().dequeue(), buffer);
+}
@@ -4,6 +4,9 @@
 
 std::mutex g_mutex;
 
+// Incremented whenever cached loggers have to be looked up again.
+static std::atomic<unsigned> g_loggerGeneration(1u);
+
 namespace mesytec
 {
 namespace mvlc
@@ -26,6 +29,8 @@ std::shared_ptr<spdlog::logger>
         {
             logger = spdlog::stdout_color_mt(name);
         }
+
+        invalidate_cached_loggers();
     }
 
     return logger;
@@ -67,5 +72,52 @@ std::vector<std::string> list_logger_names()
     return result;
 }
 
+void invalidate_cached_loggers()
+{
+    g_loggerGeneration.fetch_add(1u, std::memory_order_release);
+}
+
+CachedLogger::CachedLogger(const std::string &name)
+    : m_name(name)
+    , m_current(nullptr)
+    , m_generation(0u)
+{
+}
+
+const std::shared_ptr<spdlog::logger> &CachedLogger::get() const
+{
+    auto current = m_current.load(std::memory_order_acquire);
+
+    if (current && m_generation.load(std::memory_order_relaxed)
+        == g_loggerGeneration.load(std::memory_order_acquire))
+    {
+        return *current;
+    }
+
+    return refresh();
+}
+
+const std::shared_ptr<spdlog::logger> &CachedLogger::refresh() const
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+
+    // Read the generation before the lookup: an invalidation happening during
+    // get_logger() leads to another refresh on the next call.
+    auto generation = g_loggerGeneration.load(std::memory_order_acquire);
+    auto logger = get_logger(m_name);
+    auto current = m_current.load(std::memory_order_relaxed);
+
+    if (!current || *current != logger)
+    {
+        m_loggers.emplace_back(std::move(logger));
+        current = &m_loggers.back();
+        m_current.store(current, std::memory_order_release);
+    }
+
+    m_generation.store(generation, std::memory_order_relaxed);
+
+    return *current;
+}
+
 } // end namespace mvlc
 } // end namespace mesytec
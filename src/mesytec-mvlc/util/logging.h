@@ -1,6 +1,9 @@
 #ifndef __MESYTEC_MVLC_LOGGING_H__
 #define __MESYTEC_MVLC_LOGGING_H__
 
+#include <atomic>
+#include <list>
+#include <mutex>
 #include <string>
 #include <spdlog/spdlog.h>
 
@@ -29,6 +32,44 @@ void MESYTEC_MVLC_EXPORT
 
 MESYTEC_MVLC_EXPORT std::vector<std::string> list_logger_names();
 
+// Invalidates all CachedLogger instances. create_logger() does this
+// automatically when it registers a new logger. Call this after dropping or
+// replacing loggers directly via the spdlog registry.
+void MESYTEC_MVLC_EXPORT invalidate_cached_loggers();
+
+// Caches the result of get_logger() for use in hot code paths. get() does not
+// take any locks or touch the refcount unless the cache was invalidated. Trace
+// logging via a cached logger costs a single level check when disabled.
+//
+// Loggers obtained through the cache are kept alive until the cache is
+// destroyed, so references returned by get() stay valid even if the cache is
+// refreshed concurrently. Intended to be used as a static instance:
+//
+//   static CachedLogger s_logger("mvlc_eth");
+//   auto &logger = s_logger.get();
+class MESYTEC_MVLC_EXPORT CachedLogger
+{
+    public:
+        explicit CachedLogger(const std::string &name);
+
+        CachedLogger(const CachedLogger &) = delete;
+        CachedLogger &operator=(const CachedLogger &) = delete;
+
+        const std::shared_ptr<spdlog::logger> &get() const;
+        spdlog::logger *operator->() const { return get().get(); }
+
+        const std::string &name() const { return m_name; }
+
+    private:
+        const std::shared_ptr<spdlog::logger> &refresh() const;
+
+        const std::string m_name;
+        mutable std::atomic<const std::shared_ptr<spdlog::logger> *> m_current;
+        mutable std::atomic<unsigned> m_generation;
+        mutable std::mutex m_mutex;
+        mutable std::list<std::shared_ptr<spdlog::logger>> m_loggers;
+};
+
 template<typename View>
 void log_buffer(const std::shared_ptr<spdlog::logger> &logger,
                 const spdlog::level::level_enum &level,
@@ -0,0 +1,44 @@
+#include "gtest/gtest.h"
+#include <spdlog/sinks/null_sink.h>
+#include "mesytec-mvlc/util/logging.h"
+
+using namespace mesytec::mvlc;
+
+TEST(util_logging, CachedLoggerLookup)
+{
+    CachedLogger cached("test_cached_logger");
+
+    auto &logger = cached.get();
+    ASSERT_TRUE(logger);
+    ASSERT_EQ(logger, get_logger("test_cached_logger"));
+    ASSERT_EQ(&cached.get(), &logger);
+}
+
+TEST(util_logging, CachedLoggerInvalidation)
+{
+    CachedLogger cached("test_cached_logger_invalidation");
+    auto first = cached.get();
+
+    // Replace the logger in the registry. create_logger() invalidates all
+    // caches when registering a new logger.
+    spdlog::drop("test_cached_logger_invalidation");
+    auto sink = std::make_shared<spdlog::sinks::null_sink_mt>();
+    auto second = create_logger("test_cached_logger_invalidation", { sink });
+
+    ASSERT_NE(first, second);
+    ASSERT_EQ(cached.get(), second);
+
+    // Registering directly via spdlog requires explicit invalidation.
+    spdlog::drop("test_cached_logger_invalidation");
+    auto third = std::make_shared<spdlog::logger>("test_cached_logger_invalidation", sink);
+    spdlog::register_logger(third);
+
+    ASSERT_EQ(cached.get(), second);
+    invalidate_cached_loggers();
+    ASSERT_EQ(cached.get(), third);
+
+    // The previously returned loggers are kept alive by the cache.
+    ASSERT_EQ(first.use_count(), 2);
+
+    spdlog::drop("test_cached_logger_invalidation");
+}
@@ -172,9 +172,9 @@ class WaitableProtected
                 m_obj);
         }
 
-        template<typename Predicate, typename Rep, typename Period>
+        template<typename Predicate, typename Clock, typename Duration>
         WaitableAccess<T> wait_until(
-            const std::chrono::duration<Rep, Period> &duration,
+            const std::chrono::time_point<Clock, Duration> &timeout,
             Predicate pred_)
         {
             std::unique_lock<TicketMutex> lock(m_mutex);
@@ -184,7 +184,7 @@ class WaitableProtected
                 return pred_(m_obj);
             };
 
-            m_cond.wait_until(lock, duration, pred);
+            m_cond.wait_until(lock, timeout, pred);
 
             return WaitableAccess<T>(
                 std::move(lock),
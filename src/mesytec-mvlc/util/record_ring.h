@@ -0,0 +1,206 @@
+#ifndef __MESYTEC_MVLC_UTIL_RECORD_RING_H__
+#define __MESYTEC_MVLC_UTIL_RECORD_RING_H__
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "int_types.h"
+
+namespace mesytec
+{
+namespace mvlc
+{
+namespace util
+{
+
+// FIFO of variable sized u32 records stored contiguously in a single ring
+// buffer. Each record carries a user defined Meta value. Once the ring has
+// grown to the working set size pushing and popping records does not allocate.
+//
+// The data of each record is contiguous: if a record does not fit between the
+// write position and the end of the storage it is placed at the start and the
+// words skipped at the end are accounted to the record until it is popped.
+// The storage grows by doubling if the free space is not sufficient. Growing
+// moves all records so pointers returned by data() are only valid until the
+// next push_back() call.
+template<typename Meta>
+class RecordRing
+{
+    public:
+        struct Record
+        {
+            Meta meta;
+            size_t offset;  // word offset of the record data in the storage
+            u32 size;       // number of data words
+            u32 skipped;    // words skipped at the end of the storage to place this record
+        };
+
+        static const size_t MinCapacity = 1024; // in words
+
+        bool empty() const { return m_recordCount == 0; }
+        size_t size() const { return m_recordCount; }
+
+        // Number of bytes occupied by records including skipped words.
+        size_t usedBytes() const { return m_usedWords * sizeof(u32); }
+
+        // Number of bytes allocated for data and record storage.
+        size_t capacityBytes() const
+        {
+            return m_storage.capacity() * sizeof(u32) + m_records.capacity() * sizeof(Record);
+        }
+
+        const Record &front() const
+        {
+            assert(!empty());
+            return m_records[m_recordHead];
+        }
+
+        const u32 *data(const Record &record) const { return m_storage.data() + record.offset; }
+
+        void push_back(const Meta &meta, const u32 *data, u32 size)
+        {
+            if (m_recordCount == m_records.size())
+                growRecords();
+
+            u32 skipped = 0u;
+            bool wraps = false;
+            size_t offset = findSpace(size, skipped, wraps);
+
+            if (offset == NoSpace)
+            {
+                growStorage(size);
+                offset = findSpace(size, skipped, wraps);
+                assert(offset != NoSpace);
+            }
+
+            if (size)
+                std::memcpy(m_storage.data() + offset, data, size * sizeof(u32));
+
+            if (wraps)
+                m_wrapped = true;
+
+            m_writePos = offset + size;
+            m_usedWords += size + skipped;
+            m_records[(m_recordHead + m_recordCount) & (m_records.size() - 1)] = { meta, offset, size, skipped };
+            ++m_recordCount;
+        }
+
+        void pop_front()
+        {
+            assert(!empty());
+
+            const auto &record = front();
+            assert(m_usedWords >= record.size + record.skipped);
+            m_usedWords -= record.size + record.skipped;
+            const size_t poppedOffset = record.offset;
+
+            m_recordHead = (m_recordHead + 1) & (m_records.size() - 1);
+            --m_recordCount;
+
+            if (empty())
+                clear();
+            else if (front().offset < poppedOffset)
+                m_wrapped = false; // the reader followed the writer to the start of the storage
+        }
+
+        // Removes all records. Keeps the allocated memory.
+        void clear()
+        {
+            m_recordHead = 0;
+            m_recordCount = 0;
+            m_writePos = 0;
+            m_usedWords = 0;
+            m_wrapped = false;
+        }
+
+        // Removes all records and frees the allocated memory.
+        void release()
+        {
+            clear();
+            std::vector<u32>().swap(m_storage);
+            std::vector<Record>().swap(m_records);
+        }
+
+    private:
+        static const size_t NoSpace = static_cast<size_t>(-1);
+
+        // Returns the offset at which a record of the given size can be
+        // placed or NoSpace. Sets 'wraps' if the record is placed at the start
+        // of the storage while older records remain at the end.
+        size_t findSpace(u32 size, u32 &skipped, bool &wraps) const
+        {
+            skipped = 0u;
+            wraps = false;
+
+            if (empty())
+                return size <= m_storage.size() ? 0 : NoSpace;
+
+            const size_t readPos = front().offset;
+
+            if (m_wrapped)
+                return readPos - m_writePos >= size ? m_writePos : NoSpace;
+
+            if (m_storage.size() - m_writePos >= size)
+                return m_writePos;
+
+            if (readPos >= size)
+            {
+                skipped = m_storage.size() - m_writePos;
+                wraps = true;
+                return 0;
+            }
+
+            return NoSpace;
+        }
+
+        // Moves all records to the start of a larger storage vector.
+        void growStorage(u32 size)
+        {
+            const size_t newSize = std::max({ m_storage.size() * 2, m_usedWords + size, MinCapacity });
+            std::vector<u32> newStorage(newSize);
+            size_t writePos = 0;
+
+            for (size_t i=0; i<m_recordCount; ++i)
+            {
+                auto &record = m_records[(m_recordHead + i) & (m_records.size() - 1)];
+                std::copy(m_storage.data() + record.offset, m_storage.data() + record.offset + record.size,
+                          newStorage.data() + writePos);
+                record.offset = writePos;
+                record.skipped = 0u;
+                writePos += record.size;
+            }
+
+            m_storage = std::move(newStorage);
+            m_writePos = writePos;
+            m_usedWords = writePos;
+            m_wrapped = false;
+        }
+
+        // Doubles the record ring size, keeping it a power of two.
+        void growRecords()
+        {
+            std::vector<Record> newRecords(std::max(m_records.size() * 2, static_cast<size_t>(64)));
+
+            for (size_t i=0; i<m_recordCount; ++i)
+                newRecords[i] = m_records[(m_recordHead + i) & (m_records.size() - 1)];
+
+            m_records = std::move(newRecords);
+            m_recordHead = 0;
+        }
+
+        std::vector<u32> m_storage;
+        std::vector<Record> m_records;
+        size_t m_recordHead = 0;
+        size_t m_recordCount = 0;
+        size_t m_writePos = 0;
+        size_t m_usedWords = 0;
+        bool m_wrapped = false; // true if records have been placed before the read position
+};
+
+} // end namespace util
+} // end namespace mvlc
+} // end namespace mesytec
+
+#endif /* __MESYTEC_MVLC_UTIL_RECORD_RING_H__ */
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+#include <deque>
+#include <numeric>
+#include <random>
+#include "mesytec-mvlc/util/record_ring.h"
+
+using namespace mesytec::mvlc;
+using namespace mesytec::mvlc::util;
+
+TEST(util_record_ring, PushPop)
+{
+    RecordRing<int> ring;
+
+    ASSERT_TRUE(ring.empty());
+    ASSERT_EQ(ring.usedBytes(), 0u);
+
+    std::vector<u32> a = { 1, 2, 3 };
+    std::vector<u32> b = { 4, 5 };
+
+    ring.push_back(42, a.data(), a.size());
+    ring.push_back(43, b.data(), b.size());
+
+    ASSERT_EQ(ring.size(), 2u);
+    ASSERT_EQ(ring.usedBytes(), 5 * sizeof(u32));
+
+    {
+        const auto &record = ring.front();
+        ASSERT_EQ(record.meta, 42);
+        ASSERT_EQ(record.size, 3u);
+        ASSERT_TRUE(std::equal(a.begin(), a.end(), ring.data(record)));
+    }
+
+    ring.pop_front();
+
+    {
+        const auto &record = ring.front();
+        ASSERT_EQ(record.meta, 43);
+        ASSERT_EQ(record.size, 2u);
+        ASSERT_TRUE(std::equal(b.begin(), b.end(), ring.data(record)));
+    }
+
+    ring.pop_front();
+
+    ASSERT_TRUE(ring.empty());
+    ASSERT_EQ(ring.usedBytes(), 0u);
+}
+
+TEST(util_record_ring, ClearAndRelease)
+{
+    RecordRing<int> ring;
+    std::vector<u32> data(100);
+
+    for (int i=0; i<10; ++i)
+        ring.push_back(i, data.data(), data.size());
+
+    const size_t capacity = ring.capacityBytes();
+    ASSERT_GT(capacity, 0u);
+
+    ring.clear();
+    ASSERT_TRUE(ring.empty());
+    ASSERT_EQ(ring.usedBytes(), 0u);
+    ASSERT_EQ(ring.capacityBytes(), capacity);
+
+    ring.release();
+    ASSERT_TRUE(ring.empty());
+    ASSERT_EQ(ring.capacityBytes(), 0u);
+}
+
+// Random pushes and pops compared against a deque of vectors. Exercises
+// wrapping at the end of the storage and growing while wrapped.
+TEST(util_record_ring, RandomAgainstDeque)
+{
+    RecordRing<u32> ring;
+    std::deque<std::vector<u32>> reference;
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<u32> sizeDist(0, 300);
+    std::uniform_int_distribution<int> opDist(0, 99);
+    u32 next = 0;
+
+    for (size_t i=0; i<100000; ++i)
+    {
+        // Alternate between phases where the fill level tends to rise and
+        // phases where it tends to fall.
+        const int pushPercent = (i / 5000) % 2 ? 40 : 60;
+
+        if (opDist(rng) < pushPercent)
+        {
+            std::vector<u32> data(sizeDist(rng));
+            std::iota(data.begin(), data.end(), next);
+            next += data.size();
+            ring.push_back(data.size(), data.data(), data.size());
+            reference.emplace_back(std::move(data));
+        }
+        else if (!reference.empty())
+        {
+            const auto &record = ring.front();
+            const auto &expected = reference.front();
+            ASSERT_EQ(record.meta, expected.size());
+            ASSERT_EQ(record.size, expected.size());
+            ASSERT_TRUE(std::equal(expected.begin(), expected.end(), ring.data(record)));
+            ring.pop_front();
+            reference.pop_front();
+        }
+
+        ASSERT_EQ(ring.size(), reference.size());
+
+        size_t expectedWords = 0;
+        for (const auto &data: reference)
+            expectedWords += data.size();
+
+        ASSERT_GE(ring.usedBytes(), expectedWords * sizeof(u32));
+    }
+}